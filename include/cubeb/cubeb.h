@@ -159,6 +159,19 @@ typedef enum {
   CUBEB_LOG_VERBOSE = 2, /**< Verbose logging of callbacks, can have performance implications. */
 } cubeb_log_level;
 
+/** Area of cubeb that logs a message. The level of logging can be set for
+    each category, see cubeb_set_log_category_level. */
+typedef enum {
+  CUBEB_LOG_CATEGORY_BACKEND = 0, /**< Audio backends, streams and their callbacks. */
+  CUBEB_LOG_CATEGORY_RESAMPLER, /**< Resampling. */
+  CUBEB_LOG_CATEGORY_MIXER, /**< Up and down mixing of channels. */
+  CUBEB_LOG_CATEGORY_DEVICE, /**< Device enumeration. */
+  CUBEB_LOG_CATEGORY_TIMING, /**< Timing of the audio callbacks: a verbose
+                                  message per data callback, with its
+                                  duration and load. */
+  CUBEB_LOG_CATEGORY_COUNT /**< Number of categories, not a category. */
+} cubeb_log_category;
+
 typedef enum {
   CHANNEL_UNKNOWN = 0,
   CHANNEL_FRONT_LEFT = 1 << 0,
@@ -243,9 +256,16 @@ typedef enum {
                                          and/or application. May not be honored for
                                          all backends and platforms. */
 
-  CUBEB_STREAM_PREF_JACK_NO_AUTO_CONNECT = 0x20  /**< Don't automatically try to connect
+  CUBEB_STREAM_PREF_JACK_NO_AUTO_CONNECT = 0x20, /**< Don't automatically try to connect
                                                       ports.  Only affects the jack
                                                       backend. */
+  CUBEB_STREAM_PREF_PLANAR = 0x40 /**< The data callback gets the buffers of
+                                       this direction of the stream as arrays
+                                       of pointers to the samples of each
+                                       channel, instead of interleaved. The jack
+                                       backend hands its port buffers to float
+                                       streams that aren't resampled, the other
+                                       backends copy them. */
 } cubeb_stream_prefs;
 
 /** Stream format initialization parameters. */
@@ -376,6 +396,145 @@ typedef struct {
   size_t count;               /**< Device count in collection. */
 } cubeb_device_collection;
 
+/** How the time of a backend that doesn't play to audio hardware, like the
+ *  "null" backend, advances. Set with `cubeb_set_clock_mode`. */
+typedef enum {
+  CUBEB_CLOCK_REAL_TIME, /**< The data callbacks are called at the rate the
+                              audio would be played at. The default. */
+  CUBEB_CLOCK_FAST,      /**< The time jumps to the next data callback as soon
+                              as the previous one returns: the streams run as
+                              fast as the CPU allows. */
+  CUBEB_CLOCK_STEPPED    /**< The time only advances when calling
+                              `cubeb_advance_clock`, so that the data
+                              callbacks can be driven deterministically. */
+} cubeb_clock_mode;
+
+/** User supplied callback called by the "offline" backend with the audio
+    rendered by each data callback of an output stream, to keep it in memory.
+    @param stream The stream that rendered the audio.
+    @param user_ptr The pointer passed in `cubeb_offline_params`.
+    @param buffer The audio, in the format and channels of the output stream.
+    @param nframes The number of frames in the buffer. */
+typedef void (* cubeb_offline_output_callback)(cubeb_stream * stream,
+                                               void * user_ptr,
+                                               void const * buffer,
+                                               long nframes);
+
+/** Where the "offline" backend writes the output of the streams, and reads
+ *  their input from. Set with `cubeb_set_offline_params`, used by the
+ *  streams created afterwards. Files ending in ".wav" are WAV files, other
+ *  files are raw samples, in the format, channels and rate of the stream. */
+typedef struct {
+  char const * output_path;   /**< File the output is written to, or NULL. */
+  cubeb_offline_output_callback output_callback; /**< Called with the output,
+                                                      or NULL. */
+  void * output_user_ptr;     /**< Passed to `output_callback`. */
+  char const * input_path;    /**< File the input is read from, or NULL for
+                                   silence. Input-only streams are drained at
+                                   the end of the file, then the input is
+                                   silence. */
+} cubeb_offline_params;
+
+/** A thread created by cubeb, and the CPU time it used. */
+typedef struct {
+  char name[16];       /**< Name of the thread, also set in the system. */
+  double cpu_seconds;  /**< CPU time used by the thread since it started, in
+                            seconds. 0 if unknown. */
+  uint64_t wakeups;    /**< Number of times the thread woke up after waiting
+                            for work. */
+} cubeb_thread_info;
+
+/** Thread collection.
+ *  Returned by `cubeb_get_threads` and destroyed by
+ *  `cubeb_thread_collection_destroy`. */
+typedef struct {
+  cubeb_thread_info * threads; /**< Array of threads. */
+  size_t count;                /**< Thread count in collection. */
+} cubeb_thread_collection;
+
+/** Phases of the work done by a backend for each period of audio, outside of
+ *  the data callback. Not all the backends measure all the phases. */
+typedef enum {
+  CUBEB_BACKEND_PHASE_WAKEUP,  /**< From the audio thread waking up to knowing
+                                    how much audio the stream can take. */
+  CUBEB_BACKEND_PHASE_PREPARE, /**< From then to calling the data callback:
+                                    reading the input, getting the output
+                                    buffer. */
+  CUBEB_BACKEND_PHASE_RELOCK,  /**< Taking the lock of the stream back after
+                                    the data callback. */
+  CUBEB_BACKEND_PHASE_WRITE,   /**< After the data callback: applying the
+                                    volume, and handing the audio over to the
+                                    system. */
+  CUBEB_BACKEND_PHASE_COUNT
+} cubeb_backend_phase;
+
+/** Time spent in a `cubeb_backend_phase`. */
+typedef struct {
+  uint64_t count;    /**< Number of times the phase was measured. */
+  uint64_t total_ns; /**< Total time spent in the phase, in nanoseconds. */
+  uint64_t max_ns;   /**< Longest time spent in the phase, in nanoseconds. */
+} cubeb_phase_timing;
+
+/** Performance statistics of a stream, since it has been created. Obtained
+ *  with `cubeb_stream_get_stats`. */
+typedef struct {
+  uint64_t data_callback_count;      /**< Number of data callbacks. */
+  uint64_t frames_delivered;         /**< Frames returned by the data callbacks. */
+  uint64_t callback_duration_min_ns; /**< Shortest data callback, in nanoseconds, 0 if none. */
+  uint64_t callback_duration_mean_ns;/**< Mean duration of the data callbacks, in nanoseconds. */
+  uint64_t callback_duration_max_ns; /**< Longest data callback, in nanoseconds. */
+  uint64_t underrun_count;           /**< Number of times the output ran out of data. */
+  uint64_t overrun_count;            /**< Number of times input data was lost. */
+  float dsp_load;                    /**< Ratio of the duration of the data callbacks
+                                          to the duration of the audio they were
+                                          asked for, averaged over about a
+                                          second. Above 1, the callbacks can't
+                                          keep up. 0 if unknown. */
+  float dsp_load_peak;               /**< Highest load of a single data callback
+                                          in about the last second. */
+  cubeb_phase_timing backend_phases[CUBEB_BACKEND_PHASE_COUNT]; /**< Time spent by the
+                                          backend outside of the data callbacks,
+                                          indexed by `cubeb_backend_phase`. */
+} cubeb_stream_stats;
+
+/** Number of buckets of a `cubeb_histogram`. */
+#define CUBEB_HISTOGRAM_BUCKET_COUNT 512
+
+/** Log-linear histogram of durations, in nanoseconds. The first 16 buckets
+ *  count durations of 0 to 15ns, then each power of two is split into 16
+ *  buckets of the same width, so that a bucket is at most 1/16 wider than its
+ *  lower bound. The last bucket also counts the durations that are too long
+ *  for the histogram, about 34s. The lower bound of a bucket is given by
+ *  `cubeb_histogram_bucket_lower_bound`. */
+typedef struct {
+  uint64_t count;                                 /**< Sum of the buckets. */
+  uint64_t buckets[CUBEB_HISTOGRAM_BUCKET_COUNT]; /**< Number of durations in each bucket. */
+} cubeb_histogram;
+
+/** Distributions of the timing of the data callbacks of a stream, since it
+ *  has been created. Obtained with `cubeb_stream_get_callback_histograms`. */
+typedef struct {
+  cubeb_histogram duration; /**< Duration of the data callbacks. */
+  cubeb_histogram interval; /**< Time between the start of consecutive data
+                                 callbacks, not counting the time a stream
+                                 was stopped. */
+} cubeb_callback_histograms;
+
+/** Kind of glitch reported to a `cubeb_glitch_callback`. */
+typedef enum {
+  CUBEB_GLITCH_UNDERRUN, /**< The output ran out of data, silence was played. */
+  CUBEB_GLITCH_OVERRUN   /**< Input data was lost because it wasn't read in time. */
+} cubeb_glitch_type;
+
+/** Description of a glitch, passed to a `cubeb_glitch_callback`. */
+typedef struct {
+  cubeb_glitch_type type;       /**< Underrun or overrun. */
+  cubeb_device_type direction;  /**< CUBEB_DEVICE_TYPE_OUTPUT or CUBEB_DEVICE_TYPE_INPUT. */
+  uint64_t frames_lost;         /**< Frames lost, at the rate of the stream, 0 if unknown. */
+  uint64_t timestamp_ns;        /**< When the glitch was detected, on a monotonic
+                                     clock, in nanoseconds. */
+} cubeb_glitch_info;
+
 /** User supplied data callback.
     - Calling other cubeb functions from this callback is unsafe.
     - The code in the callback should be non-blocking.
@@ -386,9 +545,13 @@ typedef struct {
     @param stream The stream for which this callback fired.
     @param user_ptr The pointer passed to cubeb_stream_init.
     @param input_buffer A pointer containing the input data, or nullptr
-                        if this is an output-only stream.
+                        if this is an output-only stream. With
+                        CUBEB_STREAM_PREF_PLANAR, a `void const * const *`
+                        array with a pointer to the samples of each channel.
     @param output_buffer A pointer to a buffer to be filled with audio samples,
-                         or nullptr if this is an input-only stream.
+                         or nullptr if this is an input-only stream. With
+                         CUBEB_STREAM_PREF_PLANAR, a `void * const *` array
+                         with a pointer to the samples of each channel.
     @param nframes The number of frames of the two buffer.
     @retval If the stream has output, this is the number of frames written to
             the output buffer. In this case, if this number is less than
@@ -424,6 +587,28 @@ typedef void (* cubeb_device_changed_callback)(void * user_ptr);
 typedef void (* cubeb_device_collection_changed_callback)(cubeb * context,
                                                           void * user_ptr);
 
+/**
+ * User supplied callback called when a stream glitched. This is called on a
+ * thread that is not the audio thread, shortly after the glitch has been
+ * detected, and can block.
+ * @param stream The stream that glitched.
+ * @param user_ptr The pointer passed to cubeb_stream_init.
+ * @param glitch The description of the glitch, only valid during the call. */
+typedef void (* cubeb_glitch_callback)(cubeb_stream * stream,
+                                       void * user_ptr,
+                                       cubeb_glitch_info const * glitch);
+
+/**
+ * User supplied callback called when the DSP load of a stream goes above the
+ * threshold passed to cubeb_stream_register_load_callback. Like the glitch
+ * callback, this is not called on the audio thread.
+ * @param stream The stream that is overloaded.
+ * @param user_ptr The pointer passed to cubeb_stream_init.
+ * @param load The load of the stream, see `cubeb_stream_stats.dsp_load`. */
+typedef void (* cubeb_load_callback)(cubeb_stream * stream,
+                                     void * user_ptr,
+                                     float load);
+
 /** User supplied callback called when a message needs logging. */
 typedef void (* cubeb_log_callback)(char const * fmt, ...);
 
@@ -486,6 +671,44 @@ CUBEB_EXPORT int cubeb_get_min_latency(cubeb * context,
     @retval CUBEB_ERROR_NOT_SUPPORTED */
 CUBEB_EXPORT int cubeb_get_preferred_sample_rate(cubeb * context, uint32_t * rate);
 
+/** Set how the time of the backend advances. Only the backends that don't
+    play to audio hardware support this. The position and the latency of the
+    streams are in the time of the backend, and stay consistent when changing
+    modes.
+    @param context A pointer to the cubeb context.
+    @param mode How the time advances.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_set_clock_mode(cubeb * context, cubeb_clock_mode mode);
+
+/** Advance the time of a backend in the `CUBEB_CLOCK_STEPPED` mode, and
+    wait until the data callbacks that were due in that time have returned.
+    Must not be called from a callback.
+    @param context A pointer to the cubeb context.
+    @param duration_ns The time to advance the clock by, in nanoseconds.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if the clock is not in the
+            `CUBEB_CLOCK_STEPPED` mode.
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_advance_clock(cubeb * context, uint64_t duration_ns);
+
+/** Set where the streams of the "offline" backend created afterwards write
+    their output and read their input. Its clock starts in the
+    `CUBEB_CLOCK_FAST` mode, so that the streams render as fast as the CPU
+    allows, while their position and latency are in the time of the audio.
+    The streams aren't resampled: the files are at the rate of the stream.
+    A WAV input file must have the format, channels and rate of the stream,
+    16-bit integer or 32-bit float. The header of a WAV output file is
+    completed when the stream stops, drains, or is destroyed.
+    @param context A pointer to the cubeb context.
+    @param params Where to write and read the audio. The paths are copied.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_set_offline_params(cubeb * context,
+                                          cubeb_offline_params const * params);
+
 /** Destroy an application context. This must be called after all stream have
  *  been destroyed.
     @param context A pointer to the cubeb context.*/
@@ -626,6 +849,93 @@ CUBEB_EXPORT int cubeb_stream_device_destroy(cubeb_stream * stream,
 CUBEB_EXPORT int cubeb_stream_register_device_changed_callback(cubeb_stream * stream,
                                                                cubeb_device_changed_callback device_changed_callback);
 
+/** Log the last events of a stream through the log callback: when the data
+    callback was called, how many frames were requested and delivered, the
+    buffer levels reported by the backend, xruns and recoveries. This is done
+    automatically when a stream errors, this allows doing it after a glitch.
+    This needs a log callback set to at least CUBEB_LOG_NORMAL, and must not be
+    called from the data callback.
+    @param stream the stream for which to log the events.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if stream is an invalid pointer
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_stream_dump_flight_recorder(cubeb_stream * stream);
+
+/** Get the performance statistics of a stream. The statistics are updated
+    by the audio thread without locking, and can be read from any thread
+    without blocking it. The values are read one by one: they can be slightly
+    inconsistent with each other while the stream is running.
+    @param stream the stream for which to get the statistics.
+    @param stats a pointer in which the statistics will be stored.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if stream or stats are invalid
+            pointers
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_stream_get_stats(cubeb_stream * stream,
+                                        cubeb_stream_stats * stats);
+
+/** Get the distributions of the duration of the data callbacks of a stream,
+    and of the time between them. Like `cubeb_stream_get_stats`, this can be
+    called from any thread without blocking the audio thread, and the buckets
+    are read one by one.
+    @param stream the stream for which to get the histograms.
+    @param histograms a pointer in which the histograms will be stored.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if stream or histograms are invalid
+            pointers
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_stream_get_callback_histograms(cubeb_stream * stream,
+                                                      cubeb_callback_histograms * histograms);
+
+/** Get the smallest duration counted in a bucket of a `cubeb_histogram`.
+    @param bucket the index of the bucket, less than
+           CUBEB_HISTOGRAM_BUCKET_COUNT.
+    @retval The duration in nanoseconds. */
+CUBEB_EXPORT uint64_t cubeb_histogram_bucket_lower_bound(uint32_t bucket);
+
+/** Estimate a percentile of the durations counted in a histogram.
+    @param histogram the histogram.
+    @param percentile the percentile, between 0 and 100, for example 99.9.
+    @retval The end of the bucket in which the percentile falls, in
+            nanoseconds: at most 1/16 higher than the actual percentile.
+            UINT64_MAX if it falls in the last bucket, and 0 if the histogram
+            is empty. */
+CUBEB_EXPORT uint64_t cubeb_histogram_percentile(cubeb_histogram const * histogram,
+                                                 double percentile);
+
+/** Set a callback to be notified when a stream underruns or overruns. The
+    audio thread hands the glitches over to another thread without blocking,
+    the callback is called there. Glitches are dropped if too many are pending.
+    When this returns, the previous callback is not running and won't be
+    called anymore. This must not be called from the glitch callback.
+    @param stream the stream for which to set the callback.
+    @param glitch_callback a function called for each glitch. Passing NULL
+           allows to unregister a function.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if stream is an invalid pointer
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_stream_register_glitch_callback(cubeb_stream * stream,
+                                                       cubeb_glitch_callback glitch_callback);
+
+/** Set a callback to be notified when the DSP load of a stream, as reported
+    in `cubeb_stream_stats.dsp_load`, goes above a threshold. It's called once
+    when the load goes above the threshold, and can be called again after the
+    load went back below 90% of the threshold. When this returns, the previous
+    callback is not running and won't be called anymore. This must not be
+    called from the load or glitch callbacks.
+    @param stream the stream for which to set the callback.
+    @param threshold the load above which the callback is called, for example
+           0.8. Ignored when unregistering.
+    @param load_callback the callback. Passing NULL allows to unregister a
+           function.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if stream is an invalid pointer, or
+            threshold is not positive
+    @retval CUBEB_ERROR_NOT_SUPPORTED */
+CUBEB_EXPORT int cubeb_stream_register_load_callback(cubeb_stream * stream,
+                                                     float threshold,
+                                                     cubeb_load_callback load_callback);
+
 /** Return the user data pointer registered with the stream with cubeb_stream_init.
     @param stream the stream for which to retrieve user data pointer.
     @retval user data pointer */
@@ -669,7 +979,8 @@ CUBEB_EXPORT int cubeb_register_device_collection_changed(cubeb * context,
                                                           void * user_ptr);
 
 /** Set a callback to be called with a message.
-    @param log_level CUBEB_LOG_VERBOSE, CUBEB_LOG_NORMAL.
+    @param log_level CUBEB_LOG_VERBOSE, CUBEB_LOG_NORMAL. This is the level of
+                     all the categories.
     @param log_callback A function called with a message when there is
                         something to log. Pass NULL to unregister.
     @retval CUBEB_OK in case of success.
@@ -679,6 +990,60 @@ CUBEB_EXPORT int cubeb_register_device_collection_changed(cubeb * context,
 CUBEB_EXPORT int cubeb_set_log_callback(cubeb_log_level log_level,
                                         cubeb_log_callback log_callback);
 
+/** Set the level of logging of a single category, e.g. to only log verbosely
+    in the resampler. A log callback must have been set with
+    cubeb_set_log_callback, that also resets the level of all categories.
+    @param category The category, in cubeb_log_category.
+    @param log_level CUBEB_LOG_VERBOSE, CUBEB_LOG_NORMAL or CUBEB_LOG_DISABLED.
+    @retval CUBEB_OK in case of success.
+    @retval CUBEB_ERROR_INVALID_FORMAT if category or level are invalid.
+    @retval CUBEB_ERROR_INVALID_PARAMETER if no log callback is set. */
+CUBEB_EXPORT int cubeb_set_log_category_level(cubeb_log_category category,
+                                              cubeb_log_level log_level);
+
+/** List the threads that cubeb created for a context and that are running:
+    the threads of the backend, and the threads shared by all the contexts,
+    like the asynchronous logger. A thread that uses CPU time while no stream
+    is running, or wakes up often, is a bug.
+    @param context
+    @param collection output collection. Must be destroyed with
+                      cubeb_thread_collection_destroy
+    @retval CUBEB_OK in case of success
+    @retval CUBEB_ERROR_INVALID_PARAMETER if context or collection is an
+            invalid pointer
+    @retval CUBEB_ERROR if the collection couldn't be allocated */
+CUBEB_EXPORT int cubeb_get_threads(cubeb * context,
+                                   cubeb_thread_collection * collection);
+
+/** Destroy a cubeb_thread_collection.
+    @param context
+    @param collection collection to destroy
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR_INVALID_PARAMETER if context or collection is an
+            invalid pointer */
+CUBEB_EXPORT int cubeb_thread_collection_destroy(cubeb * context,
+                                                 cubeb_thread_collection * collection);
+
+/** Start or stop recording a timeline of the audio processing: when the
+    backend threads process a stream, call the data callback, resample and
+    mix. Each thread records in its own buffer, without locking, and only the
+    last few thousand events of each thread are kept. When disabled, which is
+    the default, this costs a branch at each point that could be recorded.
+    @param enabled Whether to record the timeline. Enabling it again starts a
+                   new timeline.
+    @retval CUBEB_OK in case of success.
+    @retval CUBEB_ERROR if the buffers couldn't be allocated. */
+CUBEB_EXPORT int cubeb_set_tracing(int enabled);
+
+/** Write the timeline recorded since tracing was enabled to a file, in the
+    Chrome trace event JSON format, that can be opened with Perfetto or
+    chrome://tracing. This can be called while tracing.
+    @param path The file to write.
+    @retval CUBEB_OK in case of success.
+    @retval CUBEB_ERROR_INVALID_PARAMETER if path is an invalid pointer.
+    @retval CUBEB_ERROR if the file couldn't be written. */
+CUBEB_EXPORT int cubeb_write_trace(char const * path);
+
 #if defined(__cplusplus)
 }
 #endif
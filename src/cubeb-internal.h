@@ -75,6 +75,19 @@ struct cubeb_ops {
                                              cubeb_device_type devtype,
                                              cubeb_device_collection_changed_callback callback,
                                              void * user_ptr);
+  int (* stream_dump_flight_recorder)(cubeb_stream * stream);
+  int (* stream_get_stats)(cubeb_stream * stream, cubeb_stream_stats * stats);
+  int (* stream_register_glitch_callback)(cubeb_stream * stream,
+                                          cubeb_glitch_callback glitch_callback);
+  int (* stream_register_load_callback)(cubeb_stream * stream,
+                                        float threshold,
+                                        cubeb_load_callback load_callback);
+  int (* stream_get_callback_histograms)(cubeb_stream * stream,
+                                         cubeb_callback_histograms * histograms);
+  int (* set_clock_mode)(cubeb * context, cubeb_clock_mode mode);
+  int (* advance_clock)(cubeb * context, uint64_t duration_ns);
+  int (* set_offline_params)(cubeb * context,
+                             cubeb_offline_params const * params);
 };
 
 #endif /* CUBEB_INTERNAL_0eb56756_4e20_4404_a76d_42bf88cd15a5 */
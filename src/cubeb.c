@@ -11,6 +11,8 @@
 #include <string.h>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_threads.h"
+#include "cubeb_trace.h"
 
 #define NELEMS(x) ((int) (sizeof(x) / sizeof(x[0])))
 
@@ -72,6 +74,10 @@ int audiotrack_init(cubeb ** context, char const * context_name);
 #if defined(USE_KAI)
 int kai_init(cubeb ** context, char const * context_name);
 #endif
+#if defined(USE_NULL)
+int null_init(cubeb ** context, char const * context_name);
+int offline_init(cubeb ** context, char const * context_name);
+#endif
 
 static int
 validate_stream_params(cubeb_stream_params * input_stream_params,
@@ -187,6 +193,14 @@ cubeb_init(cubeb ** context, char const * context_name, char const * backend_nam
     } else if (!strcmp(backend_name, "kai")) {
 #if defined(USE_KAI)
       init_oneshot = kai_init;
+#endif
+    } else if (!strcmp(backend_name, "null")) {
+#if defined(USE_NULL)
+      init_oneshot = null_init;
+#endif
+    } else if (!strcmp(backend_name, "offline")) {
+#if defined(USE_NULL)
+      init_oneshot = offline_init;
 #endif
     } else {
       /* Already set */
@@ -245,6 +259,10 @@ cubeb_init(cubeb ** context, char const * context_name, char const * backend_nam
 #endif
 #if defined(USE_KAI)
     kai_init,
+#endif
+    /* Last, so that it's only used when there is no audio device. */
+#if defined(USE_NULL)
+    null_init,
 #endif
   };
   int i;
@@ -264,6 +282,7 @@ cubeb_init(cubeb ** context, char const * context_name, char const * backend_nam
       OK(stream_start);
       OK(stream_stop);
       OK(stream_get_position);
+      cubeb_async_log_acquire();
       return CUBEB_OK;
     }
   }
@@ -322,6 +341,53 @@ cubeb_get_preferred_sample_rate(cubeb * context, uint32_t * rate)
   return context->ops->get_preferred_sample_rate(context, rate);
 }
 
+int
+cubeb_set_clock_mode(cubeb * context, cubeb_clock_mode mode)
+{
+  if (!context) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (mode != CUBEB_CLOCK_REAL_TIME && mode != CUBEB_CLOCK_FAST &&
+      mode != CUBEB_CLOCK_STEPPED) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!context->ops->set_clock_mode) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return context->ops->set_clock_mode(context, mode);
+}
+
+int
+cubeb_advance_clock(cubeb * context, uint64_t duration_ns)
+{
+  if (!context) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!context->ops->advance_clock) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return context->ops->advance_clock(context, duration_ns);
+}
+
+int
+cubeb_set_offline_params(cubeb * context, cubeb_offline_params const * params)
+{
+  if (!context || !params) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!context->ops->set_offline_params) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return context->ops->set_offline_params(context, params);
+}
+
 void
 cubeb_destroy(cubeb * context)
 {
@@ -330,6 +396,7 @@ cubeb_destroy(cubeb * context)
   }
 
   context->ops->destroy(context);
+  cubeb_async_log_release();
 }
 
 int
@@ -512,6 +579,75 @@ int cubeb_stream_register_device_changed_callback(cubeb_stream * stream,
   return stream->context->ops->stream_register_device_changed_callback(stream, device_changed_callback);
 }
 
+int cubeb_stream_dump_flight_recorder(cubeb_stream * stream)
+{
+  if (!stream) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!stream->context->ops->stream_dump_flight_recorder) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return stream->context->ops->stream_dump_flight_recorder(stream);
+}
+
+int cubeb_stream_get_stats(cubeb_stream * stream, cubeb_stream_stats * stats)
+{
+  if (!stream || !stats) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!stream->context->ops->stream_get_stats) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return stream->context->ops->stream_get_stats(stream, stats);
+}
+
+int cubeb_stream_get_callback_histograms(cubeb_stream * stream,
+                                         cubeb_callback_histograms * histograms)
+{
+  if (!stream || !histograms) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!stream->context->ops->stream_get_callback_histograms) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return stream->context->ops->stream_get_callback_histograms(stream, histograms);
+}
+
+int cubeb_stream_register_glitch_callback(cubeb_stream * stream,
+                                          cubeb_glitch_callback glitch_callback)
+{
+  if (!stream) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!stream->context->ops->stream_register_glitch_callback) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return stream->context->ops->stream_register_glitch_callback(stream, glitch_callback);
+}
+
+int cubeb_stream_register_load_callback(cubeb_stream * stream,
+                                        float threshold,
+                                        cubeb_load_callback load_callback)
+{
+  if (!stream || (load_callback && !(threshold > 0))) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  if (!stream->context->ops->stream_register_load_callback) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+
+  return stream->context->ops->stream_register_load_callback(stream, threshold, load_callback);
+}
+
 void * cubeb_stream_user_ptr(cubeb_stream * stream)
 {
   if (!stream) {
@@ -586,7 +722,7 @@ void log_device(cubeb_device_info * device_info)
     strcat(devfmts, " F32BE");
   }
 
-  LOG("DeviceID: \"%s\"%s\n"
+  LOG_CATEGORY(DEVICE, "DeviceID: \"%s\"%s\n"
       "\tName:\t\"%s\"\n"
       "\tGroup:\t\"%s\"\n"
       "\tVendor:\t\"%s\"\n"
@@ -622,7 +758,7 @@ int cubeb_enumerate_devices(cubeb * context,
 
   rv = context->ops->enumerate_devices(context, devtype, collection);
 
-  if (g_cubeb_log_callback) {
+  if (CUBEB_LOG_ENABLED(DEVICE, CUBEB_LOG_NORMAL)) {
     for (size_t i = 0; i < collection->count; i++) {
       log_device(&collection->device[i]);
     }
@@ -684,18 +820,90 @@ int cubeb_set_log_callback(cubeb_log_level log_level,
     return CUBEB_ERROR_NOT_SUPPORTED;
   }
 
-  g_cubeb_log_callback = log_callback;
+  // Print the queued asynchronous messages while the callback is still set.
+  if (log_level < CUBEB_LOG_VERBOSE) {
+    cubeb_async_log_set_enabled(0);
+  }
+
+  // The macros read the level before the callback: set the callback before
+  // enabling the levels, and disable the levels before clearing the callback.
+  if (log_callback) {
+    g_cubeb_log_callback = log_callback;
+  }
+  for (int i = 0; i < CUBEB_LOG_CATEGORY_COUNT; i++) {
+    g_cubeb_log_levels[i] = log_level;
+  }
   g_cubeb_log_level = log_level;
+  if (!log_callback) {
+    g_cubeb_log_callback = NULL;
+  }
 
-  // Logging a message here allows to initialize the asynchronous logger from a
-  // thread that is not the audio rendering thread, and especially to not
-  // initialize it the first time we find a verbose log, which is often in the
-  // audio rendering callback, that runs from the audio rendering thread, and
-  // that is high priority, and that we don't want to block.
+  // Start the asynchronous logger from here, rather than from the audio
+  // rendering callback that logs first, that we don't want to block.
   if (log_level >= CUBEB_LOG_VERBOSE) {
+    cubeb_async_log_set_enabled(1);
     ALOGV("Starting cubeb log");
   }
 
   return CUBEB_OK;
 }
 
+int cubeb_set_log_category_level(cubeb_log_category category,
+                                 cubeb_log_level log_level)
+{
+  if (category < 0 || category >= CUBEB_LOG_CATEGORY_COUNT ||
+      log_level < CUBEB_LOG_DISABLED || log_level > CUBEB_LOG_VERBOSE) {
+    return CUBEB_ERROR_INVALID_FORMAT;
+  }
+
+  if (!g_cubeb_log_callback && log_level != CUBEB_LOG_DISABLED) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  g_cubeb_log_levels[category] = log_level;
+
+  cubeb_log_level max_level = CUBEB_LOG_DISABLED;
+  for (int i = 0; i < CUBEB_LOG_CATEGORY_COUNT; i++) {
+    if (g_cubeb_log_levels[i] > max_level) {
+      max_level = g_cubeb_log_levels[i];
+    }
+  }
+  g_cubeb_log_level = max_level;
+  cubeb_async_log_set_enabled(max_level >= CUBEB_LOG_VERBOSE);
+
+  return CUBEB_OK;
+}
+
+int cubeb_get_threads(cubeb * context, cubeb_thread_collection * collection)
+{
+  if (context == NULL || collection == NULL) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  return cubeb_threads_get(context, collection);
+}
+
+int cubeb_thread_collection_destroy(cubeb * context,
+                                    cubeb_thread_collection * collection)
+{
+  if (context == NULL || collection == NULL) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  cubeb_threads_collection_destroy(collection);
+  return CUBEB_OK;
+}
+
+int cubeb_set_tracing(int enabled)
+{
+  return cubeb_trace_set_enabled(enabled);
+}
+
+int cubeb_write_trace(char const * path)
+{
+  if (!path) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+
+  return cubeb_trace_write(path);
+}
@@ -15,9 +15,18 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <errno.h>
 #include <alsa/asoundlib.h>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_flight_recorder.h"
+#include "cubeb_glitch.h"
+#include "cubeb_planar.h"
+#include "cubeb_probes.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_stream_stats.h"
+#include "cubeb_threads.h"
+#include "cubeb_trace.h"
 
 #ifdef DISABLE_LIBASOUND_DLOPEN
 #define WRAP(x) x
@@ -164,6 +173,14 @@ struct cubeb_stream {
   snd_pcm_stream_t stream_type;
 
   struct cubeb_stream * other_stream;
+  /* Converts the buffers of planar streams. Only set on the stream returned
+     to the user, that both sides of a duplex stream call back with. */
+  cubeb_planar_adapter * planar;
+
+  /* Last events of the stream, logged when it errors. */
+  cubeb_flight_recorder * recorder;
+  cubeb_stream_stats_counters * stats;
+  cubeb_glitch_notifier * glitches;
 };
 
 static int
@@ -313,12 +330,16 @@ alsa_set_stream_state(cubeb_stream * stm, enum stream_state state)
   poll_wake(ctx);
 }
 
+/* @param wakeup When the audio thread woke up, or finished processing the
+   previous stream, to time the phases of the processing. The wakeup phase of
+   a stream doesn't include the processing of the other streams. */
 static enum stream_state
-alsa_process_stream(cubeb_stream * stm)
+alsa_process_stream(cubeb_stream * stm, uint64_t wakeup)
 {
   unsigned short revents;
   snd_pcm_sframes_t avail;
   int draining;
+  uint64_t phase_start;
 
   draining = 0;
 
@@ -330,6 +351,9 @@ alsa_process_stream(cubeb_stream * stm)
   WRAP(snd_pcm_poll_descriptors_revents)(stm->pcm, stm->fds, stm->nfds, &revents);
 
   avail = WRAP(snd_pcm_avail_update)(stm->pcm);
+  phase_start = cubeb_stream_stats_now();
+  cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_WAKEUP, wakeup, phase_start);
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_AVAIL, avail, 0);
 
   /* Got null event? Bail and wait for another wakeup. */
   if (avail == 0) {
@@ -348,6 +372,13 @@ alsa_process_stream(cubeb_stream * stm)
 
     if (avail + stm->bufframes > stm->buffer_size) {
       /* Buffer overflow. Skip and overwrite with new data. */
+      cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN,
+                                   stm->bufframes, 0);
+      cubeb_stream_stats_overrun(stm->stats, 1);
+      cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_OVERRUN,
+                          CUBEB_DEVICE_TYPE_INPUT, stm->bufframes);
+      CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT,
+                   (uint64_t) stm->bufframes);
       stm->bufframes = 0;
       // TODO: should it be marked as DRAINING?
     }
@@ -377,8 +408,21 @@ alsa_process_stream(cubeb_stream * stm)
     }
 
     pthread_mutex_unlock(&stm->mutex);
-    wrote = stm->data_callback(mainstm, stm->user_ptr, stm->buffer, other_buffer, wrote);
+    CUBEB_RT_BEGIN();
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, wrote, 0);
+    snd_pcm_sframes_t requested = wrote;
+    uint64_t start = cubeb_stream_stats_callback_start(stm->stats);
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+    CUBEB_PROBE2(data_callback_entry, mainstm, (long) requested);
+    wrote = cubeb_planar_data_callback(mainstm->planar, stm->data_callback, mainstm,
+                                       stm->user_ptr, stm->buffer, other_buffer, wrote);
+    CUBEB_PROBE2(data_callback_exit, mainstm, (long) wrote);
+    uint64_t end = cubeb_stream_stats_callback_end(stm->stats, start, requested, wrote);
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, wrote, 0);
+    CUBEB_RT_END();
     pthread_mutex_lock(&stm->mutex);
+    phase_start = cubeb_stream_stats_now();
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_RELOCK, end, phase_start);
 
     if (wrote < 0) {
       avail = wrote; // the error handler below will recover us
@@ -404,8 +448,21 @@ alsa_process_stream(cubeb_stream * stm)
     }
 
     pthread_mutex_unlock(&stm->mutex);
-    got = stm->data_callback(stm, stm->user_ptr, other_buffer, buftail, got);
+    CUBEB_RT_BEGIN();
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, got, 0);
+    snd_pcm_sframes_t requested = got;
+    uint64_t start = cubeb_stream_stats_callback_start(stm->stats);
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+    CUBEB_PROBE2(data_callback_entry, stm, (long) requested);
+    got = cubeb_planar_data_callback(stm->planar, stm->data_callback, stm,
+                                     stm->user_ptr, other_buffer, buftail, got);
+    CUBEB_PROBE2(data_callback_exit, stm, got);
+    uint64_t end = cubeb_stream_stats_callback_end(stm->stats, start, requested, got);
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, got, 0);
+    CUBEB_RT_END();
     pthread_mutex_lock(&stm->mutex);
+    phase_start = cubeb_stream_stats_now();
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_RELOCK, end, phase_start);
 
     if (got < 0) {
       avail = got; // the error handler below will recover us
@@ -452,6 +509,8 @@ alsa_process_stream(cubeb_stream * stm)
     }
 
     wrote = WRAP(snd_pcm_writei)(stm->pcm, stm->buffer, avail);
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_WRITE, phase_start,
+                             cubeb_stream_stats_now());
     if (wrote < 0) {
       avail = wrote; // the error handler below will recover us
     } else {
@@ -464,6 +523,23 @@ alsa_process_stream(cubeb_stream * stm)
 
   /* Got some error? Let's try to recover the stream. */
   if (avail < 0) {
+    snd_pcm_sframes_t error = avail;
+    if (error == -EPIPE) {
+      cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+      if (stm->stream_type == SND_PCM_STREAM_PLAYBACK) {
+        cubeb_stream_stats_underrun(stm->stats, 1);
+        cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_UNDERRUN,
+                            CUBEB_DEVICE_TYPE_OUTPUT, 0);
+        CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT,
+                     (uint64_t) 0);
+      } else {
+        cubeb_stream_stats_overrun(stm->stats, 1);
+        cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_OVERRUN,
+                            CUBEB_DEVICE_TYPE_INPUT, 0);
+        CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT,
+                     (uint64_t) 0);
+      }
+    }
     avail = WRAP(snd_pcm_recover)(stm->pcm, avail, 0);
 
     /* Capture pcm must be started after initial setup/recover */
@@ -472,11 +548,15 @@ alsa_process_stream(cubeb_stream * stm)
         WRAP(snd_pcm_state)(stm->pcm) == SND_PCM_STATE_PREPARED) {
       avail = WRAP(snd_pcm_start)(stm->pcm);
     }
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_RECOVER, error, avail);
   }
 
   /* Failed to recover, this stream must be broken. */
   if (avail < 0) {
     pthread_mutex_unlock(&stm->mutex);
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+    cubeb_flight_recorder_dump(stm->recorder);
+    CUBEB_PROBE2(state_change, stm, CUBEB_STATE_ERROR);
     stm->state_callback(stm, stm->user_ptr, CUBEB_STATE_ERROR);
     return ERROR;
   }
@@ -494,6 +574,7 @@ alsa_run(cubeb * ctx)
   char dummy;
   cubeb_stream * stm;
   enum stream_state state;
+  uint64_t wakeup;
 
   pthread_mutex_lock(&ctx->mutex);
 
@@ -515,6 +596,8 @@ alsa_run(cubeb * ctx)
 
   pthread_mutex_unlock(&ctx->mutex);
   r = poll(ctx->fds, ctx->nfds, timeout);
+  wakeup = cubeb_stream_stats_now();
+  cubeb_thread_wakeup();
   pthread_mutex_lock(&ctx->mutex);
 
   if (r > 0) {
@@ -536,7 +619,10 @@ alsa_run(cubeb * ctx)
       if (stm && stm->state == RUNNING && stm->fds && any_revents(stm->fds, stm->nfds)) {
         alsa_set_stream_state(stm, PROCESSING);
         pthread_mutex_unlock(&ctx->mutex);
-        state = alsa_process_stream(stm);
+        CUBEB_TRACE_BEGIN("alsa_process_stream");
+        state = alsa_process_stream(stm, wakeup);
+        CUBEB_TRACE_END("alsa_process_stream");
+        wakeup = cubeb_stream_stats_now();
         pthread_mutex_lock(&ctx->mutex);
         alsa_set_stream_state(stm, state);
       }
@@ -547,9 +633,13 @@ alsa_run(cubeb * ctx)
       if (stm) {
         if (stm->state == DRAINING && ms_since(&stm->drain_timeout) >= 0) {
           alsa_set_stream_state(stm, INACTIVE);
+          CUBEB_PROBE2(state_change, stm, CUBEB_STATE_DRAINED);
           stm->state_callback(stm, stm->user_ptr, CUBEB_STATE_DRAINED);
         } else if (stm->state == RUNNING && ms_since(&stm->last_activity) > CUBEB_WATCHDOG_MS) {
           alsa_set_stream_state(stm, ERROR);
+          cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+          cubeb_flight_recorder_dump(stm->recorder);
+          CUBEB_PROBE2(state_change, stm, CUBEB_STATE_ERROR);
           stm->state_callback(stm, stm->user_ptr, CUBEB_STATE_ERROR);
         }
       }
@@ -567,9 +657,11 @@ alsa_run_thread(void * context)
   cubeb * ctx = context;
   int r;
 
+  cubeb_thread_register(ctx, "cubeb-alsa");
   do {
     r = alsa_run(ctx);
   } while (r >= 0);
+  cubeb_thread_unregister();
 
   return NULL;
 }
@@ -956,7 +1048,6 @@ alsa_stream_init_single(cubeb * ctx, cubeb_stream ** stream, char const * stream
                         cubeb_state_callback state_callback,
                         void * user_ptr)
 {
-  (void)stream_name;
   cubeb_stream * stm;
   int r;
   snd_pcm_format_t format;
@@ -1011,6 +1102,9 @@ alsa_stream_init_single(cubeb * ctx, cubeb_stream ** stream, char const * stream
   stm->bufframes = 0;
   stm->stream_type = stream_type;
   stm->other_stream = NULL;
+  stm->recorder = cubeb_flight_recorder_create(stream_name);
+  stm->glitches = cubeb_glitch_notifier_create();
+  stm->stats = cubeb_stream_stats_counters_create(stm->params.rate, stm->glitches);
 
   r = pthread_mutex_init(&stm->mutex, NULL);
   assert(r == 0);
@@ -1096,6 +1190,20 @@ alsa_stream_init(cubeb * ctx, cubeb_stream ** stream, char const * stream_name,
                                      data_callback, state_callback, user_ptr);
   }
 
+  if (result == CUBEB_OK) {
+    cubeb_stream * stm = outstm ? outstm : instm;
+    snd_pcm_uframes_t frames = stm->buffer_size;
+    if (outstm && instm && instm->buffer_size > frames) {
+      frames = instm->buffer_size;
+    }
+    result = cubeb_planar_adapter_create(input_stream_params, output_stream_params,
+                                         frames, &stm->planar);
+    if (result != CUBEB_OK && outstm) {
+      alsa_stream_destroy(outstm);
+      outstm = NULL;
+    }
+  }
+
   if (result == CUBEB_OK && input_stream_params && output_stream_params) {
     instm->other_stream = outstm;
     outstm->other_stream = instm;
@@ -1150,10 +1258,77 @@ alsa_stream_destroy(cubeb_stream * stm)
   pthread_mutex_unlock(&ctx->mutex);
 
   free(stm->buffer);
+  cubeb_planar_adapter_destroy(stm->planar);
+  cubeb_flight_recorder_destroy(stm->recorder);
+  cubeb_stream_stats_counters_destroy(stm->stats);
+  cubeb_glitch_notifier_destroy(stm->glitches);
 
   free(stm);
 }
 
+static int
+alsa_stream_dump_flight_recorder(cubeb_stream * stm)
+{
+  /* A duplex stream is made of two ALSA streams. */
+  if (stm->other_stream) {
+    cubeb_flight_recorder_dump(stm->other_stream->recorder);
+  }
+  cubeb_flight_recorder_dump(stm->recorder);
+  return CUBEB_OK;
+}
+
+static int
+alsa_stream_get_stats(cubeb_stream * stm, cubeb_stream_stats * stats)
+{
+  /* A duplex stream is made of two ALSA streams, that both call the data
+     callback. */
+  cubeb_stream_stats_counters * counters[2] = {
+    stm->stats, stm->other_stream ? stm->other_stream->stats : NULL
+  };
+  cubeb_stream_stats_counters_get(counters, 2, stats);
+  return CUBEB_OK;
+}
+
+static int
+alsa_stream_get_callback_histograms(cubeb_stream * stm,
+                                    cubeb_callback_histograms * histograms)
+{
+  cubeb_stream_stats_counters * counters[2] = {
+    stm->stats, stm->other_stream ? stm->other_stream->stats : NULL
+  };
+  cubeb_stream_stats_counters_get_histograms(counters, 2, histograms);
+  return CUBEB_OK;
+}
+
+static int
+alsa_stream_register_glitch_callback(cubeb_stream * stm,
+                                     cubeb_glitch_callback glitch_callback)
+{
+  /* Both halves of a duplex stream report their glitches as the stream
+     returned to the user. */
+  if (stm->other_stream) {
+    cubeb_glitch_notifier_set_callback(stm->other_stream->glitches, stm,
+                                       glitch_callback, stm->user_ptr);
+  }
+  cubeb_glitch_notifier_set_callback(stm->glitches, stm, glitch_callback,
+                                     stm->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+alsa_stream_register_load_callback(cubeb_stream * stm, float threshold,
+                                   cubeb_load_callback load_callback)
+{
+  if (stm->other_stream) {
+    cubeb_glitch_notifier_set_load_callback(stm->other_stream->glitches, stm,
+                                            load_callback, threshold,
+                                            stm->user_ptr);
+  }
+  cubeb_glitch_notifier_set_load_callback(stm->glitches, stm, load_callback,
+                                          threshold, stm->user_ptr);
+  return CUBEB_OK;
+}
+
 static int
 alsa_get_max_channel_count(cubeb * ctx, uint32_t * max_channels)
 {
@@ -1260,6 +1435,7 @@ alsa_stream_start(cubeb_stream * stm)
   }
 
   pthread_mutex_lock(&stm->mutex);
+  cubeb_stream_stats_started(stm->stats);
   /* Capture pcm must be started after initial setup/recover */
   if (stm->stream_type == SND_PCM_STREAM_CAPTURE &&
       WRAP(snd_pcm_state)(stm->pcm) == SND_PCM_STATE_PREPARED) {
@@ -1449,5 +1625,13 @@ static struct cubeb_ops const alsa_ops = {
   .stream_get_current_device = NULL,
   .stream_device_destroy = NULL,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = alsa_stream_dump_flight_recorder,
+  .stream_get_stats = alsa_stream_get_stats,
+  .stream_register_glitch_callback = alsa_stream_register_glitch_callback,
+  .stream_register_load_callback = alsa_stream_register_load_callback,
+  .stream_get_callback_histograms = alsa_stream_get_callback_histograms,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
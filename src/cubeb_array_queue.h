@@ -9,33 +9,56 @@
 #define CUBEB_ARRAY_QUEUE_H
 
 #include <assert.h>
-#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+/** Bounded lock-free queue of non-NULL pointers, that can be pushed to and
+    popped from any number of threads concurrently, without locks, so that it
+    can be used on real-time threads.
+
+    Each cell has a sequence number that tells which lap of the array it is
+    ready for. A thread claims a cell by advancing the write (resp. read)
+    position with a compare-and-swap, then stores (resp. loads) the item, then
+    publishes the cell by bumping its sequence number. */
+
+#define ARRAY_QUEUE_CACHE_LINE_SIZE 64
+
 typedef struct
 {
-  void ** buf;
+  size_t sequence;
+  void * item;
+} array_queue_cell;
+
+typedef struct
+{
+  array_queue_cell * cells;
   size_t num;
+  /* The positions are written by different threads, keep them on separate
+     cache lines. */
+  char pad0[ARRAY_QUEUE_CACHE_LINE_SIZE];
   size_t writePos;
+  char pad1[ARRAY_QUEUE_CACHE_LINE_SIZE - sizeof(size_t)];
   size_t readPos;
-  pthread_mutex_t mutex;
+  char pad2[ARRAY_QUEUE_CACHE_LINE_SIZE - sizeof(size_t)];
 } array_queue;
 
 array_queue * array_queue_create(size_t num)
 {
   assert(num != 0);
   array_queue * new_queue = (array_queue*)calloc(1, sizeof(array_queue));
-  new_queue->buf = (void **)calloc(1, sizeof(void *) * num);
+  new_queue->cells = (array_queue_cell *)calloc(num, sizeof(array_queue_cell));
+  for (size_t i = 0; i < num; ++i) {
+    new_queue->cells[i].sequence = i;
+  }
   new_queue->readPos = 0;
   new_queue->writePos = 0;
   new_queue->num = num;
 
-  pthread_mutex_init(&new_queue->mutex, NULL);
-
   return new_queue;
 }
 
@@ -43,8 +66,7 @@ void array_queue_destroy(array_queue * aq)
 {
   assert(aq);
 
-  free(aq->buf);
-  pthread_mutex_destroy(&aq->mutex);
+  free(aq->cells);
   free(aq);
 }
 
@@ -52,42 +74,74 @@ int array_queue_push(array_queue * aq, void * item)
 {
   assert(item);
 
-  pthread_mutex_lock(&aq->mutex);
-  int ret = -1;
-  if(aq->buf[aq->writePos % aq->num] == NULL)
-  {
-    aq->buf[aq->writePos % aq->num] = item;
-    aq->writePos = (aq->writePos + 1) % aq->num;
-    ret = 0;
+  array_queue_cell * cell;
+  size_t pos = __atomic_load_n(&aq->writePos, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &aq->cells[pos % aq->num];
+    size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    intptr_t lap = (intptr_t)seq - (intptr_t)pos;
+    if (lap == 0) {
+      /* On failure, pos is updated to the current write position. */
+      if (__atomic_compare_exchange_n(&aq->writePos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (lap < 0) {
+      // queue is full
+      return -1;
+    } else {
+      pos = __atomic_load_n(&aq->writePos, __ATOMIC_RELAXED);
+    }
   }
-  // else queue is full
-  pthread_mutex_unlock(&aq->mutex);
-  return ret;
+
+  cell->item = item;
+  __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+  return 0;
 }
 
 void* array_queue_pop(array_queue * aq)
 {
-  pthread_mutex_lock(&aq->mutex);
-  void * value = aq->buf[aq->readPos % aq->num];
-  if(value)
-  {
-    aq->buf[aq->readPos % aq->num] = NULL;
-    aq->readPos = (aq->readPos + 1) % aq->num;
+  array_queue_cell * cell;
+  size_t pos = __atomic_load_n(&aq->readPos, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &aq->cells[pos % aq->num];
+    size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    intptr_t lap = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (lap == 0) {
+      /* On failure, pos is updated to the current read position. */
+      if (__atomic_compare_exchange_n(&aq->readPos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (lap < 0) {
+      // queue is empty
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&aq->readPos, __ATOMIC_RELAXED);
+    }
   }
-  pthread_mutex_unlock(&aq->mutex);
+
+  void * value = cell->item;
+  /* Hand the cell back to the writers, for the next lap. */
+  __atomic_store_n(&cell->sequence, pos + aq->num, __ATOMIC_RELEASE);
+
   return value;
 }
 
+/** Number of items in the queue. This is only a snapshot if other threads are
+    pushing or popping concurrently. */
 size_t array_queue_get_size(array_queue * aq)
 {
-  pthread_mutex_lock(&aq->mutex);
-  ssize_t r = aq->writePos - aq->readPos;
-  if (r < 0) {
-    r = aq->num + r;
-    assert(r >= 0);
+  size_t readPos = __atomic_load_n(&aq->readPos, __ATOMIC_RELAXED);
+  size_t writePos = __atomic_load_n(&aq->writePos, __ATOMIC_RELAXED);
+  /* The two positions are not read atomically together. */
+  if (writePos < readPos) {
+    return 0;
   }
-  pthread_mutex_unlock(&aq->mutex);
-  return (size_t)r;
+  return writePos - readPos > aq->num ? aq->num : writePos - readPos;
 }
 
 #if defined(__cplusplus)
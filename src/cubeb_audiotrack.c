@@ -17,6 +17,7 @@
 
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_planar.h"
 #include "android/audiotrack_definitions.h"
 
 #ifndef ALOG
@@ -86,6 +87,8 @@ struct cubeb_stream {
   /* Number of frames that have been passed to the AudioTrack callback */
   long unsigned written;
   int draining;
+  /* Converts the buffers of planar streams. */
+  cubeb_planar_adapter * planar;
 };
 
 static void
@@ -101,7 +104,8 @@ audiotrack_refill(int event, void* user, void* info)
       return;
     }
 
-    got = stream->data_callback(stream, stream->user_ptr, NULL, b->raw, b->frameCount);
+    got = cubeb_planar_data_callback(stream->planar, stream->data_callback, stream,
+                                     stream->user_ptr, NULL, b->raw, b->frameCount);
 
     stream->written += got;
 
@@ -316,6 +320,12 @@ audiotrack_stream_init(cubeb * ctx, cubeb_stream ** stream, char const * stream_
   stm->user_ptr = user_ptr;
   stm->params = *output_stream_params;
 
+  if (cubeb_planar_adapter_create(NULL, output_stream_params, min_frame_count,
+                                  &stm->planar) != CUBEB_OK) {
+    free(stm);
+    return CUBEB_ERROR;
+  }
+
   stm->instance = calloc(SIZE_AUDIOTRACK_INSTANCE, 1);
   (*(uint32_t*)((intptr_t)stm->instance + SIZE_AUDIOTRACK_INSTANCE - 4)) = 0xbaadbaad;
   assert(stm->instance && "cubeb: EOM");
@@ -353,6 +363,7 @@ audiotrack_stream_destroy(cubeb_stream * stream)
 
   free(stream->instance);
   stream->instance = NULL;
+  cubeb_planar_adapter_destroy(stream->planar);
   free(stream);
 }
 
@@ -438,5 +449,13 @@ static struct cubeb_ops const audiotrack_ops = {
   .stream_get_current_device = NULL,
   .stream_device_destroy = NULL,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = NULL,
+  .stream_get_stats = NULL,
+  .stream_register_glitch_callback = NULL,
+  .stream_register_load_callback = NULL,
+  .stream_get_callback_histograms = NULL,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
@@ -460,7 +460,7 @@ audiounit_render_input(cubeb_stream * stm,
     }
     // For now state that no error occurred and feed silence, stream will be
     // resumed once reinit has completed.
-    ALOGV("(%p) input: reinit pending feeding silence instead", stm);
+    ALOGV_HOT("(%p) input: reinit pending feeding silence instead", stm);
     stm->input_linear_buffer->push_silence(input_frames * stm->input_desc.mChannelsPerFrame);
   } else {
     /* Copy input data in linear buffer. */
@@ -472,7 +472,7 @@ audiounit_render_input(cubeb_stream * stm,
   assert(input_frames > 0);
   stm->frames_read += input_frames;
 
-  ALOGV("(%p) input: buffers %u, size %u, channels %u, rendered frames %d, total frames %lu.",
+  ALOGV_HOT("(%p) input: buffers %u, size %u, channels %u, rendered frames %d, total frames %lu.",
         stm,
         (unsigned int) input_buffer_list.mNumberBuffers,
         (unsigned int) input_buffer_list.mBuffers[0].mDataByteSize,
@@ -598,7 +598,7 @@ audiounit_output_callback(void * user_ptr,
   // the hardware latency.
   stm->total_output_latency_frames = output_latency_ns * stm->output_hw_rate / ns2s + stm->current_latency_frames;
 
-  ALOGV("(%p) output: buffers %u, size %u, channels %u, frames %u, total input frames %lu.",
+  ALOGV_HOT("(%p) output: buffers %u, size %u, channels %u, frames %u, total input frames %lu.",
         stm,
         (unsigned int) outBufferList->mNumberBuffers,
         (unsigned int) outBufferList->mBuffers[0].mDataByteSize,
@@ -3626,5 +3626,13 @@ cubeb_ops const audiounit_ops = {
   /*.stream_get_current_device =*/ audiounit_stream_get_current_device,
   /*.stream_device_destroy =*/ audiounit_stream_device_destroy,
   /*.stream_register_device_changed_callback =*/ audiounit_stream_register_device_changed_callback,
-  /*.register_device_collection_changed =*/ audiounit_register_device_collection_changed
+  /*.register_device_collection_changed =*/ audiounit_register_device_collection_changed,
+  /*.stream_dump_flight_recorder =*/ NULL,
+  /*.stream_get_stats =*/ NULL,
+  /*.stream_register_glitch_callback =*/ NULL,
+  /*.stream_register_load_callback =*/ NULL,
+  /*.stream_get_callback_histograms =*/ NULL,
+  /*.set_clock_mode =*/ NULL,
+  /*.advance_clock =*/ NULL,
+  /*.set_offline_params =*/ NULL
 };
@@ -0,0 +1,175 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_flight_recorder.h"
+#include "cubeb-internal.h"
+#include "cubeb_ringbuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <new>
+
+static_assert((CUBEB_FLIGHT_RECORDER_SIZE & (CUBEB_FLIGHT_RECORDER_SIZE - 1)) == 0,
+              "The size of the flight recorder must be a power of two");
+
+namespace {
+
+/** An event, protected by a sequence lock. Writers make `sequence` odd while
+ * they write the event, then set it to `2 * (index + 1)`, where `index` is
+ * the index of the event since the creation of the recorder. A reader knows
+ * it has a consistent copy of event `index` when `sequence` has this value
+ * before and after the copy. All the fields are atomics, so that racing with
+ * a writer is not undefined behaviour. */
+struct flight_recorder_slot
+{
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> timestamp_ns;
+  std::atomic<int> type;
+  std::atomic<int64_t> value;
+  std::atomic<int64_t> extra;
+};
+
+uint64_t
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+char const *
+event_name(cubeb_flight_event_type type)
+{
+  switch (type) {
+  case CUBEB_FLIGHT_EVENT_CALLBACK_START:
+    return "callback start";
+  case CUBEB_FLIGHT_EVENT_CALLBACK_END:
+    return "callback end";
+  case CUBEB_FLIGHT_EVENT_AVAIL:
+    return "avail";
+  case CUBEB_FLIGHT_EVENT_XRUN:
+    return "xrun";
+  case CUBEB_FLIGHT_EVENT_RECOVER:
+    return "recover";
+  case CUBEB_FLIGHT_EVENT_STATE:
+    return "state";
+  }
+  return "unknown";
+}
+
+} // namespace
+
+struct cubeb_flight_recorder {
+  char name[64];
+  char pad0[CUBEB_CACHE_LINE_SIZE];
+  /** Index of the next event, claimed by writers with a fetch_add. */
+  std::atomic<uint64_t> write_index;
+  char pad1[CUBEB_CACHE_LINE_SIZE];
+  flight_recorder_slot slots[CUBEB_FLIGHT_RECORDER_SIZE];
+};
+
+cubeb_flight_recorder *
+cubeb_flight_recorder_create(char const * name)
+{
+  cubeb_flight_recorder * recorder = new (std::nothrow) cubeb_flight_recorder();
+  if (!recorder) {
+    return nullptr;
+  }
+  snprintf(recorder->name, sizeof(recorder->name), "%s", name ? name : "");
+  recorder->write_index.store(0, std::memory_order_relaxed);
+  for (flight_recorder_slot & slot : recorder->slots) {
+    slot.sequence.store(0, std::memory_order_relaxed);
+  }
+  return recorder;
+}
+
+void
+cubeb_flight_recorder_destroy(cubeb_flight_recorder * recorder)
+{
+  delete recorder;
+}
+
+void
+cubeb_flight_recorder_record(cubeb_flight_recorder * recorder,
+                             cubeb_flight_event_type type,
+                             int64_t value, int64_t extra)
+{
+  if (!recorder) {
+    return;
+  }
+  uint64_t index = recorder->write_index.fetch_add(1, std::memory_order_relaxed);
+  flight_recorder_slot & slot =
+    recorder->slots[index & (CUBEB_FLIGHT_RECORDER_SIZE - 1)];
+
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp_ns.store(now_ns(), std::memory_order_relaxed);
+  slot.type.store(type, std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  slot.extra.store(extra, std::memory_order_relaxed);
+  slot.sequence.store(2 * (index + 1), std::memory_order_release);
+}
+
+size_t
+cubeb_flight_recorder_read(cubeb_flight_recorder * recorder,
+                           cubeb_flight_event * events,
+                           size_t max_events)
+{
+  if (!recorder || !events) {
+    return 0;
+  }
+  uint64_t end = recorder->write_index.load(std::memory_order_acquire);
+  uint64_t count = std::min<uint64_t>(std::min<uint64_t>(end, CUBEB_FLIGHT_RECORDER_SIZE),
+                                      max_events);
+  size_t copied = 0;
+  for (uint64_t index = end - count; index < end; index++) {
+    flight_recorder_slot & slot =
+      recorder->slots[index & (CUBEB_FLIGHT_RECORDER_SIZE - 1)];
+    uint64_t expected = 2 * (index + 1);
+    if (slot.sequence.load(std::memory_order_acquire) != expected) {
+      /* Still being written, or already overwritten. */
+      continue;
+    }
+    cubeb_flight_event event;
+    event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+    event.type = static_cast<cubeb_flight_event_type>(
+      slot.type.load(std::memory_order_relaxed));
+    event.value = slot.value.load(std::memory_order_relaxed);
+    event.extra = slot.extra.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != expected) {
+      continue;
+    }
+    events[copied++] = event;
+  }
+  return copied;
+}
+
+void
+cubeb_flight_recorder_dump(cubeb_flight_recorder * recorder)
+{
+  if (!recorder || !CUBEB_LOG_ENABLED(BACKEND, CUBEB_LOG_NORMAL)) {
+    return;
+  }
+  cubeb_flight_event * events =
+    new (std::nothrow) cubeb_flight_event[CUBEB_FLIGHT_RECORDER_SIZE];
+  if (!events) {
+    return;
+  }
+  size_t count =
+    cubeb_flight_recorder_read(recorder, events, CUBEB_FLIGHT_RECORDER_SIZE);
+
+  LOG("Flight recorder of stream \"%s\": %zu events, oldest first, times in "
+      "ms relative to the last event", recorder->name, count);
+  for (size_t i = 0; i < count; i++) {
+    int64_t delta = events[i].timestamp_ns - events[count - 1].timestamp_ns;
+    LOG("  %10.3f %-14s %" PRId64 " %" PRId64, delta / 1e6,
+        event_name(events[i].type), events[i].value, events[i].extra);
+  }
+  delete [] events;
+}
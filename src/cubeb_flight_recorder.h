@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_FLIGHT_RECORDER_H
+#define CUBEB_FLIGHT_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A flight recorder keeps the last events of a stream in a fixed-size ring,
+    so that there is some history to look at when the stream fails, without
+    having to run with verbose logging.
+
+    Recording an event is lock-free and wait-free, doesn't allocate and doesn't
+    make system calls, and can be done from any thread, including the real-time
+    audio thread. The oldest events are overwritten. The events are dumped
+    through the log callback when the stream errors, or on demand with
+    cubeb_stream_dump_flight_recorder. */
+
+/** Number of events kept, a power of two. */
+#define CUBEB_FLIGHT_RECORDER_SIZE 256
+
+typedef enum {
+  /** A data callback is about to be called. value: frames requested. */
+  CUBEB_FLIGHT_EVENT_CALLBACK_START,
+  /** A data callback returned. value: frames delivered, or an error. */
+  CUBEB_FLIGHT_EVENT_CALLBACK_END,
+  /** The backend has been asked for its buffer level. value: frames that can
+      be read or written. */
+  CUBEB_FLIGHT_EVENT_AVAIL,
+  /** An underrun or an overrun. value: frames lost, if known, or 0. */
+  CUBEB_FLIGHT_EVENT_XRUN,
+  /** The backend tried to recover from an error. value: the error. extra: the
+      result of the recovery. */
+  CUBEB_FLIGHT_EVENT_RECOVER,
+  /** The state callback is about to be called. value: the cubeb_state. */
+  CUBEB_FLIGHT_EVENT_STATE,
+} cubeb_flight_event_type;
+
+typedef struct {
+  /** Monotonic time of the event, in nanoseconds. */
+  uint64_t timestamp_ns;
+  cubeb_flight_event_type type;
+  int64_t value;
+  int64_t extra;
+} cubeb_flight_event;
+
+typedef struct cubeb_flight_recorder cubeb_flight_recorder;
+
+/** Create a flight recorder.
+    @param name Name of the stream, copied, for the dumps. Can be NULL.
+    @retval The flight recorder, or NULL if out of memory. */
+cubeb_flight_recorder * cubeb_flight_recorder_create(char const * name);
+void cubeb_flight_recorder_destroy(cubeb_flight_recorder * recorder);
+
+/** Record an event. This is a no-op if recorder is NULL, so that backends
+    don't have to check that it has been created. */
+void cubeb_flight_recorder_record(cubeb_flight_recorder * recorder,
+                                  cubeb_flight_event_type type,
+                                  int64_t value, int64_t extra);
+
+/** Copy the recorded events, oldest first. Events that are overwritten while
+    being copied are skipped.
+    @param events Array of at least max_events events.
+    @retval The number of events copied. */
+size_t cubeb_flight_recorder_read(cubeb_flight_recorder * recorder,
+                                  cubeb_flight_event * events,
+                                  size_t max_events);
+
+/** Log the recorded events, oldest first, if logging is enabled. This formats
+    and calls the log callback, don't call it from a real-time thread. */
+void cubeb_flight_recorder_dump(cubeb_flight_recorder * recorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUBEB_FLIGHT_RECORDER_H
@@ -0,0 +1,209 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_FUTEX_H
+#define CUBEB_FUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__FreeBSD__)
+#include <ctime>
+#include <sys/types.h>
+#include <sys/umtx.h>
+#elif defined(__OpenBSD__)
+#include <ctime>
+#include <sys/futex.h>
+#elif defined(__APPLE__)
+#if defined(__has_include)
+#if __has_include(<os/os_sync_wait_on_address.h>)
+#include <os/clock.h>
+#include <os/os_sync_wait_on_address.h>
+#define CUBEB_FUTEX_OS_SYNC
+#endif
+#endif
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+#if !defined(__linux__) && !defined(__FreeBSD__) && !defined(__OpenBSD__) &&  \
+  !(defined(_WIN32) && _WIN32_WINNT >= 0x0602)
+/* On macOS, only used when running on a version older than 14.4. */
+#define CUBEB_FUTEX_FALLBACK
+#include <condition_variable>
+#include <mutex>
+
+/** Used to block and wake up threads where there is no futex-like system
+ * call. Shared by all the words, wakeups are rare. */
+struct cubeb_futex_fallback
+{
+  static cubeb_futex_fallback & get()
+  {
+    /* Never destroyed, so that it can be used during static destruction. */
+    static cubeb_futex_fallback * instance = new cubeb_futex_fallback;
+    return *instance;
+  }
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+#endif
+
+#if defined(CUBEB_FUTEX_OS_SYNC)
+/** Whether `os_sync_wait_on_address` can be used, macOS 14.4 and later. */
+inline bool cubeb_futex_has_os_sync()
+{
+  if (__builtin_available(macOS 14.4, iOS 17.4, tvOS 17.4, watchOS 10.4, *)) {
+    return true;
+  }
+  return false;
+}
+#endif
+
+/**
+ * Block until `*word` is no longer `expected`, or until `timeout_ms`
+ * milliseconds have passed, whichever comes first. A negative timeout waits
+ * forever. This can return early, callers must check their condition again.
+ *
+ * This is a futex on Linux and OpenBSD, `_umtx_op` on FreeBSD,
+ * `os_sync_wait_on_address` on macOS 14.4 and later and `WaitOnAddress` on
+ * Windows 8 and later. Elsewhere (older macOS, NetBSD, ...), this waits on a
+ * condition variable, and `cubeb_futex_wake` takes a lock. `word` can be in
+ * memory shared with other processes on Linux only.
+ */
+inline void cubeb_futex_wait(std::atomic<uint32_t> * word, uint32_t expected,
+                             int timeout_ms)
+{
+#if defined(__linux__)
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected,
+          timeout_ms < 0 ? nullptr : &timeout, nullptr, 0);
+#elif defined(__FreeBSD__)
+  /* A relative timeout is passed as a timespec, with its size in `uaddr`. */
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  _umtx_op(word, UMTX_OP_WAIT_UINT_PRIVATE, expected,
+           timeout_ms < 0 ? nullptr
+                          : reinterpret_cast<void *>(sizeof(timeout)),
+           timeout_ms < 0 ? nullptr : &timeout);
+#elif defined(__OpenBSD__)
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  futex(reinterpret_cast<volatile uint32_t *>(word),
+        FUTEX_WAIT | FUTEX_PRIVATE_FLAG, int(expected),
+        timeout_ms < 0 ? nullptr : &timeout, nullptr);
+#elif !defined(CUBEB_FUTEX_FALLBACK)
+  WaitOnAddress(word, &expected, sizeof(expected),
+                timeout_ms < 0 ? INFINITE : DWORD(timeout_ms));
+#else
+#if defined(CUBEB_FUTEX_OS_SYNC)
+  if (cubeb_futex_has_os_sync()) {
+    if (timeout_ms < 0) {
+      os_sync_wait_on_address(word, expected, sizeof(expected),
+                              OS_SYNC_WAIT_ON_ADDRESS_NONE);
+    } else if (timeout_ms > 0) {
+      os_sync_wait_on_address_with_timeout(
+        word, expected, sizeof(expected), OS_SYNC_WAIT_ON_ADDRESS_NONE,
+        OS_CLOCK_MACH_ABSOLUTE_TIME, uint64_t(timeout_ms) * 1000000);
+    }
+    return;
+  }
+#endif
+  cubeb_futex_fallback & fallback = cubeb_futex_fallback::get();
+  std::unique_lock<std::mutex> lock(fallback.mutex);
+  if (word->load(std::memory_order_seq_cst) != expected) {
+    return;
+  }
+  if (timeout_ms < 0) {
+    fallback.cond.wait(lock);
+  } else {
+    fallback.cond.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+  }
+#endif
+}
+
+/**
+ * Wake up all the threads blocked in `cubeb_futex_wait` on `word`. This is a
+ * system call, callers should only call it when they know a thread is
+ * waiting. With the condition variable fallback, this also takes a lock that
+ * the waiting threads hold briefly, so this can block for a short time: on
+ * older macOS, NetBSD and other platforms without a futex, the audio threads
+ * that wake up the logger or the glitch dispatcher take this lock.
+ */
+inline void cubeb_futex_wake(std::atomic<uint32_t> * word)
+{
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX,
+          nullptr, nullptr, 0);
+#elif defined(__FreeBSD__)
+  _umtx_op(word, UMTX_OP_WAKE_PRIVATE, INT_MAX, nullptr, nullptr);
+#elif defined(__OpenBSD__)
+  futex(reinterpret_cast<volatile uint32_t *>(word),
+        FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, nullptr, nullptr);
+#elif !defined(CUBEB_FUTEX_FALLBACK)
+  WakeByAddressAll(word);
+#else
+#if defined(CUBEB_FUTEX_OS_SYNC)
+  if (cubeb_futex_has_os_sync()) {
+    os_sync_wake_by_address_all(word, sizeof(uint32_t),
+                                OS_SYNC_WAKE_BY_ADDRESS_NONE);
+    return;
+  }
+#endif
+  cubeb_futex_fallback & fallback = cubeb_futex_fallback::get();
+  /* A thread that has seen the old value is either already waiting, or
+   * will see the new one once we have the lock. */
+  { std::lock_guard<std::mutex> lock(fallback.mutex); }
+  fallback.cond.notify_all();
+#endif
+}
+
+/**
+ * A point in time after which a wait gives up, to call `cubeb_futex_wait` in
+ * a loop.
+ */
+class cubeb_deadline
+{
+public:
+  /** @param timeout_ms Milliseconds from now, negative for no deadline. */
+  explicit cubeb_deadline(int timeout_ms)
+    : infinite_(timeout_ms < 0)
+    , deadline_(std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(infinite_ ? 0 : timeout_ms))
+  {
+  }
+  /**
+   * @return The number of milliseconds left, rounded up, 0 if the deadline
+   * has passed, -1 if there is no deadline.
+   */
+  int remaining_ms() const
+  {
+    if (infinite_) {
+      return -1;
+    }
+    auto remaining = deadline_ - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::steady_clock::duration::zero()) {
+      return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+             remaining + std::chrono::milliseconds(1) -
+             std::chrono::steady_clock::duration(1)).count();
+  }
+private:
+  const bool infinite_;
+  const std::chrono::steady_clock::time_point deadline_;
+};
+
+#endif // CUBEB_FUTEX_H
@@ -0,0 +1,317 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_glitch.h"
+#include "cubeb_log.h"
+#include "cubeb_mpsc_consumer.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+/** Maximum number of glitches waiting to be passed to the callbacks, for all
+ * the streams. */
+const int CUBEB_GLITCH_QUEUE_DEPTH = 256;
+/** Number of glitches dequeued at once by the dispatcher thread. */
+const int CUBEB_GLITCH_BATCH_SIZE = 16;
+/** Once the load callback has been called, the load has to go below this
+ * fraction of the threshold before it can be called again, so that a load
+ * hovering around the threshold doesn't call it repeatedly. */
+const float CUBEB_LOAD_REARM_RATIO = 0.9f;
+
+/** A notifier is handed over to the dispatcher thread each time a glitch is
+ * queued. Unsetting a callback only returns when no thread is in the middle
+ * of reporting a glitch, and the dispatcher has seen all the queued glitches,
+ * so that the notifier can be destroyed afterwards. */
+struct cubeb_glitch_notifier {
+  /** Serializes the changes of callbacks. */
+  std::mutex mutex;
+  std::atomic<cubeb_stream *> stream;
+  std::atomic<void *> user_ptr;
+  std::atomic<cubeb_glitch_callback> callback;
+  std::atomic<cubeb_load_callback> load_callback;
+  std::atomic<float> load_threshold;
+  /** Set when the load callback has been queued, until the load goes back
+   * below the threshold. */
+  std::atomic<bool> overloaded;
+  /** Number of threads reporting a glitch or the load. */
+  std::atomic<uint32_t> reporting;
+  /** Number of glitches queued and passed to the callback so far. */
+  std::atomic<uint64_t> queued;
+  std::atomic<uint64_t> delivered;
+};
+
+namespace {
+
+uint64_t
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct glitch_record
+{
+  cubeb_glitch_notifier * notifier;
+  /** A glitch, or the load going above the threshold. */
+  bool is_load;
+  float load;
+  cubeb_glitch_info info;
+};
+
+/** Calls the glitch callbacks, on a `cubeb_mpsc_consumer` thread like the
+ *  asynchronous logger. It runs while at least one callback is registered. */
+class glitch_dispatcher
+{
+public:
+  /* Never destroyed, like the asynchronous logger. */
+  static glitch_dispatcher & get()
+  {
+    static glitch_dispatcher * instance = new glitch_dispatcher;
+    return *instance;
+  }
+  /** Queue a glitch. Returns false if the queue is full. */
+  bool push(glitch_record const & record)
+  {
+    return consumer.push(record);
+  }
+  /** A callback has been registered: start the thread if it's the first. */
+  void acquire()
+  {
+    std::lock_guard<std::mutex> lock(lifecycle_mutex);
+    if (user_count++ == 0) {
+      consumer.start();
+    }
+  }
+  /** A callback has been unregistered: join the thread if it was the last. */
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(lifecycle_mutex);
+    assert(user_count > 0);
+    if (--user_count == 0) {
+      consumer.stop();
+    }
+  }
+  /** Block until `count` glitches of `notifier` have been dispatched. */
+  void wait_for_delivery(cubeb_glitch_notifier * notifier, uint64_t count)
+  {
+    std::unique_lock<std::mutex> lock(delivery_mutex);
+    delivered_cond.wait(lock, [notifier, count] {
+      return notifier->delivered.load(std::memory_order_relaxed) >= count;
+    });
+  }
+private:
+  typedef cubeb_mpsc_consumer<glitch_record, glitch_dispatcher,
+                              CUBEB_GLITCH_BATCH_SIZE> glitch_consumer;
+  friend glitch_consumer;
+
+  glitch_dispatcher()
+    : consumer(CUBEB_GLITCH_QUEUE_DEPTH, "cubeb-glitch", *this)
+    , user_count(0)
+  {
+  }
+  /** Called on the dispatcher thread for each queued glitch. */
+  void consume(glitch_record const & record)
+  {
+    cubeb_glitch_notifier * notifier = record.notifier;
+    cubeb_stream * stream = notifier->stream.load(std::memory_order_relaxed);
+    void * user_ptr = notifier->user_ptr.load(std::memory_order_relaxed);
+    /* The callbacks are NULL if they have been unregistered since the glitch
+     * was queued: the thread that did it is waiting for the glitch to be
+     * skipped. */
+    if (record.is_load) {
+      cubeb_load_callback callback =
+        notifier->load_callback.load(std::memory_order_acquire);
+      if (callback) {
+        callback(stream, user_ptr, record.load);
+      }
+    } else {
+      cubeb_glitch_callback callback =
+        notifier->callback.load(std::memory_order_acquire);
+      if (callback) {
+        callback(stream, user_ptr, &record.info);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(delivery_mutex);
+      notifier->delivered.fetch_add(1, std::memory_order_relaxed);
+    }
+    delivered_cond.notify_all();
+  }
+  void dropped(uint64_t count)
+  {
+    LOG("%llu glitch notifications dropped, the queue is full",
+        (unsigned long long)count);
+  }
+  glitch_consumer consumer;
+  /** Signaled when a glitch has been dispatched. */
+  std::mutex delivery_mutex;
+  std::condition_variable delivered_cond;
+  /** Protects `user_count`, that decides when the thread runs. */
+  std::mutex lifecycle_mutex;
+  int user_count;
+};
+
+/** Queue a glitch or a load notification. The caller has checked that the
+ * callback is set, while counted in `reporting`. */
+void
+queue_record(glitch_record const & record)
+{
+  if (glitch_dispatcher::get().push(record)) {
+    record.notifier->queued.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/** Unset a callback of `notifier`, and wait until it's not running and won't
+ * be called anymore. */
+template <typename Callback>
+void
+clear_callback(cubeb_glitch_notifier * notifier, std::atomic<Callback> & callback)
+{
+  if (!callback.exchange(nullptr, std::memory_order_seq_cst)) {
+    return;
+  }
+  glitch_dispatcher & dispatcher = glitch_dispatcher::get();
+  /* Threads that have seen the previous callback are about to queue a
+   * glitch, this doesn't block. */
+  while (notifier->reporting.load(std::memory_order_seq_cst)) {
+    std::this_thread::yield();
+  }
+  dispatcher.wait_for_delivery(notifier,
+                               notifier->queued.load(std::memory_order_relaxed));
+  dispatcher.release();
+}
+
+} // namespace
+
+cubeb_glitch_notifier *
+cubeb_glitch_notifier_create()
+{
+  cubeb_glitch_notifier * notifier = new (std::nothrow) cubeb_glitch_notifier();
+  if (!notifier) {
+    return nullptr;
+  }
+  notifier->stream.store(nullptr, std::memory_order_relaxed);
+  notifier->user_ptr.store(nullptr, std::memory_order_relaxed);
+  notifier->callback.store(nullptr, std::memory_order_relaxed);
+  notifier->load_callback.store(nullptr, std::memory_order_relaxed);
+  notifier->load_threshold.store(0, std::memory_order_relaxed);
+  notifier->overloaded.store(false, std::memory_order_relaxed);
+  notifier->reporting.store(0, std::memory_order_relaxed);
+  notifier->queued.store(0, std::memory_order_relaxed);
+  notifier->delivered.store(0, std::memory_order_relaxed);
+  return notifier;
+}
+
+void
+cubeb_glitch_notifier_destroy(cubeb_glitch_notifier * notifier)
+{
+  cubeb_glitch_notifier_set_callback(notifier, nullptr, nullptr, nullptr);
+  cubeb_glitch_notifier_set_load_callback(notifier, nullptr, nullptr, 0, nullptr);
+  delete notifier;
+}
+
+void
+cubeb_glitch_notifier_set_callback(cubeb_glitch_notifier * notifier,
+                                   cubeb_stream * stream,
+                                   cubeb_glitch_callback callback,
+                                   void * user_ptr)
+{
+  if (!notifier) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(notifier->mutex);
+
+  /* Acquire before releasing the previous callback, so that the thread keeps
+   * running when replacing a callback. */
+  if (callback) {
+    glitch_dispatcher::get().acquire();
+  }
+  clear_callback(notifier, notifier->callback);
+  if (callback) {
+    notifier->stream.store(stream, std::memory_order_relaxed);
+    notifier->user_ptr.store(user_ptr, std::memory_order_relaxed);
+    notifier->callback.store(callback, std::memory_order_seq_cst);
+  }
+}
+
+void
+cubeb_glitch_notifier_set_load_callback(cubeb_glitch_notifier * notifier,
+                                        cubeb_stream * stream,
+                                        cubeb_load_callback callback,
+                                        float threshold,
+                                        void * user_ptr)
+{
+  if (!notifier) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(notifier->mutex);
+
+  if (callback) {
+    glitch_dispatcher::get().acquire();
+  }
+  clear_callback(notifier, notifier->load_callback);
+  if (callback) {
+    notifier->stream.store(stream, std::memory_order_relaxed);
+    notifier->user_ptr.store(user_ptr, std::memory_order_relaxed);
+    notifier->load_threshold.store(threshold, std::memory_order_relaxed);
+    notifier->overloaded.store(false, std::memory_order_relaxed);
+    notifier->load_callback.store(callback, std::memory_order_seq_cst);
+  }
+}
+
+void
+cubeb_glitch_report(cubeb_glitch_notifier * notifier,
+                    cubeb_glitch_type type,
+                    cubeb_device_type direction,
+                    uint64_t frames_lost)
+{
+  /* Most of the time, no callback is registered. */
+  if (!notifier || !notifier->callback.load(std::memory_order_relaxed)) {
+    return;
+  }
+  notifier->reporting.fetch_add(1, std::memory_order_seq_cst);
+  if (notifier->callback.load(std::memory_order_seq_cst)) {
+    glitch_record record;
+    record.notifier = notifier;
+    record.is_load = false;
+    record.load = 0;
+    record.info.type = type;
+    record.info.direction = direction;
+    record.info.frames_lost = frames_lost;
+    record.info.timestamp_ns = now_ns();
+    queue_record(record);
+  }
+  notifier->reporting.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void
+cubeb_glitch_report_load(cubeb_glitch_notifier * notifier, float load)
+{
+  if (!notifier || !notifier->load_callback.load(std::memory_order_relaxed)) {
+    return;
+  }
+  notifier->reporting.fetch_add(1, std::memory_order_seq_cst);
+  if (notifier->load_callback.load(std::memory_order_seq_cst)) {
+    float threshold = notifier->load_threshold.load(std::memory_order_relaxed);
+    bool overloaded = notifier->overloaded.load(std::memory_order_relaxed);
+    if (!overloaded && load > threshold) {
+      notifier->overloaded.store(true, std::memory_order_relaxed);
+      glitch_record record = glitch_record();
+      record.notifier = notifier;
+      record.is_load = true;
+      record.load = load;
+      queue_record(record);
+    } else if (overloaded && load < threshold * CUBEB_LOAD_REARM_RATIO) {
+      notifier->overloaded.store(false, std::memory_order_relaxed);
+    }
+  }
+  notifier->reporting.fetch_sub(1, std::memory_order_seq_cst);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_GLITCH_H
+#define CUBEB_GLITCH_H
+
+#include "cubeb/cubeb.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Glitch and overload notifications of a stream, behind
+    cubeb_stream_register_glitch_callback and
+    cubeb_stream_register_load_callback.
+
+    Backends report underruns and overruns from the audio thread, without
+    blocking, allocating or making system calls other than reading the
+    monotonic clock and waking up a sleeping thread. The glitches are queued,
+    and the glitch callbacks are called on a thread shared by all the
+    notifiers, that only runs while at least one callback is registered. If
+    too many glitches are waiting to be passed to the callbacks, the new ones
+    are dropped.
+
+    All the functions are no-ops when passed a NULL notifier, so that backends
+    don't have to check that it has been created. */
+typedef struct cubeb_glitch_notifier cubeb_glitch_notifier;
+
+/** @retval The notifier, or NULL if out of memory. */
+cubeb_glitch_notifier * cubeb_glitch_notifier_create(void);
+/** Unregister the callbacks, if any, and free the notifier. */
+void cubeb_glitch_notifier_destroy(cubeb_glitch_notifier * notifier);
+
+/** Set or unset the glitch callback. When this returns, the previous callback
+    is not running and won't be called anymore. Must not be called from the
+    glitch callback.
+    @param stream The stream passed to the callback.
+    @param callback The callback, NULL to unregister it.
+    @param user_ptr The user pointer passed to the callback. */
+void cubeb_glitch_notifier_set_callback(cubeb_glitch_notifier * notifier,
+                                        cubeb_stream * stream,
+                                        cubeb_glitch_callback callback,
+                                        void * user_ptr);
+
+/** Set or unset the load callback, like cubeb_glitch_notifier_set_callback.
+    @param threshold The load above which the callback is called. */
+void cubeb_glitch_notifier_set_load_callback(cubeb_glitch_notifier * notifier,
+                                             cubeb_stream * stream,
+                                             cubeb_load_callback callback,
+                                             float threshold,
+                                             void * user_ptr);
+
+/** Report a glitch. This can be called from any thread, including the audio
+    thread, and does nothing if no callback is registered.
+    @param frames_lost The number of frames lost, 0 if unknown. */
+void cubeb_glitch_report(cubeb_glitch_notifier * notifier,
+                         cubeb_glitch_type type,
+                         cubeb_device_type direction,
+                         uint64_t frames_lost);
+
+/** Report the current load of the stream, after each data callback. This
+    queues a call to the load callback when the load goes above the
+    threshold. Must be called from a single thread at a time. */
+void cubeb_glitch_report_load(cubeb_glitch_notifier * notifier, float load);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUBEB_GLITCH_H
@@ -18,8 +18,15 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <math.h>
+#include <algorithm>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_flight_recorder.h"
+#include "cubeb_glitch.h"
+#include "cubeb_probes.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_stream_stats.h"
+#include "cubeb_trace.h"
 #include "cubeb_resampler.h"
 #include "cubeb_utils.h"
 
@@ -100,6 +107,7 @@ static void cbjack_destroy(cubeb * context);
 static void cbjack_interleave_capture(cubeb_stream * stream, float **in, jack_nframes_t nframes, bool format_mismatch);
 static void cbjack_deinterleave_playback_refill_s16ne(cubeb_stream * stream, short **bufs_in, float **bufs_out, jack_nframes_t nframes);
 static void cbjack_deinterleave_playback_refill_float(cubeb_stream * stream, float **bufs_in, float **bufs_out, jack_nframes_t nframes);
+static void cbjack_refill_planar(cubeb_stream * stream, float **bufs_in, float **bufs_out, jack_nframes_t nframes);
 static int cbjack_stream_device_destroy(cubeb_stream * stream,
                                         cubeb_device * device);
 static int cbjack_stream_get_current_device(cubeb_stream * stm, cubeb_device ** const device);
@@ -117,6 +125,15 @@ static int cbjack_stream_init(cubeb * context, cubeb_stream ** stream, char cons
                               cubeb_state_callback state_callback,
                               void * user_ptr);
 static void cbjack_stream_destroy(cubeb_stream * stream);
+static int cbjack_stream_dump_flight_recorder(cubeb_stream * stream);
+static int cbjack_stream_get_stats(cubeb_stream * stream, cubeb_stream_stats * stats);
+static int cbjack_stream_register_glitch_callback(cubeb_stream * stream,
+                                                  cubeb_glitch_callback glitch_callback);
+static int cbjack_stream_register_load_callback(cubeb_stream * stream,
+                                                float threshold,
+                                                cubeb_load_callback load_callback);
+static int cbjack_stream_get_callback_histograms(cubeb_stream * stream,
+                                                 cubeb_callback_histograms * histograms);
 static int cbjack_stream_start(cubeb_stream * stream);
 static int cbjack_stream_stop(cubeb_stream * stream);
 static int cbjack_stream_get_position(cubeb_stream * stream, uint64_t * position);
@@ -143,7 +160,15 @@ static struct cubeb_ops const cbjack_ops = {
   .stream_get_current_device = cbjack_stream_get_current_device,
   .stream_device_destroy = cbjack_stream_device_destroy,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = cbjack_stream_dump_flight_recorder,
+  .stream_get_stats = cbjack_stream_get_stats,
+  .stream_register_glitch_callback = cbjack_stream_register_glitch_callback,
+  .stream_register_load_callback = cbjack_stream_register_load_callback,
+  .stream_get_callback_histograms = cbjack_stream_get_callback_histograms,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
 
 struct cubeb_stream {
@@ -164,6 +189,8 @@ struct cubeb_stream {
   cubeb_stream_params out_params;
 
   cubeb_resampler * resampler;
+  /**< Set to true iff the stream is given the buffers of the ports */
+  bool planar;
 
   uint64_t position;
   bool pause;
@@ -173,6 +200,14 @@ struct cubeb_stream {
   jack_port_t * output_ports[MAX_CHANNELS];
   jack_port_t * input_ports[MAX_CHANNELS];
   float volume;
+  /**< Last events of the stream, logged when a stream that errored is destroyed */
+  cubeb_flight_recorder * recorder;
+  /**< Set to true when the stream errored, protected by the stream mutex */
+  bool recorder_dump_pending;
+  /**< Counters for cubeb_stream_get_stats */
+  cubeb_stream_stats_counters * stats;
+  /**< Glitch notifications for cubeb_stream_register_glitch_callback */
+  cubeb_glitch_notifier * glitches;
 };
 
 struct cubeb {
@@ -355,6 +390,8 @@ cbjack_graph_order_callback(void * arg)
 static int
 cbjack_process(jack_nframes_t nframes, void * arg)
 {
+  CUBEB_TRACE_SCOPE("cbjack_process");
+  CUBEB_RT_SCOPE();
   cubeb * ctx = (cubeb *)arg;
   unsigned int t_jack_xruns = ctx->jack_xruns;
   int i;
@@ -375,6 +412,27 @@ cbjack_process(jack_nframes_t nframes, void * arg)
     if (!stm->ports_ready)
       continue;
 
+    if (t_jack_xruns) {
+      cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN,
+                                   t_jack_xruns * ctx->fragment_size, 0);
+      uint64_t frames_lost = t_jack_xruns * ctx->fragment_size * stm->ratio;
+      if (stm->devs & OUT_ONLY) {
+        cubeb_stream_stats_underrun(stm->stats, t_jack_xruns);
+        cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_UNDERRUN,
+                            CUBEB_DEVICE_TYPE_OUTPUT, frames_lost);
+        CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT,
+                     frames_lost);
+      }
+      if (stm->devs & IN_ONLY) {
+        cubeb_stream_stats_overrun(stm->stats, t_jack_xruns);
+        cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_OVERRUN,
+                            CUBEB_DEVICE_TYPE_INPUT, frames_lost);
+        CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT,
+                     frames_lost);
+      }
+    }
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_AVAIL, nframes, 0);
+
     if (stm->devs & OUT_ONLY) {
       // get jack output buffers
       for (i = 0; i < (int)stm->out_params.channels; i++)
@@ -413,7 +471,12 @@ cbjack_process(jack_nframes_t nframes, void * arg)
         float *in_float = stm->context->in_resampled_interleaved_buffer_float;
 
         // unpaused, play audio
-        if (stm->devs == DUPLEX) {
+        if (stm->planar) {
+          cbjack_refill_planar(stm,
+                               (stm->devs & IN_ONLY) ? bufs_in : nullptr,
+                               (stm->devs & OUT_ONLY) ? bufs_out : nullptr,
+                               nframes);
+        } else if (stm->devs == DUPLEX) {
           if (stm->out_params.format == CUBEB_SAMPLE_S16NE) {
             cbjack_interleave_capture(stm, bufs_in, nframes, true);
             cbjack_deinterleave_playback_refill_s16ne(stm, &in_s16ne, bufs_out, nframes);
@@ -477,11 +540,16 @@ cbjack_deinterleave_playback_refill_float(cubeb_stream * stream, float ** in, fl
   long done_frames = 0;
   long input_frames_count = (in != NULL) ? nframes : 0;
 
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START,
+                               bufs_out ? needed_frames : input_frames_count, 0);
+  uint64_t start = cubeb_stream_stats_callback_start(stream->stats);
   done_frames = cubeb_resampler_fill(stream->resampler,
                                      inptr,
                                      &input_frames_count,
                                      (bufs_out != NULL) ? stream->context->out_resampled_interleaved_buffer_float : NULL,
                                      needed_frames);
+  cubeb_stream_stats_callback_end(stream->stats, start, nframes, done_frames);
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, done_frames, 0);
 
   out_interleaved_buffer = stream->context->out_resampled_interleaved_buffer_float;
 
@@ -509,6 +577,7 @@ cbjack_deinterleave_playback_refill_float(cubeb_stream * stream, float ** in, fl
 
   if (done_frames >= 0 && done_frames < needed_frames) {
     // set drained
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_DRAINED);
     stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_DRAINED);
     // stop stream
     cbjack_stream_stop(stream);
@@ -519,6 +588,10 @@ cbjack_deinterleave_playback_refill_float(cubeb_stream * stream, float ** in, fl
   }
   if (done_frames < 0 || done_frames > needed_frames) {
     // stream error
+    cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+    // dumped when the stream is destroyed, not on the real-time thread
+    stream->recorder_dump_pending = true;
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_ERROR);
     stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_ERROR);
   }
 }
@@ -535,11 +608,16 @@ cbjack_deinterleave_playback_refill_s16ne(cubeb_stream * stream, short ** in, fl
   long done_frames = 0;
   long input_frames_count = (in != NULL) ? nframes : 0;
 
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START,
+                               bufs_out ? needed_frames : input_frames_count, 0);
+  uint64_t start = cubeb_stream_stats_callback_start(stream->stats);
   done_frames = cubeb_resampler_fill(stream->resampler,
                                      inptr,
                                      &input_frames_count,
                                      (bufs_out != NULL) ? stream->context->out_resampled_interleaved_buffer_s16ne : NULL,
                                      needed_frames);
+  cubeb_stream_stats_callback_end(stream->stats, start, nframes, done_frames);
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, done_frames, 0);
 
   s16ne_to_float(stream->context->out_resampled_interleaved_buffer_float, stream->context->out_resampled_interleaved_buffer_s16ne, done_frames * stream->out_params.channels);
 
@@ -569,6 +647,78 @@ cbjack_deinterleave_playback_refill_s16ne(cubeb_stream * stream, short ** in, fl
 
   if (done_frames >= 0 && done_frames < needed_frames) {
     // set drained
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_DRAINED);
+    stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_DRAINED);
+    // stop stream
+    cbjack_stream_stop(stream);
+  }
+  if (done_frames > 0 && done_frames <= needed_frames) {
+    // advance stream position
+    stream->position += done_frames * stream->ratio;
+  }
+  if (done_frames < 0 || done_frames > needed_frames) {
+    // stream error
+    cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+    // dumped when the stream is destroyed, not on the real-time thread
+    stream->recorder_dump_pending = true;
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_ERROR);
+    stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_ERROR);
+  }
+}
+
+static void
+cbjack_refill_planar(cubeb_stream * stream, float ** bufs_in, float ** bufs_out, jack_nframes_t nframes)
+{
+  float * in_scaled[stream->in_params.channels];
+  float ** in = bufs_in;
+
+  if (bufs_in && stream->volume != 1.0f) {
+    // the buffers of the input ports can't be modified, scale a copy
+    float * in_buffer = stream->context->in_float_interleaved_buffer;
+    for (unsigned int c = 0; c < stream->in_params.channels; c++) {
+      in_scaled[c] = in_buffer + c * nframes;
+      for (long f = 0; f < nframes; f++) {
+        in_scaled[c][f] = bufs_in[c][f] * stream->volume;
+      }
+    }
+    in = in_scaled;
+  }
+
+  long needed_frames = (bufs_out != NULL) ? nframes : 0;
+  long done_frames = 0;
+  long input_frames_count = (bufs_in != NULL) ? nframes : 0;
+
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START,
+                               bufs_out ? needed_frames : input_frames_count, 0);
+  uint64_t start = cubeb_stream_stats_callback_start(stream->stats);
+  // the data callback renders in the output ports
+  done_frames = cubeb_resampler_fill_planar(stream->resampler,
+                                            (void * const *)in,
+                                            &input_frames_count,
+                                            (void * const *)bufs_out,
+                                            needed_frames);
+  cubeb_stream_stats_callback_end(stream->stats, start, nframes, done_frames);
+  cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, done_frames, 0);
+
+  if (bufs_out) {
+    long rendered = std::max(0l, std::min(done_frames, needed_frames));
+    for (unsigned int c = 0; c < stream->out_params.channels; c++) {
+      float* buffer = bufs_out[c];
+      if (stream->volume != 1.0f) {
+        for (long f = 0; f < rendered; f++) {
+          buffer[f] *= stream->volume;
+        }
+      }
+      // draining, or stopping
+      for (long f = rendered; f < needed_frames; f++) {
+        buffer[f] = 0.f;
+      }
+    }
+  }
+
+  if (done_frames >= 0 && done_frames < needed_frames) {
+    // set drained
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_DRAINED);
     stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_DRAINED);
     // stop stream
     cbjack_stream_stop(stream);
@@ -579,6 +729,10 @@ cbjack_deinterleave_playback_refill_s16ne(cubeb_stream * stream, short ** in, fl
   }
   if (done_frames < 0 || done_frames > needed_frames) {
     // stream error
+    cubeb_flight_recorder_record(stream->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+    // dumped when the stream is destroyed, not on the real-time thread
+    stream->recorder_dump_pending = true;
+    CUBEB_PROBE2(state_change, stream, CUBEB_STATE_ERROR);
     stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_ERROR);
   }
 }
@@ -842,10 +996,20 @@ cbjack_stream_init(cubeb * context, cubeb_stream ** stream, char const * stream_
 
   stm->ratio = (float)stream_actual_rate / (float)jack_rate;
 
+  // Planar float streams that aren't resampled are given the buffers of the
+  // ports, other planar streams are converted by the resampler.
+  cubeb_sample_format format = (stm->devs & OUT_ONLY) ? stm->out_params.format
+                                                      : stm->in_params.format;
+  stm->planar = format == CUBEB_SAMPLE_FLOAT32NE &&
+                stream_actual_rate == jack_rate &&
+                (!(stm->devs & IN_ONLY) || (stm->in_params.prefs & CUBEB_STREAM_PREF_PLANAR)) &&
+                (!(stm->devs & OUT_ONLY) || (stm->out_params.prefs & CUBEB_STREAM_PREF_PLANAR));
+
   stm->data_callback = data_callback;
   stm->state_callback = state_callback;
   stm->position = 0;
   stm->volume = 1.0f;
+  stm->recorder_dump_pending = false;
   context->jack_buffer_size = api_jack_get_buffer_size(context->jack_client);
   context->fragment_size = context->jack_buffer_size;
 
@@ -928,6 +1092,12 @@ cbjack_stream_init(cubeb * context, cubeb_stream ** stream, char const * stream_
 
   *stream = stm;
 
+  stm->recorder = cubeb_flight_recorder_create(stm->stream_name);
+  stm->glitches = cubeb_glitch_notifier_create();
+  /* The data callback is timed with the resampler, that is asked for frames
+     at the rate of JACK. */
+  stm->stats = cubeb_stream_stats_counters_create(context->jack_sample_rate,
+                                                  stm->glitches);
   stm->ports_ready = true;
   stm->pause = true;
   pthread_mutex_unlock(&stm->mutex);
@@ -938,6 +1108,11 @@ cbjack_stream_init(cubeb * context, cubeb_stream ** stream, char const * stream_
 static void
 cbjack_stream_destroy(cubeb_stream * stream)
 {
+  /* This waits for the glitch callback to return, do it before locking, in
+     case it calls back into cubeb. */
+  cubeb_glitch_notifier_set_callback(stream->glitches, NULL, NULL, NULL);
+  cubeb_glitch_notifier_set_load_callback(stream->glitches, NULL, NULL, 0, NULL);
+
   pthread_mutex_lock(&stream->mutex);
   stream->ports_ready = false;
 
@@ -963,14 +1138,67 @@ cbjack_stream_destroy(cubeb_stream * stream)
     cubeb_resampler_destroy(stream->resampler);
     stream->resampler = NULL;
   }
+  if (stream->recorder_dump_pending) {
+    cubeb_flight_recorder_dump(stream->recorder);
+    stream->recorder_dump_pending = false;
+  }
+  cubeb_flight_recorder_destroy(stream->recorder);
+  stream->recorder = NULL;
+  cubeb_stream_stats_counters_destroy(stream->stats);
+  stream->stats = NULL;
+  cubeb_glitch_notifier_destroy(stream->glitches);
+  stream->glitches = NULL;
   stream->in_use = false;
   pthread_mutex_unlock(&stream->mutex);
 }
 
+static int
+cbjack_stream_dump_flight_recorder(cubeb_stream * stream)
+{
+  cubeb_flight_recorder_dump(stream->recorder);
+  return CUBEB_OK;
+}
+
+static int
+cbjack_stream_get_stats(cubeb_stream * stream, cubeb_stream_stats * stats)
+{
+  cubeb_stream_stats_counters_get(&stream->stats, 1, stats);
+  return CUBEB_OK;
+}
+
+static int
+cbjack_stream_get_callback_histograms(cubeb_stream * stream,
+                                      cubeb_callback_histograms * histograms)
+{
+  cubeb_stream_stats_counters_get_histograms(&stream->stats, 1, histograms);
+  return CUBEB_OK;
+}
+
+static int
+cbjack_stream_register_glitch_callback(cubeb_stream * stream,
+                                       cubeb_glitch_callback glitch_callback)
+{
+  cubeb_glitch_notifier_set_callback(stream->glitches, stream, glitch_callback,
+                                     stream->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+cbjack_stream_register_load_callback(cubeb_stream * stream, float threshold,
+                                     cubeb_load_callback load_callback)
+{
+  cubeb_glitch_notifier_set_load_callback(stream->glitches, stream,
+                                          load_callback, threshold,
+                                          stream->user_ptr);
+  return CUBEB_OK;
+}
+
 static int
 cbjack_stream_start(cubeb_stream * stream)
 {
+  cubeb_stream_stats_started(stream->stats);
   stream->pause = false;
+  CUBEB_PROBE2(state_change, stream, CUBEB_STATE_STARTED);
   stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_STARTED);
   return CUBEB_OK;
 }
@@ -979,6 +1207,7 @@ static int
 cbjack_stream_stop(cubeb_stream * stream)
 {
   stream->pause = true;
+  CUBEB_PROBE2(state_change, stream, CUBEB_STATE_STOPPED);
   stream->state_callback(stream, stream->user_ptr, CUBEB_STATE_STOPPED);
   return CUBEB_OK;
 }
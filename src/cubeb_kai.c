@@ -13,6 +13,7 @@
 
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_planar.h"
 
 /* We don't support more than 2 channels in KAI */
 #define MAX_CHANNELS 2
@@ -45,6 +46,7 @@ struct cubeb_stream {
   float soft_volume;
   _fmutex mutex;
   float float_buffer[FRAME_SIZE * MAX_CHANNELS];
+  cubeb_planar_adapter * planar;
 };
 
 static inline long
@@ -125,7 +127,8 @@ kai_callback(PVOID cbdata, PVOID buffer, ULONG len)
       ? stm->float_buffer : buffer;
 
   wanted_frames = bytes_to_frames(len, stm->params);
-  frames = stm->data_callback(stm, stm->user_ptr, NULL, p, wanted_frames);
+  frames = cubeb_planar_data_callback(stm->planar, stm->data_callback, stm,
+                                      stm->user_ptr, NULL, p, wanted_frames);
 
   _fmutex_request(&stm->mutex, 0);
   stm->total_frames += frames;
@@ -197,7 +200,14 @@ kai_stream_init(cubeb * context, cubeb_stream ** stream,
   stm->user_ptr = user_ptr;
   stm->soft_volume = -1.0f;
 
+  if (cubeb_planar_adapter_create(NULL, output_stream_params, FRAME_SIZE,
+                                  &stm->planar) != CUBEB_OK) {
+    free(stm);
+    return CUBEB_ERROR;
+  }
+
   if (_fmutex_create(&stm->mutex, 0)) {
+    cubeb_planar_adapter_destroy(stm->planar);
     free(stm);
     return CUBEB_ERROR;
   }
@@ -216,6 +226,7 @@ kai_stream_init(cubeb * context, cubeb_stream ** stream,
 
   if (kaiOpen(&wanted_spec, &stm->spec, &stm->hkai)) {
     _fmutex_close(&stm->mutex);
+    cubeb_planar_adapter_destroy(stm->planar);
     free(stm);
     return CUBEB_ERROR;
   }
@@ -230,6 +241,7 @@ kai_stream_destroy(cubeb_stream * stm)
 {
   kaiClose(stm->hkai);
   _fmutex_close(&stm->mutex);
+  cubeb_planar_adapter_destroy(stm->planar);
   free(stm);
 }
 
@@ -366,5 +378,13 @@ static struct cubeb_ops const kai_ops = {
   /*.stream_get_current_device =*/ NULL,
   /*.stream_device_destroy =*/ NULL,
   /*.stream_register_device_changed_callback=*/ NULL,
-  /*.register_device_collection_changed=*/ NULL
+  /*.register_device_collection_changed=*/ NULL,
+  /*.stream_dump_flight_recorder=*/ NULL,
+  /*.stream_get_stats=*/ NULL,
+  /*.stream_register_glitch_callback=*/ NULL,
+  /*.stream_register_load_callback=*/ NULL,
+  /*.stream_get_callback_histograms=*/ NULL,
+  /*.set_clock_mode=*/ NULL,
+  /*.advance_clock=*/ NULL,
+  /*.set_offline_params=*/ NULL
 };
@@ -7,138 +7,555 @@
 #define NOMINMAX
 
 #include "cubeb_log.h"
-#include "cubeb_ringbuffer.h"
+#include "cubeb_mpsc_consumer.h"
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <time.h>
-#endif
+#include <cstring>
+#include <mutex>
 
 cubeb_log_level g_cubeb_log_level;
+cubeb_log_level g_cubeb_log_levels[CUBEB_LOG_CATEGORY_COUNT];
 cubeb_log_callback g_cubeb_log_callback;
 
 /** The maximum size of a log message, after having been formatted. */
 const size_t CUBEB_LOG_MESSAGE_MAX_SIZE = 256;
 /** The maximum number of log messages that can be queued before dropping
- * messages. */
-const size_t CUBEB_LOG_MESSAGE_QUEUE_DEPTH = 40;
-/** Number of milliseconds to wait before dequeuing log messages. */
-#define CUBEB_LOG_BATCH_PRINT_INTERVAL_MS 10
+ * messages. This is set by the build system. */
+#ifndef CUBEB_LOG_MESSAGE_QUEUE_DEPTH
+#define CUBEB_LOG_MESSAGE_QUEUE_DEPTH 256
+#endif
+/** Number of log messages dequeued at once by the logger thread. */
+const int CUBEB_LOG_BATCH_SIZE = 16;
+/** The maximum number of arguments of an asynchronous log message, including
+ * `*` widths and precisions. */
+const int CUBEB_LOG_RECORD_MAX_ARGS = 10;
+/** Room for the contents of the strings passed to an asynchronous log
+ * message. Longer strings are truncated. */
+const size_t CUBEB_LOG_RECORD_STRINGS_SIZE = 64;
+/** Offsets of the strings that couldn't be copied. */
+const long long NULL_STRING = -1;
+const long long TRUNCATED_STRING = -2;
+
+/** How an argument is read from a `va_list`, and passed back to `snprintf`. */
+enum cubeb_log_arg_type : uint8_t {
+  CUBEB_LOG_ARG_INT,
+  CUBEB_LOG_ARG_LONG,
+  CUBEB_LOG_ARG_LONG_LONG,
+  CUBEB_LOG_ARG_INTMAX,
+  CUBEB_LOG_ARG_SIZE,
+  CUBEB_LOG_ARG_PTRDIFF,
+  CUBEB_LOG_ARG_DOUBLE,
+  CUBEB_LOG_ARG_POINTER,
+  CUBEB_LOG_ARG_STRING,
+  /** A conversion we don't know how to defer, `%n`, `%ls`, `%Lf`... */
+  CUBEB_LOG_ARG_UNSUPPORTED,
+};
+
+/** A conversion specification in a `printf` format string. */
+struct cubeb_log_conversion
+{
+  /** Pointer to the `%`. */
+  char const * start;
+  /** Number of characters, from the `%` to the conversion specifier. */
+  size_t length;
+  /** Whether the width (resp. the precision) is `*`, and is an argument. */
+  bool star_width;
+  bool star_precision;
+  /** Type of the argument that is converted, if any. */
+  cubeb_log_arg_type type;
+  /** `false` for `%%`, that doesn't convert an argument. */
+  bool has_arg;
+};
+
+/** Find the next conversion specification in `fmt`.
+ * @return `false` if there is none. */
+static bool
+cubeb_log_next_conversion(char const * fmt, cubeb_log_conversion * conv)
+{
+  char const * p = strchr(fmt, '%');
+  if (!p) {
+    return false;
+  }
+  conv->start = p++;
+  conv->star_width = false;
+  conv->star_precision = false;
+  conv->has_arg = true;
+
+  while (*p && strchr("-+ #0'", *p)) {
+    p++;
+  }
+  if (*p == '*') {
+    conv->star_width = true;
+    p++;
+  }
+  while (*p >= '0' && *p <= '9') {
+    p++;
+  }
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      conv->star_precision = true;
+      p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+      p++;
+    }
+  }
+
+  cubeb_log_arg_type integer = CUBEB_LOG_ARG_INT;
+  bool is_long = false;
+  bool unsupported = false;
+  if (p[0] == 'h') {
+    p += p[1] == 'h' ? 2 : 1;
+  } else if (p[0] == 'l' && p[1] == 'l') {
+    integer = CUBEB_LOG_ARG_LONG_LONG;
+    p += 2;
+  } else if (p[0] == 'l') {
+    integer = CUBEB_LOG_ARG_LONG;
+    is_long = true;
+    p++;
+  } else if (p[0] == 'q') {
+    integer = CUBEB_LOG_ARG_LONG_LONG;
+    p++;
+  } else if (p[0] == 'j') {
+    integer = CUBEB_LOG_ARG_INTMAX;
+    p++;
+  } else if (p[0] == 'z') {
+    integer = CUBEB_LOG_ARG_SIZE;
+    p++;
+  } else if (p[0] == 't') {
+    integer = CUBEB_LOG_ARG_PTRDIFF;
+    p++;
+  } else if (p[0] == 'L') {
+    unsupported = true;
+    p++;
+  } else if (p[0] == 'I') {
+    /* Microsoft extensions: `I` is the size of a pointer, `I32` and `I64`. */
+    if (p[1] == '6' && p[2] == '4') {
+      integer = CUBEB_LOG_ARG_LONG_LONG;
+      p += 3;
+    } else if (p[1] == '3' && p[2] == '2') {
+      p += 3;
+    } else {
+      integer = CUBEB_LOG_ARG_SIZE;
+      p++;
+    }
+  }
+
+  switch (*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+      conv->type = integer;
+      break;
+    case 'c':
+      conv->type = is_long ? CUBEB_LOG_ARG_UNSUPPORTED : CUBEB_LOG_ARG_INT;
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a':
+    case 'A':
+      conv->type = CUBEB_LOG_ARG_DOUBLE;
+      break;
+    case 'p':
+      conv->type = CUBEB_LOG_ARG_POINTER;
+      break;
+    case 's':
+      conv->type = is_long ? CUBEB_LOG_ARG_UNSUPPORTED : CUBEB_LOG_ARG_STRING;
+      break;
+    case '%':
+      conv->has_arg = false;
+      conv->type = CUBEB_LOG_ARG_INT;
+      break;
+    default:
+      conv->type = CUBEB_LOG_ARG_UNSUPPORTED;
+      break;
+  }
+  if (unsupported) {
+    conv->type = CUBEB_LOG_ARG_UNSUPPORTED;
+  }
+  if (*p) {
+    p++;
+  }
+  conv->length = p - conv->start;
+  return true;
+}
 
 /**
-  * This wraps an inline buffer, that represents a log message, that must be
-  * null-terminated.
-  * This class should not use system calls or other potentially blocking code.
+  * A log message whose formatting has been deferred: the format string, the
+  * time at which it was logged, and its arguments, each with its type. The
+  * contents of the strings are copied, since they might not outlive the call.
+  * This is a fixed size record, that can be captured on a real-time thread
+  * without formatting, allocating or making system calls. It is formatted
+  * later, on the logger thread.
   */
 class cubeb_log_message
 {
 public:
   cubeb_log_message()
+    : fmt(nullptr)
+    , timestamp_ns(0)
+    , arg_count(0)
+    , strings_length(0)
+    , conversion_count(0)
   {
-    *storage = '\0';
   }
-  cubeb_log_message(char const str[CUBEB_LOG_MESSAGE_MAX_SIZE])
+  /** Capture a message. `fmt` must be a string literal, and `ap` its
+   * arguments. */
+  cubeb_log_message(char const * fmt, uint64_t timestamp_ns, va_list * ap)
+    : fmt(fmt)
+    , timestamp_ns(timestamp_ns)
+    , arg_count(0)
+    , strings_length(0)
+    , conversion_count(0)
   {
-    size_t length = strlen(str);
-    /* paranoia against malformed message */
-    assert(length < CUBEB_LOG_MESSAGE_MAX_SIZE);
-    if (length > CUBEB_LOG_MESSAGE_MAX_SIZE - 1) {
-      return;
+    cubeb_log_conversion conv;
+    char const * p = fmt;
+    while (cubeb_log_next_conversion(p, &conv)) {
+      p = conv.start + conv.length;
+      if (!conv.has_arg) {
+        continue;
+      }
+      if (conv.type == CUBEB_LOG_ARG_UNSUPPORTED ||
+          arg_count + conv.star_width + conv.star_precision + 1 >
+            CUBEB_LOG_RECORD_MAX_ARGS) {
+        /* The rest of the format string will be printed as is. */
+        return;
+      }
+      if (conv.star_width) {
+        capture_arg(CUBEB_LOG_ARG_INT, ap);
+      }
+      if (conv.star_precision) {
+        capture_arg(CUBEB_LOG_ARG_INT, ap);
+      }
+      capture_arg(conv.type, ap);
+      conversion_count++;
     }
-    PodCopy(storage, str, length);
-    storage[length] = '\0';
   }
-  char const * get() {
-    return storage;
+  /** Format the message into `out`, that has room for `size` characters. */
+  void format(char * out, size_t size) const
+  {
+    assert(fmt && size > 0);
+    size_t length = 0;
+    int arg = 0;
+    int conversion = 0;
+    cubeb_log_conversion conv;
+    char const * p = fmt;
+    *out = '\0';
+
+    while (length < size - 1 && cubeb_log_next_conversion(p, &conv)) {
+      append(out, size, &length, "%.*s", int(conv.start - p), p);
+      p = conv.start + conv.length;
+      if (!conv.has_arg) {
+        append(out, size, &length, "%%");
+        continue;
+      }
+      if (conversion++ == conversion_count) {
+        /* Not captured, print the rest verbatim. */
+        p = conv.start;
+        break;
+      }
+
+      /* Put the `*` values in the conversion specification itself. */
+      char spec[64];
+      size_t spec_length = 0;
+      for (size_t i = 0; i < conv.length && spec_length < sizeof(spec) - 16;
+           i++) {
+        char c = conv.start[i];
+        if (c != '*') {
+          spec[spec_length++] = c;
+          continue;
+        }
+        long long value = args[arg++].i;
+        if (value < 0 && spec_length && spec[spec_length - 1] == '.') {
+          /* A negative precision is as if it were omitted. */
+          spec_length--;
+          continue;
+        }
+        spec_length += snprintf(spec + spec_length, 16, "%lld", value);
+      }
+      spec[spec_length] = '\0';
+
+      const value & v = args[arg++];
+      switch (types[arg - 1]) {
+        case CUBEB_LOG_ARG_INT:
+          append(out, size, &length, spec, int(v.i));
+          break;
+        case CUBEB_LOG_ARG_LONG:
+          append(out, size, &length, spec, long(v.i));
+          break;
+        case CUBEB_LOG_ARG_LONG_LONG:
+          append(out, size, &length, spec, v.i);
+          break;
+        case CUBEB_LOG_ARG_INTMAX:
+          append(out, size, &length, spec, intmax_t(v.i));
+          break;
+        case CUBEB_LOG_ARG_SIZE:
+          append(out, size, &length, spec, size_t(v.i));
+          break;
+        case CUBEB_LOG_ARG_PTRDIFF:
+          append(out, size, &length, spec, ptrdiff_t(v.i));
+          break;
+        case CUBEB_LOG_ARG_DOUBLE:
+          append(out, size, &length, spec, v.d);
+          break;
+        case CUBEB_LOG_ARG_POINTER:
+          append(out, size, &length, spec, v.p);
+          break;
+        case CUBEB_LOG_ARG_STRING:
+          append(out, size, &length, spec,
+                 v.i == NULL_STRING ? "(null)" :
+                 v.i == TRUNCATED_STRING ? "" : strings + v.i);
+          break;
+        case CUBEB_LOG_ARG_UNSUPPORTED:
+          assert(false);
+          break;
+      }
+    }
+    append(out, size, &length, "%s", p);
+  }
+  /** Time at which the message was logged, in nanoseconds. */
+  uint64_t timestamp() const
+  {
+    return timestamp_ns;
   }
 private:
-  char storage[CUBEB_LOG_MESSAGE_MAX_SIZE];
+  union value {
+    long long i;
+    double d;
+    void const * p;
+  };
+  /** Read an argument of type `type` from `ap`, and store it. */
+  void capture_arg(cubeb_log_arg_type type, va_list * ap)
+  {
+    value & v = this->args[arg_count];
+    types[arg_count++] = type;
+    switch (type) {
+      case CUBEB_LOG_ARG_INT:
+        v.i = va_arg(*ap, int);
+        break;
+      case CUBEB_LOG_ARG_LONG:
+        v.i = va_arg(*ap, long);
+        break;
+      case CUBEB_LOG_ARG_LONG_LONG:
+        v.i = va_arg(*ap, long long);
+        break;
+      case CUBEB_LOG_ARG_INTMAX:
+        v.i = va_arg(*ap, intmax_t);
+        break;
+      case CUBEB_LOG_ARG_SIZE:
+        v.i = va_arg(*ap, size_t);
+        break;
+      case CUBEB_LOG_ARG_PTRDIFF:
+        v.i = va_arg(*ap, ptrdiff_t);
+        break;
+      case CUBEB_LOG_ARG_DOUBLE:
+        v.d = va_arg(*ap, double);
+        break;
+      case CUBEB_LOG_ARG_POINTER:
+        v.p = va_arg(*ap, void *);
+        break;
+      case CUBEB_LOG_ARG_STRING: {
+        char const * str = va_arg(*ap, char const *);
+        size_t room = CUBEB_LOG_RECORD_STRINGS_SIZE - strings_length;
+        if (!str || !room) {
+          v.i = str ? TRUNCATED_STRING : NULL_STRING;
+          break;
+        }
+        /* Copy as much as fits, the last string might be truncated. */
+        v.i = strings_length;
+        size_t length = 0;
+        while (length + 1 < room && str[length]) {
+          strings[strings_length + length] = str[length];
+          length++;
+        }
+        strings[strings_length + length] = '\0';
+        strings_length += length + 1;
+        break;
+      }
+      case CUBEB_LOG_ARG_UNSUPPORTED:
+        assert(false);
+        break;
+    }
+  }
+  /** `snprintf` at the end of `out`, up to `size`, and update `length`. */
+  static void append(char * out, size_t size, size_t * length,
+                     char const * fmt, ...)
+  {
+    if (*length >= size - 1) {
+      return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int rv = vsnprintf(out + *length, size - *length, fmt, args);
+    va_end(args);
+    if (rv > 0) {
+      *length = std::min(size - 1, *length + rv);
+    }
+  }
+  char const * fmt;
+  uint64_t timestamp_ns;
+  value args[CUBEB_LOG_RECORD_MAX_ARGS];
+  cubeb_log_arg_type types[CUBEB_LOG_RECORD_MAX_ARGS];
+  uint8_t arg_count;
+  uint8_t strings_length;
+  /** Number of conversions whose arguments have been captured, the format
+   * string is printed verbatim after that. */
+  uint8_t conversion_count;
+  char strings[CUBEB_LOG_RECORD_STRINGS_SIZE];
 };
 
 /** Lock-free asynchronous logger, made so that logging from a
- *  real-time audio callback does not block the audio thread. */
+ *  real-time audio callback does not block the audio thread. Any number of
+ *  threads can log concurrently.
+ *
+ *  Messages are printed by a `cubeb_mpsc_consumer` thread, that runs while
+ *  there are cubeb contexts alive and verbose messages can be logged. Logging
+ *  only makes a system call when the logger thread is idle. When it's
+ *  stopped, the queued messages are printed and the thread is joined. */
 class cubeb_async_logger
 {
 public:
-  /* This is thread-safe since C++11 */
+  /* This is thread-safe since C++11. This is never destroyed, so that a
+   * message can be logged at any time, even during static destruction. */
   static cubeb_async_logger & get() {
-    static cubeb_async_logger instance;
-    return instance;
+    static cubeb_async_logger * instance = new cubeb_async_logger;
+    return *instance;
   }
-  void push(char const str[CUBEB_LOG_MESSAGE_MAX_SIZE])
+  void push(cubeb_log_message const & msg)
   {
-    cubeb_log_message msg(str);
-    msg_queue.enqueue(msg);
+    consumer.push(msg);
   }
-  void run()
+  /** Current time, in nanoseconds, for the timestamp of the messages. This
+   * doesn't make a system call on common platforms. */
+  static uint64_t now()
   {
-    std::thread([this]() {
-      while (true) {
-        cubeb_log_message msg;
-        while (msg_queue.dequeue(&msg, 1)) {
-          LOGV("%s", msg.get());
-        }
-#ifdef _WIN32
-        Sleep(CUBEB_LOG_BATCH_PRINT_INTERVAL_MS);
-#else
-        timespec sleep_duration = sleep_for;
-        timespec remainder;
-        do {
-          if (nanosleep(&sleep_duration, &remainder) == 0 ||
-              errno != EINTR) {
-            break;
-          }
-          sleep_duration = remainder;
-        } while (remainder.tv_sec || remainder.tv_nsec);
-#endif
-      }
-    }).detach();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  /** Start the logger thread. Called with `cubeb_async_log_lifecycle::mutex`
+   * held, when the thread isn't running. */
+  void start()
+  {
+    consumer.start();
+  }
+  /** Print the queued messages, and join the logger thread. Called with
+   * `cubeb_async_log_lifecycle::mutex` held, when the thread is running. */
+  void stop()
+  {
+    consumer.stop();
   }
-  // Tell the underlying queue the producer thread has changed, so it does not
-  // assert in debug. This should be called with the thread stopped.
-  void reset_producer_thread()
+  /** Number of messages dropped so far, because the queue was full. */
+  uint64_t dropped_count() const
   {
-    msg_queue.reset_thread_ids();
+    return consumer.dropped_count();
   }
 private:
-#ifndef _WIN32
-  const struct timespec sleep_for = {
-    CUBEB_LOG_BATCH_PRINT_INTERVAL_MS/1000,
-    (CUBEB_LOG_BATCH_PRINT_INTERVAL_MS%1000)*1000*1000
-  };
-#endif
+  typedef cubeb_mpsc_consumer<cubeb_log_message, cubeb_async_logger,
+                              CUBEB_LOG_BATCH_SIZE> log_consumer;
+  friend log_consumer;
+
   cubeb_async_logger()
-    : msg_queue(CUBEB_LOG_MESSAGE_QUEUE_DEPTH)
+    : start_time(now())
+    , consumer(CUBEB_LOG_MESSAGE_QUEUE_DEPTH, "cubeb-log", *this)
+  {
+  }
+  /** Called on the logger thread, shared by all the contexts. */
+  void consume(cubeb_log_message const & msg)
+  {
+    msg.format(str, sizeof(str));
+    /* The message might have been logged a while ago, print when, in seconds
+     * since the logger started. Its category was checked when it was pushed,
+     * so don't filter it again on BACKEND here. */
+    cubeb_log_callback callback = g_cubeb_log_callback;
+    if (callback) {
+      callback("%s:%d: [%.6f] %s\n", __FILENAME__, __LINE__,
+               (msg.timestamp() - start_time) / 1e9, str);
+    }
+  }
+  void dropped(uint64_t count)
   {
-    run();
+    LOGV("%llu asynchronous log messages dropped, the queue is full",
+         (unsigned long long)count);
   }
+  /** Time at which the logger started, in nanoseconds. */
+  const uint64_t start_time;
+  /** Formatted message, only used by the logger thread. */
+  char str[CUBEB_LOG_MESSAGE_MAX_SIZE];
   /** This is quite a big data structure, but is only instantiated if the
    * asynchronous logger is used.*/
-  lock_free_queue<cubeb_log_message> msg_queue;
+  log_consumer consumer;
+};
+
+/** Decides when the logger thread runs. This is separate from
+ *  `cubeb_async_logger`, so that the logger isn't instantiated by programs
+ *  that don't log verbosely, e.g. on Android. */
+struct cubeb_async_log_lifecycle
+{
+  /** Protects the fields below. */
+  static std::mutex mutex;
+  /** Number of contexts alive. */
+  static int context_count;
+  /** Whether a log callback is set, with a verbose level. */
+  static bool enabled;
+  static bool running;
+
+  /** Start or stop the logger thread. Called with `mutex` held. */
+  static void update()
+  {
+    bool run = context_count > 0 && enabled;
+    if (run == running) {
+      return;
+    }
+    if (run) {
+      cubeb_async_logger::get().start();
+    } else {
+      cubeb_async_logger::get().stop();
+    }
+    running = run;
+  }
 };
 
+std::mutex cubeb_async_log_lifecycle::mutex;
+int cubeb_async_log_lifecycle::context_count = 0;
+bool cubeb_async_log_lifecycle::enabled = false;
+bool cubeb_async_log_lifecycle::running = false;
+
+void cubeb_async_log_acquire()
+{
+  std::lock_guard<std::mutex> lock(cubeb_async_log_lifecycle::mutex);
+  cubeb_async_log_lifecycle::context_count++;
+  cubeb_async_log_lifecycle::update();
+}
+
+void cubeb_async_log_release()
+{
+  std::lock_guard<std::mutex> lock(cubeb_async_log_lifecycle::mutex);
+  assert(cubeb_async_log_lifecycle::context_count > 0);
+  cubeb_async_log_lifecycle::context_count--;
+  cubeb_async_log_lifecycle::update();
+}
+
+void cubeb_async_log_set_enabled(int enabled)
+{
+  std::lock_guard<std::mutex> lock(cubeb_async_log_lifecycle::mutex);
+  cubeb_async_log_lifecycle::enabled = enabled;
+  cubeb_async_log_lifecycle::update();
+}
+
+uint64_t cubeb_async_log_dropped_count()
+{
+  return cubeb_async_logger::get().dropped_count();
+}
 
 void cubeb_async_log(char const * fmt, ...)
 {
   if (!g_cubeb_log_callback) {
     return;
   }
-  // This is going to copy a 256 bytes array around, which is fine.
-  // We don't want to allocate memory here, because this is made to
-  // be called from a real-time callback.
+  // This only captures the arguments, the message is formatted on the logger
+  // thread. We don't want to format, allocate memory or make system calls
+  // here, because this is made to be called from a real-time callback.
   va_list args;
   va_start(args, fmt);
-  char msg[CUBEB_LOG_MESSAGE_MAX_SIZE];
-  vsnprintf(msg, CUBEB_LOG_MESSAGE_MAX_SIZE, fmt, args);
-  cubeb_async_logger::get().push(msg);
+  cubeb_log_message msg(fmt, cubeb_async_logger::now(), &args);
   va_end(args);
-}
-
-void cubeb_async_log_reset_threads()
-{
-  if (!g_cubeb_log_callback) {
-    return;
-  }
-  cubeb_async_logger::get().reset_producer_thread();
+  cubeb_async_logger::get().push(msg);
 }
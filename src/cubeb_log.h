@@ -27,29 +27,100 @@ extern "C" {
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+#define CUBEB_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define CUBEB_UNLIKELY(x) (x)
+#endif
+
+/** Highest level of all the categories. */
 extern cubeb_log_level g_cubeb_log_level;
+/** Level of each category. This is always CUBEB_LOG_DISABLED when there is no
+    callback, so checking whether to log is a single comparison. */
+extern cubeb_log_level g_cubeb_log_levels[CUBEB_LOG_CATEGORY_COUNT];
 extern cubeb_log_callback g_cubeb_log_callback PRINTF_FORMAT(1, 2);
 void cubeb_async_log(const char * fmt, ...);
-void cubeb_async_log_reset_threads();
+/** Called when a context is created (resp. destroyed). The thread that prints
+    the asynchronous log messages runs while there are contexts alive and
+    asynchronous logging is enabled. It's joined after printing the queued
+    messages when either stops being true. */
+void cubeb_async_log_acquire(void);
+void cubeb_async_log_release(void);
+/** Called when the log callback or the levels change: asynchronous logging is
+    enabled when a callback is set with a verbose level. */
+void cubeb_async_log_set_enabled(int enabled);
+/** Number of asynchronous log messages dropped so far, because they were
+    logged faster than they could be printed. */
+uint64_t cubeb_async_log_dropped_count(void);
 
 #ifdef __cplusplus
 }
 #endif
 
-#define LOGV(msg, ...) LOG_INTERNAL(CUBEB_LOG_VERBOSE, msg, ##__VA_ARGS__)
-#define LOG(msg, ...) LOG_INTERNAL(CUBEB_LOG_NORMAL, msg, ##__VA_ARGS__)
+/* Log in the backend category. */
+#define LOGV(msg, ...) LOG_INTERNAL(BACKEND, CUBEB_LOG_VERBOSE, msg, ##__VA_ARGS__)
+#define LOG(msg, ...) LOG_INTERNAL(BACKEND, CUBEB_LOG_NORMAL, msg, ##__VA_ARGS__)
 
-#define LOG_INTERNAL(level, fmt, ...) do {                                              \
-    if (g_cubeb_log_callback && level <= g_cubeb_log_level) {                           \
-      g_cubeb_log_callback("%s:%d: " fmt "\n",  __FILENAME__, __LINE__, ##__VA_ARGS__); \
-    }                                                                                   \
+/* Log in a category, e.g. LOGV_CATEGORY(RESAMPLER, ...). */
+#define LOGV_CATEGORY(category, msg, ...) \
+  LOG_INTERNAL(category, CUBEB_LOG_VERBOSE, msg, ##__VA_ARGS__)
+#define LOG_CATEGORY(category, msg, ...) \
+  LOG_INTERNAL(category, CUBEB_LOG_NORMAL, msg, ##__VA_ARGS__)
+
+/* Verbose logging in code that runs for each audio buffer. This is compiled
+   out entirely when building with CUBEB_NO_HOT_PATH_VERBOSE_LOGGING. */
+#if defined(CUBEB_NO_HOT_PATH_VERBOSE_LOGGING)
+#define LOGV_HOT(category, msg, ...) do {                   \
+    if (0) {                                                \
+      LOGV_CATEGORY(category, msg, ##__VA_ARGS__);          \
+    }                                                       \
+  } while(0)
+#else
+#define LOGV_HOT(category, msg, ...) LOGV_CATEGORY(category, msg, ##__VA_ARGS__)
+#endif
+
+#define CUBEB_LOG_ENABLED(category, level) \
+  CUBEB_UNLIKELY((level) <= g_cubeb_log_levels[CUBEB_LOG_CATEGORY_##category])
+
+#define LOG_INTERNAL(category, level, fmt, ...) do {                                   \
+    if (CUBEB_LOG_ENABLED(category, level)) {                                          \
+      cubeb_log_callback log_callback = g_cubeb_log_callback;                          \
+      if (log_callback) {                                                              \
+        log_callback("%s:%d: " fmt "\n",  __FILENAME__, __LINE__, ##__VA_ARGS__);     \
+      }                                                                                \
+    }                                                                                  \
   } while(0)
 
 /* Asynchronous verbose logging, to log in real-time callbacks. */
 /* Should not be used on android due to the use of global/static variables. */
-#define ALOGV(fmt, ...)                   \
-do {                                      \
-  cubeb_async_log(fmt, ##__VA_ARGS__);    \
+/* Formatting is deferred to the logger thread: `fmt` must be a string literal,
+   and string arguments are truncated. */
+#define ALOGV_CATEGORY(category, fmt, ...)      \
+do {                                            \
+  if (CUBEB_LOG_ENABLED(category, CUBEB_LOG_VERBOSE)) { \
+    cubeb_async_log("" fmt, ##__VA_ARGS__);     \
+  }                                             \
 } while(0)
+#define ALOGV(fmt, ...) ALOGV_CATEGORY(BACKEND, fmt, ##__VA_ARGS__)
+
+/* ALOGV in code that runs for each audio buffer, compiled out like LOGV_HOT.
+   Expands to ALOGV at the point of use, so backends that redefine ALOGV get
+   their own version. */
+#if defined(CUBEB_NO_HOT_PATH_VERBOSE_LOGGING)
+#define ALOGV_HOT(fmt, ...) do {                \
+    if (0) {                                    \
+      ALOGV(fmt, ##__VA_ARGS__);                \
+    }                                           \
+  } while(0)
+#define ALOGV_HOT_CATEGORY(category, fmt, ...) do {         \
+    if (0) {                                                \
+      ALOGV_CATEGORY(category, fmt, ##__VA_ARGS__);         \
+    }                                                       \
+  } while(0)
+#else
+#define ALOGV_HOT(fmt, ...) ALOGV(fmt, ##__VA_ARGS__)
+#define ALOGV_HOT_CATEGORY(category, fmt, ...) \
+  ALOGV_CATEGORY(category, fmt, ##__VA_ARGS__)
+#endif
 
 #endif // CUBEB_LOG
@@ -18,6 +18,7 @@
 #include <type_traits>
 #include "cubeb-internal.h"
 #include "cubeb_mixer.h"
+#include "cubeb_trace.h"
 #include "cubeb_utils.h"
 
 #ifndef FF_ARRAY_ELEMS
@@ -122,7 +123,7 @@ struct MixerContext {
   static cubeb_channel_layout clean_layout(cubeb_channel_layout layout)
   {
     if (layout && layout != CHANNEL_FRONT_LEFT && !(layout & (layout - 1))) {
-      LOG("Treating layout as mono");
+      LOG_CATEGORY(MIXER, "Treating layout as mono");
       return CHANNEL_FRONT_CENTER;
     }
 
@@ -185,12 +186,12 @@ int MixerContext::auto_matrix()
 
   if (!sane_layout(in_ch_layout)) {
     // Channel Not Supported
-    LOG("Input Layout %x is not supported", _in_ch_layout);
+    LOG_CATEGORY(MIXER, "Input Layout %x is not supported", _in_ch_layout);
     return -1;
   }
 
   if (!sane_layout(out_ch_layout)) {
-    LOG("Output Layout %x is not supported", _out_ch_layout);
+    LOG_CATEGORY(MIXER, "Output Layout %x is not supported", _out_ch_layout);
     return -1;
   }
 
@@ -658,6 +659,7 @@ int cubeb_mixer_mix(cubeb_mixer * mixer,
                     void * output_buffer,
                     size_t output_buffer_size)
 {
+  CUBEB_TRACE_SCOPE("cubeb_mixer_mix");
   return mixer->mix(
     frames, input_buffer, input_buffer_size, output_buffer, output_buffer_size);
 }
@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_MPSC_CONSUMER_H
+#define CUBEB_MPSC_CONSUMER_H
+
+#include "cubeb_futex.h"
+#include "cubeb_mpsc_queue.h"
+#include "cubeb_threads.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/**
+ * A thread that consumes the elements that any number of threads push to a
+ * `lock_free_mpsc_queue`, e.g. from real-time audio callbacks.
+ *
+ * The thread sleeps on a futex, and is woken up by the threads that push, but
+ * only if it's actually sleeping, so pushing only makes a system call when
+ * the consumer thread is idle. When it's stopped, the queued elements are
+ * consumed and the thread is joined.
+ *
+ * `Handler` is called on the consumer thread:
+ * - `void consume(T const & element)` for each element, in order,
+ * - `void dropped(uint64_t count)` when elements have been dropped since the
+ *   last call, because the queue was full.
+ *
+ * Starting and stopping is left to the owner, that must serialize the calls.
+ */
+template <typename T, typename Handler, int BatchSize>
+class cubeb_mpsc_consumer
+{
+public:
+  /**
+   * @param depth Number of elements that can be queued.
+   * @param thread_name Name of the consumer thread, a string literal.
+   * @param handler Called on the consumer thread, must outlive this.
+   */
+  cubeb_mpsc_consumer(size_t depth, char const * thread_name,
+                      Handler & handler)
+    : queue(depth)
+    , thread_name(thread_name)
+    , handler(handler)
+    , reported_dropped(0)
+  {
+    pushed = 0;
+    sleeping = 0;
+    dropped = 0;
+    stopping = false;
+  }
+  /** Queue an element. Returns false if the queue is full. */
+  bool push(T const & element)
+  {
+    if (!queue.enqueue(element)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    /* Sequentially consistent, so that either the consumer thread sees the
+     * new count before sleeping, or we see that it's sleeping. */
+    pushed.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst)) {
+      cubeb_futex_wake(&pushed);
+    }
+    return true;
+  }
+  /** Start the consumer thread, when it isn't running. */
+  void start()
+  {
+    stopping.store(false, std::memory_order_relaxed);
+    /* The previous consumer thread, if any, has been joined. */
+    queue.reset_thread_ids();
+    thread = std::thread([this] { run(); });
+  }
+  /** Consume the queued elements, and join the consumer thread, when it is
+   * running. */
+  void stop()
+  {
+    stopping.store(true, std::memory_order_seq_cst);
+    pushed.fetch_add(1, std::memory_order_seq_cst);
+    cubeb_futex_wake(&pushed);
+    thread.join();
+  }
+  /** Number of elements dropped so far, because the queue was full. */
+  uint64_t dropped_count() const
+  {
+    return dropped.load(std::memory_order_relaxed);
+  }
+private:
+  cubeb_mpsc_consumer(cubeb_mpsc_consumer const &) = delete;
+  cubeb_mpsc_consumer & operator=(cubeb_mpsc_consumer const &) = delete;
+  void run()
+  {
+    T elements[BatchSize];
+
+    cubeb_thread_register(nullptr, thread_name);
+    while (true) {
+      uint32_t seen = pushed.load(std::memory_order_seq_cst);
+      bool stop = stopping.load(std::memory_order_seq_cst);
+
+      int count;
+      while ((count = queue.dequeue(elements, BatchSize))) {
+        for (int i = 0; i < count; i++) {
+          handler.consume(elements[i]);
+        }
+      }
+      uint64_t total_dropped = dropped.load(std::memory_order_relaxed);
+      if (total_dropped != reported_dropped) {
+        handler.dropped(total_dropped - reported_dropped);
+        reported_dropped = total_dropped;
+      }
+
+      /* The queue was empty after `stopping` was set, we're done. */
+      if (stop) {
+        break;
+      }
+
+      sleeping.store(1, std::memory_order_seq_cst);
+      if (pushed.load(std::memory_order_seq_cst) == seen) {
+        cubeb_futex_wait(&pushed, seen, -1);
+        cubeb_thread_wakeup();
+      }
+      sleeping.store(0, std::memory_order_relaxed);
+    }
+    cubeb_thread_unregister();
+  }
+  lock_free_mpsc_queue<T> queue;
+  char const * const thread_name;
+  Handler & handler;
+  /** Number of elements pushed so far, the consumer thread sleeps on this. */
+  std::atomic<uint32_t> pushed;
+  /** Set while the consumer thread is sleeping. */
+  std::atomic<uint32_t> sleeping;
+  /** Number of elements dropped because the queue was full. */
+  std::atomic<uint64_t> dropped;
+  /** Number of dropped elements already reported, only used by the consumer
+   * thread. */
+  uint64_t reported_dropped;
+  /** Set when the consumer thread has to consume the queued elements and
+   * exit. */
+  std::atomic<bool> stopping;
+  std::thread thread;
+};
+
+#endif // CUBEB_MPSC_CONSUMER_H
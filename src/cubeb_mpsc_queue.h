@@ -0,0 +1,197 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_MPSC_QUEUE_H
+#define CUBEB_MPSC_QUEUE_H
+
+#include "cubeb_ringbuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/**
+ * Bounded multiple producers single consumer lock-free queue.
+ *
+ * This data structure allows producing elements from any number of threads,
+ * and consuming them on another thread, without explicit synchronization and
+ * without allocating after construction. Unlike `lock_free_queue`, producers
+ * don't have to be the same thread, or even to take turns.
+ *
+ * Some words about the inner workings of this class:
+ * - Capacity is fixed, rounded up to a power of two. Only one allocation is
+ *   performed, in the constructor.
+ * - Each cell of the storage has a sequence number, that tells which lap of
+ *   the storage it is ready for. A producer claims a cell by incrementing the
+ *   enqueue position with a compare-and-swap, then writes the element, then
+ *   publishes it by bumping the sequence number of the cell. The consumer
+ *   reads a cell only after its sequence number has been published, and hands
+ *   it back to the producers for the next lap by bumping it again.
+ * - Producers never wait for each other: a failed compare-and-swap means
+ *   another producer has made progress. If the queue is full, `enqueue`
+ *   returns immediately.
+ * - The enqueue position and the dequeue position live on separate cache
+ *   lines.
+ */
+template <typename T>
+class lock_free_mpsc_queue
+{
+public:
+  /**
+   * Constructor for a queue.
+   *
+   * This performs an allocation, but is the only allocation that will happen
+   * for the life time of a `lock_free_mpsc_queue`.
+   *
+   * @param capacity The minimum number of elements this queue will hold. It is
+   * rounded up to a power of two.
+   */
+  lock_free_mpsc_queue(int capacity)
+    : mask_(ring_buffer_next_power_of_two(capacity) - 1)
+    , cells_(new cell[mask_ + 1])
+  {
+    assert(capacity > 0);
+    for (size_t i = 0; i <= mask_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    dequeue_position_ = 0;
+    /* If this queue is using atomics, initializing those members as the last
+     * action in the constructor acts as a full barrier. */
+    enqueue_position_ = 0;
+  }
+  /**
+   * @brief Put an element in the queue.
+   *
+   * Can be called safely on any thread, concurrently.
+   *
+   * @param element The element to put in the queue.
+   *
+   * @return 1 if the element was inserted, 0 if the queue was full.
+   */
+  int enqueue(T const & element)
+  {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    cell * c;
+
+    while (true) {
+      c = &cells_[position & mask_];
+      size_t sequence = c->sequence.load(std::memory_order_acquire);
+      intptr_t lap = static_cast<intptr_t>(sequence) -
+                     static_cast<intptr_t>(position);
+      if (lap == 0) {
+        /* The cell is free for this lap, try to claim it. On failure,
+         * `position` is updated to the current enqueue position. */
+        if (enqueue_position_.compare_exchange_weak(position, position + 1,
+                                                    std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (lap < 0) {
+        /* The cell still holds an element from the previous lap. */
+        return 0;
+      } else {
+        /* Another producer has claimed this cell. */
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+
+    c->element = element;
+    c->sequence.store(position + 1, std::memory_order_release);
+
+    return 1;
+  }
+  /**
+   * Retrieve at most `count` elements from the queue, and copy them to
+   * `elements`.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param elements A pointer to a buffer with space for at least `count`
+   * elements.
+   * @param count The maximum number of elements to dequeue.
+   * @return The number of elements written to `elements`.
+   */
+  int dequeue(T * elements, int count)
+  {
+#ifndef NDEBUG
+    assert_correct_thread(consumer_id);
+#endif
+
+    int i;
+    for (i = 0; i < count; i++) {
+      cell * c = &cells_[dequeue_position_ & mask_];
+      size_t sequence = c->sequence.load(std::memory_order_acquire);
+      if (sequence != dequeue_position_ + 1) {
+        /* Empty, or the producer that claimed this cell has not published
+         * it yet. */
+        break;
+      }
+      elements[i] = c->element;
+      c->sequence.store(dequeue_position_ + mask_ + 1,
+                        std::memory_order_release);
+      dequeue_position_++;
+    }
+
+    return i;
+  }
+  /**
+   * Get the total capacity, for this queue.
+   *
+   * Can be called safely on any thread.
+   *
+   * @return The maximum capacity of this queue.
+   */
+  int capacity() const
+  {
+    return mask_ + 1;
+  }
+  /**
+   * Reset the consumer thread identifier, in case the thread is being
+   * changed. This has to be externally synchronized. This is no-op when
+   * asserts are disabled.
+   */
+  void reset_thread_ids()
+  {
+#ifndef NDEBUG
+    consumer_id = std::thread::id();
+#endif
+  }
+private:
+  /** An element, and the lap of the storage it is ready for. */
+  struct cell
+  {
+    std::atomic<size_t> sequence;
+    T element;
+  };
+#ifndef NDEBUG
+  static void assert_correct_thread(std::thread::id& id)
+  {
+    if (id == std::thread::id()) {
+      id = std::this_thread::get_id();
+      return;
+    }
+    assert(id == std::this_thread::get_id());
+  }
+#endif
+  char padding_begin_[CUBEB_CACHE_LINE_SIZE];
+  /** Number of cells in the storage, minus one. */
+  const size_t mask_;
+  /** Data storage */
+  std::unique_ptr<cell[]> cells_;
+  char padding_shared_[CUBEB_CACHE_LINE_SIZE];
+  /** Position of the next cell to claim, shared by all the producers. */
+  std::atomic<size_t> enqueue_position_;
+  char padding_producers_[CUBEB_CACHE_LINE_SIZE];
+  /** Position of the next cell to read, only used by the consumer. */
+  size_t dequeue_position_;
+#ifndef NDEBUG
+  /** The id of the only thread that is allowed to read from the queue. */
+  std::thread::id consumer_id;
+#endif
+  char padding_consumer_[CUBEB_CACHE_LINE_SIZE];
+};
+
+#endif // CUBEB_MPSC_QUEUE_H
@@ -0,0 +1,1173 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+/* A backend that plays to virtual devices: the output is discarded, and the
+   input is silence. It doesn't need audio hardware or a sound server, so that
+   the tests can run anywhere. Its clock can be virtual, so that the data
+   callbacks can be driven deterministically, or as fast as the CPU allows, see
+   cubeb_set_clock_mode.
+
+   The "offline" backend is the same, with devices at the rate of each stream,
+   so that nothing is resampled, and a clock that starts in the fast mode. Its
+   streams write their output to a WAV or raw file, or hand it to a callback,
+   and read their input from a file, see cubeb_set_offline_params.
+
+   A single thread per context runs the streams: it calls the data callback of
+   each started stream when its next period is due, in the time of the
+   clock. */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cubeb/cubeb.h"
+#include "cubeb-internal.h"
+#include "cubeb_flight_recorder.h"
+#include "cubeb_glitch.h"
+#include "cubeb_probes.h"
+#include "cubeb_resampler.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_stream_stats.h"
+#include "cubeb_threads.h"
+#include "cubeb_trace.h"
+#include "cubeb_utils.h"
+
+namespace {
+
+/** Rate of the virtual devices of the null backend. Streams at other rates
+    are resampled. */
+const uint32_t NULL_DEVICE_RATE = 48000;
+const uint32_t NULL_DEVICE_CHANNELS = 8;
+/** Bounds of the number of frames of the device processed by each data
+    callback, derived from the latency of the stream. At most a second. */
+const uint32_t NULL_MIN_PERIOD_FRAMES = 128;
+
+/** The devices are identified by the address of their name. */
+char const NULL_INPUT_DEVICE[] = "null-input";
+char const NULL_OUTPUT_DEVICE[] = "null-output";
+char const OFFLINE_INPUT_DEVICE[] = "offline-input";
+char const OFFLINE_OUTPUT_DEVICE[] = "offline-output";
+
+/** Size of the header written to WAV files, up to the samples. */
+const long WAV_HEADER_SIZE = 44;
+const uint16_t WAV_FORMAT_PCM = 1;
+const uint16_t WAV_FORMAT_IEEE_FLOAT = 3;
+const uint16_t WAV_FORMAT_EXTENSIBLE = 0xFFFE;
+
+uint64_t
+steady_now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Time at which `frames` frames of the device have been played. Whole
+ * seconds are converted separately, `frames * 1000000000` would overflow
+ * after a few days of playback. */
+uint64_t
+frames_to_ns(uint64_t frames, uint32_t rate)
+{
+  return frames / rate * 1000000000 + frames % rate * 1000000000 / rate;
+}
+
+bool
+ends_with_wav(std::string const & path)
+{
+  if (path.size() < 4) {
+    return false;
+  }
+  std::string extension = path.substr(path.size() - 4);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return static_cast<char>(tolower(c)); });
+  return extension == ".wav";
+}
+
+/* WAV files are little-endian. */
+uint16_t
+read_le16(uint8_t const * p)
+{
+  return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t
+read_le32(uint8_t const * p)
+{
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+         static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+void
+write_le16(uint8_t * p, uint16_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = value >> 8;
+}
+
+void
+write_le32(uint8_t * p, uint32_t value)
+{
+  for (int i = 0; i < 4; i++) {
+    p[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+bool
+host_is_little_endian()
+{
+  uint16_t one = 1;
+  return *reinterpret_cast<uint8_t *>(&one) == 1;
+}
+
+/** Convert samples between the native endianness and the little-endian
+    samples of WAV files. */
+void
+swap_samples_if_big_endian(uint8_t * samples, size_t bytes, size_t sample_size)
+{
+  if (host_is_little_endian()) {
+    return;
+  }
+  for (size_t i = 0; i + sample_size <= bytes; i += sample_size) {
+    std::reverse(samples + i, samples + i + sample_size);
+  }
+}
+
+/** Write the header of a WAV file holding `data_bytes` of samples. */
+bool
+write_wav_header(FILE * file, cubeb_stream_params const & params,
+                 uint32_t data_bytes)
+{
+  uint32_t sample_size = cubeb_sample_size(params.format);
+  uint8_t header[WAV_HEADER_SIZE];
+  memcpy(header, "RIFF", 4);
+  write_le32(header + 4, WAV_HEADER_SIZE - 8 + data_bytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  write_le32(header + 16, 16);
+  write_le16(header + 20, params.format == CUBEB_SAMPLE_FLOAT32NE
+                            ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM);
+  write_le16(header + 22, params.channels);
+  write_le32(header + 24, params.rate);
+  write_le32(header + 28, params.rate * params.channels * sample_size);
+  write_le16(header + 32, params.channels * sample_size);
+  write_le16(header + 34, sample_size * 8);
+  memcpy(header + 36, "data", 4);
+  write_le32(header + 40, data_bytes);
+  return fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(header, sizeof(header), 1, file) == 1 &&
+         fseek(file, 0, SEEK_END) == 0;
+}
+
+/** Read the header of a WAV file, up to its samples, and check that they are
+    in the format of the stream. Stores the size of the samples in
+    `data_bytes`. */
+int
+read_wav_header(FILE * file, cubeb_stream_params const & params,
+                uint64_t * data_bytes)
+{
+  uint8_t riff[12];
+  if (fread(riff, sizeof(riff), 1, file) != 1 ||
+      memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4)) {
+    return CUBEB_ERROR_INVALID_FORMAT;
+  }
+  bool has_format = false;
+  for (;;) {
+    uint8_t chunk[8];
+    if (fread(chunk, sizeof(chunk), 1, file) != 1) {
+      return CUBEB_ERROR_INVALID_FORMAT;
+    }
+    uint32_t size = read_le32(chunk + 4);
+    if (!memcmp(chunk, "fmt ", 4)) {
+      uint8_t format[40] = {};
+      if (size < 16 || fread(format, std::min<uint32_t>(size, sizeof(format)), 1, file) != 1 ||
+          (size > sizeof(format) && fseek(file, size - sizeof(format), SEEK_CUR))) {
+        return CUBEB_ERROR_INVALID_FORMAT;
+      }
+      uint16_t tag = read_le16(format);
+      if (tag == WAV_FORMAT_EXTENSIBLE && size >= 40) {
+        /* The tag is the start of the GUID of the sub-format. */
+        tag = read_le16(format + 24);
+      }
+      uint16_t channels = read_le16(format + 2);
+      uint32_t rate = read_le32(format + 4);
+      uint16_t bits = read_le16(format + 14);
+      bool s16 = tag == WAV_FORMAT_PCM && bits == 16;
+      bool f32 = tag == WAV_FORMAT_IEEE_FLOAT && bits == 32;
+      if (channels != params.channels || rate != params.rate ||
+          !(params.format == CUBEB_SAMPLE_S16NE ? s16 : f32)) {
+        return CUBEB_ERROR_INVALID_FORMAT;
+      }
+      has_format = true;
+    } else if (!memcmp(chunk, "data", 4)) {
+      if (!has_format) {
+        return CUBEB_ERROR_INVALID_FORMAT;
+      }
+      /* Files that are still being written have no size yet. */
+      *data_bytes = size ? size : UINT64_MAX;
+      return CUBEB_OK;
+    } else if (fseek(file, size + (size & 1), SEEK_CUR)) {
+      return CUBEB_ERROR_INVALID_FORMAT;
+    }
+  }
+}
+
+enum null_stream_state {
+  NULL_STREAM_STOPPED,
+  NULL_STREAM_RUNNING,
+  /** The data callback returned less frames than requested, the stream is
+      drained when they have been played. */
+  NULL_STREAM_DRAINING
+};
+
+} // namespace
+
+extern "C"
+{
+/*static*/ int null_init(cubeb ** context, char const * context_name);
+/*static*/ int offline_init(cubeb ** context, char const * context_name);
+}
+
+static void null_stream_destroy(cubeb_stream * stm);
+
+extern cubeb_ops const null_ops;
+extern cubeb_ops const offline_ops;
+
+struct cubeb {
+  cubeb_ops const * ops = &null_ops;
+  /** Protects the fields below, and the state of the streams. */
+  std::mutex mutex;
+  /** Wakes up the thread of the context. */
+  std::condition_variable wakeup;
+  /** Signaled when a callback of a stream has returned, or when the thread
+      has caught up with the time set by cubeb_advance_clock. */
+  std::condition_variable progress;
+  std::thread thread;
+  bool shutdown = false;
+  std::vector<cubeb_stream *> streams;
+  cubeb_clock_mode clock_mode = CUBEB_CLOCK_REAL_TIME;
+  /** Time of the virtual clock, in nanoseconds. */
+  uint64_t clock_ns = 0;
+  /** In real time, the clock is the monotonic clock minus this offset. Can
+      wrap around if the virtual clock went ahead of the real time. */
+  uint64_t clock_offset_ns = 0;
+  /** Time the clock is advanced to, when stepped. */
+  uint64_t target_ns = 0;
+  /** Number of calls to cubeb_advance_clock, and how many of them the
+      thread has caught up with. */
+  uint64_t steps_requested = 0;
+  uint64_t steps_done = 0;
+  /** Whether this is the offline backend, and the parameters of its next
+      streams. */
+  bool offline = false;
+  std::string output_path;
+  cubeb_offline_output_callback output_callback = nullptr;
+  void * output_user_ptr = nullptr;
+  std::string input_path;
+};
+
+struct cubeb_stream {
+  /* Note: Must match cubeb_stream layout in cubeb.c. */
+  cubeb * context = nullptr;
+  void * user_ptr = nullptr;
+  /**/
+  cubeb_data_callback data_callback = nullptr;
+  cubeb_state_callback state_callback = nullptr;
+  cubeb_resampler * resampler = nullptr;
+  bool has_input = false;
+  bool has_output = false;
+  cubeb_stream_params input_params{};
+  cubeb_stream_params output_params{};
+  /** Rate of the stream, as requested, and of its devices. */
+  uint32_t rate = 0;
+  uint32_t device_rate = 0;
+  /** Frames of the device processed by each data callback. */
+  uint32_t period_frames = 0;
+  std::vector<uint8_t> input_buffer;
+  std::vector<uint8_t> output_buffer;
+  cubeb_flight_recorder * recorder = nullptr;
+  cubeb_glitch_notifier * glitches = nullptr;
+  cubeb_stream_stats_counters * stats = nullptr;
+  /* Offline streams only. */
+  FILE * output_file = nullptr;
+  bool output_wav = false;
+  uint64_t output_bytes = 0;
+  cubeb_offline_output_callback output_callback = nullptr;
+  void * output_user_ptr = nullptr;
+  FILE * input_file = nullptr;
+  bool input_wav = false;
+  /** Bytes of samples left in the input file. */
+  uint64_t input_bytes_left = 0;
+  /* Protected by the mutex of the context. */
+  std::string name;
+  float volume = 1.0f;
+  cubeb_device_changed_callback device_changed_callback = nullptr;
+  null_stream_state state = NULL_STREAM_STOPPED;
+  /** Set while the thread calls a callback of the stream, without holding
+      the mutex. */
+  bool in_callback = false;
+  /** Time at which the stream was started, or at which it recovered from an
+      underrun. */
+  uint64_t start_ns = 0;
+  /** Frames of the device processed since start_ns. */
+  uint64_t period_start_frames = 0;
+  /** When the next period is due. */
+  uint64_t next_ns = 0;
+  /** Frames of the device played since the stream was created. */
+  uint64_t frames_played = 0;
+};
+
+static uint64_t
+null_clock_now(cubeb * ctx)
+{
+  if (ctx->clock_mode == CUBEB_CLOCK_REAL_TIME) {
+    return steady_now_ns() - ctx->clock_offset_ns;
+  }
+  return ctx->clock_ns;
+}
+
+/** The started stream whose period is due first, if any. */
+static cubeb_stream *
+null_next_stream(cubeb * ctx)
+{
+  cubeb_stream * next = nullptr;
+  for (cubeb_stream * stm : ctx->streams) {
+    if (stm->state != NULL_STREAM_STOPPED &&
+        (!next || stm->next_ns < next->next_ns)) {
+      next = stm;
+    }
+  }
+  return next;
+}
+
+/** Call the state callback from the thread of the context. The lock is
+    released during the call. */
+static void
+null_stream_notify(cubeb_stream * stm, std::unique_lock<std::mutex> & lock,
+                   cubeb_state state)
+{
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, state, 0);
+  CUBEB_PROBE2(state_change, stm, state);
+  stm->in_callback = true;
+  lock.unlock();
+  stm->state_callback(stm, stm->user_ptr, state);
+  lock.lock();
+  stm->in_callback = false;
+  stm->context->progress.notify_all();
+}
+
+/** Count the periods the thread was too late to process, in real time, as an
+    underrun, and start again from now. */
+static void
+null_stream_check_underrun(cubeb_stream * stm, uint64_t now)
+{
+  uint64_t late_ns = now - stm->next_ns;
+  if (stm->next_ns > now ||
+      late_ns < frames_to_ns(stm->period_frames, stm->device_rate)) {
+    return;
+  }
+  uint64_t frames_lost = late_ns * stm->device_rate / 1000000000;
+  cubeb_device_type direction =
+    stm->has_output ? CUBEB_DEVICE_TYPE_OUTPUT : CUBEB_DEVICE_TYPE_INPUT;
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN, frames_lost, 0);
+  if (stm->has_output) {
+    cubeb_stream_stats_underrun(stm->stats, 1);
+  } else {
+    cubeb_stream_stats_overrun(stm->stats, 1);
+  }
+  cubeb_glitch_type type =
+    stm->has_output ? CUBEB_GLITCH_UNDERRUN : CUBEB_GLITCH_OVERRUN;
+  cubeb_glitch_report(stm->glitches, type, direction, frames_lost);
+  CUBEB_PROBE4(xrun, stm, type, direction, frames_lost);
+  stm->start_ns = now;
+  stm->period_start_frames = 0;
+  stm->next_ns = now;
+}
+
+/** Read the next frames of the input file of an offline stream, followed by
+    silence after its end. Returns the number of frames read, all of them
+    without an input file. */
+static long
+null_stream_read_input(cubeb_stream * stm, long frames)
+{
+  if (!stm->input_file) {
+    return frames;
+  }
+  size_t sample_size = cubeb_sample_size(stm->input_params.format);
+  size_t frame_size = stm->input_params.channels * sample_size;
+  size_t bytes = frames * frame_size;
+  uint8_t * buffer = stm->input_buffer.data();
+  size_t read = fread(buffer, 1, std::min<uint64_t>(bytes, stm->input_bytes_left),
+                      stm->input_file);
+  read -= read % frame_size;
+  stm->input_bytes_left -= read;
+  if (stm->input_wav) {
+    swap_samples_if_big_endian(buffer, read, sample_size);
+  }
+  memset(buffer + read, 0, bytes - read);
+  return read / frame_size;
+}
+
+/** Apply the volume to the frames rendered by the data callback of an
+    offline stream, and hand them to its sinks. */
+static bool
+null_stream_write_output(cubeb_stream * stm, long frames, float volume)
+{
+  if (!stm->output_file && !stm->output_callback) {
+    return true;
+  }
+  uint8_t * buffer = stm->output_buffer.data();
+  size_t sample_size = cubeb_sample_size(stm->output_params.format);
+  size_t samples = frames * stm->output_params.channels;
+  if (volume != 1.0f) {
+    if (stm->output_params.format == CUBEB_SAMPLE_FLOAT32NE) {
+      float * out = reinterpret_cast<float *>(buffer);
+      for (size_t i = 0; i < samples; i++) {
+        out[i] *= volume;
+      }
+    } else {
+      int16_t * out = reinterpret_cast<int16_t *>(buffer);
+      for (size_t i = 0; i < samples; i++) {
+        out[i] = static_cast<int16_t>(out[i] * volume);
+      }
+    }
+  }
+  if (stm->output_callback) {
+    stm->output_callback(stm, stm->output_user_ptr, buffer, frames);
+  }
+  if (stm->output_file) {
+    size_t bytes = samples * sample_size;
+    if (stm->output_wav) {
+      swap_samples_if_big_endian(buffer, bytes, sample_size);
+    }
+    if (fwrite(buffer, 1, bytes, stm->output_file) != bytes) {
+      LOG("Could not write the output of stream %p", stm);
+      return false;
+    }
+    stm->output_bytes += bytes;
+  }
+  return true;
+}
+
+/** Complete the header of the WAV output file of an offline stream, so that
+    it can be read. */
+static void
+null_stream_finish_output(cubeb_stream * stm)
+{
+  if (!stm->output_file) {
+    return;
+  }
+  if (stm->output_wav &&
+      !write_wav_header(stm->output_file, stm->output_params,
+                        static_cast<uint32_t>(std::min<uint64_t>(
+                          stm->output_bytes, UINT32_MAX - WAV_HEADER_SIZE)))) {
+    LOG("Could not write the WAV header of stream %p", stm);
+  }
+  fflush(stm->output_file);
+}
+
+/** Process the period of the stream that is due. The lock is released while
+    calling the data callback. */
+static void
+null_process_stream(cubeb_stream * stm, std::unique_lock<std::mutex> & lock)
+{
+  if (stm->state == NULL_STREAM_DRAINING) {
+    /* The last frames returned by the data callback have been played. */
+    stm->state = NULL_STREAM_STOPPED;
+    null_stream_finish_output(stm);
+    null_stream_notify(stm, lock, CUBEB_STATE_DRAINED);
+    return;
+  }
+
+  long input_frames = stm->has_input ? stm->period_frames : 0;
+  long output_frames = stm->has_output ? stm->period_frames : 0;
+  long requested = stm->has_output ? output_frames : input_frames;
+  float volume = stm->volume;
+
+  stm->in_callback = true;
+  lock.unlock();
+  uint64_t phase_start = cubeb_stream_stats_now();
+  long input_read = stm->has_input ? null_stream_read_input(stm, input_frames) : 0;
+  CUBEB_RT_BEGIN();
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, requested, 0);
+  uint64_t start = cubeb_stream_stats_callback_start(stm->stats);
+  cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+  /* Without an input file, the input is silence. The resampler leaves the
+     buffer untouched. */
+  long got = cubeb_resampler_fill(stm->resampler,
+                                  stm->has_input ? stm->input_buffer.data() : nullptr,
+                                  stm->has_input ? &input_frames : nullptr,
+                                  stm->has_output ? stm->output_buffer.data() : nullptr,
+                                  output_frames);
+  uint64_t end = cubeb_stream_stats_callback_end(stm->stats, start, requested, got);
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, got, 0);
+  CUBEB_RT_END();
+  if (got > 0 && stm->has_output &&
+      !null_stream_write_output(stm, std::min(got, requested), volume)) {
+    got = CUBEB_ERROR;
+  }
+  phase_start = cubeb_stream_stats_now();
+  cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_WRITE, end, phase_start);
+  lock.lock();
+  cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_RELOCK, phase_start,
+                           cubeb_stream_stats_now());
+  stm->in_callback = false;
+  stm->context->progress.notify_all();
+
+  if (stm->state != NULL_STREAM_RUNNING) {
+    /* Stopped during the callback. */
+    return;
+  }
+  if (got < 0) {
+    stm->state = NULL_STREAM_STOPPED;
+    cubeb_flight_recorder_dump(stm->recorder);
+    null_stream_notify(stm, lock, CUBEB_STATE_ERROR);
+    return;
+  }
+  if (!stm->has_output) {
+    /* Input-only streams are drained at the end of their input file. */
+    got = std::min(got, input_read);
+  }
+  stm->frames_played += std::min(got, requested);
+  stm->period_start_frames += stm->period_frames;
+  stm->next_ns = stm->start_ns +
+                frames_to_ns(stm->period_start_frames, stm->device_rate);
+  if (got < requested) {
+    stm->state = NULL_STREAM_DRAINING;
+  }
+}
+
+static void
+null_run(cubeb * ctx)
+{
+  std::unique_lock<std::mutex> lock(ctx->mutex);
+  while (!ctx->shutdown) {
+    cubeb_stream * stm = null_next_stream(ctx);
+    uint64_t now = null_clock_now(ctx);
+
+    if (stm && stm->next_ns > now) {
+      switch (ctx->clock_mode) {
+      case CUBEB_CLOCK_REAL_TIME:
+        ctx->wakeup.wait_until(lock, std::chrono::steady_clock::time_point(
+          std::chrono::nanoseconds(stm->next_ns + ctx->clock_offset_ns)));
+        cubeb_thread_wakeup();
+        continue;
+      case CUBEB_CLOCK_FAST:
+        ctx->clock_ns = stm->next_ns;
+        break;
+      case CUBEB_CLOCK_STEPPED:
+        if (stm->next_ns <= ctx->target_ns) {
+          ctx->clock_ns = stm->next_ns;
+        } else {
+          stm = nullptr;
+        }
+        break;
+      }
+    }
+
+    if (!stm) {
+      /* Nothing to do until the clock advances, or a stream starts. */
+      if (ctx->clock_mode == CUBEB_CLOCK_STEPPED) {
+        ctx->clock_ns = ctx->target_ns;
+        ctx->steps_done = ctx->steps_requested;
+        ctx->progress.notify_all();
+      }
+      ctx->wakeup.wait(lock);
+      cubeb_thread_wakeup();
+      continue;
+    }
+
+    if (ctx->clock_mode == CUBEB_CLOCK_REAL_TIME) {
+      null_stream_check_underrun(stm, now);
+    }
+    CUBEB_TRACE_BEGIN("null_process_stream");
+    null_process_stream(stm, lock);
+    CUBEB_TRACE_END("null_process_stream");
+  }
+}
+
+static int
+null_context_create(cubeb ** context, bool offline)
+{
+  cubeb * ctx = new (std::nothrow) cubeb();
+  if (!ctx) {
+    return CUBEB_ERROR;
+  }
+  if (offline) {
+    ctx->ops = &offline_ops;
+    ctx->offline = true;
+    ctx->clock_mode = CUBEB_CLOCK_FAST;
+  }
+  ctx->clock_offset_ns = steady_now_ns();
+  ctx->thread = std::thread([ctx] {
+    cubeb_thread_register(ctx, ctx->offline ? "cubeb-offline" : "cubeb-null");
+    null_run(ctx);
+    cubeb_thread_unregister();
+  });
+  *context = ctx;
+  return CUBEB_OK;
+}
+
+/*static*/ int
+null_init(cubeb ** context, char const * /* context_name */)
+{
+  return null_context_create(context, false);
+}
+
+/*static*/ int
+offline_init(cubeb ** context, char const * /* context_name */)
+{
+  return null_context_create(context, true);
+}
+
+static char const *
+null_get_backend_id(cubeb * context)
+{
+  return context->offline ? "offline" : "null";
+}
+
+static int
+null_get_max_channel_count(cubeb * /* context */, uint32_t * max_channels)
+{
+  *max_channels = NULL_DEVICE_CHANNELS;
+  return CUBEB_OK;
+}
+
+static int
+null_get_min_latency(cubeb * context, cubeb_stream_params params,
+                     uint32_t * latency_frames)
+{
+  if (context->offline) {
+    *latency_frames = NULL_MIN_PERIOD_FRAMES;
+    return CUBEB_OK;
+  }
+  *latency_frames = std::max<uint64_t>(
+    1, static_cast<uint64_t>(NULL_MIN_PERIOD_FRAMES) * params.rate / NULL_DEVICE_RATE);
+  return CUBEB_OK;
+}
+
+static int
+null_get_preferred_sample_rate(cubeb * /* context */, uint32_t * rate)
+{
+  *rate = NULL_DEVICE_RATE;
+  return CUBEB_OK;
+}
+
+static char const *
+null_device(cubeb * context, cubeb_device_type type)
+{
+  if (type == CUBEB_DEVICE_TYPE_INPUT) {
+    return context->offline ? OFFLINE_INPUT_DEVICE : NULL_INPUT_DEVICE;
+  }
+  return context->offline ? OFFLINE_OUTPUT_DEVICE : NULL_OUTPUT_DEVICE;
+}
+
+static void
+null_fill_device_info(cubeb * context, cubeb_device_info * info,
+                      cubeb_device_type type)
+{
+  char const * device = null_device(context, type);
+  info->devid = device;
+  info->device_id = device;
+  info->friendly_name = device;
+  info->group_id = null_get_backend_id(context);
+  info->vendor_name = NULL;
+  info->type = type;
+  info->state = CUBEB_DEVICE_STATE_ENABLED;
+  info->preferred = CUBEB_DEVICE_PREF_ALL;
+  info->format = static_cast<cubeb_device_fmt>(CUBEB_DEVICE_FMT_S16NE | CUBEB_DEVICE_FMT_F32NE);
+  info->default_format = CUBEB_DEVICE_FMT_F32NE;
+  info->max_channels = NULL_DEVICE_CHANNELS;
+  info->default_rate = NULL_DEVICE_RATE;
+  info->max_rate = 192000;
+  info->min_rate = 1000;
+  info->latency_lo = NULL_MIN_PERIOD_FRAMES;
+  info->latency_hi = NULL_DEVICE_RATE;
+}
+
+static int
+null_enumerate_devices(cubeb * context, cubeb_device_type type,
+                       cubeb_device_collection * collection)
+{
+  cubeb_device_info * devices =
+    static_cast<cubeb_device_info *>(calloc(2, sizeof(cubeb_device_info)));
+  if (!devices) {
+    return CUBEB_ERROR;
+  }
+  size_t count = 0;
+  if (type & CUBEB_DEVICE_TYPE_INPUT) {
+    null_fill_device_info(context, &devices[count++], CUBEB_DEVICE_TYPE_INPUT);
+  }
+  if (type & CUBEB_DEVICE_TYPE_OUTPUT) {
+    null_fill_device_info(context, &devices[count++], CUBEB_DEVICE_TYPE_OUTPUT);
+  }
+  collection->device = devices;
+  collection->count = count;
+  return CUBEB_OK;
+}
+
+static int
+null_device_collection_destroy(cubeb * /* context */,
+                               cubeb_device_collection * collection)
+{
+  /* The strings are static. */
+  free(collection->device);
+  collection->device = NULL;
+  collection->count = 0;
+  return CUBEB_OK;
+}
+
+static void
+null_destroy(cubeb * ctx)
+{
+  {
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    XASSERT(ctx->streams.empty());
+    ctx->shutdown = true;
+    ctx->wakeup.notify_all();
+  }
+  ctx->thread.join();
+  delete ctx;
+}
+
+static int
+null_set_clock_mode(cubeb * ctx, cubeb_clock_mode mode)
+{
+  std::lock_guard<std::mutex> lock(ctx->mutex);
+  uint64_t now = null_clock_now(ctx);
+  ctx->clock_ns = now;
+  ctx->clock_offset_ns = steady_now_ns() - now;
+  ctx->target_ns = now;
+  ctx->steps_done = ctx->steps_requested;
+  ctx->clock_mode = mode;
+  ctx->wakeup.notify_all();
+  ctx->progress.notify_all();
+  return CUBEB_OK;
+}
+
+static int
+null_advance_clock(cubeb * ctx, uint64_t duration_ns)
+{
+  std::unique_lock<std::mutex> lock(ctx->mutex);
+  if (ctx->clock_mode != CUBEB_CLOCK_STEPPED) {
+    return CUBEB_ERROR_INVALID_PARAMETER;
+  }
+  ctx->target_ns += duration_ns;
+  uint64_t step = ++ctx->steps_requested;
+  ctx->wakeup.notify_all();
+  ctx->progress.wait(lock, [ctx, step] {
+    return ctx->steps_done >= step ||
+           ctx->clock_mode != CUBEB_CLOCK_STEPPED || ctx->shutdown;
+  });
+  return CUBEB_OK;
+}
+
+static int
+offline_set_offline_params(cubeb * ctx, cubeb_offline_params const * params)
+{
+  std::lock_guard<std::mutex> lock(ctx->mutex);
+  ctx->output_path = params->output_path ? params->output_path : "";
+  ctx->output_callback = params->output_callback;
+  ctx->output_user_ptr = params->output_user_ptr;
+  ctx->input_path = params->input_path ? params->input_path : "";
+  return CUBEB_OK;
+}
+
+/** Open the files an offline stream writes its output to and reads its input
+    from. */
+static int
+offline_stream_open_files(cubeb_stream * stm)
+{
+  cubeb * ctx = stm->context;
+  std::lock_guard<std::mutex> lock(ctx->mutex);
+  if (stm->has_output) {
+    stm->output_callback = ctx->output_callback;
+    stm->output_user_ptr = ctx->output_user_ptr;
+    if (!ctx->output_path.empty()) {
+      stm->output_file = fopen(ctx->output_path.c_str(), "wb");
+      if (!stm->output_file) {
+        LOG("Could not open %s", ctx->output_path.c_str());
+        return CUBEB_ERROR;
+      }
+      stm->output_wav = ends_with_wav(ctx->output_path);
+      if (stm->output_wav &&
+          !write_wav_header(stm->output_file, stm->output_params, 0)) {
+        LOG("Could not write the WAV header of %s", ctx->output_path.c_str());
+        return CUBEB_ERROR;
+      }
+    }
+  }
+  if (stm->has_input && !ctx->input_path.empty()) {
+    stm->input_file = fopen(ctx->input_path.c_str(), "rb");
+    if (!stm->input_file) {
+      LOG("Could not open %s", ctx->input_path.c_str());
+      return CUBEB_ERROR;
+    }
+    stm->input_wav = ends_with_wav(ctx->input_path);
+    stm->input_bytes_left = UINT64_MAX;
+    if (stm->input_wav) {
+      int r = read_wav_header(stm->input_file, stm->input_params,
+                              &stm->input_bytes_left);
+      if (r != CUBEB_OK) {
+        LOG("%s is not a WAV file in the format of the stream",
+            ctx->input_path.c_str());
+        return r;
+      }
+    }
+  }
+  return CUBEB_OK;
+}
+
+static int
+null_stream_init(cubeb * context, cubeb_stream ** stream, char const * stream_name,
+                 cubeb_devid input_device,
+                 cubeb_stream_params * input_stream_params,
+                 cubeb_devid output_device,
+                 cubeb_stream_params * output_stream_params,
+                 unsigned int latency_frames,
+                 cubeb_data_callback data_callback,
+                 cubeb_state_callback state_callback,
+                 void * user_ptr)
+{
+  cubeb_stream_params * params =
+    output_stream_params ? output_stream_params : input_stream_params;
+  if (params->format != CUBEB_SAMPLE_S16NE &&
+      params->format != CUBEB_SAMPLE_FLOAT32NE) {
+    return CUBEB_ERROR_INVALID_FORMAT;
+  }
+  if (input_stream_params &&
+      (input_stream_params->prefs & CUBEB_STREAM_PREF_LOOPBACK)) {
+    return CUBEB_ERROR_NOT_SUPPORTED;
+  }
+  if ((input_device && input_device != null_device(context, CUBEB_DEVICE_TYPE_INPUT)) ||
+      (output_device && output_device != null_device(context, CUBEB_DEVICE_TYPE_OUTPUT))) {
+    return CUBEB_ERROR_DEVICE_UNAVAILABLE;
+  }
+
+  cubeb_stream * stm = new (std::nothrow) cubeb_stream();
+  if (!stm) {
+    return CUBEB_ERROR;
+  }
+  stm->context = context;
+  stm->user_ptr = user_ptr;
+  stm->data_callback = data_callback;
+  stm->state_callback = state_callback;
+  stm->name = stream_name ? stream_name : "";
+  stm->rate = params->rate;
+  /* The offline backend renders at the rate of the stream. */
+  stm->device_rate = context->offline ? stm->rate : NULL_DEVICE_RATE;
+  stm->period_frames = static_cast<uint32_t>(std::min<uint64_t>(
+    std::max<uint64_t>(static_cast<uint64_t>(latency_frames) * stm->device_rate / stm->rate,
+                       NULL_MIN_PERIOD_FRAMES),
+    stm->device_rate));
+
+  /* The parameters of the device side of the resampler. */
+  if (input_stream_params) {
+    stm->has_input = true;
+    stm->input_params = *input_stream_params;
+    stm->input_params.rate = stm->device_rate;
+    stm->input_buffer.resize(stm->period_frames * stm->input_params.channels *
+                             cubeb_sample_size(stm->input_params.format));
+  }
+  if (output_stream_params) {
+    stm->has_output = true;
+    stm->output_params = *output_stream_params;
+    stm->output_params.rate = stm->device_rate;
+    stm->output_buffer.resize(stm->period_frames * stm->output_params.channels *
+                              cubeb_sample_size(stm->output_params.format));
+  }
+
+  stm->resampler = cubeb_resampler_create(stm,
+                                          stm->has_input ? &stm->input_params : nullptr,
+                                          stm->has_output ? &stm->output_params : nullptr,
+                                          stm->rate,
+                                          data_callback,
+                                          user_ptr,
+                                          CUBEB_RESAMPLER_QUALITY_DESKTOP);
+  if (!stm->resampler) {
+    LOG("Could not create a resampler");
+    null_stream_destroy(stm);
+    return CUBEB_ERROR;
+  }
+  /* Periods can be up to a second long. */
+  cubeb_resampler_reserve(stm->resampler, stm->period_frames);
+
+  if (context->offline) {
+    int r = offline_stream_open_files(stm);
+    if (r != CUBEB_OK) {
+      null_stream_destroy(stm);
+      return r;
+    }
+  }
+
+  stm->recorder = cubeb_flight_recorder_create(stream_name);
+  stm->glitches = cubeb_glitch_notifier_create();
+  stm->stats = cubeb_stream_stats_counters_create(stm->device_rate, stm->glitches);
+
+  {
+    std::lock_guard<std::mutex> lock(context->mutex);
+    context->streams.push_back(stm);
+  }
+
+  *stream = stm;
+  return CUBEB_OK;
+}
+
+static void
+null_stream_destroy(cubeb_stream * stm)
+{
+  cubeb * ctx = stm->context;
+  {
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->streams.erase(std::remove(ctx->streams.begin(), ctx->streams.end(), stm),
+                       ctx->streams.end());
+    ctx->progress.wait(lock, [stm] { return !stm->in_callback; });
+  }
+  if (stm->resampler) {
+    cubeb_resampler_destroy(stm->resampler);
+  }
+  cubeb_flight_recorder_destroy(stm->recorder);
+  cubeb_stream_stats_counters_destroy(stm->stats);
+  cubeb_glitch_notifier_destroy(stm->glitches);
+  if (stm->output_file) {
+    null_stream_finish_output(stm);
+    fclose(stm->output_file);
+  }
+  if (stm->input_file) {
+    fclose(stm->input_file);
+  }
+  delete stm;
+}
+
+static int
+null_stream_start(cubeb_stream * stm)
+{
+  cubeb * ctx = stm->context;
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_STARTED, 0);
+  CUBEB_PROBE2(state_change, stm, CUBEB_STATE_STARTED);
+  stm->state_callback(stm, stm->user_ptr, CUBEB_STATE_STARTED);
+  std::lock_guard<std::mutex> lock(ctx->mutex);
+  cubeb_stream_stats_started(stm->stats);
+  stm->state = NULL_STREAM_RUNNING;
+  /* The first period is due now, to fill the buffers. */
+  stm->start_ns = null_clock_now(ctx);
+  stm->period_start_frames = 0;
+  stm->next_ns = stm->start_ns;
+  ctx->wakeup.notify_all();
+  return CUBEB_OK;
+}
+
+static int
+null_stream_stop(cubeb_stream * stm)
+{
+  cubeb * ctx = stm->context;
+  {
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    stm->state = NULL_STREAM_STOPPED;
+    ctx->progress.wait(lock, [stm] { return !stm->in_callback; });
+    null_stream_finish_output(stm);
+  }
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_STOPPED, 0);
+  CUBEB_PROBE2(state_change, stm, CUBEB_STATE_STOPPED);
+  stm->state_callback(stm, stm->user_ptr, CUBEB_STATE_STOPPED);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_position(cubeb_stream * stm, uint64_t * position)
+{
+  std::lock_guard<std::mutex> lock(stm->context->mutex);
+  *position = stm->frames_played * stm->rate / stm->device_rate;
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_latency(cubeb_stream * stm, uint32_t * latency)
+{
+  if (!stm->has_output) {
+    return CUBEB_ERROR;
+  }
+  *latency = static_cast<uint64_t>(stm->period_frames) * stm->rate / stm->device_rate +
+             cubeb_resampler_latency(stm->resampler);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_input_latency(cubeb_stream * stm, uint32_t * latency)
+{
+  if (!stm->has_input) {
+    return CUBEB_ERROR;
+  }
+  *latency = static_cast<uint64_t>(stm->period_frames) * stm->rate / stm->device_rate +
+             cubeb_resampler_latency(stm->resampler);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_set_volume(cubeb_stream * stm, float volume)
+{
+  std::lock_guard<std::mutex> lock(stm->context->mutex);
+  stm->volume = volume;
+  return CUBEB_OK;
+}
+
+static int
+null_stream_set_name(cubeb_stream * stm, char const * stream_name)
+{
+  std::lock_guard<std::mutex> lock(stm->context->mutex);
+  stm->name = stream_name;
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_current_device(cubeb_stream * stm, cubeb_device ** const device)
+{
+  *device = static_cast<cubeb_device *>(calloc(1, sizeof(cubeb_device)));
+  if (!*device) {
+    return CUBEB_ERROR;
+  }
+  (*device)->input_name = stm->has_input ? strdup(null_device(stm->context, CUBEB_DEVICE_TYPE_INPUT)) : NULL;
+  (*device)->output_name = stm->has_output ? strdup(null_device(stm->context, CUBEB_DEVICE_TYPE_OUTPUT)) : NULL;
+  return CUBEB_OK;
+}
+
+static int
+null_stream_device_destroy(cubeb_stream * /* stream */, cubeb_device * device)
+{
+  free(device->input_name);
+  free(device->output_name);
+  free(device);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_register_device_changed_callback(cubeb_stream * stm,
+                                             cubeb_device_changed_callback device_changed_callback)
+{
+  /* The devices never change. */
+  std::lock_guard<std::mutex> lock(stm->context->mutex);
+  stm->device_changed_callback = device_changed_callback;
+  return CUBEB_OK;
+}
+
+static int
+null_register_device_collection_changed(cubeb * /* context */,
+                                        cubeb_device_type /* devtype */,
+                                        cubeb_device_collection_changed_callback /* callback */,
+                                        void * /* user_ptr */)
+{
+  /* The devices never change. */
+  return CUBEB_OK;
+}
+
+static int
+null_stream_dump_flight_recorder(cubeb_stream * stm)
+{
+  cubeb_flight_recorder_dump(stm->recorder);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_stats(cubeb_stream * stm, cubeb_stream_stats * stats)
+{
+  cubeb_stream_stats_counters_get(&stm->stats, 1, stats);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_register_glitch_callback(cubeb_stream * stm,
+                                     cubeb_glitch_callback glitch_callback)
+{
+  cubeb_glitch_notifier_set_callback(stm->glitches, stm, glitch_callback,
+                                     stm->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_register_load_callback(cubeb_stream * stm, float threshold,
+                                   cubeb_load_callback load_callback)
+{
+  cubeb_glitch_notifier_set_load_callback(stm->glitches, stm, load_callback,
+                                          threshold, stm->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+null_stream_get_callback_histograms(cubeb_stream * stm,
+                                    cubeb_callback_histograms * histograms)
+{
+  cubeb_stream_stats_counters_get_histograms(&stm->stats, 1, histograms);
+  return CUBEB_OK;
+}
+
+cubeb_ops const null_ops = {
+  /*.init =*/ null_init,
+  /*.get_backend_id =*/ null_get_backend_id,
+  /*.get_max_channel_count =*/ null_get_max_channel_count,
+  /*.get_min_latency =*/ null_get_min_latency,
+  /*.get_preferred_sample_rate =*/ null_get_preferred_sample_rate,
+  /*.enumerate_devices =*/ null_enumerate_devices,
+  /*.device_collection_destroy =*/ null_device_collection_destroy,
+  /*.destroy =*/ null_destroy,
+  /*.stream_init =*/ null_stream_init,
+  /*.stream_destroy =*/ null_stream_destroy,
+  /*.stream_start =*/ null_stream_start,
+  /*.stream_stop =*/ null_stream_stop,
+  /*.stream_get_position =*/ null_stream_get_position,
+  /*.stream_get_latency =*/ null_stream_get_latency,
+  /*.stream_get_input_latency =*/ null_stream_get_input_latency,
+  /*.stream_set_volume =*/ null_stream_set_volume,
+  /*.stream_set_name =*/ null_stream_set_name,
+  /*.stream_get_current_device =*/ null_stream_get_current_device,
+  /*.stream_device_destroy =*/ null_stream_device_destroy,
+  /*.stream_register_device_changed_callback =*/ null_stream_register_device_changed_callback,
+  /*.register_device_collection_changed =*/ null_register_device_collection_changed,
+  /*.stream_dump_flight_recorder =*/ null_stream_dump_flight_recorder,
+  /*.stream_get_stats =*/ null_stream_get_stats,
+  /*.stream_register_glitch_callback =*/ null_stream_register_glitch_callback,
+  /*.stream_register_load_callback =*/ null_stream_register_load_callback,
+  /*.stream_get_callback_histograms =*/ null_stream_get_callback_histograms,
+  /*.set_clock_mode =*/ null_set_clock_mode,
+  /*.advance_clock =*/ null_advance_clock,
+  /*.set_offline_params =*/ NULL
+};
+
+cubeb_ops const offline_ops = {
+  /*.init =*/ offline_init,
+  /*.get_backend_id =*/ null_get_backend_id,
+  /*.get_max_channel_count =*/ null_get_max_channel_count,
+  /*.get_min_latency =*/ null_get_min_latency,
+  /*.get_preferred_sample_rate =*/ null_get_preferred_sample_rate,
+  /*.enumerate_devices =*/ null_enumerate_devices,
+  /*.device_collection_destroy =*/ null_device_collection_destroy,
+  /*.destroy =*/ null_destroy,
+  /*.stream_init =*/ null_stream_init,
+  /*.stream_destroy =*/ null_stream_destroy,
+  /*.stream_start =*/ null_stream_start,
+  /*.stream_stop =*/ null_stream_stop,
+  /*.stream_get_position =*/ null_stream_get_position,
+  /*.stream_get_latency =*/ null_stream_get_latency,
+  /*.stream_get_input_latency =*/ null_stream_get_input_latency,
+  /*.stream_set_volume =*/ null_stream_set_volume,
+  /*.stream_set_name =*/ null_stream_set_name,
+  /*.stream_get_current_device =*/ null_stream_get_current_device,
+  /*.stream_device_destroy =*/ null_stream_device_destroy,
+  /*.stream_register_device_changed_callback =*/ null_stream_register_device_changed_callback,
+  /*.register_device_collection_changed =*/ null_register_device_collection_changed,
+  /*.stream_dump_flight_recorder =*/ null_stream_dump_flight_recorder,
+  /*.stream_get_stats =*/ null_stream_get_stats,
+  /*.stream_register_glitch_callback =*/ null_stream_register_glitch_callback,
+  /*.stream_register_load_callback =*/ null_stream_register_load_callback,
+  /*.stream_get_callback_histograms =*/ null_stream_get_callback_histograms,
+  /*.set_clock_mode =*/ null_set_clock_mode,
+  /*.advance_clock =*/ null_advance_clock,
+  /*.set_offline_params =*/ offline_set_offline_params
+};
@@ -1755,5 +1755,13 @@ static struct cubeb_ops const opensl_ops = {
   .stream_get_current_device = NULL,
   .stream_device_destroy = NULL,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = NULL,
+  .stream_get_stats = NULL,
+  .stream_register_glitch_callback = NULL,
+  .stream_register_load_callback = NULL,
+  .stream_get_callback_histograms = NULL,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
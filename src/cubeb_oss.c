@@ -29,6 +29,13 @@
 #include "cubeb_mixer.h"
 #include "cubeb_strings.h"
 #include "cubeb-internal.h"
+#include "cubeb_flight_recorder.h"
+#include "cubeb_glitch.h"
+#include "cubeb_planar.h"
+#include "cubeb_probes.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_stream_stats.h"
+#include "cubeb_threads.h"
 
 /* Supported well by most hardware. */
 #ifndef OSS_PREFER_RATE
@@ -129,6 +136,10 @@ struct cubeb_stream {
   unsigned int nfr; /* Number of frames allocated */
   unsigned int nfrags;
   unsigned int bufframes;
+  cubeb_planar_adapter * planar; /* Converts the buffers of planar streams */
+  cubeb_flight_recorder * recorder; /* Last events, logged on error */
+  cubeb_stream_stats_counters * stats;
+  cubeb_glitch_notifier * glitches;
 };
 
 static char const *
@@ -668,6 +679,7 @@ oss_stream_stop(cubeb_stream * s)
   if (s->state != CUBEB_STATE_STOPPED) {
     s->state = CUBEB_STATE_STOPPED;
     pthread_mutex_unlock(&s->mtx);
+    CUBEB_PROBE2(state_change, s, CUBEB_STATE_STOPPED);
     s->state_cb(s, s->user_ptr, CUBEB_STATE_STOPPED);
   } else {
     pthread_mutex_unlock(&s->mtx);
@@ -698,6 +710,10 @@ oss_stream_destroy(cubeb_stream * s)
   }
   free(s->play.buf);
   free(s->record.buf);
+  cubeb_planar_adapter_destroy(s->planar);
+  cubeb_flight_recorder_destroy(s->recorder);
+  cubeb_stream_stats_counters_destroy(s->stats);
+  cubeb_glitch_notifier_destroy(s->glitches);
   free(s);
 }
 
@@ -793,6 +809,7 @@ oss_wait_playfd_for_space(cubeb_stream * s)
   if (poll(&pfd, 1, 2000) == -1) {
     return CUBEB_ERROR;
   }
+  cubeb_thread_wakeup();
 
   if (pfd.revents & POLLHUP) {
     return CUBEB_ERROR;
@@ -812,6 +829,7 @@ oss_wait_recfd_for_space(cubeb_stream * s)
   if (poll(&pfd, 1, 2000) == -1) {
     return CUBEB_ERROR;
   }
+  cubeb_thread_wakeup();
 
   if (pfd.revents & POLLHUP) {
     return CUBEB_ERROR;
@@ -819,6 +837,36 @@ oss_wait_recfd_for_space(cubeb_stream * s)
   return 0;
 }
 
+/* Count the xruns since the last call, the driver resets its counters. */
+static void
+oss_update_xruns(cubeb_stream * s)
+{
+#ifdef SNDCTL_DSP_GETERROR
+  audio_errinfo ei;
+
+  if (s->play.fd != -1 && ioctl(s->play.fd, SNDCTL_DSP_GETERROR, &ei) == 0 &&
+      ei.play_underruns > 0) {
+    cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+    cubeb_stream_stats_underrun(s->stats, ei.play_underruns);
+    cubeb_glitch_report(s->glitches, CUBEB_GLITCH_UNDERRUN,
+                        CUBEB_DEVICE_TYPE_OUTPUT, 0);
+    CUBEB_PROBE4(xrun, s, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT,
+                 (uint64_t) 0);
+  }
+  if (s->record.fd != -1 && ioctl(s->record.fd, SNDCTL_DSP_GETERROR, &ei) == 0 &&
+      ei.rec_overruns > 0) {
+    cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+    cubeb_stream_stats_overrun(s->stats, ei.rec_overruns);
+    cubeb_glitch_report(s->glitches, CUBEB_GLITCH_OVERRUN,
+                        CUBEB_DEVICE_TYPE_INPUT, 0);
+    CUBEB_PROBE4(xrun, s, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT,
+                 (uint64_t) 0);
+  }
+#else
+  (void)s;
+#endif
+}
+
 /* 1 - Stopped by cubeb_stream_stop, otherwise 0 */
 static int
 oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
@@ -827,6 +875,8 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
   int trig = 0, drain = 0;
   const bool play_on = s->play.fd != -1, record_on = s->record.fd != -1;
   long nfr = 0;
+  /* When the last wait for the device returned. */
+  uint64_t wakeup = 0;
 
   if (record_on) {
     if (ioctl(s->record.fd, SNDCTL_DSP_SETTRIGGER, &trig)) {
@@ -864,6 +914,8 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
 
     long got = 0;
     if (nfr > 0) {
+      uint64_t phase_start = cubeb_stream_stats_now();
+      cubeb_stream_stats_phase(s->stats, CUBEB_BACKEND_PHASE_WAKEUP, wakeup, phase_start);
       if (record_on) {
         if (oss_get_rec_frames(s, nfr) == CUBEB_ERROR) {
           state = CUBEB_STATE_ERROR;
@@ -873,7 +925,17 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
           oss_linear32_to_float(s->record.buf, s->record.info.channels * nfr);
         }
       }
-      got = s->data_cb(s, s->user_ptr, s->record.buf, s->play.buf, nfr);
+      CUBEB_RT_BEGIN();
+      cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, nfr, 0);
+      uint64_t start = cubeb_stream_stats_callback_start(s->stats);
+      cubeb_stream_stats_phase(s->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+      CUBEB_PROBE2(data_callback_entry, s, (long) nfr);
+      got = cubeb_planar_data_callback(s->planar, s->data_cb, s, s->user_ptr,
+                                       s->record.buf, s->play.buf, nfr);
+      CUBEB_PROBE2(data_callback_exit, s, got);
+      uint64_t end = cubeb_stream_stats_callback_end(s->stats, start, nfr, got);
+      cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, got, 0);
+      CUBEB_RT_END();
       if (got == CUBEB_ERROR) {
         state = CUBEB_STATE_ERROR;
         goto breakdown;
@@ -909,6 +971,8 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
           state = CUBEB_STATE_ERROR;
           goto breakdown;
         }
+        cubeb_stream_stats_phase(s->stats, CUBEB_BACKEND_PHASE_WRITE, end,
+                                 cubeb_stream_stats_now());
       }
       if (drain) {
         state = CUBEB_STATE_DRAINED;
@@ -925,6 +989,7 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
         state = CUBEB_STATE_ERROR;
         goto breakdown;
       }
+      wakeup = cubeb_stream_stats_now();
 
       audio_buf_info bi;
       if (ioctl(s->record.fd, SNDCTL_DSP_GETISPACE, &bi) == -1) {
@@ -933,6 +998,7 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
       }
 
       mfr = (bi.fragsize * bi.fragments) / s->record.frame_size;
+      cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_AVAIL, mfr, 0);
       if (nfr > mfr)
         nfr = mfr;
     }
@@ -944,6 +1010,7 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
         state = CUBEB_STATE_ERROR;
         goto breakdown;
       }
+      wakeup = cubeb_stream_stats_now();
 
       audio_buf_info bi;
       if (ioctl(s->play.fd, SNDCTL_DSP_GETOSPACE, &bi) == -1) {
@@ -952,9 +1019,12 @@ oss_audio_loop(cubeb_stream * s, cubeb_state *new_state)
       }
 
       mfr = (bi.fragsize * bi.fragments) / s->play.frame_size;
+      cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_AVAIL, mfr, 0);
       if (nfr > mfr)
         nfr = mfr;
     }
+
+    oss_update_xruns(s);
   }
 
   return 1;
@@ -974,6 +1044,7 @@ oss_io_routine(void *arg)
   cubeb_state new_state;
   int stopped;
 
+  cubeb_thread_register(s->context, "cubeb-oss");
   do {
     pthread_mutex_lock(&s->mtx);
     if (s->destroying) {
@@ -985,8 +1056,14 @@ oss_io_routine(void *arg)
     stopped = oss_audio_loop(s, &new_state);
     if (s->record.fd != -1)
       ioctl(s->record.fd, SNDCTL_DSP_HALT_INPUT, NULL);
-    if (!stopped)
+    if (!stopped) {
+      cubeb_flight_recorder_record(s->recorder, CUBEB_FLIGHT_EVENT_STATE, new_state, 0);
+      if (new_state == CUBEB_STATE_ERROR) {
+        cubeb_flight_recorder_dump(s->recorder);
+      }
+      CUBEB_PROBE2(state_change, s, new_state);
       s->state_cb(s, s->user_ptr, new_state);
+    }
 
     pthread_mutex_lock(&s->mtx);
     pthread_cond_signal(&s->stopped_cv);
@@ -996,11 +1073,13 @@ oss_io_routine(void *arg)
     }
     while (!s->doorbell) {
       pthread_cond_wait(&s->doorbell_cv, &s->mtx);
+      cubeb_thread_wakeup();
     }
     s->doorbell = false;
     pthread_mutex_unlock(&s->mtx);
   } while (1);
 
+  cubeb_thread_unregister();
   pthread_mutex_lock(&s->mtx);
   s->thread_created = false;
   pthread_mutex_unlock(&s->mtx);
@@ -1044,11 +1123,15 @@ oss_stream_init(cubeb * context,
   if (!(defdsp = getenv(ENV_AUDIO_DEVICE)) || *defdsp == '\0')
     defdsp = OSS_DEFAULT_DEVICE;
 
-  (void)stream_name;
   if ((s = calloc(1, sizeof(cubeb_stream))) == NULL) {
     ret = CUBEB_ERROR;
     goto error;
   }
+  s->recorder = cubeb_flight_recorder_create(stream_name);
+  s->glitches = cubeb_glitch_notifier_create();
+  s->stats = cubeb_stream_stats_counters_create(
+    output_stream_params ? output_stream_params->rate : input_stream_params->rate,
+    s->glitches);
   s->state = CUBEB_STATE_STOPPED;
   s->record.fd = s->play.fd = -1;
   s->nfr = latency_frames;
@@ -1190,6 +1273,11 @@ oss_stream_init(cubeb * context,
       goto error;
     }
   }
+  if (cubeb_planar_adapter_create(input_stream_params, output_stream_params,
+                                  s->bufframes, &s->planar) != CUBEB_OK) {
+    ret = CUBEB_ERROR;
+    goto error;
+  }
 
   *stream = s;
   return CUBEB_OK;
@@ -1200,6 +1288,46 @@ error:
   return ret;
 }
 
+static int
+oss_stream_dump_flight_recorder(cubeb_stream * s)
+{
+  cubeb_flight_recorder_dump(s->recorder);
+  return CUBEB_OK;
+}
+
+static int
+oss_stream_get_stats(cubeb_stream * s, cubeb_stream_stats * stats)
+{
+  cubeb_stream_stats_counters_get(&s->stats, 1, stats);
+  return CUBEB_OK;
+}
+
+static int
+oss_stream_get_callback_histograms(cubeb_stream * s,
+                                   cubeb_callback_histograms * histograms)
+{
+  cubeb_stream_stats_counters_get_histograms(&s->stats, 1, histograms);
+  return CUBEB_OK;
+}
+
+static int
+oss_stream_register_glitch_callback(cubeb_stream * s,
+                                    cubeb_glitch_callback glitch_callback)
+{
+  cubeb_glitch_notifier_set_callback(s->glitches, s, glitch_callback,
+                                     s->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+oss_stream_register_load_callback(cubeb_stream * s, float threshold,
+                                  cubeb_load_callback load_callback)
+{
+  cubeb_glitch_notifier_set_load_callback(s->glitches, s, load_callback,
+                                          threshold, s->user_ptr);
+  return CUBEB_OK;
+}
+
 static int
 oss_stream_thr_create(cubeb_stream * s)
 {
@@ -1220,12 +1348,15 @@ oss_stream_thr_create(cubeb_stream * s)
 static int
 oss_stream_start(cubeb_stream * s)
 {
+  CUBEB_PROBE2(state_change, s, CUBEB_STATE_STARTED);
   s->state_cb(s, s->user_ptr, CUBEB_STATE_STARTED);
   pthread_mutex_lock(&s->mtx);
   /* Disallow starting an already started stream */
   assert(!s->running && s->state != CUBEB_STATE_STARTED);
+  cubeb_stream_stats_started(s->stats);
   if (oss_stream_thr_create(s) != CUBEB_OK) {
     pthread_mutex_unlock(&s->mtx);
+    CUBEB_PROBE2(state_change, s, CUBEB_STATE_ERROR);
     s->state_cb(s, s->user_ptr, CUBEB_STATE_ERROR);
     return CUBEB_ERROR;
   }
@@ -1317,4 +1448,12 @@ static struct cubeb_ops const oss_ops = {
     .stream_get_current_device = oss_get_current_device,
     .stream_device_destroy = oss_stream_device_destroy,
     .stream_register_device_changed_callback = NULL,
-    .register_device_collection_changed = NULL};
+    .register_device_collection_changed = NULL,
+    .stream_dump_flight_recorder = oss_stream_dump_flight_recorder,
+    .stream_get_stats = oss_stream_get_stats,
+    .stream_register_glitch_callback = oss_stream_register_glitch_callback,
+    .stream_register_load_callback = oss_stream_register_load_callback,
+    .stream_get_callback_histograms = oss_stream_get_callback_histograms,
+    .set_clock_mode = NULL,
+    .advance_clock = NULL,
+    .set_offline_params = NULL};
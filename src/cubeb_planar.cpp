@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_planar.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+#include <vector>
+#include "cubeb-internal.h"
+#include "cubeb_utils.h"
+
+namespace {
+
+template<typename T>
+void
+interleave(T const * const * channels, uint32_t channel_count, T * interleaved,
+           long frames)
+{
+  for (uint32_t c = 0; c < channel_count; c++) {
+    T const * channel = channels[c];
+    for (long f = 0; f < frames; f++) {
+      interleaved[f * channel_count + c] = channel[f];
+    }
+  }
+}
+
+template<typename T>
+void
+deinterleave(T const * interleaved, uint32_t channel_count, T * const * channels,
+             long frames)
+{
+  for (uint32_t c = 0; c < channel_count; c++) {
+    T * channel = channels[c];
+    for (long f = 0; f < frames; f++) {
+      channel[f] = interleaved[f * channel_count + c];
+    }
+  }
+}
+
+/** The buffers of a direction of a stream. */
+struct planar_buffers {
+  bool planar = false;
+  uint32_t channels = 0;
+  size_t sample_size = 0;
+  std::vector<uint8_t> samples;
+  std::vector<void *> pointers;
+
+  void init(cubeb_stream_params const * params, long frames)
+  {
+    if (!params) {
+      return;
+    }
+    planar = params->prefs & CUBEB_STREAM_PREF_PLANAR;
+    channels = params->channels;
+    sample_size = cubeb_sample_size(params->format);
+    if (planar) {
+      samples.resize(channels * frames * sample_size);
+      pointers.resize(channels);
+      for (uint32_t c = 0; c < channels; c++) {
+        pointers[c] = samples.data() + c * frames * sample_size;
+      }
+    }
+  }
+
+  size_t frame_size() const
+  {
+    return channels * sample_size;
+  }
+};
+
+} // namespace
+
+struct cubeb_planar_adapter {
+  /* Frames of the buffers. Longer callbacks are split. */
+  long frames;
+  planar_buffers input;
+  planar_buffers output;
+};
+
+int
+cubeb_planar_adapter_create(cubeb_stream_params const * input_params,
+                            cubeb_stream_params const * output_params,
+                            long frames, cubeb_planar_adapter ** adapter)
+{
+  *adapter = nullptr;
+  if (!(input_params && (input_params->prefs & CUBEB_STREAM_PREF_PLANAR)) &&
+      !(output_params && (output_params->prefs & CUBEB_STREAM_PREF_PLANAR))) {
+    return CUBEB_OK;
+  }
+  cubeb_planar_adapter * a = new (std::nothrow) cubeb_planar_adapter();
+  if (!a) {
+    return CUBEB_ERROR;
+  }
+  a->frames = std::max(frames, 1l);
+  a->input.init(input_params, a->frames);
+  a->output.init(output_params, a->frames);
+  *adapter = a;
+  return CUBEB_OK;
+}
+
+void
+cubeb_planar_adapter_destroy(cubeb_planar_adapter * adapter)
+{
+  delete adapter;
+}
+
+long
+cubeb_planar_data_callback(cubeb_planar_adapter * adapter,
+                           cubeb_data_callback callback,
+                           cubeb_stream * stream, void * user_ptr,
+                           void const * input_buffer, void * output_buffer,
+                           long nframes)
+{
+  if (!adapter) {
+    return callback(stream, user_ptr, input_buffer, output_buffer, nframes);
+  }
+  /* The buffers are not resized here, on the audio thread: the callback is
+     called as many times as needed instead. */
+  long done = 0;
+  while (done < nframes) {
+    long chunk = std::min(nframes - done, adapter->frames);
+    void const * input = nullptr;
+    void * output = nullptr;
+    if (input_buffer) {
+      input = static_cast<uint8_t const *>(input_buffer) +
+              done * adapter->input.frame_size();
+      if (adapter->input.planar) {
+        cubeb_planar_deinterleave(input, adapter->input.channels,
+                                  adapter->input.sample_size,
+                                  adapter->input.pointers.data(), chunk);
+        input = adapter->input.pointers.data();
+      }
+    }
+    if (output_buffer) {
+      output = static_cast<uint8_t *>(output_buffer) +
+               done * adapter->output.frame_size();
+    }
+    long got = callback(stream, user_ptr, input,
+                        output && adapter->output.planar
+                          ? adapter->output.pointers.data() : output,
+                        chunk);
+    if (got < 0 || got > chunk) {
+      return got;
+    }
+    if (output && adapter->output.planar) {
+      cubeb_planar_interleave(adapter->output.pointers.data(),
+                              adapter->output.channels,
+                              adapter->output.sample_size, output, got);
+    }
+    done += got;
+    if (got < chunk) {
+      break;
+    }
+  }
+  return done;
+}
+
+void
+cubeb_planar_interleave(void const * const * channels, uint32_t channel_count,
+                        size_t sample_size, void * interleaved, long frames)
+{
+  /* All the sample formats are 16 or 32-bit. */
+  if (sample_size == sizeof(int16_t)) {
+    interleave(reinterpret_cast<int16_t const * const *>(channels), channel_count,
+               static_cast<int16_t *>(interleaved), frames);
+  } else {
+    XASSERT(sample_size == sizeof(int32_t));
+    interleave(reinterpret_cast<int32_t const * const *>(channels), channel_count,
+               static_cast<int32_t *>(interleaved), frames);
+  }
+}
+
+void
+cubeb_planar_deinterleave(void const * interleaved, uint32_t channel_count,
+                          size_t sample_size, void * const * channels,
+                          long frames)
+{
+  if (sample_size == sizeof(int16_t)) {
+    deinterleave(static_cast<int16_t const *>(interleaved), channel_count,
+                 reinterpret_cast<int16_t * const *>(channels), frames);
+  } else {
+    XASSERT(sample_size == sizeof(int32_t));
+    deinterleave(static_cast<int32_t const *>(interleaved), channel_count,
+                 reinterpret_cast<int32_t * const *>(channels), frames);
+  }
+}
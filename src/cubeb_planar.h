@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_PLANAR_H
+#define CUBEB_PLANAR_H
+
+#include "cubeb/cubeb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Support for CUBEB_STREAM_PREF_PLANAR in the backends that work on
+   interleaved buffers: the adapter deinterleaves the input before calling the
+   data callback, and interleaves the output it rendered. */
+
+typedef struct cubeb_planar_adapter cubeb_planar_adapter;
+
+/** Create an adapter if a direction of a stream is planar.
+    @param input_params The parameters of the input of the stream, or NULL.
+    @param output_params The parameters of the output of the stream, or NULL.
+    @param frames The number of frames of the buffers, the maximum number of
+                  frames the backend asks for in a callback. Longer callbacks
+                  are split, so that calling the data callback never
+                  allocates.
+    @param adapter Set to the adapter, or to NULL if the stream isn't planar.
+    @retval CUBEB_OK
+    @retval CUBEB_ERROR if the adapter could not be allocated. */
+int cubeb_planar_adapter_create(cubeb_stream_params const * input_params,
+                                cubeb_stream_params const * output_params,
+                                long frames,
+                                cubeb_planar_adapter ** adapter);
+/** Destroy an adapter. NULL is ignored. */
+void cubeb_planar_adapter_destroy(cubeb_planar_adapter * adapter);
+
+/** Call a data callback with interleaved buffers of the backend, converting
+    them to the layout of the stream. Calls it directly without an adapter. */
+long cubeb_planar_data_callback(cubeb_planar_adapter * adapter,
+                                cubeb_data_callback callback,
+                                cubeb_stream * stream, void * user_ptr,
+                                void const * input_buffer, void * output_buffer,
+                                long nframes);
+
+/** Copy `frames` frames from the buffers of each channel to an interleaved
+    buffer. */
+void cubeb_planar_interleave(void const * const * channels,
+                             uint32_t channel_count, size_t sample_size,
+                             void * interleaved, long frames);
+/** Copy `frames` frames from an interleaved buffer to the buffers of each
+    channel. */
+void cubeb_planar_deinterleave(void const * interleaved,
+                               uint32_t channel_count, size_t sample_size,
+                               void * const * channels, long frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUBEB_PLANAR_H
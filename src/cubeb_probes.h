@@ -0,0 +1,47 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_PROBES_H
+#define CUBEB_PROBES_H
+
+/* USDT probes, for bpftrace, perf or SystemTap. They are built when
+   configuring with -DCUBEB_USDT_PROBES=ON, and compile to a single nop
+   instruction that is patched when a tracer attaches to the probe. Probes
+   are in the "cubeb" provider, and take these arguments:
+
+   data_callback_entry(cubeb_stream *, long frames)
+   data_callback_exit(cubeb_stream *, long frames)
+     Around the calls to the data callback of the user, with the number of
+     frames requested, and the number of frames returned.
+   resampler_fill_entry(cubeb_resampler *, long frames)
+   resampler_fill_exit(cubeb_resampler *, long frames)
+     Around cubeb_resampler_fill, with the number of output frames requested,
+     and the number of frames returned.
+   xrun(cubeb_stream *, cubeb_glitch_type, cubeb_device_type, uint64_t frames)
+     When a backend recovers from an underrun or an overrun, with the number
+     of frames lost, when known.
+   state_change(cubeb_stream *, cubeb_state)
+     Before calling the state callback of the user.
+
+   For example, the distribution of the duration of the data callbacks can
+   be measured with:
+
+   bpftrace -e 'usdt:libcubeb.so:cubeb:data_callback_entry
+                { @start[tid] = nsecs; }
+                usdt:libcubeb.so:cubeb:data_callback_exit /@start[tid]/
+                { @us = hist((nsecs - @start[tid]) / 1000); delete(@start[tid]); }' */
+
+#if defined(CUBEB_USDT_PROBES)
+#include <sys/sdt.h>
+#define CUBEB_PROBE2(name, a, b) DTRACE_PROBE2(cubeb, name, a, b)
+#define CUBEB_PROBE4(name, a, b, c, d) DTRACE_PROBE4(cubeb, name, a, b, c, d)
+#else
+#define CUBEB_PROBE2(name, a, b) do { } while (0)
+#define CUBEB_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif // CUBEB_PROBES_H
@@ -13,6 +13,13 @@
 #include <string.h>
 #include "cubeb-internal.h"
 #include "cubeb/cubeb.h"
+#include "cubeb_flight_recorder.h"
+#include "cubeb_glitch.h"
+#include "cubeb_planar.h"
+#include "cubeb_probes.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_stream_stats.h"
+#include "cubeb_trace.h"
 #include "cubeb_mixer.h"
 #include "cubeb_strings.h"
 
@@ -87,6 +94,8 @@
   X(pa_get_library_version)                     \
   X(pa_channel_map_init_auto)                   \
   X(pa_stream_set_name)                         \
+  X(pa_stream_set_underflow_callback)           \
+  X(pa_stream_set_overflow_callback)            \
 
 #define MAKE_TYPEDEF(x) static typeof(x) * cubeb_##x;
 LIBPULSE_API_VISIT(MAKE_TYPEDEF);
@@ -135,6 +144,12 @@ struct cubeb_stream {
   int shutdown;
   float volume;
   cubeb_state state;
+  /* Converts the buffers of planar streams. */
+  cubeb_planar_adapter * planar;
+  /* Last events of the stream, logged when it errors. */
+  cubeb_flight_recorder * recorder;
+  cubeb_stream_stats_counters * stats;
+  cubeb_glitch_notifier * glitches;
 };
 
 static const float PULSE_NO_GAIN = -1.0;
@@ -219,6 +234,11 @@ static void
 stream_state_change_callback(cubeb_stream * stm, cubeb_state s)
 {
   stm->state = s;
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_STATE, s, 0);
+  if (s == CUBEB_STATE_ERROR) {
+    cubeb_flight_recorder_dump(stm->recorder);
+  }
+  CUBEB_PROBE2(state_change, stm, s);
   stm->state_callback(stm, stm->user_ptr, s);
 }
 
@@ -256,6 +276,7 @@ trigger_user_callback(pa_stream * s, void const * input_data, size_t nbytes, cub
   size_t towrite, read_offset;
   size_t frame_size;
 
+  CUBEB_TRACE_BEGIN("trigger_user_callback");
   frame_size = WRAP(pa_frame_size)(&stm->output_sample_spec);
   assert(nbytes % frame_size == 0);
 
@@ -263,17 +284,29 @@ trigger_user_callback(pa_stream * s, void const * input_data, size_t nbytes, cub
   read_offset = 0;
   while (towrite) {
     size = towrite;
+    uint64_t phase_start = cubeb_stream_stats_now();
     r = WRAP(pa_stream_begin_write)(s, &buffer, &size);
     // Note: this has failed running under rr on occassion - needs investigation.
     assert(r == 0);
     assert(size > 0);
     assert(size % frame_size == 0);
 
-    LOGV("Trigger user callback with output buffer size=%zd, read_offset=%zd", size, read_offset);
-    got = stm->data_callback(stm, stm->user_ptr, (uint8_t const *)input_data + read_offset, buffer, size / frame_size);
+    LOGV_HOT(BACKEND, "Trigger user callback with output buffer size=%zd, read_offset=%zd", size, read_offset);
+    CUBEB_RT_BEGIN();
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, size / frame_size, 0);
+    uint64_t start = cubeb_stream_stats_callback_start(stm->stats);
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+    CUBEB_PROBE2(data_callback_entry, stm, (long) (size / frame_size));
+    got = cubeb_planar_data_callback(stm->planar, stm->data_callback, stm, stm->user_ptr,
+                                     (uint8_t const *)input_data + read_offset, buffer, size / frame_size);
+    CUBEB_PROBE2(data_callback_exit, stm, got);
+    uint64_t end = cubeb_stream_stats_callback_end(stm->stats, start, size / frame_size, got);
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, got, 0);
+    CUBEB_RT_END();
     if (got < 0) {
       WRAP(pa_stream_cancel_write)(s);
       stm->shutdown = 1;
+      CUBEB_TRACE_END("trigger_user_callback");
       return;
     }
     // If more iterations move offset of read buffer
@@ -301,6 +334,9 @@ trigger_user_callback(pa_stream * s, void const * input_data, size_t nbytes, cub
 
     r = WRAP(pa_stream_write)(s, buffer, got * frame_size, NULL, 0, PA_SEEK_RELATIVE);
     assert(r == 0);
+    /* Includes applying the volume. */
+    cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_WRITE, end,
+                             cubeb_stream_stats_now());
 
     if ((size_t) got < size / frame_size) {
       pa_usec_t latency = 0;
@@ -315,6 +351,7 @@ trigger_user_callback(pa_stream * s, void const * input_data, size_t nbytes, cub
       assert(!stm->drain_timer);
       stm->drain_timer = WRAP(pa_context_rttime_new)(stm->context->context, WRAP(pa_rtclock_now)() + 2 * latency, stream_drain_callback, stm);
       stm->shutdown = 1;
+      CUBEB_TRACE_END("trigger_user_callback");
       return;
     }
 
@@ -322,6 +359,7 @@ trigger_user_callback(pa_stream * s, void const * input_data, size_t nbytes, cub
   }
 
   assert(towrite == 0);
+  CUBEB_TRACE_END("trigger_user_callback");
 }
 
 static int
@@ -339,7 +377,7 @@ read_from_input(pa_stream * s, void const ** buffer, size_t * size)
 static void
 stream_write_callback(pa_stream * s, size_t nbytes, void * u)
 {
-  LOGV("Output callback to be written buffer size %zd", nbytes);
+  LOGV_HOT(BACKEND, "Output callback to be written buffer size %zd", nbytes);
   cubeb_stream * stm = u;
   if (stm->shutdown ||
       stm->state != CUBEB_STATE_STARTED) {
@@ -350,6 +388,8 @@ stream_write_callback(pa_stream * s, size_t nbytes, void * u)
     // Output/playback only operation.
     // Write directly to output
     assert(!stm->input_stream && stm->output_stream);
+    cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_AVAIL,
+                                 nbytes / WRAP(pa_frame_size)(&stm->output_sample_spec), 0);
     trigger_user_callback(s, NULL, nbytes, stm);
   }
 }
@@ -357,7 +397,7 @@ stream_write_callback(pa_stream * s, size_t nbytes, void * u)
 static void
 stream_read_callback(pa_stream * s, size_t nbytes, void * u)
 {
-  LOGV("Input callback buffer size %zd", nbytes);
+  LOGV_HOT(BACKEND, "Input callback buffer size %zd", nbytes);
   cubeb_stream * stm = u;
   if (stm->shutdown) {
     return;
@@ -365,11 +405,13 @@ stream_read_callback(pa_stream * s, size_t nbytes, void * u)
 
   void const * read_data = NULL;
   size_t read_size;
+  uint64_t phase_start = cubeb_stream_stats_now();
   while (read_from_input(s, &read_data, &read_size) > 0) {
     /* read_data can be NULL in case of a hole. */
     if (read_data) {
       size_t in_frame_size = WRAP(pa_frame_size)(&stm->input_sample_spec);
       size_t read_frames = read_size / in_frame_size;
+      cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_AVAIL, read_frames, 0);
 
       if (stm->output_stream) {
         // input/capture + output/playback operation
@@ -379,7 +421,17 @@ stream_read_callback(pa_stream * s, size_t nbytes, void * u)
         trigger_user_callback(stm->output_stream, read_data, write_size, stm);
       } else {
         // input/capture only operation. Call callback directly
-        long got = stm->data_callback(stm, stm->user_ptr, read_data, NULL, read_frames);
+        CUBEB_RT_BEGIN();
+        cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, read_frames, 0);
+        uint64_t start = cubeb_stream_stats_callback_start(stm->stats);
+        cubeb_stream_stats_phase(stm->stats, CUBEB_BACKEND_PHASE_PREPARE, phase_start, start);
+        CUBEB_PROBE2(data_callback_entry, stm, (long) read_frames);
+        long got = cubeb_planar_data_callback(stm->planar, stm->data_callback, stm,
+                                              stm->user_ptr, read_data, NULL, read_frames);
+        CUBEB_PROBE2(data_callback_exit, stm, got);
+        cubeb_stream_stats_callback_end(stm->stats, start, read_frames, got);
+        cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, got, 0);
+        CUBEB_RT_END();
         if (got < 0 || (size_t) got != read_frames) {
           WRAP(pa_stream_cancel_write)(s);
           stm->shutdown = 1;
@@ -394,9 +446,36 @@ stream_read_callback(pa_stream * s, size_t nbytes, void * u)
     if (stm->shutdown) {
       return;
     }
+    phase_start = cubeb_stream_stats_now();
   }
 }
 
+static void
+stream_underflow_callback(pa_stream * s, void * u)
+{
+  (void)s;
+  cubeb_stream * stm = u;
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+  cubeb_stream_stats_underrun(stm->stats, 1);
+  cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_UNDERRUN,
+                      CUBEB_DEVICE_TYPE_OUTPUT, 0);
+  CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT,
+               (uint64_t) 0);
+}
+
+static void
+stream_overflow_callback(pa_stream * s, void * u)
+{
+  (void)s;
+  cubeb_stream * stm = u;
+  cubeb_flight_recorder_record(stm->recorder, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+  cubeb_stream_stats_overrun(stm->stats, 1);
+  cubeb_glitch_report(stm->glitches, CUBEB_GLITCH_OVERRUN,
+                      CUBEB_DEVICE_TYPE_INPUT, 0);
+  CUBEB_PROBE4(xrun, stm, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT,
+               (uint64_t) 0);
+}
+
 static int
 wait_until_context_ready(cubeb * ctx)
 {
@@ -917,8 +996,19 @@ pulse_stream_init(cubeb * context,
   stm->user_ptr = user_ptr;
   stm->volume = PULSE_NO_GAIN;
   stm->state = -1;
+  stm->recorder = cubeb_flight_recorder_create(stream_name);
+  stm->glitches = cubeb_glitch_notifier_create();
+  stm->stats = cubeb_stream_stats_counters_create(
+    output_stream_params ? output_stream_params->rate : input_stream_params->rate,
+    stm->glitches);
   assert(stm->shutdown == 0);
 
+  if (cubeb_planar_adapter_create(input_stream_params, output_stream_params,
+                                  latency_frames, &stm->planar) != CUBEB_OK) {
+    pulse_stream_destroy(stm);
+    return CUBEB_ERROR;
+  }
+
   WRAP(pa_threaded_mainloop_lock)(stm->context->mainloop);
   if (output_stream_params) {
     r = create_pa_stream(stm, &stm->output_stream, output_stream_params, stream_name);
@@ -932,6 +1022,7 @@ pulse_stream_init(cubeb * context,
 
     WRAP(pa_stream_set_state_callback)(stm->output_stream, stream_state_callback, stm);
     WRAP(pa_stream_set_write_callback)(stm->output_stream, stream_write_callback, stm);
+    WRAP(pa_stream_set_underflow_callback)(stm->output_stream, stream_underflow_callback, stm);
 
     battr = set_buffering_attribute(latency_frames, &stm->output_sample_spec);
     WRAP(pa_stream_connect_playback)(stm->output_stream,
@@ -955,6 +1046,7 @@ pulse_stream_init(cubeb * context,
 
     WRAP(pa_stream_set_state_callback)(stm->input_stream, stream_state_callback, stm);
     WRAP(pa_stream_set_read_callback)(stm->input_stream, stream_read_callback, stm);
+    WRAP(pa_stream_set_overflow_callback)(stm->input_stream, stream_overflow_callback, stm);
 
     battr = set_buffering_attribute(latency_frames, &stm->input_sample_spec);
     WRAP(pa_stream_connect_record)(stm->input_stream,
@@ -978,7 +1070,7 @@ pulse_stream_init(cubeb * context,
     return CUBEB_ERROR;
   }
 
-  if (g_cubeb_log_level) {
+  if (CUBEB_LOG_ENABLED(BACKEND, CUBEB_LOG_NORMAL)) {
     if (output_stream_params){
       const pa_buffer_attr * output_att;
       output_att = WRAP(pa_stream_get_buffer_attr)(stm->output_stream);
@@ -1015,6 +1107,7 @@ pulse_stream_destroy(cubeb_stream * stm)
 
     WRAP(pa_stream_set_state_callback)(stm->output_stream, NULL, NULL);
     WRAP(pa_stream_set_write_callback)(stm->output_stream, NULL, NULL);
+    WRAP(pa_stream_set_underflow_callback)(stm->output_stream, NULL, NULL);
     WRAP(pa_stream_disconnect)(stm->output_stream);
     WRAP(pa_stream_unref)(stm->output_stream);
   }
@@ -1022,15 +1115,60 @@ pulse_stream_destroy(cubeb_stream * stm)
   if (stm->input_stream) {
     WRAP(pa_stream_set_state_callback)(stm->input_stream, NULL, NULL);
     WRAP(pa_stream_set_read_callback)(stm->input_stream, NULL, NULL);
+    WRAP(pa_stream_set_overflow_callback)(stm->input_stream, NULL, NULL);
     WRAP(pa_stream_disconnect)(stm->input_stream);
     WRAP(pa_stream_unref)(stm->input_stream);
   }
   WRAP(pa_threaded_mainloop_unlock)(stm->context->mainloop);
 
+  cubeb_planar_adapter_destroy(stm->planar);
+  cubeb_flight_recorder_destroy(stm->recorder);
+  cubeb_stream_stats_counters_destroy(stm->stats);
+  cubeb_glitch_notifier_destroy(stm->glitches);
   LOG("Cubeb stream (%p) destroyed successfully.", stm);
   free(stm);
 }
 
+static int
+pulse_stream_dump_flight_recorder(cubeb_stream * stm)
+{
+  cubeb_flight_recorder_dump(stm->recorder);
+  return CUBEB_OK;
+}
+
+static int
+pulse_stream_get_stats(cubeb_stream * stm, cubeb_stream_stats * stats)
+{
+  cubeb_stream_stats_counters_get(&stm->stats, 1, stats);
+  return CUBEB_OK;
+}
+
+static int
+pulse_stream_get_callback_histograms(cubeb_stream * stm,
+                                     cubeb_callback_histograms * histograms)
+{
+  cubeb_stream_stats_counters_get_histograms(&stm->stats, 1, histograms);
+  return CUBEB_OK;
+}
+
+static int
+pulse_stream_register_glitch_callback(cubeb_stream * stm,
+                                      cubeb_glitch_callback glitch_callback)
+{
+  cubeb_glitch_notifier_set_callback(stm->glitches, stm, glitch_callback,
+                                     stm->user_ptr);
+  return CUBEB_OK;
+}
+
+static int
+pulse_stream_register_load_callback(cubeb_stream * stm, float threshold,
+                                    cubeb_load_callback load_callback)
+{
+  cubeb_glitch_notifier_set_load_callback(stm->glitches, stm, load_callback,
+                                          threshold, stm->user_ptr);
+  return CUBEB_OK;
+}
+
 static void
 pulse_defer_event_cb(pa_mainloop_api * a, void * userdata)
 {
@@ -1047,6 +1185,7 @@ static int
 pulse_stream_start(cubeb_stream * stm)
 {
   stm->shutdown = 0;
+  cubeb_stream_stats_started(stm->stats);
   stream_cork(stm, UNCORK | NOTIFY);
 
   if (stm->output_stream && !stm->input_stream) {
@@ -1521,7 +1660,7 @@ pulse_subscribe_callback(pa_context * ctx,
   case PA_SUBSCRIPTION_EVENT_SOURCE:
   case PA_SUBSCRIPTION_EVENT_SINK:
 
-    if (g_cubeb_log_level) {
+    if (CUBEB_LOG_ENABLED(BACKEND, CUBEB_LOG_NORMAL)) {
       if ((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == PA_SUBSCRIPTION_EVENT_SOURCE &&
           (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
         LOG("Removing source index %d", index);
@@ -1633,5 +1772,13 @@ static struct cubeb_ops const pulse_ops = {
   .stream_get_current_device = pulse_stream_get_current_device,
   .stream_device_destroy = pulse_stream_device_destroy,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = pulse_register_device_collection_changed
+  .register_device_collection_changed = pulse_register_device_collection_changed,
+  .stream_dump_flight_recorder = pulse_stream_dump_flight_recorder,
+  .stream_get_stats = pulse_stream_get_stats,
+  .stream_register_glitch_callback = pulse_stream_register_glitch_callback,
+  .stream_register_load_callback = pulse_stream_register_load_callback,
+  .stream_get_callback_histograms = pulse_stream_get_callback_histograms,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
@@ -17,6 +17,9 @@
 #include "cubeb_resampler.h"
 #include "cubeb-speex-resampler.h"
 #include "cubeb_resampler_internal.h"
+#include "cubeb_probes.h"
+#include "cubeb_rt_check.h"
+#include "cubeb_trace.h"
 #include "cubeb_utils.h"
 
 int
@@ -40,6 +43,10 @@ uint32_t min_buffered_audio_frame(uint32_t sample_rate)
   return sample_rate / 20;
 }
 
+/* Frames of the buffers converting the layout of planar streams. The data
+   callback is called several times when the resampler asks for more. */
+static const long PLANAR_BUFFER_FRAMES = 2048;
+
 template<typename T>
 passthrough_resampler<T>::passthrough_resampler(cubeb_stream * s,
                                                 cubeb_data_callback cb,
@@ -52,6 +59,7 @@ passthrough_resampler<T>::passthrough_resampler(cubeb_stream * s,
   , user_ptr(ptr)
   , sample_rate(sample_rate)
 {
+  reserve(RESAMPLER_PREALLOCATED_FRAMES);
 }
 
 template<typename T>
@@ -105,7 +113,9 @@ long passthrough_resampler<T>::fill(void * input_buffer, long * input_frames_cou
     }
   }
 
+  CUBEB_PROBE2(data_callback_entry, stream, output_frames);
   long rv = data_callback(stream, user_ptr, in_buf, output_buffer, output_frames);
+  CUBEB_PROBE2(data_callback_exit, stream, rv);
 
   if (input_buffer) {
     if (pop_input_count) {
@@ -124,6 +134,63 @@ long passthrough_resampler<T>::fill(void * input_buffer, long * input_frames_cou
 template class passthrough_resampler<float>;
 template class passthrough_resampler<short>;
 
+planar_resampler::planar_resampler(cubeb_stream * s,
+                                   cubeb_stream_params const * input_params,
+                                   cubeb_stream_params const * output_params,
+                                   bool passthrough,
+                                   cubeb_data_callback cb,
+                                   void * ptr,
+                                   cubeb_planar_adapter * adapter)
+  : stream(s)
+  , callback(cb)
+  , user_ptr(ptr)
+  , adapter(adapter)
+  , passthrough(passthrough)
+  , input_planar(input_params && (input_params->prefs & CUBEB_STREAM_PREF_PLANAR))
+  , output_planar(output_params && (output_params->prefs & CUBEB_STREAM_PREF_PLANAR))
+{
+}
+
+planar_resampler::~planar_resampler()
+{
+  inner.reset();
+  cubeb_planar_adapter_destroy(adapter);
+}
+
+long
+planar_resampler::data_callback(cubeb_stream * stream, void * user_ptr,
+                                void const * input_buffer, void * output_buffer,
+                                long nframes)
+{
+  planar_resampler * resampler = static_cast<planar_resampler *>(user_ptr);
+  return cubeb_planar_data_callback(resampler->adapter, resampler->callback,
+                                    stream, resampler->user_ptr,
+                                    input_buffer, output_buffer, nframes);
+}
+
+long
+planar_resampler::fill_planar(void * const * input_channels_buffers,
+                              long * input_frames_count,
+                              void * const * output_channels_buffers,
+                              long output_frames)
+{
+  bool has_input = input_channels_buffers != nullptr;
+  bool has_output = output_channels_buffers != nullptr;
+  /* Resampled buffers are interleaved, the backend must use `fill`. */
+  if (!passthrough ||
+      (has_input && !input_planar) || (has_output && !output_planar) ||
+      (has_input && has_output && *input_frames_count != output_frames)) {
+    return CUBEB_ERROR;
+  }
+  long frames = has_output ? output_frames : *input_frames_count;
+  CUBEB_PROBE2(data_callback_entry, stream, frames);
+  /* The callback of a planar stream gets the arrays of channels. */
+  long rv = callback(stream, user_ptr, input_channels_buffers,
+                     const_cast<void **>(output_channels_buffers), frames);
+  CUBEB_PROBE2(data_callback_exit, stream, rv);
+  return rv;
+}
+
 template<typename T, typename InputProcessor, typename OutputProcessor>
 cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
   ::cubeb_resampler_speex(InputProcessor * input_processor,
@@ -164,6 +231,25 @@ cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
                                 out_buffer, output_frames_needed);
 }
 
+template<typename T, typename InputProcessor, typename OutputProcessor>
+void
+cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
+::reserve(long frames)
+{
+  /* The frames of the stream passed to the data callback, for `frames` frames
+   * of the backend, see `fill_internal_duplex`. */
+  size_t callback_frames = output_processor
+    ? output_processor->input_needed_for_output(frames)
+    : input_processor->output_for_input(frames) + 1;
+  if (input_processor) {
+    input_processor->reserve(frames, callback_frames);
+  }
+  if (output_processor) {
+    /* The output is written to the buffer of the backend. */
+    output_processor->reserve(callback_frames, 0);
+  }
+}
+
 template<typename T, typename InputProcessor, typename OutputProcessor>
 long
 cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
@@ -185,9 +271,11 @@ cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
     out_unprocessed =
       output_processor->input_buffer(output_frames_before_processing);
 
+    CUBEB_PROBE2(data_callback_entry, stream, output_frames_before_processing);
     got = data_callback(stream, user_ptr,
                         nullptr, out_unprocessed,
                         output_frames_before_processing);
+    CUBEB_PROBE2(data_callback_exit, stream, got);
 
     if (got < output_frames_before_processing) {
       draining = true;
@@ -232,8 +320,10 @@ cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
   resampled_input = input_processor->output(resampled_frame_count, &frames_resampled);
   *input_frames_count = frames_resampled;
 
+  CUBEB_PROBE2(data_callback_entry, stream, resampled_frame_count);
   long got = data_callback(stream, user_ptr,
                            resampled_input, nullptr, resampled_frame_count);
+  CUBEB_PROBE2(data_callback_exit, stream, got);
 
   /* Return the number of initial input frames or part of it.
   * Since output_frames_needed == 0 in input scenario, the only
@@ -290,9 +380,11 @@ cubeb_resampler_speex<T, InputProcessor, OutputProcessor>
     resampled_input = nullptr;
   }
 
+  CUBEB_PROBE2(data_callback_entry, stream, output_frames_before_processing);
   got = data_callback(stream, user_ptr,
                       resampled_input, out_unprocessed,
                       output_frames_before_processing);
+  CUBEB_PROBE2(data_callback_exit, stream, got);
 
   if (got < output_frames_before_processing) {
     draining = true;
@@ -336,6 +428,51 @@ cubeb_resampler_create(cubeb_stream * stream,
     format = output_params->format;
   }
 
+  if ((input_params && (input_params->prefs & CUBEB_STREAM_PREF_PLANAR)) ||
+      (output_params && (output_params->prefs & CUBEB_STREAM_PREF_PLANAR))) {
+    /* The data callback of the resampler converts the interleaved buffers to
+       the layout of the stream. */
+    cubeb_planar_adapter * adapter;
+    if (cubeb_planar_adapter_create(input_params, output_params,
+                                    PLANAR_BUFFER_FRAMES,
+                                    &adapter) != CUBEB_OK) {
+      return nullptr;
+    }
+    bool passthrough = (!input_params || input_params->rate == target_rate) &&
+                       (!output_params || output_params->rate == target_rate);
+    std::unique_ptr<planar_resampler> planar(
+      new planar_resampler(stream, input_params, output_params, passthrough,
+                           callback, user_ptr, adapter));
+    cubeb_resampler * resampler = nullptr;
+    switch(format) {
+      case CUBEB_SAMPLE_S16NE:
+        resampler = cubeb_resampler_create_internal<short>(stream,
+                                                           input_params,
+                                                           output_params,
+                                                           target_rate,
+                                                           planar_resampler::data_callback,
+                                                           planar.get(),
+                                                           quality);
+        break;
+      case CUBEB_SAMPLE_FLOAT32NE:
+        resampler = cubeb_resampler_create_internal<float>(stream,
+                                                           input_params,
+                                                           output_params,
+                                                           target_rate,
+                                                           planar_resampler::data_callback,
+                                                           planar.get(),
+                                                           quality);
+        break;
+      default:
+        assert(false);
+    }
+    if (!resampler) {
+      return nullptr;
+    }
+    planar->set_resampler(resampler);
+    return planar.release();
+  }
+
   switch(format) {
     case CUBEB_SAMPLE_S16NE:
       return cubeb_resampler_create_internal<short>(stream,
@@ -366,8 +503,35 @@ cubeb_resampler_fill(cubeb_resampler * resampler,
                      void * output_buffer,
                      long output_frames_needed)
 {
-  return resampler->fill(input_buffer, input_frames_count,
-                         output_buffer, output_frames_needed);
+  CUBEB_TRACE_SCOPE("cubeb_resampler_fill");
+  CUBEB_RT_SCOPE();
+  CUBEB_PROBE2(resampler_fill_entry, resampler, output_frames_needed);
+  long rv = resampler->fill(input_buffer, input_frames_count,
+                            output_buffer, output_frames_needed);
+  CUBEB_PROBE2(resampler_fill_exit, resampler, rv);
+  return rv;
+}
+
+long
+cubeb_resampler_fill_planar(cubeb_resampler * resampler,
+                            void * const * input_channels,
+                            long * input_frames_count,
+                            void * const * output_channels,
+                            long output_frames_needed)
+{
+  CUBEB_TRACE_SCOPE("cubeb_resampler_fill_planar");
+  CUBEB_RT_SCOPE();
+  CUBEB_PROBE2(resampler_fill_entry, resampler, output_frames_needed);
+  long rv = resampler->fill_planar(input_channels, input_frames_count,
+                                   output_channels, output_frames_needed);
+  CUBEB_PROBE2(resampler_fill_exit, resampler, rv);
+  return rv;
+}
+
+void
+cubeb_resampler_reserve(cubeb_resampler * resampler, long frames)
+{
+  resampler->reserve(frames);
 }
 
 void
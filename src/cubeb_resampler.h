@@ -65,6 +65,31 @@ long cubeb_resampler_fill(cubeb_resampler * resampler,
                           void * output_buffer,
                           long output_frames_needed);
 
+/**
+ * Like cubeb_resampler_fill, for a backend whose buffers are planar: arrays of
+ * pointers to the samples of each channel. The buffers are handed to the data
+ * callback without copies, so this is only for streams that aren't resampled,
+ * whose directions all have CUBEB_STREAM_PREF_PLANAR, and whose input and
+ * output have as many frames. Other streams use cubeb_resampler_fill.
+ * @retval Number of frames that are actually produced.
+ * @retval CUBEB_ERROR on error, or if the buffers can't be handed over.
+ */
+long cubeb_resampler_fill_planar(cubeb_resampler * resampler,
+                                 void * const * input_channels,
+                                 long * input_frame_count,
+                                 void * const * output_channels,
+                                 long output_frames_needed);
+
+/**
+ * Size the buffers of the resampler for calls to cubeb_resampler_fill of up to
+ * `frames` frames, so that they don't allocate memory on the audio thread.
+ * They are sized for a few thousand frames when the resampler is created:
+ * backends with bigger callbacks call this before starting the stream.
+ * @param resampler A cubeb_resampler instance.
+ * @param frames The maximum number of frames of the backend passed at once.
+ */
+void cubeb_resampler_reserve(cubeb_resampler * resampler, long frames);
+
 /**
  * Destroy a cubeb_resampler.
  * @param resampler A cubeb_resampler instance.
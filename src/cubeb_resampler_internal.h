@@ -36,6 +36,7 @@ MOZ_END_STD_NAMESPACE
 #include "cubeb-speex-resampler.h"
 #include "cubeb_resampler.h"
 #include "cubeb_log.h"
+#include "cubeb_planar.h"
 #include <stdio.h>
 
 /* This header file contains the internal C++ API of the resamplers, for testing. */
@@ -47,11 +48,26 @@ MOZ_END_STD_NAMESPACE
 // @return A number of frames to keep.
 uint32_t min_buffered_audio_frame(uint32_t sample_rate);
 
+/** The buffers of the resampler are sized when it's created for callbacks of
+ * up to this many frames, so that they don't grow on the audio thread. Use
+ * `cubeb_resampler_reserve` for bigger callbacks. */
+const uint32_t RESAMPLER_PREALLOCATED_FRAMES = 4096;
+
 int to_speex_quality(cubeb_resampler_quality q);
 
 struct cubeb_resampler {
   virtual long fill(void * input_buffer, long * input_frames_count,
                     void * output_buffer, long frames_needed) = 0;
+  /** Only the resamplers of planar streams take planar buffers. */
+  virtual long fill_planar(void * const * /*input_channels*/,
+                           long * /*input_frames_count*/,
+                           void * const * /*output_channels*/,
+                           long /*frames_needed*/)
+  {
+    return CUBEB_ERROR;
+  }
+  /** Size the buffers for callbacks of up to `frames` frames. */
+  virtual void reserve(long /*frames*/) {}
   virtual long latency() = 0;
   virtual ~cubeb_resampler() {}
 };
@@ -63,6 +79,14 @@ public:
     : channels(channels)
   {}
 protected:
+  /** Grow `buffer` to at least `samples` samples. */
+  template<typename T>
+  static void reserve_samples(auto_array<T> & buffer, size_t samples)
+  {
+    if (buffer.capacity() < samples) {
+      buffer.reserve(samples);
+    }
+  }
   size_t frames_to_samples(size_t frames) const
   {
     return frames * channels;
@@ -89,6 +113,12 @@ public:
   virtual long fill(void * input_buffer, long * input_frames_count,
                     void * output_buffer, long output_frames);
 
+  virtual void reserve(long frames)
+  {
+    reserve_samples(internal_input_buffer, frames_to_samples(
+      min_buffered_audio_frame(sample_rate) + frames));
+  }
+
   virtual long latency()
   {
     return 0;
@@ -113,6 +143,66 @@ private:
   uint32_t sample_rate;
 };
 
+/** Resampler of a stream with planar buffers. It wraps a resampler working on
+ * interleaved buffers, whose data callback converts them to the layout of the
+ * stream. Backends with planar buffers can also hand them over when the
+ * stream isn't resampled: they go to the data callback without copies. */
+class planar_resampler : public cubeb_resampler {
+public:
+  planar_resampler(cubeb_stream * s,
+                   cubeb_stream_params const * input_params,
+                   cubeb_stream_params const * output_params,
+                   bool passthrough,
+                   cubeb_data_callback cb,
+                   void * ptr,
+                   cubeb_planar_adapter * adapter);
+  virtual ~planar_resampler();
+
+  /** Set the resampler working on interleaved buffers, created with
+   * `data_callback` and this as user pointer. */
+  void set_resampler(cubeb_resampler * resampler)
+  {
+    inner.reset(resampler);
+  }
+
+  virtual long fill(void * input_buffer, long * input_frames_count,
+                    void * output_buffer, long output_frames)
+  {
+    return inner->fill(input_buffer, input_frames_count,
+                       output_buffer, output_frames);
+  }
+
+  virtual long fill_planar(void * const * input_channels,
+                           long * input_frames_count,
+                           void * const * output_channels,
+                           long output_frames);
+
+  virtual void reserve(long frames)
+  {
+    inner->reserve(frames);
+  }
+
+  virtual long latency()
+  {
+    return inner->latency();
+  }
+
+  static long data_callback(cubeb_stream * stream, void * user_ptr,
+                            void const * input_buffer, void * output_buffer,
+                            long nframes);
+
+private:
+  cubeb_stream * const stream;
+  const cubeb_data_callback callback;
+  void * const user_ptr;
+  cubeb_planar_adapter * const adapter;
+  std::unique_ptr<cubeb_resampler> inner;
+  /* Whether the buffers of the backend can be handed to the callback. */
+  const bool passthrough;
+  const bool input_planar;
+  const bool output_planar;
+};
+
 /** Bidirectional resampler, can resample an input and an output stream, or just
  * an input stream or output stream. In this case a delay is inserted in the
  * opposite direction to keep the streams synchronized. */
@@ -130,6 +220,8 @@ public:
   virtual long fill(void * input_buffer, long * input_frames_count,
                     void * output_buffer, long output_frames_needed);
 
+  virtual void reserve(long frames);
+
   virtual long latency()
   {
     if (input_processor && output_processor) {
@@ -205,6 +297,9 @@ public:
       &input_frame_count,
       output_buffer,
       &output_frame_count);
+
+    reserve((size_t)ceilf(RESAMPLER_PREALLOCATED_FRAMES * resampling_ratio),
+            RESAMPLER_PREALLOCATED_FRAMES);
   }
 
   /** Destructor, deallocate the resampler */
@@ -213,6 +308,17 @@ public:
     speex_resampler_destroy(speex_resampler);
   }
 
+  /** Size the buffers to take `input_frames` frames at once, and to return
+   * `output_frames` frames with the `output` method that doesn't take a
+   * buffer. */
+  void reserve(size_t input_frames, size_t output_frames)
+  {
+    /* Up to min_buffered_audio_frame frames are kept between callbacks. */
+    reserve_samples(resampling_in_buffer, frames_to_samples(
+      min_buffered_audio_frame(source_rate) + input_frames));
+    reserve_samples(resampling_out_buffer, frames_to_samples(output_frames));
+  }
+
   /* Fill the resampler with `input_frame_count` frames. */
   void input(T * input_buffer, size_t input_frame_count)
   {
@@ -247,9 +353,7 @@ public:
     * The consumer should not hold onto the pointer. */
   T * output(size_t output_frame_count, size_t * input_frames_used)
   {
-    if (resampling_out_buffer.capacity() < frames_to_samples(output_frame_count)) {
-      resampling_out_buffer.reserve(frames_to_samples(output_frame_count));
-    }
+    reserve_samples(resampling_out_buffer, frames_to_samples(output_frame_count));
 
     uint32_t in_len = samples_to_frames(resampling_in_buffer.length());
     uint32_t out_len = output_frame_count;
@@ -258,7 +362,7 @@ public:
                    resampling_out_buffer.data(), &out_len);
 
     if (out_len < output_frame_count) {
-      LOGV("underrun during resampling: got %u frames, expected %zu", (unsigned)out_len, output_frame_count);
+      LOGV_HOT(RESAMPLER, "underrun during resampling: got %u frames, expected %zu", (unsigned)out_len, output_frame_count);
       // silence the rightmost part
       T* data = resampling_out_buffer.data();
       for (uint32_t i = frames_to_samples(out_len); i < frames_to_samples(output_frame_count); i++) {
@@ -315,8 +419,8 @@ public:
   T * input_buffer(size_t frame_count)
   {
     leftover_samples = resampling_in_buffer.length();
-    resampling_in_buffer.reserve(leftover_samples +
-                                 frames_to_samples(frame_count));
+    reserve_samples(resampling_in_buffer,
+                    leftover_samples + frames_to_samples(frame_count));
     return resampling_in_buffer.data() + leftover_samples;
   }
 
@@ -400,9 +504,19 @@ public:
     , leftover_samples(0)
     , sample_rate(sample_rate)
   {
+    reserve(RESAMPLER_PREALLOCATED_FRAMES, RESAMPLER_PREALLOCATED_FRAMES);
     /* Fill the delay line with some silent frames to add latency. */
     delay_input_buffer.push_silence(frames * channels);
   }
+  /** Size the buffers to take `input_frames` frames at once, and to return
+   * `output_frames` frames with the `output` method that doesn't take a
+   * buffer. */
+  void reserve(size_t input_frames, size_t output_frames)
+  {
+    reserve_samples(delay_input_buffer, frames_to_samples(
+      length + min_buffered_audio_frame(sample_rate) + input_frames));
+    reserve_samples(delay_output_buffer, frames_to_samples(output_frames));
+  }
   /** Push some frames into the delay line.
    * @parameter buffer the frames to push.
    * @parameter frame_count the number of frames in #buffer. */
@@ -416,9 +530,7 @@ public:
    * hold onto the pointer. */
   T * output(uint32_t frames_needed, size_t * input_frames_used)
   {
-    if (delay_output_buffer.capacity() < frames_to_samples(frames_needed)) {
-      delay_output_buffer.reserve(frames_to_samples(frames_needed));
-    }
+    reserve_samples(delay_output_buffer, frames_to_samples(frames_needed));
 
     delay_output_buffer.clear();
     delay_output_buffer.push(delay_input_buffer.data(),
@@ -436,7 +548,8 @@ public:
   T * input_buffer(uint32_t frames_needed)
   {
     leftover_samples = delay_input_buffer.length();
-    delay_input_buffer.reserve(leftover_samples + frames_to_samples(frames_needed));
+    reserve_samples(delay_input_buffer,
+                    leftover_samples + frames_to_samples(frames_needed));
     return delay_input_buffer.data() + leftover_samples;
   }
   /** This method works with `input_buffer`, and allows to inform the processor
@@ -531,7 +644,7 @@ cubeb_resampler_create_internal(cubeb_stream * stream,
       (output_params && output_params->rate == target_rate)) ||
       (input_params && !output_params && (input_params->rate == target_rate)) ||
       (output_params && !input_params && (output_params->rate == target_rate))) {
-    LOG("Input and output sample-rate match, target rate of %dHz", target_rate);
+    LOG_CATEGORY(RESAMPLER, "Input and output sample-rate match, target rate of %dHz", target_rate);
     return new passthrough_resampler<T>(stream, callback,
                                         user_ptr,
                                         input_params ? input_params->channels : 0,
@@ -582,7 +695,7 @@ cubeb_resampler_create_internal(cubeb_stream * stream,
   }
 
   if (input_resampler && output_resampler) {
-    LOG("Resampling input (%d) and output (%d) to target rate of %dHz", input_params->rate, output_params->rate, target_rate);
+    LOG_CATEGORY(RESAMPLER, "Resampling input (%d) and output (%d) to target rate of %dHz", input_params->rate, output_params->rate, target_rate);
     return new cubeb_resampler_speex<T,
                                      cubeb_resampler_speex_one_way<T>,
                                      cubeb_resampler_speex_one_way<T>>
@@ -590,7 +703,7 @@ cubeb_resampler_create_internal(cubeb_stream * stream,
                                         output_resampler.release(),
                                         stream, callback, user_ptr);
   } else if (input_resampler) {
-    LOG("Resampling input (%d) to target and output rate of %dHz", input_params->rate, target_rate);
+    LOG_CATEGORY(RESAMPLER, "Resampling input (%d) to target and output rate of %dHz", input_params->rate, target_rate);
     return new cubeb_resampler_speex<T,
                                      cubeb_resampler_speex_one_way<T>,
                                      delay_line<T>>
@@ -598,7 +711,7 @@ cubeb_resampler_create_internal(cubeb_stream * stream,
                                        output_delay.release(),
                                        stream, callback, user_ptr);
   } else {
-    LOG("Resampling output (%dHz) to target and input rate of %dHz", output_params->rate, target_rate);
+    LOG_CATEGORY(RESAMPLER, "Resampling output (%dHz) to target and input rate of %dHz", output_params->rate, target_rate);
     return new cubeb_resampler_speex<T,
                                      delay_line<T>,
                                      cubeb_resampler_speex_one_way<T>>
@@ -9,39 +9,58 @@
 #define CUBEB_RING_ARRAY_H
 
 #include "cubeb_utils.h"
+#include "cubeb_ringbuffer.h"
+#include <atomic>
+#include <new>
+#if defined(__APPLE__)
+#include <CoreAudio/CoreAudioTypes.h>
+#endif
 
 /** Ring array of pointers is used to hold buffers. In case that
     asynchronous producer/consumer callbacks do not arrive in a
     repeated order the ring array stores the buffers and fetch
-    them in the correct order. */
+    them in the correct order.
+
+    This is a lock-free single producer single consumer pool of fixed-size
+    buffers. The producer gets a free buffer, fills it, and commits it. The
+    consumer then gets it as a data buffer, reads it, and releases it back to
+    the producer. Committing and releasing have release semantics, getting a
+    buffer has acquire semantics, so the contents of a buffer are always
+    visible to the thread that gets it, and a buffer is never handed out to
+    both threads at the same time.
+
+    All the buffers live in a single allocation, and each buffer starts on its
+    own cache line. */
+
+#if defined(__APPLE__)
+typedef AudioBuffer ring_array_buffer;
+#else
+/** Same layout as CoreAudio's AudioBuffer. */
+typedef struct {
+  uint32_t mNumberChannels;
+  uint32_t mDataByteSize;
+  void * mData;
+} ring_array_buffer;
+#endif
 
 typedef struct {
-  AudioBuffer * buffer_array;   /**< Array that hold pointers of the allocated space for the buffers. */
-  unsigned int tail;            /**< Index of the last element (first to deliver). */
-  unsigned int count;           /**< Number of elements in the array. */
-  unsigned int capacity;        /**< Total length of the array. */
+  ring_array_buffer * buffer_array; /**< The buffers, plus a dummy buffer at the end. */
+  void * storage;                   /**< Single allocation for the buffers and their data. */
+  unsigned int capacity;            /**< Total length of the array. */
+  char pad0[CUBEB_CACHE_LINE_SIZE];
+  /** Number of buffers committed so far, only written by the producer. */
+  std::atomic<unsigned int> write_count;
+  char pad1[CUBEB_CACHE_LINE_SIZE];
+  /** Number of buffers released so far, only written by the consumer. */
+  std::atomic<unsigned int> read_count;
+  char pad2[CUBEB_CACHE_LINE_SIZE];
 } ring_array;
 
-static int
-single_audiobuffer_init(AudioBuffer * buffer,
-                        uint32_t bytesPerFrame,
-                        uint32_t channelsPerFrame,
-                        uint32_t frames)
+/** Round up `size` to a whole number of cache lines. */
+static size_t
+ring_array_cache_align(size_t size)
 {
-  assert(buffer);
-  assert(bytesPerFrame > 0 && channelsPerFrame && frames > 0);
-
-  size_t size = bytesPerFrame * frames;
-  buffer->mData = operator new(size);
-  if (buffer->mData == NULL) {
-    return CUBEB_ERROR;
-  }
-  PodZero(static_cast<char*>(buffer->mData), size);
-
-  buffer->mNumberChannels = channelsPerFrame;
-  buffer->mDataByteSize = size;
-
-  return CUBEB_OK;
+  return (size + CUBEB_CACHE_LINE_SIZE - 1) & ~(CUBEB_CACHE_LINE_SIZE - 1);
 }
 
 /** Initialize the ring array.
@@ -55,27 +74,37 @@ ring_array_init(ring_array * ra,
                 uint32_t framesPerBuffer)
 {
   assert(ra);
+  ra->buffer_array = NULL;
+  ra->storage = NULL;
   if (capacity == 0 || bytesPerFrame == 0 ||
       channelsPerFrame == 0 || framesPerBuffer == 0) {
     return CUBEB_ERROR_INVALID_PARAMETER;
   }
   ra->capacity = capacity;
-  ra->tail = 0;
-  ra->count = 0;
-
-  ra->buffer_array = new AudioBuffer[ra->capacity];
-  PodZero(ra->buffer_array, ra->capacity);
-  if (ra->buffer_array == NULL) {
+  ra->write_count.store(0, std::memory_order_relaxed);
+  ra->read_count.store(0, std::memory_order_relaxed);
+
+  /* One more buffer, for ring_array_get_dummy_buffer. */
+  size_t count = ra->capacity + 1;
+  size_t size = bytesPerFrame * framesPerBuffer;
+  size_t header_size = ring_array_cache_align(count * sizeof(ring_array_buffer));
+  size_t slot_size = ring_array_cache_align(size);
+  size_t total = header_size + count * slot_size;
+
+  /* Over-allocate to align the start of the block on a cache line. */
+  ra->storage = operator new(total + CUBEB_CACHE_LINE_SIZE, std::nothrow);
+  if (ra->storage == NULL) {
     return CUBEB_ERROR;
   }
-
-  for (unsigned int i = 0; i < ra->capacity; ++i) {
-    if (single_audiobuffer_init(&ra->buffer_array[i],
-                                bytesPerFrame,
-                                channelsPerFrame,
-                                framesPerBuffer) != CUBEB_OK) {
-      return CUBEB_ERROR;
-    }
+  uintptr_t base = reinterpret_cast<uintptr_t>(ra->storage);
+  char * block = reinterpret_cast<char *>(ring_array_cache_align(base));
+  PodZero(block, total);
+
+  ra->buffer_array = reinterpret_cast<ring_array_buffer *>(block);
+  for (unsigned int i = 0; i < count; ++i) {
+    ra->buffer_array[i].mNumberChannels = channelsPerFrame;
+    ra->buffer_array[i].mDataByteSize = size;
+    ra->buffer_array[i].mData = block + header_size + i * slot_size;
   }
 
   return CUBEB_OK;
@@ -87,73 +116,93 @@ void
 ring_array_destroy(ring_array * ra)
 {
   assert(ra);
-  if (ra->buffer_array == NULL){
+  if (ra->storage == NULL){
     return;
   }
-  for (unsigned int i = 0; i < ra->capacity; ++i) {
-    if (ra->buffer_array[i].mData) {
-      operator delete(ra->buffer_array[i].mData);
-    }
-  }
-  delete [] ra->buffer_array;
+  operator delete(ra->storage);
+  ra->storage = NULL;
+  ra->buffer_array = NULL;
 }
 
-/** Get the allocated buffer to be stored with fresh data.
+/** Get the next free buffer, to be filled with fresh data. Calling this again
+    before ring_array_commit_free_buffer returns the same buffer.
+    Only safely called on the producer thread.
     @param ra The ring_array pointer.
     @retval Pointer of the allocated space to be stored with fresh data or NULL if full. */
-AudioBuffer *
+ring_array_buffer *
 ring_array_get_free_buffer(ring_array * ra)
 {
   assert(ra && ra->buffer_array);
-  assert(ra->buffer_array[0].mData != NULL);
-  if (ra->count == ra->capacity) {
+  unsigned int write = ra->write_count.load(std::memory_order_relaxed);
+  /* Pairs with the release in ring_array_release_data_buffer: the consumer
+     is done with the buffer we're about to hand out. */
+  unsigned int read = ra->read_count.load(std::memory_order_acquire);
+  if (write - read == ra->capacity) {
     return NULL;
   }
 
-  assert(ra->count == 0 || (ra->tail + ra->count) % ra->capacity != ra->tail);
-  AudioBuffer * ret = &ra->buffer_array[(ra->tail + ra->count) % ra->capacity];
-
-  ++ra->count;
-  assert(ra->count <= ra->capacity);
+  return &ra->buffer_array[write % ra->capacity];
+}
 
-  return ret;
+/** Hand the buffer returned by ring_array_get_free_buffer to the consumer.
+    Only safely called on the producer thread.
+    @param ra The ring_array pointer. */
+void
+ring_array_commit_free_buffer(ring_array * ra)
+{
+  assert(ra && ra->buffer_array);
+  unsigned int write = ra->write_count.load(std::memory_order_relaxed);
+  assert(write - ra->read_count.load(std::memory_order_relaxed) < ra->capacity);
+  ra->write_count.store(write + 1, std::memory_order_release);
 }
 
-/** Get the next available buffer with data.
+/** Get the next available buffer with data. Calling this again before
+    ring_array_release_data_buffer returns the same buffer.
+    Only safely called on the consumer thread.
     @param ra The ring_array pointer.
     @retval Pointer of the next in order data buffer or NULL if empty. */
-AudioBuffer *
+ring_array_buffer *
 ring_array_get_data_buffer(ring_array * ra)
 {
   assert(ra && ra->buffer_array);
-  assert(ra->buffer_array[0].mData != NULL);
-
-  if (ra->count == 0) {
+  unsigned int read = ra->read_count.load(std::memory_order_relaxed);
+  /* Pairs with the release in ring_array_commit_free_buffer: the data written
+     by the producer is visible. */
+  unsigned int write = ra->write_count.load(std::memory_order_acquire);
+  if (write == read) {
     return NULL;
   }
-  AudioBuffer * ret = &ra->buffer_array[ra->tail];
 
-  ra->tail = (ra->tail + 1) % ra->capacity;
-  assert(ra->tail < ra->capacity);
-
-  assert(ra->count > 0);
-  --ra->count;
+  return &ra->buffer_array[read % ra->capacity];
+}
 
-  return ret;
+/** Hand the buffer returned by ring_array_get_data_buffer back to the
+    producer.
+    Only safely called on the consumer thread.
+    @param ra The ring_array pointer. */
+void
+ring_array_release_data_buffer(ring_array * ra)
+{
+  assert(ra && ra->buffer_array);
+  unsigned int read = ra->read_count.load(std::memory_order_relaxed);
+  assert(ra->write_count.load(std::memory_order_relaxed) != read);
+  ra->read_count.store(read + 1, std::memory_order_release);
 }
 
-/** When array is empty get the first allocated buffer in the array.
+/** When array is empty get a zeroed buffer of the same size, that is never
+    handed to the producer.
+    Only safely called on the consumer thread.
     @param ra The ring_array pointer.
     @retval If arrays is empty, pointer of the allocated space else NULL. */
-AudioBuffer *
+ring_array_buffer *
 ring_array_get_dummy_buffer(ring_array * ra)
 {
   assert(ra && ra->buffer_array);
   assert(ra->capacity > 0);
-  if (ra->count > 0) {
+  if (ring_array_get_data_buffer(ra)) {
     return NULL;
   }
-  return &ra->buffer_array[0];
+  return &ra->buffer_array[ra->capacity];
 }
 
 #endif //CUBEB_RING_ARRAY_H
@@ -8,12 +8,204 @@
 #ifndef CUBEB_RING_BUFFER_H
 #define CUBEB_RING_BUFFER_H
 
+#include "cubeb_futex.h"
 #include "cubeb_utils.h"
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <memory>
 #include <thread>
+#include <type_traits>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Up to two contiguous regions of the storage of a ring buffer, as handed out
+ * by the zero-copy methods `reserve_write` and `peek_read`. The second region
+ * is only non-empty when the data wraps around the end of the storage, and
+ * always starts at the beginning of the storage.
+ */
+template <typename T>
+struct ring_buffer_region
+{
+  /** Pointer to the first part of the region. */
+  T * first;
+  /** Number of elements available at `first`. */
+  int first_length;
+  /** Pointer to the second part of the region. */
+  T * second;
+  /** Number of elements available at `second`. */
+  int second_length;
+  /** Total number of elements in the region. */
+  int length() const
+  {
+    return first_length + second_length;
+  }
+};
+
+/**
+ * Size of a cache line, used to keep data that is written by different threads
+ * apart, to avoid false sharing.
+ */
+const size_t CUBEB_CACHE_LINE_SIZE = 64;
+
+/**
+ * Return the smallest power of two greater or equal to `value`.
+ */
+inline int ring_buffer_next_power_of_two(int value)
+{
+  int rv = 1;
+  while (rv < value) {
+    rv <<= 1;
+  }
+  return rv;
+}
+
+/**
+ * Storage for a `ring_buffer_base`, allocated on the heap.
+ *
+ * The storage is larger than the capacity, and is a power of two multiple of
+ * `alignment` elements, so that groups of `alignment` elements are never split
+ * across the end of the storage.
+ */
+template <typename T>
+class ring_buffer_heap_storage
+{
+public:
+  ring_buffer_heap_storage(int capacity, int alignment)
+    : size_(ring_buffer_next_power_of_two(capacity / alignment + 1) * alignment)
+    , data_(new T[size_])
+  {
+  }
+  /** Pointer to the first element of the storage. */
+  T * data() const
+  {
+    return data_.get();
+  }
+  /** Number of elements in the storage. */
+  int size() const
+  {
+    return size_;
+  }
+  /** Whether the storage is mapped twice, back to back. */
+  bool mirrored() const
+  {
+    return false;
+  }
+private:
+  const int size_;
+  std::unique_ptr<T[]> data_;
+};
+
+/**
+ * Storage for a `ring_buffer_base` that is mapped twice in a row in virtual
+ * memory, so that accessing past the end of the storage wraps around to its
+ * start. Any region of a ring buffer using this storage is contiguous, and
+ * the `second` part of a `ring_buffer_region` is always empty.
+ *
+ * This uses `memfd_create` and is only available on Linux, and for trivial
+ * types whose size divides the page size. Otherwise, or if the mapping fails,
+ * it falls back to `ring_buffer_heap_storage`, check `mirrored()`.
+ */
+template <typename T>
+class ring_buffer_mirrored_storage
+{
+public:
+  ring_buffer_mirrored_storage(int capacity, int alignment)
+    : size_(0)
+    , mapping_size_(0)
+    , data_(nullptr)
+  {
+#if defined(__linux__) && defined(SYS_memfd_create)
+    if (std::is_trivial<T>::value) {
+      map(capacity);
+    }
+#endif
+    if (!data_) {
+      fallback_.reset(new ring_buffer_heap_storage<T>(capacity, alignment));
+      data_ = fallback_->data();
+      size_ = fallback_->size();
+    }
+  }
+  ~ring_buffer_mirrored_storage()
+  {
+#if defined(__linux__)
+    if (mapping_size_) {
+      munmap(data_, mapping_size_);
+    }
+#endif
+  }
+  /** Pointer to the first element of the storage. */
+  T * data() const
+  {
+    return data_;
+  }
+  /** Number of elements in the storage, the mapping is twice as big. */
+  int size() const
+  {
+    return size_;
+  }
+  /** Whether the storage is mapped twice, back to back. */
+  bool mirrored() const
+  {
+    return mapping_size_ != 0;
+  }
+private:
+#if defined(__linux__) && defined(SYS_memfd_create)
+  void map(int capacity)
+  {
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    if (page_size % sizeof(T)) {
+      return;
+    }
+    /* Same sizing as the heap storage, rounded up to a power of two number of
+     * pages. */
+    size_t pages = ((capacity + 1) * sizeof(T) + page_size - 1) / page_size;
+    size_t bytes = ring_buffer_next_power_of_two(pages) * page_size;
+
+    int fd = syscall(SYS_memfd_create, "cubeb-ring-buffer", MFD_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+
+    void * base = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0) {
+      /* Reserve twice the size, and map the file over each half. */
+      base = mmap(nullptr, 2 * bytes, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base != MAP_FAILED) {
+      char * first = static_cast<char *>(base);
+      if (mmap(first, bytes, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+          mmap(first + bytes, bytes, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * bytes);
+        base = MAP_FAILED;
+      }
+    }
+    /* The mappings keep the memory alive. */
+    close(fd);
+
+    if (base == MAP_FAILED) {
+      return;
+    }
+    data_ = static_cast<T *>(base);
+    size_ = bytes / sizeof(T);
+    mapping_size_ = 2 * bytes;
+  }
+#endif
+  int size_;
+  size_t mapping_size_;
+  T * data_;
+  std::unique_ptr<ring_buffer_heap_storage<T>> fallback_;
+};
 
 /**
  * Single producer single consumer lock-free and wait-free ring buffer.
@@ -32,23 +224,34 @@
  * - Capacity is fixed. Only one allocation is performed, in the constructor.
  *   When reading and writing, the return value of the method allows checking if
  *   the ring buffer is empty or full.
- * - We always keep the read index at least one element ahead of the write
- *   index, so we can distinguish between an empty and a full ring buffer: an
- *   empty ring buffer is when the write index is at the same position as the
- *   read index. A full buffer is when the write index is exactly one position
- *   before the read index.
+ * - The storage is larger than the capacity, and is a power of two (or a power
+ *   of two multiple of `alignment`, see the constructor), so that indices
+ *   can be wrapped with a mask instead of a modulo. How the storage is
+ *   allocated is a policy, `Storage`: it is either on the heap, or mirrored in
+ *   virtual memory so that all regions are contiguous. An empty ring buffer is
+ *   when the write index is at the same position as the read index, a full
+ *   ring buffer is when there are `capacity()` elements between them.
  * - We synchronize updates to the read index after having read the data, and
  *   the write index after having written the data. This means that the each
  *   thread can only touch a portion of the buffer that is not touched by the
  *   other thread.
+ * - The read index and the write index live on separate cache lines. Each
+ *   side keeps a copy of the index of the other side, and only reloads the
+ *   shared index when its copy makes the ring buffer appear too full (resp.
+ *   too empty) for the current operation. In steady state, this means each
+ *   thread only writes its own cache line, and rarely reads the other one.
  * - Callers are expected to provide buffers. When writing to the queue,
  *   elements are copied into the internal storage from the buffer passed in.
  *   When reading from the queue, the user is expected to provide a buffer.
  *   Because this is a ring buffer, data might not be contiguous in memory,
  *   providing an external buffer to copy into is an easy way to have linear
  *   data for further processing.
+ * - Alternatively, `reserve_write`/`commit_write` and `peek_read`/`consume`
+ *   give direct access to the storage, as at most two contiguous regions, so
+ *   that data can be produced or consumed in place without an intermediate
+ *   copy.
  */
-template <typename T>
+template <typename T, typename Storage = ring_buffer_heap_storage<T>>
 class ring_buffer_base
 {
 public:
@@ -59,17 +262,28 @@ public:
    * for the life time of a `ring_buffer_base`.
    *
    * @param capacity The maximum number of element this ring buffer will hold.
+   * @param alignment If all reads and writes are done in multiples of
+   * `alignment` elements, the storage is sized so that those groups of
+   * elements are never split across the end of the storage. `capacity` must
+   * be a multiple of `alignment`. The indices are wrapped with a mask when
+   * `alignment` is a power of two, and with a comparison otherwise.
    */
-  ring_buffer_base(int capacity)
-    /* One more element to distinguish from empty and full buffer. */
-    : capacity_(capacity + 1)
+  ring_buffer_base(int capacity, int alignment = 1)
+    : capacity_(capacity)
+    , storage_(capacity, alignment)
+    , storage_capacity_(storage_.size())
+    /* The mask is only usable if the storage is a power of two. */
+    , mask_((storage_capacity_ & (storage_capacity_ - 1)) ?
+            0 : storage_capacity_ - 1)
   {
     assert(storage_capacity() <
            std::numeric_limits<int>::max() / 2 &&
            "buffer too large for the type of index used.");
-    assert(capacity_ > 0);
+    assert(capacity_ > 0 && alignment > 0);
+    assert(capacity_ % alignment == 0);
 
-    data_.reset(new T[storage_capacity()]);
+    cached_read_index_ = 0;
+    cached_write_index_ = 0;
     /* If this queue is using atomics, initializing those members as the last
      * action in the constructor acts as a full barrier, and allow capacity() to
      * be thread-safe. */
@@ -114,37 +328,19 @@ public:
    */
   int enqueue(T * elements, int count)
   {
-#ifndef NDEBUG
-    assert_correct_thread(producer_id);
-#endif
-
-    int rd_idx = read_index_.load(std::memory_order_relaxed);
-    int wr_idx = write_index_.load(std::memory_order_relaxed);
-
-    if (full_internal(rd_idx, wr_idx)) {
-      return 0;
-    }
-
-    int to_write =
-      std::min(available_write_internal(rd_idx, wr_idx), count);
-
-    /* First part, from the write index to the end of the array. */
-    int first_part = std::min(storage_capacity() - wr_idx,
-                                          to_write);
-    /* Second part, from the beginning of the array */
-    int second_part = to_write - first_part;
+    ring_buffer_region<T> region = reserve_write(count);
 
     if (elements) {
-      Copy(data_.get() + wr_idx, elements, first_part);
-      Copy(data_.get(), elements + first_part, second_part);
+      Copy(region.first, elements, region.first_length);
+      Copy(region.second, elements + region.first_length, region.second_length);
     } else {
-      ConstructDefault(data_.get() + wr_idx, first_part);
-      ConstructDefault(data_.get(), second_part);
+      ConstructDefault(region.first, region.first_length);
+      ConstructDefault(region.second, region.second_length);
     }
 
-    write_index_.store(increment_index(wr_idx, to_write), std::memory_order_release);
+    commit_write(region.length());
 
-    return to_write;
+    return region.length();
   }
   /**
    * Retrieve at most `count` elements from the ring buffer, and copy them to
@@ -158,32 +354,163 @@ public:
    * @return The number of elements written to `elements`.
    */
   int dequeue(T * elements, int count)
+  {
+    ring_buffer_region<T> region = peek_read(count);
+
+    if (elements) {
+      Copy(elements, region.first, region.first_length);
+      Copy(elements + region.first_length, region.second, region.second_length);
+    }
+
+    consume(region.length());
+
+    return region.length();
+  }
+  /**
+   * Get direct access to at most `count` empty elements of the storage, to be
+   * written in place. The elements are only made visible to the consumer
+   * after a call to `commit_write`.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param count The maximum number of elements to reserve.
+   * @return The region of the storage that can be written to. Its length can
+   * be smaller than `count` if the ring buffer is almost full.
+   */
+  ring_buffer_region<T> reserve_write(int count)
   {
 #ifndef NDEBUG
-    assert_correct_thread(consumer_id);
+    assert_correct_thread(producer_id);
 #endif
 
-    int wr_idx = write_index_.load(std::memory_order_acquire);
-    int rd_idx = read_index_.load(std::memory_order_relaxed);
+    int wr_idx = write_index_.load(std::memory_order_relaxed);
+    int available = available_write_internal(cached_read_index_, wr_idx);
 
-    if (empty_internal(rd_idx, wr_idx)) {
-      return 0;
+    /* Only look at the consumer side if our copy of the read index does not
+     * leave enough room. */
+    if (available < count) {
+      cached_read_index_ = read_index_.load(std::memory_order_acquire);
+      available = available_write_internal(cached_read_index_, wr_idx);
     }
 
-    int to_read =
-      std::min(available_read_internal(rd_idx, wr_idx), count);
+    return region_internal(wr_idx, std::min(available, count));
+  }
+  /**
+   * Publish `count` elements, previously obtained with `reserve_write`, to
+   * the consumer.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param count The number of elements that have been written, at most the
+   * length of the region returned by the last call to `reserve_write`.
+   */
+  void commit_write(int count)
+  {
+#ifndef NDEBUG
+    assert_correct_thread(producer_id);
+#endif
+
+    int wr_idx = write_index_.load(std::memory_order_relaxed);
 
-    int first_part = std::min(storage_capacity() - rd_idx, to_read);
-    int second_part = to_read - first_part;
+    assert(count <= available_write_internal(cached_read_index_, wr_idx));
 
-    if (elements) {
-      Copy(elements, data_.get() + rd_idx, first_part);
-      Copy(elements + first_part, data_.get(), second_part);
+    write_index_.store(increment_index(wr_idx, count), std::memory_order_release);
+  }
+  /**
+   * Get direct access to at most `count` elements available for reading,
+   * without removing them from the ring buffer. The elements can be read or
+   * modified in place until they are released with `consume`.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param count The maximum number of elements to peek at.
+   * @return The region of the storage that can be read from. Its length can
+   * be smaller than `count` if the ring buffer is almost empty.
+   */
+  ring_buffer_region<T> peek_read(int count)
+  {
+#ifndef NDEBUG
+    assert_correct_thread(consumer_id);
+#endif
+
+    int rd_idx = read_index_.load(std::memory_order_relaxed);
+    int available = available_read_internal(rd_idx, cached_write_index_);
+
+    /* Only look at the producer side if our copy of the write index does not
+     * have enough elements. */
+    if (available < count) {
+      cached_write_index_ = write_index_.load(std::memory_order_acquire);
+      available = available_read_internal(rd_idx, cached_write_index_);
     }
 
-    read_index_.store(increment_index(rd_idx, to_read), std::memory_order_relaxed);
+    return region_internal(rd_idx, std::min(available, count));
+  }
+  /**
+   * Remove `count` elements, previously obtained with `peek_read`, from the
+   * ring buffer, handing their storage back to the producer.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param count The number of elements to remove, at most the length of the
+   * region returned by the last call to `peek_read`.
+   */
+  void consume(int count)
+  {
+#ifndef NDEBUG
+    assert_correct_thread(consumer_id);
+#endif
+
+    int rd_idx = read_index_.load(std::memory_order_relaxed);
+
+    assert(count <= available_read_internal(rd_idx, cached_write_index_));
 
-    return to_read;
+    read_index_.store(increment_index(rd_idx, count), std::memory_order_release);
+  }
+  /**
+   * Pointer-based variant of `reserve_write`, that only returns the first
+   * contiguous part of the region. With a mirrored storage, this is always the
+   * whole region.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param count On input, the maximum number of elements to reserve. On
+   * output, the number of elements that can be written at the returned
+   * pointer, to be published with `commit_write`.
+   * @return A pointer into the storage.
+   */
+  T * reserve_write_contiguous(int * count)
+  {
+    ring_buffer_region<T> region = reserve_write(*count);
+    *count = region.first_length;
+    return region.first;
+  }
+  /**
+   * Pointer-based variant of `peek_read`, that only returns the first
+   * contiguous part of the region. With a mirrored storage, this is always the
+   * whole region.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param count On input, the maximum number of elements to peek at. On
+   * output, the number of elements that can be read at the returned pointer,
+   * to be released with `consume`.
+   * @return A pointer into the storage.
+   */
+  T * peek_read_contiguous(int * count)
+  {
+    ring_buffer_region<T> region = peek_read(*count);
+    *count = region.first_length;
+    return region.first;
+  }
+  /**
+   * Whether the storage is mirrored, in which case all regions are
+   * contiguous.
+   *
+   * Can be called safely on any thread.
+   */
+  bool mirrored() const
+  {
+    return storage_.mirrored();
   }
   /**
    * Get the number of available element for consuming.
@@ -197,8 +524,9 @@ public:
 #ifndef NDEBUG
     assert_correct_thread(consumer_id);
 #endif
+    cached_write_index_ = write_index_.load(std::memory_order_acquire);
     return available_read_internal(read_index_.load(std::memory_order_relaxed),
-                                   write_index_.load(std::memory_order_relaxed));
+                                   cached_write_index_);
   }
   /**
    * Get the number of available elements for consuming.
@@ -212,7 +540,8 @@ public:
 #ifndef NDEBUG
     assert_correct_thread(producer_id);
 #endif
-    return available_write_internal(read_index_.load(std::memory_order_relaxed),
+    cached_read_index_ = read_index_.load(std::memory_order_acquire);
+    return available_write_internal(cached_read_index_,
                                     write_index_.load(std::memory_order_relaxed));
   }
   /**
@@ -224,7 +553,7 @@ public:
    */
   int capacity() const
   {
-    return storage_capacity() - 1;
+    return capacity_;
   }
   /**
    * Reset the consumer and producer thread identifier, in case the thread are
@@ -238,56 +567,45 @@ public:
 #endif
   }
 private:
-  /** Return true if the ring buffer is empty.
-   *
-   * @param read_index the read index to consider
-   * @param write_index the write index to consider
-   * @return true if the ring buffer is empty, false otherwise.
-   **/
-  bool empty_internal(int read_index,
-                      int write_index) const
-  {
-    return write_index == read_index;
-  }
-  /** Return true if the ring buffer is full.
-   *
-   * This happens if the write index is exactly one element behind the read
-   * index.
-   *
-   * @param read_index the read index to consider
-   * @param write_index the write index to consider
-   * @return true if the ring buffer is full, false otherwise.
-   **/
-  bool full_internal(int read_index,
-                     int write_index) const
-  {
-    return (write_index + 1) % storage_capacity() == read_index;
-  }
   /**
-   * Return the size of the storage. It is one more than the number of elements
+   * Return the size of the storage. It is larger than the number of elements
    * that can be stored in the buffer.
    *
    * @return the number of elements that can be stored in the buffer.
    */
   int storage_capacity() const
   {
-    return capacity_;
+    return storage_capacity_;
   }
   /**
-   * Returns the number of elements available for reading.
+   * Returns the number of elements between two indices.
    *
-   * @return the number of available elements for reading.
+   * @return the number of elements between `read_index` and `write_index`.
    */
   int
-  available_read_internal(int read_index,
-                          int write_index) const
+  used_internal(int read_index,
+                int write_index) const
   {
+    if (mask_) {
+      return (write_index - read_index) & mask_;
+    }
     if (write_index >= read_index) {
       return write_index - read_index;
     } else {
       return write_index + storage_capacity() - read_index;
     }
   }
+  /**
+   * Returns the number of elements available for reading.
+   *
+   * @return the number of available elements for reading.
+   */
+  int
+  available_read_internal(int read_index,
+                          int write_index) const
+  {
+    return used_internal(read_index, write_index);
+  }
   /**
    * Returns the number of empty elements, available for writing.
    *
@@ -297,13 +615,29 @@ private:
   available_write_internal(int read_index,
                            int write_index) const
   {
-    /* We substract one element here to always keep at least one sample
-     * free in the buffer, to distinguish between full and empty array. */
-    int rv = read_index - write_index - 1;
-    if (write_index >= read_index) {
-      rv += storage_capacity();
-    }
-    return rv;
+    return capacity_ - used_internal(read_index, write_index);
+  }
+  /**
+   * Split `count` elements of the storage, starting at `index`, into at most
+   * two contiguous regions.
+   *
+   * @param index the index of the first element of the region.
+   * @param count the number of elements in the region.
+   * @return the region.
+   */
+  ring_buffer_region<T>
+  region_internal(int index, int count) const
+  {
+    ring_buffer_region<T> region;
+    /* First part, from the index to the end of the array. */
+    region.first = storage_.data() + index;
+    /* A mirrored storage can be accessed past its end. */
+    region.first_length = storage_.mirrored() ?
+                          count : std::min(storage_capacity() - index, count);
+    /* Second part, from the beginning of the array */
+    region.second = storage_.data();
+    region.second_length = count - region.first_length;
+    return region;
   }
   /**
    * Increments an index, wrapping it around the storage.
@@ -315,8 +649,13 @@ private:
   int
   increment_index(int index, int increment) const
   {
-    assert(increment >= 0);
-    return (index + increment) % storage_capacity();
+    assert(increment >= 0 && increment <= capacity_);
+    int rv = index + increment;
+    if (mask_) {
+      return rv & mask_;
+    }
+    /* The capacity is less than the storage, one subtraction is enough. */
+    return rv >= storage_capacity() ? rv - storage_capacity() : rv;
   }
   /**
    * @brief This allows checking that enqueue (resp. dequeue) are always called
@@ -334,27 +673,50 @@ private:
     assert(id == std::this_thread::get_id());
   }
 #endif
-  /** Index at which the oldest element is at, in samples. */
-  std::atomic<int> read_index_;
-  /** Index at which to write new elements. `write_index` is always at
-   * least one element ahead of `read_index_`. */
-  std::atomic<int> write_index_;
+  /* Members that are only written in the constructor, and shared. They are
+   * padded on both sides so that they don't share a cache line with the
+   * indices, or with other objects. */
+  char padding_begin_[CUBEB_CACHE_LINE_SIZE];
   /** Maximum number of elements that can be stored in the ring buffer. */
   const int capacity_;
   /** Data storage */
-  std::unique_ptr<T[]> data_;
+  Storage storage_;
+  /** Number of elements in the storage, larger than `capacity_`. */
+  const int storage_capacity_;
+  /** `storage_capacity_ - 1` if the storage is a power of two, 0 otherwise. */
+  const int mask_;
+  char padding_shared_[CUBEB_CACHE_LINE_SIZE];
+  /* Members written by the producer thread. */
+  /** Index at which to write new elements. There are at most `capacity_`
+   * elements between `read_index_` and `write_index_`. */
+  std::atomic<int> write_index_;
+  /** Copy of `read_index_` from the last time the producer looked at it. */
+  mutable int cached_read_index_;
 #ifndef NDEBUG
-  /** The id of the only thread that is allowed to read from the queue. */
-  mutable std::thread::id consumer_id;
   /** The id of the only thread that is allowed to write from the queue. */
   mutable std::thread::id producer_id;
 #endif
+  char padding_producer_[CUBEB_CACHE_LINE_SIZE];
+  /* Members written by the consumer thread. */
+  /** Index at which the oldest element is at, in samples. */
+  std::atomic<int> read_index_;
+  /** Copy of `write_index_` from the last time the consumer looked at it. */
+  mutable int cached_write_index_;
+#ifndef NDEBUG
+  /** The id of the only thread that is allowed to read from the queue. */
+  mutable std::thread::id consumer_id;
+#endif
+  char padding_consumer_[CUBEB_CACHE_LINE_SIZE];
 };
 
 /**
  * Adapter for `ring_buffer_base` that exposes an interface in frames.
+ *
+ * The underlying storage is a whole number of frames, so that a frame is never
+ * split across the end of the storage, and the regions returned by
+ * `reserve_write` and `peek_read` always hold complete frames.
  */
-template <typename T>
+template <typename T, typename Storage = ring_buffer_heap_storage<T>>
 class audio_ring_buffer_base
 {
 public:
@@ -366,7 +728,7 @@ public:
    */
   audio_ring_buffer_base(int channel_count, int capacity_in_frames)
     : channel_count(channel_count)
-    , ring_buffer(frames_to_samples(capacity_in_frames))
+    , ring_buffer(frames_to_samples(capacity_in_frames), channel_count)
   {
     assert(channel_count > 0);
   }
@@ -415,6 +777,106 @@ public:
   {
     return samples_to_frames(ring_buffer.dequeue(frames, frames_to_samples(frame_count)));
   }
+  /**
+   * @brief Get direct access to at most `frame_count` frames of empty storage.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param frame_count The maximum number of frames to reserve.
+   *
+   * @return The region of the storage that can be written to. The pointers
+   *         point to interleaved samples, the lengths are in frames.
+   */
+  ring_buffer_region<T> reserve_write(int frame_count)
+  {
+    return region_to_frames(ring_buffer.reserve_write(frames_to_samples(frame_count)));
+  }
+  /**
+   * @brief Publish `frame_count` frames previously written in the region
+   *        returned by `reserve_write`.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param frame_count The number of frames that have been written.
+   */
+  void commit_write(int frame_count)
+  {
+    ring_buffer.commit_write(frames_to_samples(frame_count));
+  }
+  /**
+   * @brief Get direct access to at most `frame_count` frames available for
+   *        reading, without removing them from the buffer.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param frame_count The maximum number of frames to peek at.
+   *
+   * @return The region of the storage that can be read from. The pointers
+   *         point to interleaved samples, the lengths are in frames.
+   */
+  ring_buffer_region<T> peek_read(int frame_count)
+  {
+    return region_to_frames(ring_buffer.peek_read(frames_to_samples(frame_count)));
+  }
+  /**
+   * @brief Remove `frame_count` frames previously obtained with `peek_read`.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param frame_count The number of frames to remove.
+   */
+  void consume(int frame_count)
+  {
+    ring_buffer.consume(frames_to_samples(frame_count));
+  }
+  /**
+   * @brief Pointer-based variant of `reserve_write`, that only returns the
+   *        first contiguous part of the region. With a mirrored storage, this
+   *        is always the whole region.
+   *
+   * Only safely called on the producer thread.
+   *
+   * @param frame_count On input, the maximum number of frames to reserve. On
+   *                    output, the number of frames that can be written at
+   *                    the returned pointer.
+   *
+   * @return A pointer to interleaved samples in the storage.
+   */
+  T * reserve_write_contiguous(int * frame_count)
+  {
+    ring_buffer_region<T> region = reserve_write(*frame_count);
+    *frame_count = region.first_length;
+    return region.first;
+  }
+  /**
+   * @brief Pointer-based variant of `peek_read`, that only returns the first
+   *        contiguous part of the region. With a mirrored storage, this is
+   *        always the whole region.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param frame_count On input, the maximum number of frames to peek at. On
+   *                    output, the number of frames that can be read at the
+   *                    returned pointer.
+   *
+   * @return A pointer to interleaved samples in the storage.
+   */
+  T * peek_read_contiguous(int * frame_count)
+  {
+    ring_buffer_region<T> region = peek_read(*frame_count);
+    *frame_count = region.first_length;
+    return region.first;
+  }
+  /**
+   * Whether the storage is mirrored, in which case all regions are
+   * contiguous.
+   *
+   * Can be called safely on any thread.
+   */
+  bool mirrored() const
+  {
+    return ring_buffer.mirrored();
+  }
   /**
    * Get the number of available frames of audio for consuming.
    *
@@ -471,10 +933,232 @@ private:
   {
     return samples / channel_count;
   }
+  /**
+   * @brief Convert the lengths of a region from samples to frames.
+   *
+   * @param region A region whose lengths are in samples.
+   *
+   * @return The same region, with lengths in frames.
+   */
+  ring_buffer_region<T> region_to_frames(ring_buffer_region<T> region) const
+  {
+    assert(region.first_length % channel_count == 0 &&
+           region.second_length % channel_count == 0);
+    region.first_length = samples_to_frames(region.first_length);
+    region.second_length = samples_to_frames(region.second_length);
+    return region;
+  }
   /** Number of channels of audio that will stream through this ring buffer. */
   int channel_count;
   /** The underlying ring buffer that is used to store the data. */
-  ring_buffer_base<T> ring_buffer;
+  ring_buffer_base<T, Storage> ring_buffer;
+};
+
+/**
+ * An `audio_ring_buffer_base` whose consumer can block until enough frames are
+ * available, for consumers that don't run on a real-time thread, such as disk
+ * writers or encoders, instead of polling `available_read()` with sleeps.
+ *
+ * The producer keeps a count of the frames written, that the consumer sleeps
+ * on with a futex (or polls every millisecond where futexes aren't
+ * available). When the consumer parks, it publishes the count it is waiting
+ * for, the watermark. The producer only makes a system call when a consumer
+ * is parked and the watermark has been crossed: otherwise, publishing frames
+ * only costs an additional store and load of an atomic. This never blocks the
+ * producer.
+ */
+template <typename T, typename Storage = ring_buffer_heap_storage<T>>
+class waitable_audio_ring_buffer
+{
+public:
+  /**
+   * @brief Constructor.
+   *
+   * @param channel_count       Number of channels.
+   * @param capacity_in_frames  The capacity in frames.
+   */
+  waitable_audio_ring_buffer(int channel_count, int capacity_in_frames)
+    : ring_buffer(channel_count, capacity_in_frames)
+    , frames_read_(0)
+  {
+    consumer_watermark_ = 0;
+    consumer_waiting_ = 0;
+    frames_written_ = 0;
+  }
+  /**
+   * @brief Enqueue silence, and wake up the consumer if needed.
+   *
+   * Only safely called on the producer thread.
+   */
+  int enqueue_default(int frame_count)
+  {
+    return notify(ring_buffer.enqueue_default(frame_count));
+  }
+  /**
+   * @brief Enqueue `frame_count` frames of audio, and wake up the consumer if
+   *        needed.
+   *
+   * Only safely called on the producer thread.
+   */
+  int enqueue(T * frames, int frame_count)
+  {
+    return notify(ring_buffer.enqueue(frames, frame_count));
+  }
+  /**
+   * @brief Remove `frame_count` frames from the buffer, and write them to
+   *        `frames` if it is non-null. This doesn't block.
+   *
+   * Only safely called on the consumer thread.
+   */
+  int dequeue(T * frames, int frame_count)
+  {
+    int rv = ring_buffer.dequeue(frames, frame_count);
+    frames_read_ += rv;
+    return rv;
+  }
+  /**
+   * @brief See `audio_ring_buffer_base::reserve_write`.
+   *
+   * Only safely called on the producer thread.
+   */
+  ring_buffer_region<T> reserve_write(int frame_count)
+  {
+    return ring_buffer.reserve_write(frame_count);
+  }
+  /**
+   * @brief See `audio_ring_buffer_base::commit_write`. This also wakes up the
+   *        consumer if needed.
+   *
+   * Only safely called on the producer thread.
+   */
+  void commit_write(int frame_count)
+  {
+    ring_buffer.commit_write(frame_count);
+    notify(frame_count);
+  }
+  /**
+   * @brief See `audio_ring_buffer_base::peek_read`.
+   *
+   * Only safely called on the consumer thread.
+   */
+  ring_buffer_region<T> peek_read(int frame_count)
+  {
+    return ring_buffer.peek_read(frame_count);
+  }
+  /**
+   * @brief See `audio_ring_buffer_base::consume`.
+   *
+   * Only safely called on the consumer thread.
+   */
+  void consume(int frame_count)
+  {
+    ring_buffer.consume(frame_count);
+    frames_read_ += frame_count;
+  }
+  /**
+   * @brief Block until at least `frame_count` frames are available for
+   *        reading, or until `timeout_ms` milliseconds have passed. A negative
+   *        timeout waits forever. This is not real-time safe.
+   *
+   * Only safely called on the consumer thread.
+   *
+   * @param frame_count The watermark, clamped to the capacity.
+   * @param timeout_ms The maximum time to wait, in milliseconds.
+   *
+   * @return The number of frames available for reading, that is less than
+   *         `frame_count` on timeout.
+   */
+  int wait_for_read(int frame_count, int timeout_ms)
+  {
+    frame_count = std::min(frame_count, capacity());
+    cubeb_deadline deadline(timeout_ms);
+    uint32_t watermark = frames_read_ + frame_count;
+
+    int frames = ring_buffer.available_read();
+    while (frames < frame_count) {
+      int remaining_ms = deadline.remaining_ms();
+      if (remaining_ms == 0) {
+        break;
+      }
+      consumer_watermark_.store(watermark, std::memory_order_relaxed);
+      consumer_waiting_.store(1, std::memory_order_seq_cst);
+      /* Check again after announcing that we're waiting, the producer might
+       * have crossed the watermark without seeing the flag. */
+      uint32_t written = frames_written_.load(std::memory_order_seq_cst);
+      if (static_cast<int32_t>(written - watermark) < 0) {
+        cubeb_futex_wait(&frames_written_, written, remaining_ms);
+      }
+      consumer_waiting_.store(0, std::memory_order_relaxed);
+      frames = ring_buffer.available_read();
+    }
+    return frames;
+  }
+  /**
+   * @brief Get the number of frames available for reading.
+   *
+   * Only safely called on the consumer thread.
+   */
+  int available_read() const
+  {
+    return ring_buffer.available_read();
+  }
+  /**
+   * @brief Get the number of frames available for writing.
+   *
+   * Only safely called on the producer thread.
+   */
+  int available_write() const
+  {
+    return ring_buffer.available_write();
+  }
+  /**
+   * @brief Get the total capacity, in frames.
+   *
+   * Can be called safely on any thread.
+   */
+  int capacity() const
+  {
+    return ring_buffer.capacity();
+  }
+private:
+  /**
+   * Account for `frame_count` frames that have just been published, and wake
+   * up the consumer if it's parked and its watermark has been crossed.
+   *
+   * @return `frame_count`
+   */
+  int notify(int frame_count)
+  {
+    if (!frame_count) {
+      return 0;
+    }
+    uint32_t written =
+      frames_written_.load(std::memory_order_relaxed) + frame_count;
+    /* Sequentially consistent, so that either the consumer sees the new count
+     * before parking, or we see that it's parked. */
+    frames_written_.store(written, std::memory_order_seq_cst);
+    if (consumer_waiting_.load(std::memory_order_seq_cst)) {
+      uint32_t watermark =
+        consumer_watermark_.load(std::memory_order_relaxed);
+      if (static_cast<int32_t>(written - watermark) >= 0) {
+        cubeb_futex_wake(&frames_written_);
+      }
+    }
+    return frame_count;
+  }
+  /** The underlying ring buffer that is used to store the data. */
+  audio_ring_buffer_base<T, Storage> ring_buffer;
+  /** Number of frames read so far, only used by the consumer. */
+  uint32_t frames_read_;
+  char padding_consumer_[CUBEB_CACHE_LINE_SIZE];
+  /** Number of frames written so far, only written by the producer. This is
+   * the futex the consumer sleeps on. */
+  std::atomic<uint32_t> frames_written_;
+  char padding_producer_[CUBEB_CACHE_LINE_SIZE];
+  /** Set while the consumer is parked. */
+  std::atomic<uint32_t> consumer_waiting_;
+  /** Value of `frames_written_` the parked consumer is waiting for. */
+  std::atomic<uint32_t> consumer_watermark_;
 };
 
 /**
@@ -491,5 +1175,16 @@ using lock_free_queue = ring_buffer_base<T>;
  */
 template<typename T>
 using lock_free_audio_ring_buffer = audio_ring_buffer_base<T>;
+/**
+ * Variants of `lock_free_queue` and `lock_free_audio_ring_buffer` whose
+ * storage is mirrored in virtual memory when possible, so that reads and
+ * writes never wrap. They fall back to a regular storage otherwise.
+ */
+template<typename T>
+using mirrored_lock_free_queue =
+  ring_buffer_base<T, ring_buffer_mirrored_storage<T>>;
+template<typename T>
+using mirrored_lock_free_audio_ring_buffer =
+  audio_ring_buffer_base<T, ring_buffer_mirrored_storage<T>>;
 
 #endif // CUBEB_RING_BUFFER_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_rt_check.h"
+#include <atomic>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The allocator of glibc, that the interposed functions forward to. Looking
+ * up malloc with dlsym would call malloc. */
+extern "C" {
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void * ptr, size_t size);
+void __libc_free(void * ptr);
+}
+
+namespace {
+
+/* Initial-exec, so that accessing them from malloc doesn't allocate. */
+__attribute__((tls_model("initial-exec"))) thread_local int rt_depth;
+__attribute__((tls_model("initial-exec"))) thread_local bool reporting;
+
+std::atomic<uint64_t> violations;
+
+const int MAX_FRAMES = 32;
+/** Hashes of the backtraces already printed. */
+const int MAX_REPORTED = 256;
+std::atomic<uint64_t> reported[MAX_REPORTED];
+
+void
+write_stderr(char const * str)
+{
+  /* Called while reporting, so the interposed write doesn't report it. */
+  ssize_t rv = write(STDERR_FILENO, str, strlen(str));
+  (void)rv;
+}
+
+/** Returns true if the backtrace hasn't been printed yet. */
+bool
+first_report(void * const * frames, int count)
+{
+  /* Skip the frames of the checker. */
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 2; i < count; i++) {
+    hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+  }
+  hash |= 1;
+  for (int i = 0; i < MAX_REPORTED; i++) {
+    uint64_t expected = 0;
+    if (reported[i].compare_exchange_strong(expected, hash) ||
+        expected == hash) {
+      return expected == 0;
+    }
+  }
+  return false;
+}
+
+void
+report(char const * function)
+{
+  violations.fetch_add(1, std::memory_order_relaxed);
+  /* Printing the backtrace calls the interposed functions. */
+  reporting = true;
+  void * frames[MAX_FRAMES];
+  int count = backtrace(frames, MAX_FRAMES);
+  if (first_report(frames, count)) {
+    write_stderr("cubeb: ");
+    write_stderr(function);
+    write_stderr(" called on a real-time thread\n");
+    backtrace_symbols_fd(frames + 1, count - 1, STDERR_FILENO);
+  }
+  reporting = false;
+}
+
+inline void
+check(char const * function)
+{
+  if (rt_depth && !reporting) {
+    report(function);
+  }
+}
+
+template<typename F>
+F
+resolve(std::atomic<F> & function, char const * name)
+{
+  F f = function.load(std::memory_order_relaxed);
+  if (!f) {
+    f = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+    function.store(f, std::memory_order_relaxed);
+  }
+  return f;
+}
+
+typedef int (* pthread_mutex_lock_function)(pthread_mutex_t * mutex);
+typedef ssize_t (* write_function)(int fd, void const * buf, size_t count);
+std::atomic<pthread_mutex_lock_function> real_pthread_mutex_lock;
+std::atomic<write_function> real_write;
+
+} // namespace
+
+void
+cubeb_rt_check_enter(void)
+{
+  rt_depth++;
+}
+
+void
+cubeb_rt_check_leave(void)
+{
+  rt_depth--;
+}
+
+uint64_t
+cubeb_rt_check_violations(void)
+{
+  return violations.load(std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void *
+malloc(size_t size)
+{
+  check("malloc");
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+  check("calloc");
+  return __libc_calloc(count, size);
+}
+
+void *
+realloc(void * ptr, size_t size)
+{
+  check("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void
+free(void * ptr)
+{
+  if (ptr) {
+    check("free");
+  }
+  __libc_free(ptr);
+}
+
+int
+pthread_mutex_lock(pthread_mutex_t * mutex)
+{
+  check("pthread_mutex_lock");
+  return resolve(real_pthread_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+ssize_t
+write(int fd, void const * buf, size_t count)
+{
+  check("write");
+  return resolve(real_write, "write")(fd, buf, count);
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_RT_CHECK_H
+#define CUBEB_RT_CHECK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Real-time safety checks, built when configuring with
+   -DCUBEB_RT_CHECKS=ON. The backends mark the code that runs on their audio
+   threads, around the data callbacks, as real-time. malloc, calloc, realloc,
+   free, pthread_mutex_lock and write are interposed, and calling them from a
+   real-time section is reported on stderr, with a backtrace, once for each
+   distinct backtrace. This interposes the allocator, so it can't be used
+   with the address or thread sanitizers. Without the option, the macros
+   compile to nothing. */
+
+/** Enter and leave a real-time section on the calling thread. Sections can
+    be nested. */
+void cubeb_rt_check_enter(void);
+void cubeb_rt_check_leave(void);
+/** Number of calls that were not real-time safe, since the start of the
+    process. */
+uint64_t cubeb_rt_check_violations(void);
+
+#if defined(CUBEB_RT_CHECKS)
+#define CUBEB_RT_BEGIN() cubeb_rt_check_enter()
+#define CUBEB_RT_END() cubeb_rt_check_leave()
+#else
+#define CUBEB_RT_BEGIN() do { } while (0)
+#define CUBEB_RT_END() do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+
+/** Marks the rest of the enclosing scope as real-time. */
+class cubeb_rt_scope
+{
+public:
+  cubeb_rt_scope() { CUBEB_RT_BEGIN(); }
+  ~cubeb_rt_scope() { CUBEB_RT_END(); }
+private:
+  cubeb_rt_scope(cubeb_rt_scope const &) = delete;
+  cubeb_rt_scope & operator=(cubeb_rt_scope const &) = delete;
+};
+
+#define CUBEB_RT_SCOPE() cubeb_rt_scope cubeb_rt_scope_
+#endif
+
+#endif // CUBEB_RT_CHECK_H
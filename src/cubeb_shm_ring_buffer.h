@@ -0,0 +1,491 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_SHM_RING_BUFFER_H
+#define CUBEB_SHM_RING_BUFFER_H
+
+#if defined(__linux__)
+
+#include "cubeb_futex.h"
+#include "cubeb_ringbuffer.h"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <type_traits>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#define F_GET_SEALS (1024 + 10)
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+/**
+ * Single producer single consumer lock-free audio ring buffer, that lives in
+ * memory shared between two processes.
+ *
+ * One process creates the ring buffer, and sends the file descriptor returned
+ * by `fd()` to the other process (e.g. with `SCM_RIGHTS`, or by inheritance),
+ * which attaches to it with the constructor that takes a file descriptor.
+ * Audio is then written directly in the shared memory by one side, and read
+ * directly from it by the other side, without any copy through a socket.
+ *
+ * Some words about the inner workings of this class:
+ * - The memory is a sealed `memfd`: it can't be shrunk or grown, so a
+ *   misbehaving peer can't make accesses fault. It starts with a header page,
+ *   that holds the format and the indices, followed by the samples.
+ * - The samples are mapped twice, back to back, so that all the regions handed
+ *   out by `reserve_write` and `peek_read` are contiguous.
+ * - The indices are free-running 32-bit frame counters, on separate cache
+ *   lines. The number of frames in the storage is a power of two, so the
+ *   counters wrap consistently with the storage.
+ * - Operations never block. The non-real-time side can block with
+ *   `wait_for_read` (resp. `wait_for_write`), that sleeps on the write (resp.
+ *   read) index with a futex. The other side only makes a system call to wake
+ *   it up if it's actually waiting.
+ * - The format is read from the header once, when attaching, and the indices
+ *   are clamped, so that a peer writing garbage to the header can't make this
+ *   process access memory outside the mapping.
+ */
+template <typename T>
+class shared_audio_ring_buffer
+{
+public:
+  /**
+   * Create a shared ring buffer.
+   *
+   * Check `valid()` before using the ring buffer, creating the shared memory
+   * can fail.
+   *
+   * @param channel_count Number of channels.
+   * @param capacity_in_frames The minimum number of frames the ring buffer
+   * will hold. It is rounded up to a power of two, and to a whole number of
+   * pages, see `capacity()`.
+   */
+  shared_audio_ring_buffer(int channel_count, int capacity_in_frames)
+    : fd_(-1)
+  {
+    static_assert(std::is_trivial<T>::value,
+                  "Only trivial types can be shared between processes.");
+    assert(channel_count > 0 && capacity_in_frames > 0);
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t frame_size = sizeof(T) * channel_count;
+    /* The samples must be a whole number of pages to be mapped twice. */
+    size_t frame_alignment = frame_size & -frame_size;
+    int min_frames = page_size > frame_alignment ?
+                     page_size / frame_alignment : 1;
+    uint32_t frame_count = ring_buffer_next_power_of_two(
+                             std::max(capacity_in_frames, min_frames));
+    size_t data_size = frame_count * frame_size;
+
+#if defined(SYS_memfd_create)
+    int fd = syscall(SYS_memfd_create, "cubeb-shm-ring-buffer",
+                     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    int fd = -1;
+#endif
+    if (fd < 0) {
+      return;
+    }
+    if (ftruncate(fd, page_size + data_size) != 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0 ||
+        !map(fd, page_size, data_size)) {
+      close(fd);
+      return;
+    }
+    fd_ = fd;
+    channel_count_ = channel_count;
+    frame_count_ = frame_count;
+
+    header_ = new (header_) header;
+    header_->magic = MAGIC;
+    header_->sample_size = sizeof(T);
+    header_->channel_count = channel_count;
+    header_->frame_count = frame_count;
+    header_->read_index.store(0, std::memory_order_relaxed);
+    header_->producer_waiting.store(0, std::memory_order_relaxed);
+    header_->consumer_waiting.store(0, std::memory_order_relaxed);
+    header_->write_index.store(0, std::memory_order_seq_cst);
+  }
+  /**
+   * Attach to a shared ring buffer created by another process.
+   *
+   * Check `valid()` before using the ring buffer, the file descriptor might
+   * not be a shared ring buffer of the right type.
+   *
+   * @param fd A file descriptor returned by `fd()`. It is not kept, and can be
+   * closed after this returns.
+   */
+  explicit shared_audio_ring_buffer(int fd)
+    : fd_(-1)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (fstat(fd, &st) != 0 || seals < 0 || !(seals & F_SEAL_SHRINK) ||
+        static_cast<size_t>(st.st_size) <= page_size) {
+      return;
+    }
+    size_t data_size = st.st_size - page_size;
+    if (data_size % page_size || !map(fd, page_size, data_size)) {
+      return;
+    }
+
+    /* Never read the format again, the other process can change it. */
+    uint32_t channel_count = header_->channel_count;
+    uint32_t frame_count = header_->frame_count;
+    if (header_->magic != MAGIC || header_->sample_size != sizeof(T) ||
+        channel_count == 0 || frame_count == 0 ||
+        (frame_count & (frame_count - 1)) ||
+        frame_count > INT_MAX / channel_count ||
+        static_cast<size_t>(frame_count) * channel_count * sizeof(T) !=
+          data_size) {
+      unmap();
+      return;
+    }
+    channel_count_ = channel_count;
+    frame_count_ = frame_count;
+  }
+  shared_audio_ring_buffer(const shared_audio_ring_buffer &) = delete;
+  shared_audio_ring_buffer & operator=(const shared_audio_ring_buffer &) = delete;
+  ~shared_audio_ring_buffer()
+  {
+    unmap();
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  /**
+   * Whether the shared memory has been successfully created or attached to.
+   * No other method can be called if this returns false.
+   */
+  bool valid() const
+  {
+    return header_ != nullptr;
+  }
+  /**
+   * File descriptor of the shared memory, to send to the other process. This
+   * is only valid on the side that created the ring buffer, and is closed
+   * when it's destroyed.
+   *
+   * @return A file descriptor, or -1 on the side that attached.
+   */
+  int fd() const
+  {
+    return fd_;
+  }
+  /**
+   * Push `frame_count` frames of audio in the ring buffer.
+   *
+   * Only safely called on the producer side.
+   *
+   * @param frames A pointer to a buffer containing at least `frame_count`
+   * frames of interleaved audio, or nullptr to write silence.
+   * @param frame_count The number of frames to write.
+   * @return The number of frames written.
+   */
+  int enqueue(const T * frames, int frame_count)
+  {
+    ring_buffer_region<T> region = reserve_write(frame_count);
+    int samples = frames_to_samples(region.first_length);
+    if (frames) {
+      PodCopy(region.first, frames, samples);
+    } else {
+      PodZero(region.first, samples);
+    }
+    commit_write(region.first_length);
+    return region.first_length;
+  }
+  /**
+   * Read `frame_count` frames of audio from the ring buffer.
+   *
+   * Only safely called on the consumer side.
+   *
+   * @param frames A pointer to a buffer with space for at least `frame_count`
+   * frames of interleaved audio, or nullptr to discard them.
+   * @param frame_count The number of frames to read.
+   * @return The number of frames read.
+   */
+  int dequeue(T * frames, int frame_count)
+  {
+    ring_buffer_region<T> region = peek_read(frame_count);
+    if (frames) {
+      PodCopy(frames, region.first, frames_to_samples(region.first_length));
+    }
+    consume(region.first_length);
+    return region.first_length;
+  }
+  /**
+   * Get direct access to at most `frame_count` frames of free space in the
+   * shared memory. The region is always contiguous, `second_length` is 0.
+   *
+   * Only safely called on the producer side.
+   *
+   * @param frame_count The maximum number of frames to reserve.
+   * @return A region with lengths in frames.
+   */
+  ring_buffer_region<T> reserve_write(int frame_count)
+  {
+    uint32_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+    int available = std::min(frame_count, available_write());
+    return region_internal(write_index, available);
+  }
+  /**
+   * Publish `frame_count` frames, previously obtained with `reserve_write`,
+   * to the consumer, and wake it up if it's waiting.
+   *
+   * Only safely called on the producer side.
+   *
+   * @param frame_count The number of frames that have been written.
+   */
+  void commit_write(int frame_count)
+  {
+    assert(frame_count <= available_write());
+    uint32_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+    /* Sequentially consistent, so that either the consumer sees the new index
+     * before sleeping, or we see that it's waiting. */
+    header_->write_index.store(write_index + frame_count,
+                               std::memory_order_seq_cst);
+    if (header_->consumer_waiting.load(std::memory_order_seq_cst)) {
+      cubeb_futex_wake(&header_->write_index);
+    }
+  }
+  /**
+   * Get direct access to at most `frame_count` frames available for reading
+   * in the shared memory. The region is always contiguous, `second_length`
+   * is 0.
+   *
+   * Only safely called on the consumer side.
+   *
+   * @param frame_count The maximum number of frames to peek at.
+   * @return A region with lengths in frames.
+   */
+  ring_buffer_region<T> peek_read(int frame_count)
+  {
+    uint32_t read_index = header_->read_index.load(std::memory_order_relaxed);
+    int available = std::min(frame_count, available_read());
+    return region_internal(read_index, available);
+  }
+  /**
+   * Release `frame_count` frames, previously obtained with `peek_read`, back
+   * to the producer, and wake it up if it's waiting.
+   *
+   * Only safely called on the consumer side.
+   *
+   * @param frame_count The number of frames that have been read.
+   */
+  void consume(int frame_count)
+  {
+    assert(frame_count <= available_read());
+    uint32_t read_index = header_->read_index.load(std::memory_order_relaxed);
+    header_->read_index.store(read_index + frame_count,
+                              std::memory_order_seq_cst);
+    if (header_->producer_waiting.load(std::memory_order_seq_cst)) {
+      cubeb_futex_wake(&header_->read_index);
+    }
+  }
+  /**
+   * Block until at least `frame_count` frames are available for reading, or
+   * until `timeout_ms` milliseconds have passed. A negative timeout waits
+   * forever. This is not real-time safe.
+   *
+   * Only safely called on the consumer side.
+   *
+   * @return The number of frames available for reading, that is less than
+   * `frame_count` on timeout.
+   */
+  int wait_for_read(int frame_count, int timeout_ms)
+  {
+    return wait(&header_->write_index, &header_->consumer_waiting,
+                [this] { return available_read(); },
+                std::min(frame_count, capacity()), timeout_ms);
+  }
+  /**
+   * Block until at least `frame_count` frames are available for writing, or
+   * until `timeout_ms` milliseconds have passed. A negative timeout waits
+   * forever. This is not real-time safe.
+   *
+   * Only safely called on the producer side.
+   *
+   * @return The number of frames available for writing, that is less than
+   * `frame_count` on timeout.
+   */
+  int wait_for_write(int frame_count, int timeout_ms)
+  {
+    return wait(&header_->read_index, &header_->producer_waiting,
+                [this] { return available_write(); },
+                std::min(frame_count, capacity()), timeout_ms);
+  }
+  /**
+   * Get the number of frames available for reading.
+   *
+   * Only safely called on the consumer side.
+   */
+  int available_read() const
+  {
+    uint32_t read_index = header_->read_index.load(std::memory_order_relaxed);
+    uint32_t write_index =
+      header_->write_index.load(std::memory_order_acquire);
+    return std::min(write_index - read_index, frame_count_);
+  }
+  /**
+   * Get the number of frames available for writing.
+   *
+   * Only safely called on the producer side.
+   */
+  int available_write() const
+  {
+    uint32_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+    uint32_t read_index = header_->read_index.load(std::memory_order_acquire);
+    return frame_count_ - std::min(write_index - read_index, frame_count_);
+  }
+  /**
+   * Get the total capacity of this ring buffer, in frames.
+   *
+   * Can be called safely on any thread.
+   */
+  int capacity() const
+  {
+    return frame_count_;
+  }
+  /**
+   * Get the number of channels of this ring buffer.
+   *
+   * Can be called safely on any thread.
+   */
+  int channel_count() const
+  {
+    return channel_count_;
+  }
+private:
+  static const uint32_t MAGIC = 0x63726231; /* "crb1" */
+  /** Start of the shared memory. */
+  struct header
+  {
+    uint32_t magic;
+    uint32_t sample_size;
+    uint32_t channel_count;
+    uint32_t frame_count;
+    char padding_format_[CUBEB_CACHE_LINE_SIZE];
+    /** Number of frames written so far, only written by the producer. */
+    std::atomic<uint32_t> write_index;
+    /** Set while the consumer is sleeping on `write_index`. */
+    std::atomic<uint32_t> consumer_waiting;
+    char padding_producer_[CUBEB_CACHE_LINE_SIZE];
+    /** Number of frames read so far, only written by the consumer. */
+    std::atomic<uint32_t> read_index;
+    /** Set while the producer is sleeping on `read_index`. */
+    std::atomic<uint32_t> producer_waiting;
+    char padding_consumer_[CUBEB_CACHE_LINE_SIZE];
+  };
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "A futex is a bare 32-bit integer.");
+
+  /**
+   * Map the header page, then the samples twice in a row.
+   *
+   * @return true on success.
+   */
+  bool map(int fd, size_t page_size, size_t data_size)
+  {
+    static_assert(sizeof(header) <= 4096, "The header must fit in a page.");
+    size_t mapping_size = page_size + 2 * data_size;
+    void * base = mmap(nullptr, mapping_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    char * first = static_cast<char *>(base);
+    if (mmap(first, page_size + data_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(first + page_size + data_size, data_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, page_size) == MAP_FAILED) {
+      munmap(base, mapping_size);
+      return false;
+    }
+    header_ = reinterpret_cast<header *>(first);
+    data_ = reinterpret_cast<T *>(first + page_size);
+    mapping_size_ = mapping_size;
+    return true;
+  }
+  void unmap()
+  {
+    if (header_) {
+      munmap(header_, mapping_size_);
+      header_ = nullptr;
+      data_ = nullptr;
+    }
+  }
+  template <typename Available>
+  int wait(std::atomic<uint32_t> * index, std::atomic<uint32_t> * waiting,
+           Available available, int frame_count, int timeout_ms)
+  {
+    cubeb_deadline deadline(timeout_ms);
+
+    int frames = available();
+    while (frames < frame_count) {
+      int remaining_ms = deadline.remaining_ms();
+      if (remaining_ms == 0) {
+        break;
+      }
+      waiting->store(1, std::memory_order_seq_cst);
+      uint32_t value = index->load(std::memory_order_seq_cst);
+      /* Check again after announcing that we're waiting, the other side might
+       * have made progress without seeing the flag. */
+      if (available() < frame_count) {
+        cubeb_futex_wait(index, value, remaining_ms);
+      }
+      waiting->store(0, std::memory_order_relaxed);
+      frames = available();
+    }
+    return frames;
+  }
+  ring_buffer_region<T> region_internal(uint32_t index, int frame_count) const
+  {
+    ring_buffer_region<T> region;
+    region.first = data_ + frames_to_samples(index & (frame_count_ - 1));
+    region.first_length = frame_count;
+    region.second = data_;
+    region.second_length = 0;
+    return region;
+  }
+  int frames_to_samples(int frames) const
+  {
+    return frames * channel_count_;
+  }
+  /** The header, at the start of the mapping. */
+  header * header_ = nullptr;
+  /** The samples, mapped twice after the header. */
+  T * data_ = nullptr;
+  size_t mapping_size_ = 0;
+  /** The memfd, only kept by the side that created the ring buffer. */
+  int fd_;
+  /** Format, copied out of the header. */
+  uint32_t channel_count_ = 0;
+  uint32_t frame_count_ = 0;
+};
+
+#endif // __linux__
+
+#endif // CUBEB_SHM_RING_BUFFER_H
@@ -16,6 +16,8 @@
 #include <assert.h>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_planar.h"
+#include "cubeb_threads.h"
 
 #if defined(CUBEB_SNDIO_DEBUG)
 #define DPR(...) fprintf(stderr, __VA_ARGS__);
@@ -79,6 +81,7 @@ struct cubeb_stream {
   cubeb_data_callback data_cb;    /* cb to preapare data */
   cubeb_state_callback state_cb;  /* cb to notify about state changes */
   float volume;			  /* current volume */
+  cubeb_planar_adapter *planar;   /* converts buffers of planar streams */
 };
 
 static void
@@ -159,10 +162,13 @@ sndio_mainloop(void *arg)
   size_t pstart = 0, pend = 0, rstart = 0, rend = 0;
   long nfr;
 
+  cubeb_thread_register(s->context, "cubeb-sndio");
   nfds = WRAP(sio_nfds)(s->hdl);
   pfds = calloc(nfds, sizeof (struct pollfd));
-  if (pfds == NULL)
-	  return NULL;
+  if (pfds == NULL) {
+    cubeb_thread_unregister();
+    return NULL;
+  }
 
   DPR("sndio_mainloop()\n");
   s->state_cb(s, s->arg, CUBEB_STATE_STARTED);
@@ -170,6 +176,7 @@ sndio_mainloop(void *arg)
   if (!WRAP(sio_start)(s->hdl)) {
     pthread_mutex_unlock(&s->mtx);
     free(pfds);
+    cubeb_thread_unregister();
     return NULL;
   }
   DPR("sndio_mainloop(), started\n");
@@ -209,7 +216,8 @@ sndio_mainloop(void *arg)
 
       /* invoke call-back, it returns less that s->nfr if done */
       pthread_mutex_unlock(&s->mtx);
-      nfr = s->data_cb(s, s->arg, s->rbuf, s->pbuf, s->nfr);
+      nfr = cubeb_planar_data_callback(s->planar, s->data_cb, s, s->arg,
+          s->rbuf, s->pbuf, s->nfr);
       pthread_mutex_lock(&s->mtx);
       if (nfr < 0) {
         DPR("sndio_mainloop() cb err\n");
@@ -257,6 +265,7 @@ sndio_mainloop(void *arg)
     if (nfds > 0) {
       pthread_mutex_unlock(&s->mtx);
       n = poll(pfds, nfds, -1);
+      cubeb_thread_wakeup();
       pthread_mutex_lock(&s->mtx);
       if (n < 0)
         continue;
@@ -298,6 +307,7 @@ sndio_mainloop(void *arg)
   pthread_mutex_unlock(&s->mtx);
   s->state_cb(s, s->arg, state);
   free(pfds);
+  cubeb_thread_unregister();
   return NULL;
 }
 
@@ -482,6 +492,9 @@ sndio_stream_init(cubeb * context,
     if (s->rbuf == NULL)
       goto err;
   }
+  if (cubeb_planar_adapter_create(input_stream_params, output_stream_params,
+      s->nfr, &s->planar) != CUBEB_OK)
+    goto err;
   s->volume = 1.;
   *stream = s;
   DPR("sndio_stream_init() end, ok\n");
@@ -541,6 +554,7 @@ sndio_stream_destroy(cubeb_stream *s)
     free(s->pbuf);
   if (s->mode & SIO_REC)
     free(s->rbuf);
+  cubeb_planar_adapter_destroy(s->planar);
   free(s);
 }
 
@@ -665,5 +679,13 @@ static struct cubeb_ops const sndio_ops = {
   .stream_get_current_device = NULL,
   .stream_device_destroy = NULL,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = NULL,
+  .stream_get_stats = NULL,
+  .stream_register_glitch_callback = NULL,
+  .stream_register_load_callback = NULL,
+  .stream_get_callback_histograms = NULL,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
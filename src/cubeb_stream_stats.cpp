@@ -0,0 +1,353 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_stream_stats.h"
+#include "cubeb_log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <new>
+
+/** Time constant of the exponentially weighted moving average of the load. */
+const double CUBEB_LOAD_AVERAGING_NS = 1e9;
+/** Time during which the peak load is held, unless a higher load replaces
+ * it. */
+const uint64_t CUBEB_LOAD_PEAK_HOLD_NS = 1000000000;
+
+/** Each power of two of the histograms is split into 2^4 buckets. */
+const uint32_t CUBEB_HISTOGRAM_SUB_BUCKET_BITS = 4;
+const uint32_t CUBEB_HISTOGRAM_SUB_BUCKETS = 1 << CUBEB_HISTOGRAM_SUB_BUCKET_BITS;
+static_assert(CUBEB_HISTOGRAM_BUCKET_COUNT % CUBEB_HISTOGRAM_SUB_BUCKETS == 0,
+              "The histograms must have a whole number of powers of two");
+
+/** Histogram written by a single thread, see cubeb_histogram. */
+struct histogram_counters {
+  std::atomic<uint64_t> buckets[CUBEB_HISTOGRAM_BUCKET_COUNT];
+};
+
+/** The counters are only written by the thread that calls the data callback,
+ * except the xrun counts, that some backends get on another thread. Readers
+ * load each counter separately. */
+struct cubeb_stream_stats_counters {
+  uint32_t rate;
+  cubeb_glitch_notifier * notifier;
+  std::atomic<uint64_t> callback_count;
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> duration_total_ns;
+  std::atomic<uint64_t> duration_min_ns;
+  std::atomic<uint64_t> duration_max_ns;
+  std::atomic<uint64_t> underruns;
+  std::atomic<uint64_t> overruns;
+  std::atomic<float> load;
+  std::atomic<float> load_peak;
+  /** When the peak load was reached, only used by the audio thread. */
+  uint64_t load_peak_time_ns;
+  /** When the last callback started, 0 before the first callback after the
+   * stream started. */
+  std::atomic<uint64_t> last_start_ns;
+  histogram_counters duration_histogram;
+  histogram_counters interval_histogram;
+  struct {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+  } phases[CUBEB_BACKEND_PHASE_COUNT];
+};
+
+namespace {
+
+uint64_t
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Increment a counter that only the calling thread writes, without a
+ * read-modify-write instruction. */
+void
+single_writer_add(std::atomic<uint64_t> & counter, uint64_t value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+uint32_t
+histogram_bucket(uint64_t value)
+{
+  if (value < CUBEB_HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  /* The position of the highest bit set gives the power of two, and the
+   * next bits the bucket within it. */
+#if __GNUC__ || __clang__
+  uint32_t exponent = 63 - __builtin_clzll(value);
+#else
+  uint32_t exponent = 0;
+  for (uint64_t v = value >> 1; v; v >>= 1) {
+    exponent++;
+  }
+#endif
+  uint32_t group = exponent - CUBEB_HISTOGRAM_SUB_BUCKET_BITS + 1;
+  if (group >= CUBEB_HISTOGRAM_BUCKET_COUNT / CUBEB_HISTOGRAM_SUB_BUCKETS) {
+    return CUBEB_HISTOGRAM_BUCKET_COUNT - 1;
+  }
+  uint32_t sub_bucket = (value >> (exponent - CUBEB_HISTOGRAM_SUB_BUCKET_BITS)) -
+                        CUBEB_HISTOGRAM_SUB_BUCKETS;
+  return group * CUBEB_HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+void
+histogram_record(histogram_counters & histogram, uint64_t value)
+{
+  single_writer_add(histogram.buckets[histogram_bucket(value)], 1);
+}
+
+void
+histogram_add_to(histogram_counters const & histogram, cubeb_histogram & out)
+{
+  for (uint32_t i = 0; i < CUBEB_HISTOGRAM_BUCKET_COUNT; i++) {
+    uint64_t count = histogram.buckets[i].load(std::memory_order_relaxed);
+    out.buckets[i] += count;
+    out.count += count;
+  }
+}
+
+} // namespace
+
+cubeb_stream_stats_counters *
+cubeb_stream_stats_counters_create(uint32_t rate,
+                                   cubeb_glitch_notifier * notifier)
+{
+  cubeb_stream_stats_counters * counters =
+    new (std::nothrow) cubeb_stream_stats_counters();
+  if (!counters) {
+    return nullptr;
+  }
+  counters->rate = rate;
+  counters->notifier = notifier;
+  counters->duration_min_ns.store(std::numeric_limits<uint64_t>::max(),
+                                  std::memory_order_relaxed);
+  counters->load.store(0, std::memory_order_relaxed);
+  counters->load_peak.store(0, std::memory_order_relaxed);
+  counters->load_peak_time_ns = 0;
+  return counters;
+}
+
+void
+cubeb_stream_stats_counters_destroy(cubeb_stream_stats_counters * counters)
+{
+  delete counters;
+}
+
+void
+cubeb_stream_stats_started(cubeb_stream_stats_counters * counters)
+{
+  if (counters) {
+    counters->last_start_ns.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t
+cubeb_stream_stats_callback_start(cubeb_stream_stats_counters * counters)
+{
+  if (!counters) {
+    return 0;
+  }
+  uint64_t start = now_ns();
+  /* The stream can be restarted from another thread, while the last
+   * callback before it stopped is running. */
+  uint64_t last_start = counters->last_start_ns.exchange(start, std::memory_order_relaxed);
+  if (last_start) {
+    histogram_record(counters->interval_histogram, start - last_start);
+  }
+  return start;
+}
+
+uint64_t
+cubeb_stream_stats_callback_end(cubeb_stream_stats_counters * counters,
+                                uint64_t start, long requested, long frames)
+{
+  if (!counters) {
+    return 0;
+  }
+  uint64_t end = now_ns();
+  uint64_t duration = end - start;
+  single_writer_add(counters->callback_count, 1);
+  if (frames > 0) {
+    single_writer_add(counters->frames, frames);
+  }
+  single_writer_add(counters->duration_total_ns, duration);
+  if (duration < counters->duration_min_ns.load(std::memory_order_relaxed)) {
+    counters->duration_min_ns.store(duration, std::memory_order_relaxed);
+  }
+  if (duration > counters->duration_max_ns.load(std::memory_order_relaxed)) {
+    counters->duration_max_ns.store(duration, std::memory_order_relaxed);
+  }
+  histogram_record(counters->duration_histogram, duration);
+
+  if (counters->rate == 0 || requested <= 0) {
+    ALOGV_HOT_CATEGORY(TIMING, "timing: %ld frames requested, %ld returned, "
+                       "in %llu ns", requested, frames,
+                       (unsigned long long)duration);
+    return end;
+  }
+  /* The load of this callback, and its weight in the average, are relative
+   * to the duration of the audio it was asked for, so that the average
+   * covers the same time whatever the buffer size. */
+  double buffer_ns = requested * 1e9 / counters->rate;
+  float load = duration / buffer_ns;
+  float average = counters->load.load(std::memory_order_relaxed);
+  float alpha = 1 - std::exp(-buffer_ns / CUBEB_LOAD_AVERAGING_NS);
+  average += alpha * (load - average);
+  counters->load.store(average, std::memory_order_relaxed);
+  if (load >= counters->load_peak.load(std::memory_order_relaxed) ||
+      end - counters->load_peak_time_ns > CUBEB_LOAD_PEAK_HOLD_NS) {
+    counters->load_peak.store(load, std::memory_order_relaxed);
+    counters->load_peak_time_ns = end;
+  }
+  ALOGV_HOT_CATEGORY(TIMING, "timing: %ld frames requested, %ld returned, "
+                     "in %llu ns, load %.3f, average %.3f", requested, frames,
+                     (unsigned long long)duration, load, average);
+  cubeb_glitch_report_load(counters->notifier, average);
+  return end;
+}
+
+uint64_t
+cubeb_stream_stats_now(void)
+{
+  return now_ns();
+}
+
+void
+cubeb_stream_stats_phase(cubeb_stream_stats_counters * counters,
+                         cubeb_backend_phase phase,
+                         uint64_t start, uint64_t end)
+{
+  if (!counters || !start || end < start) {
+    return;
+  }
+  uint64_t duration = end - start;
+  single_writer_add(counters->phases[phase].count, 1);
+  single_writer_add(counters->phases[phase].total_ns, duration);
+  if (duration > counters->phases[phase].max_ns.load(std::memory_order_relaxed)) {
+    counters->phases[phase].max_ns.store(duration, std::memory_order_relaxed);
+  }
+}
+
+void
+cubeb_stream_stats_underrun(cubeb_stream_stats_counters * counters,
+                            uint64_t count)
+{
+  if (counters) {
+    counters->underruns.fetch_add(count, std::memory_order_relaxed);
+  }
+}
+
+void
+cubeb_stream_stats_overrun(cubeb_stream_stats_counters * counters,
+                           uint64_t count)
+{
+  if (counters) {
+    counters->overruns.fetch_add(count, std::memory_order_relaxed);
+  }
+}
+
+void
+cubeb_stream_stats_counters_get(cubeb_stream_stats_counters * const * counters,
+                                size_t count,
+                                cubeb_stream_stats * stats)
+{
+  uint64_t total_ns = 0;
+  uint64_t min_ns = std::numeric_limits<uint64_t>::max();
+  *stats = cubeb_stream_stats();
+
+  for (size_t i = 0; i < count; i++) {
+    cubeb_stream_stats_counters * c = counters[i];
+    if (!c) {
+      continue;
+    }
+    stats->data_callback_count += c->callback_count.load(std::memory_order_relaxed);
+    stats->frames_delivered += c->frames.load(std::memory_order_relaxed);
+    total_ns += c->duration_total_ns.load(std::memory_order_relaxed);
+    min_ns = std::min(min_ns, c->duration_min_ns.load(std::memory_order_relaxed));
+    stats->callback_duration_max_ns =
+      std::max(stats->callback_duration_max_ns,
+               c->duration_max_ns.load(std::memory_order_relaxed));
+    stats->underrun_count += c->underruns.load(std::memory_order_relaxed);
+    stats->overrun_count += c->overruns.load(std::memory_order_relaxed);
+    /* The halves of a duplex stream run in parallel, the busiest one is
+     * the closest to glitching. */
+    stats->dsp_load = std::max(stats->dsp_load,
+                               c->load.load(std::memory_order_relaxed));
+    stats->dsp_load_peak = std::max(stats->dsp_load_peak,
+                                    c->load_peak.load(std::memory_order_relaxed));
+    for (int p = 0; p < CUBEB_BACKEND_PHASE_COUNT; p++) {
+      cubeb_phase_timing & timing = stats->backend_phases[p];
+      timing.count += c->phases[p].count.load(std::memory_order_relaxed);
+      timing.total_ns += c->phases[p].total_ns.load(std::memory_order_relaxed);
+      timing.max_ns = std::max(timing.max_ns,
+                               c->phases[p].max_ns.load(std::memory_order_relaxed));
+    }
+  }
+
+  if (stats->data_callback_count) {
+    /* The minimum can lag behind the count, when read while the first
+     * callback ends. */
+    if (min_ns != std::numeric_limits<uint64_t>::max()) {
+      stats->callback_duration_min_ns = min_ns;
+    }
+    stats->callback_duration_mean_ns = total_ns / stats->data_callback_count;
+  }
+}
+
+void
+cubeb_stream_stats_counters_get_histograms(cubeb_stream_stats_counters * const * counters,
+                                           size_t count,
+                                           cubeb_callback_histograms * histograms)
+{
+  *histograms = cubeb_callback_histograms();
+  for (size_t i = 0; i < count; i++) {
+    if (counters[i]) {
+      histogram_add_to(counters[i]->duration_histogram, histograms->duration);
+      histogram_add_to(counters[i]->interval_histogram, histograms->interval);
+    }
+  }
+}
+
+uint64_t
+cubeb_histogram_bucket_lower_bound(uint32_t bucket)
+{
+  if (bucket < CUBEB_HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t group = bucket / CUBEB_HISTOGRAM_SUB_BUCKETS;
+  uint64_t sub_bucket = bucket % CUBEB_HISTOGRAM_SUB_BUCKETS;
+  return (CUBEB_HISTOGRAM_SUB_BUCKETS + sub_bucket) << (group - 1);
+}
+
+uint64_t
+cubeb_histogram_percentile(cubeb_histogram const * histogram, double percentile)
+{
+  if (!histogram || histogram->count == 0) {
+    return 0;
+  }
+  /* The rank of the percentile, counting from 1. Multiplying first keeps
+   * exact ranks exact, such as the 99.9th of 1000. */
+  double rank = std::ceil(std::min(std::max(percentile, 0.0), 100.0) *
+                          histogram->count / 100);
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < CUBEB_HISTOGRAM_BUCKET_COUNT - 1; i++) {
+    seen += histogram->buckets[i];
+    if (seen > 0 && seen >= rank) {
+      return cubeb_histogram_bucket_lower_bound(i + 1);
+    }
+  }
+  return std::numeric_limits<uint64_t>::max();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_STREAM_STATS_H
+#define CUBEB_STREAM_STATS_H
+
+#include "cubeb/cubeb.h"
+#include "cubeb_glitch.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Counters behind cubeb_stream_get_stats. Backends update them around the
+    data callbacks, and when they detect an xrun. Updating the counters is
+    lock-free and doesn't allocate or make system calls, other than reading
+    the monotonic clock. Reading them never blocks the audio thread.
+
+    All the functions are no-ops when passed NULL counters, so that backends
+    don't have to check that they have been created. */
+typedef struct cubeb_stream_stats_counters cubeb_stream_stats_counters;
+
+/** @param rate The rate of the frames passed to the data callback, to compute
+                the load. 0 if unknown.
+    @param notifier The notifier to which the load is reported after each
+                    callback, can be NULL.
+    @retval The counters, or NULL if out of memory. */
+cubeb_stream_stats_counters * cubeb_stream_stats_counters_create(uint32_t rate,
+                                                                 cubeb_glitch_notifier * notifier);
+void cubeb_stream_stats_counters_destroy(cubeb_stream_stats_counters * counters);
+
+/** Called when a stream starts, so that the time it was stopped is not
+    counted as an interval between callbacks. */
+void cubeb_stream_stats_started(cubeb_stream_stats_counters * counters);
+/** Called before calling the data callback.
+    @retval The current time, to pass to cubeb_stream_stats_callback_end. */
+uint64_t cubeb_stream_stats_callback_start(cubeb_stream_stats_counters * counters);
+/** Called after the data callback returned.
+    @param start The value returned by cubeb_stream_stats_callback_start.
+    @param requested The number of frames passed to the data callback.
+    @param frames The value returned by the data callback.
+    @retval The current time, to start timing the next phase. */
+uint64_t cubeb_stream_stats_callback_end(cubeb_stream_stats_counters * counters,
+                                         uint64_t start, long requested,
+                                         long frames);
+/** @retval The current time, to pass to cubeb_stream_stats_phase. */
+uint64_t cubeb_stream_stats_now(void);
+/** Count the time spent in a phase of the backend. Nothing is counted if
+    start is 0.
+    @param start When the phase started.
+    @param end When the phase ended. */
+void cubeb_stream_stats_phase(cubeb_stream_stats_counters * counters,
+                              cubeb_backend_phase phase,
+                              uint64_t start, uint64_t end);
+void cubeb_stream_stats_underrun(cubeb_stream_stats_counters * counters,
+                                 uint64_t count);
+void cubeb_stream_stats_overrun(cubeb_stream_stats_counters * counters,
+                                uint64_t count);
+
+/** Read the counters. This can be called from any thread.
+    @param counters Array of counters to add up, for backends that make a
+                    duplex stream out of an input and an output stream. Some
+                    of them can be NULL.
+    @param count Number of counters.
+    @param stats The statistics. */
+void cubeb_stream_stats_counters_get(cubeb_stream_stats_counters * const * counters,
+                                     size_t count,
+                                     cubeb_stream_stats * stats);
+/** Read the histograms, like cubeb_stream_stats_counters_get. */
+void cubeb_stream_stats_counters_get_histograms(cubeb_stream_stats_counters * const * counters,
+                                                size_t count,
+                                                cubeb_callback_histograms * histograms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUBEB_STREAM_STATS_H
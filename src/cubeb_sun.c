@@ -16,6 +16,7 @@
 #include <limits.h>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_planar.h"
 
 /* Default to 4 + 1 for the default device. */
 #ifndef SUN_DEVICE_COUNT
@@ -88,6 +89,7 @@ struct cubeb_stream {
   cubeb_state_callback state_cb;
   uint64_t frames_written;
   uint64_t blocks_written;
+  cubeb_planar_adapter * planar; /* converts buffers of planar streams */
 };
 
 int
@@ -372,6 +374,7 @@ sun_stream_destroy(cubeb_stream * s)
   }
   free(s->play.buf);
   free(s->record.buf);
+  cubeb_planar_adapter_destroy(s->planar);
   free(s);
 }
 
@@ -439,8 +442,9 @@ sun_io_routine(void * arg)
       sun_linear32_to_float(s->record.buf,
                             s->record.info.record.channels * SUN_BUFFER_FRAMES);
     }
-    to_write = s->data_cb(s, s->user_ptr,
-                          s->record.buf, s->play.buf, SUN_BUFFER_FRAMES);
+    to_write = cubeb_planar_data_callback(s->planar, s->data_cb, s, s->user_ptr,
+                                          s->record.buf, s->play.buf,
+                                          SUN_BUFFER_FRAMES);
     if (to_write == CUBEB_ERROR) {
       state = CUBEB_STATE_ERROR;
       break;
@@ -611,6 +615,11 @@ sun_stream_init(cubeb * context,
     ret = CUBEB_ERROR;
     goto error;
   }
+  if (cubeb_planar_adapter_create(input_stream_params, output_stream_params,
+                                  SUN_BUFFER_FRAMES, &s->planar) != CUBEB_OK) {
+    ret = CUBEB_ERROR;
+    goto error;
+  }
   *stream = s;
   return CUBEB_OK;
 error:
@@ -726,5 +735,13 @@ static struct cubeb_ops const sun_ops = {
   .stream_get_current_device = sun_get_current_device,
   .stream_device_destroy = sun_stream_device_destroy,
   .stream_register_device_changed_callback = NULL,
-  .register_device_collection_changed = NULL
+  .register_device_collection_changed = NULL,
+  .stream_dump_flight_recorder = NULL,
+  .stream_get_stats = NULL,
+  .stream_register_glitch_callback = NULL,
+  .stream_register_load_callback = NULL,
+  .stream_get_callback_histograms = NULL,
+  .set_clock_mode = NULL,
+  .advance_clock = NULL,
+  .set_offline_params = NULL
 };
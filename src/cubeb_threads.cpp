@@ -0,0 +1,173 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_threads.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <pthread_np.h>
+#endif
+
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+#define CUBEB_HAVE_THREAD_CPU_CLOCK
+#endif
+
+namespace {
+
+struct thread_entry
+{
+  cubeb * owner;
+  char name[16];
+#if defined(CUBEB_HAVE_THREAD_CPU_CLOCK)
+  /** CPU-time clock of the thread, readable from any thread while it is
+   * registered. */
+  clockid_t cpu_clock;
+  bool has_cpu_clock;
+#endif
+  /** Only incremented by the thread itself. */
+  std::atomic<uint64_t> wakeups;
+};
+
+/** Protects the list, and keeps the threads in it from unregistering while
+ * their clocks are being read. */
+std::mutex g_threads_mutex;
+std::vector<thread_entry *> g_threads;
+thread_local thread_entry * t_current_thread = nullptr;
+
+void
+set_thread_name(char const * name)
+{
+#if defined(__linux__)
+  pthread_setname_np(pthread_self(), name);
+#elif defined(__APPLE__)
+  pthread_setname_np(name);
+#elif defined(__FreeBSD__) || defined(__OpenBSD__)
+  pthread_set_name_np(pthread_self(), name);
+#elif defined(__NetBSD__)
+  pthread_setname_np(pthread_self(), "%s", const_cast<char *>(name));
+#else
+  (void)name;
+#endif
+}
+
+double
+thread_cpu_seconds(thread_entry const * thread)
+{
+#if defined(CUBEB_HAVE_THREAD_CPU_CLOCK)
+  struct timespec ts;
+  if (thread->has_cpu_clock && clock_gettime(thread->cpu_clock, &ts) == 0) {
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+#else
+  (void)thread;
+#endif
+  return 0.0;
+}
+
+} // namespace
+
+void
+cubeb_thread_register(cubeb * owner, char const * name)
+{
+  if (t_current_thread) {
+    return;
+  }
+  thread_entry * thread = new (std::nothrow) thread_entry();
+  if (!thread) {
+    return;
+  }
+  thread->owner = owner;
+  strncpy(thread->name, name, sizeof(thread->name) - 1);
+  thread->name[sizeof(thread->name) - 1] = '\0';
+  set_thread_name(thread->name);
+#if defined(CUBEB_HAVE_THREAD_CPU_CLOCK)
+  thread->has_cpu_clock =
+    pthread_getcpuclockid(pthread_self(), &thread->cpu_clock) == 0;
+#endif
+  thread->wakeups.store(0, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(g_threads_mutex);
+  g_threads.push_back(thread);
+  t_current_thread = thread;
+}
+
+void
+cubeb_thread_wakeup(void)
+{
+  thread_entry * thread = t_current_thread;
+  if (thread) {
+    thread->wakeups.store(thread->wakeups.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+  }
+}
+
+void
+cubeb_thread_unregister(void)
+{
+  thread_entry * thread = t_current_thread;
+  if (!thread) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_threads_mutex);
+    g_threads.erase(std::remove(g_threads.begin(), g_threads.end(), thread),
+                    g_threads.end());
+  }
+  t_current_thread = nullptr;
+  delete thread;
+}
+
+int
+cubeb_threads_get(cubeb * owner, cubeb_thread_collection * collection)
+{
+  std::lock_guard<std::mutex> lock(g_threads_mutex);
+  collection->threads = nullptr;
+  collection->count = 0;
+  if (g_threads.empty()) {
+    return CUBEB_OK;
+  }
+  cubeb_thread_info * threads = static_cast<cubeb_thread_info *>(
+    calloc(g_threads.size(), sizeof(cubeb_thread_info)));
+  if (!threads) {
+    return CUBEB_ERROR;
+  }
+  size_t count = 0;
+  for (thread_entry * thread : g_threads) {
+    if (thread->owner && thread->owner != owner) {
+      continue;
+    }
+    cubeb_thread_info & info = threads[count++];
+    memcpy(info.name, thread->name, sizeof(info.name));
+    info.cpu_seconds = thread_cpu_seconds(thread);
+    info.wakeups = thread->wakeups.load(std::memory_order_relaxed);
+  }
+  if (count == 0) {
+    free(threads);
+    return CUBEB_OK;
+  }
+  collection->threads = threads;
+  collection->count = count;
+  return CUBEB_OK;
+}
+
+void
+cubeb_threads_collection_destroy(cubeb_thread_collection * collection)
+{
+  free(collection->threads);
+  collection->threads = nullptr;
+  collection->count = 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_THREADS_H
+#define CUBEB_THREADS_H
+
+#include "cubeb/cubeb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Accounting of the threads created by cubeb, so that the CPU time they use
+   can be attributed to them. A thread registers itself when it starts, and
+   unregisters before it exits. */
+
+/** Name the calling thread, and register it.
+    @param owner The context the thread works for, or NULL for the threads
+                 shared by all the contexts.
+    @param name The name of the thread. Truncated to 15 characters, the
+                maximum on Linux. */
+void cubeb_thread_register(cubeb * owner, char const * name);
+/** Count a wakeup of the calling thread, after it waited for work. Does
+    nothing if the thread isn't registered. */
+void cubeb_thread_wakeup(void);
+/** Unregister the calling thread. Its CPU time can't be read once it has
+    exited. */
+void cubeb_thread_unregister(void);
+
+/** Implementation of cubeb_get_threads and cubeb_thread_collection_destroy.
+    Lists the threads of `owner`, and the threads shared by all the
+    contexts. */
+int cubeb_threads_get(cubeb * owner, cubeb_thread_collection * collection);
+void cubeb_threads_collection_destroy(cubeb_thread_collection * collection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUBEB_THREADS_H
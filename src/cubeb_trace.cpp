@@ -0,0 +1,282 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "cubeb_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+int g_cubeb_trace_enabled;
+
+namespace {
+
+uint64_t
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct trace_event_slot
+{
+  std::atomic<uint64_t> timestamp_ns;
+  std::atomic<char const *> name;
+  std::atomic<int> phase;
+};
+
+/** The events of a thread, in a ring buffer. Only the thread that owns the
+ * buffer writes to it. It marks a slot as claimed before overwriting it, and
+ * as published after, so that a reader can tell which of the events it copied
+ * have been overwritten while it was copying them. The event fields are
+ * atomics, so that racing with the writer is not undefined behaviour.
+ *
+ * A buffer is released when its thread exits, and reused by the next thread
+ * that records an event. Its events are kept until then. */
+struct trace_thread_buffer
+{
+  /* Protected by g_trace_mutex. */
+  char thread_name[16];
+  bool in_use;
+  /** Incremented each time a thread takes the buffer, so that the threads
+   * that used it have different ids in the trace. */
+  uint32_t generation;
+  /** Index of the first event of the current, or last, thread. */
+  uint64_t first_event;
+
+  std::atomic<uint64_t> claimed;
+  std::atomic<uint64_t> published;
+  trace_event_slot events[CUBEB_TRACE_BUFFER_SIZE];
+};
+
+static_assert((CUBEB_TRACE_BUFFER_SIZE & (CUBEB_TRACE_BUFFER_SIZE - 1)) == 0,
+              "The size of the trace buffers must be a power of two");
+
+/** Buffers for all the threads, allocated the first time tracing is enabled,
+ * and never freed, because threads can record events at any time. */
+struct trace_buffers
+{
+  trace_thread_buffer threads[CUBEB_TRACE_MAX_THREADS];
+  /** When tracing was last enabled. Older events are not written out. */
+  std::atomic<uint64_t> start_ns;
+};
+
+std::atomic<trace_buffers *> g_trace_buffers;
+std::mutex g_trace_mutex;
+
+/** Sentinel for threads that couldn't get a buffer. */
+trace_thread_buffer * const NO_BUFFER = reinterpret_cast<trace_thread_buffer *>(1);
+
+/** The buffer of the calling thread, released when the thread exits. */
+struct trace_thread_slot
+{
+  trace_thread_buffer * buffer = nullptr;
+  ~trace_thread_slot()
+  {
+    if (buffer && buffer != NO_BUFFER) {
+      std::lock_guard<std::mutex> lock(g_trace_mutex);
+      buffer->in_use = false;
+    }
+    /* Events recorded later during the thread's exit are dropped. */
+    buffer = NO_BUFFER;
+  }
+};
+
+trace_thread_buffer *
+thread_buffer()
+{
+  static thread_local trace_thread_slot slot;
+  if (slot.buffer) {
+    return slot.buffer == NO_BUFFER ? nullptr : slot.buffer;
+  }
+  trace_buffers * buffers = g_trace_buffers.load(std::memory_order_acquire);
+  if (!buffers) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(g_trace_mutex);
+  trace_thread_buffer * buffer = nullptr;
+  for (trace_thread_buffer & b : buffers->threads) {
+    if (!b.in_use) {
+      buffer = &b;
+      break;
+    }
+  }
+  if (!buffer) {
+    slot.buffer = NO_BUFFER;
+    return nullptr;
+  }
+  buffer->in_use = true;
+  buffer->generation++;
+  /* The events of the previous thread are not written out anymore. */
+  buffer->first_event = buffer->claimed.load(std::memory_order_relaxed);
+  buffer->thread_name[0] = '\0';
+#if defined(__linux__)
+  if (pthread_getname_np(pthread_self(), buffer->thread_name,
+                         sizeof(buffer->thread_name)) != 0) {
+    buffer->thread_name[0] = '\0';
+  }
+#endif
+  slot.buffer = buffer;
+  return buffer;
+}
+
+/** Write out a string, escaped for JSON. */
+void
+write_json_string(FILE * file, char const * str)
+{
+  fputc('"', file);
+  for (; *str; str++) {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+struct trace_event
+{
+  uint64_t timestamp_ns;
+  char const * name;
+  int phase;
+};
+
+/** Copy the events of a thread that are still in its buffer, oldest first. */
+void
+read_thread_buffer(trace_thread_buffer & buffer, uint64_t start_ns,
+                   std::vector<trace_event> & events)
+{
+  events.clear();
+  uint64_t end = buffer.published.load(std::memory_order_acquire);
+  uint64_t begin = end > CUBEB_TRACE_BUFFER_SIZE ? end - CUBEB_TRACE_BUFFER_SIZE : 0;
+  begin = std::max(begin, buffer.first_event);
+  for (uint64_t i = begin; i < end; i++) {
+    trace_event_slot & slot = buffer.events[i & (CUBEB_TRACE_BUFFER_SIZE - 1)];
+    trace_event event;
+    event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.phase = slot.phase.load(std::memory_order_relaxed);
+    events.push_back(event);
+  }
+  /* Drop the events that the thread has started to overwrite. */
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t claimed = buffer.claimed.load(std::memory_order_relaxed);
+  size_t overwritten = 0;
+  if (claimed > CUBEB_TRACE_BUFFER_SIZE && claimed - CUBEB_TRACE_BUFFER_SIZE > begin) {
+    overwritten = std::min<uint64_t>(claimed - CUBEB_TRACE_BUFFER_SIZE - begin,
+                                     events.size());
+  }
+  events.erase(events.begin(), events.begin() + overwritten);
+  /* Drop the events from before tracing was enabled. */
+  size_t old = 0;
+  while (old < events.size() && events[old].timestamp_ns < start_ns) {
+    old++;
+  }
+  events.erase(events.begin(), events.begin() + old);
+}
+
+} // namespace
+
+void
+cubeb_trace_event(char const * name, cubeb_trace_phase phase)
+{
+  trace_thread_buffer * buffer = thread_buffer();
+  if (!buffer) {
+    return;
+  }
+  uint64_t index = buffer->claimed.load(std::memory_order_relaxed);
+  trace_event_slot & slot = buffer->events[index & (CUBEB_TRACE_BUFFER_SIZE - 1)];
+
+  buffer->claimed.store(index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp_ns.store(now_ns(), std::memory_order_relaxed);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.phase.store(phase, std::memory_order_relaxed);
+  buffer->published.store(index + 1, std::memory_order_release);
+}
+
+int
+cubeb_trace_set_enabled(int enabled)
+{
+  std::lock_guard<std::mutex> lock(g_trace_mutex);
+  if (!enabled) {
+    g_cubeb_trace_enabled = 0;
+    return CUBEB_OK;
+  }
+  trace_buffers * buffers = g_trace_buffers.load(std::memory_order_relaxed);
+  if (!buffers) {
+    buffers = new (std::nothrow) trace_buffers();
+    if (!buffers) {
+      return CUBEB_ERROR;
+    }
+    g_trace_buffers.store(buffers, std::memory_order_release);
+  }
+  if (!g_cubeb_trace_enabled) {
+    buffers->start_ns.store(now_ns(), std::memory_order_relaxed);
+    g_cubeb_trace_enabled = 1;
+  }
+  return CUBEB_OK;
+}
+
+int
+cubeb_trace_write(char const * path)
+{
+  std::lock_guard<std::mutex> lock(g_trace_mutex);
+  FILE * file = fopen(path, "w");
+  if (!file) {
+    return CUBEB_ERROR;
+  }
+
+  /* Chrome trace event format, that Perfetto can also open. Timestamps are
+   * in microseconds. */
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+  trace_buffers * buffers = g_trace_buffers.load(std::memory_order_acquire);
+  if (buffers) {
+    uint64_t start_ns = buffers->start_ns.load(std::memory_order_relaxed);
+    std::vector<trace_event> events;
+    events.reserve(CUBEB_TRACE_BUFFER_SIZE);
+    for (int t = 0; t < CUBEB_TRACE_MAX_THREADS; t++) {
+      trace_thread_buffer & buffer = buffers->threads[t];
+      read_thread_buffer(buffer, start_ns, events);
+      if (events.empty()) {
+        continue;
+      }
+      /* A different id for each thread that has used this buffer. */
+      unsigned tid = t + 1 + (buffer.generation - 1) * CUBEB_TRACE_MAX_THREADS;
+      fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", tid);
+      write_json_string(file, buffer.thread_name[0] ? buffer.thread_name : "cubeb");
+      fprintf(file, "}}");
+      first = false;
+      for (trace_event const & event : events) {
+        fprintf(file, ",\n{\"name\":");
+        write_json_string(file, event.name);
+        fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                event.phase == CUBEB_TRACE_PHASE_BEGIN ? 'B' : 'E',
+                (event.timestamp_ns - start_ns) / 1e3, tid);
+      }
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  int rv = ferror(file) ? CUBEB_ERROR : CUBEB_OK;
+  if (fclose(file) != 0) {
+    rv = CUBEB_ERROR;
+  }
+  return rv;
+}
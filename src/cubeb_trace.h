@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#ifndef CUBEB_TRACE_H
+#define CUBEB_TRACE_H
+
+#include "cubeb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of events kept for each thread. Older events are overwritten. */
+#define CUBEB_TRACE_BUFFER_SIZE 4096
+/** Number of threads that can record events at the same time. A thread's
+    buffer is reused once it has exited, events of additional threads are
+    dropped. */
+#define CUBEB_TRACE_MAX_THREADS 32
+
+/** Set by cubeb_set_tracing. Checked before recording an event, so that
+    tracing costs a single comparison when disabled. */
+extern int g_cubeb_trace_enabled;
+
+typedef enum {
+  CUBEB_TRACE_PHASE_BEGIN,
+  CUBEB_TRACE_PHASE_END
+} cubeb_trace_phase;
+
+/** Record an event in the buffer of the calling thread. This doesn't lock,
+    allocate or make system calls, except the first time a thread records an
+    event, to get a buffer and its name.
+    @param name A string literal, only its address is stored. */
+void cubeb_trace_event(char const * name, cubeb_trace_phase phase);
+
+/** Implementation of cubeb_set_tracing and cubeb_write_trace. */
+int cubeb_trace_set_enabled(int enabled);
+int cubeb_trace_write(char const * path);
+
+#define CUBEB_TRACE_BEGIN(name) do {                          \
+    if (CUBEB_UNLIKELY(g_cubeb_trace_enabled)) {              \
+      cubeb_trace_event(name, CUBEB_TRACE_PHASE_BEGIN);       \
+    }                                                         \
+  } while(0)
+
+#define CUBEB_TRACE_END(name) do {                            \
+    if (CUBEB_UNLIKELY(g_cubeb_trace_enabled)) {              \
+      cubeb_trace_event(name, CUBEB_TRACE_PHASE_END);         \
+    }                                                         \
+  } while(0)
+
+#ifdef __cplusplus
+}
+
+/** Records a begin event, and the matching end event when going out of
+    scope. The end event is only recorded if the begin event was, so that
+    they match even if tracing is toggled in between. */
+class cubeb_trace_scope
+{
+public:
+  explicit cubeb_trace_scope(char const * name)
+    : name(name)
+    , traced(CUBEB_UNLIKELY(g_cubeb_trace_enabled))
+  {
+    if (traced) {
+      cubeb_trace_event(name, CUBEB_TRACE_PHASE_BEGIN);
+    }
+  }
+  ~cubeb_trace_scope()
+  {
+    if (traced) {
+      cubeb_trace_event(name, CUBEB_TRACE_PHASE_END);
+    }
+  }
+private:
+  cubeb_trace_scope(cubeb_trace_scope const &) = delete;
+  cubeb_trace_scope & operator=(cubeb_trace_scope const &) = delete;
+  char const * const name;
+  bool const traced;
+};
+
+#define CUBEB_TRACE_SCOPE(name) cubeb_trace_scope cubeb_trace_scope_(name)
+#endif
+
+#endif // CUBEB_TRACE_H
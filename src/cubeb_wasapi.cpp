@@ -1024,7 +1024,7 @@ bool get_input_buffer(cubeb_stream * stm)
     offset += input_stream_samples;
   }
 
-  ALOGV("get_input_buffer: got %d frames", offset);
+  ALOGV_HOT("get_input_buffer: got %d frames", offset);
 
   XASSERT(stm->linear_input_buffer->length() >= offset);
 
@@ -1122,13 +1122,13 @@ refill_callback_duplex(cubeb_stream * stm)
 
   stm->total_output_frames += output_frames;
 
-  ALOGV("in: %zu, out: %zu, missing: %ld, ratio: %f",
+  ALOGV_HOT("in: %zu, out: %zu, missing: %ld, ratio: %f",
         stm->total_input_frames, stm->total_output_frames,
         static_cast<long>(stm->total_output_frames) - stm->total_input_frames,
         static_cast<float>(stm->total_output_frames) / stm->total_input_frames);
 
   if (stm->has_dummy_output) {
-    ALOGV("Duplex callback (dummy output): input frames: %Iu, output frames: %Iu",
+    ALOGV_HOT("Duplex callback (dummy output): input frames: %Iu, output frames: %Iu",
           input_frames, output_frames);
 
     // We don't want to expose the dummy output to the callback so don't pass
@@ -1139,7 +1139,7 @@ refill_callback_duplex(cubeb_stream * stm)
            nullptr,
            0);
   } else {
-    ALOGV("Duplex callback: input frames: %Iu, output frames: %Iu",
+    ALOGV_HOT("Duplex callback: input frames: %Iu, output frames: %Iu",
           input_frames, output_frames);
 
     refill(stm,
@@ -1182,7 +1182,7 @@ refill_callback_input(cubeb_stream * stm)
     return true;
   }
 
-  ALOGV("Input callback: input frames: %Iu", input_frames);
+  ALOGV_HOT("Input callback: input frames: %Iu", input_frames);
 
   long read = refill(stm,
                      stm->linear_input_buffer->data(),
@@ -1222,7 +1222,7 @@ refill_callback_output(cubeb_stream * stm)
                     output_buffer,
                     output_frames);
 
-  ALOGV("Output callback: output frames requested: %Iu, got %ld",
+  ALOGV_HOT("Output callback: output frames requested: %Iu, got %ld",
         output_frames, got);
 
   XASSERT(got >= 0);
@@ -2430,8 +2430,11 @@ int setup_wasapi_stream(cubeb_stream * stm)
    that WASAPI wants. */
   cubeb_stream_params input_params = stm->input_mix_params;
   input_params.channels = stm->input_stream_params.channels;
+  /* The layout of the buffers of the callback is the one of the stream. */
+  input_params.prefs = stm->input_stream_params.prefs;
   cubeb_stream_params output_params = stm->output_mix_params;
   output_params.channels = stm->output_stream_params.channels;
+  output_params.prefs = stm->output_stream_params.prefs;
 
   stm->resampler.reset(
     cubeb_resampler_create(stm,
@@ -2764,7 +2767,6 @@ int wasapi_stream_start(cubeb_stream * stm)
     return CUBEB_ERROR;
   }
 
-  cubeb_async_log_reset_threads();
   stm->thread = (HANDLE) _beginthreadex(NULL, 512 * 1024, wasapi_stream_render_loop, stm, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
   if (stm->thread == NULL) {
     LOG("could not create WASAPI render thread.");
@@ -3333,5 +3335,13 @@ cubeb_ops const wasapi_ops = {
   /*.stream_device_destroy =*/ NULL,
   /*.stream_register_device_changed_callback =*/ NULL,
   /*.register_device_collection_changed =*/ wasapi_register_device_collection_changed,
+  /*.stream_dump_flight_recorder =*/ NULL,
+  /*.stream_get_stats =*/ NULL,
+  /*.stream_register_glitch_callback =*/ NULL,
+  /*.stream_register_load_callback =*/ NULL,
+  /*.stream_get_callback_histograms =*/ NULL,
+  /*.set_clock_mode =*/ NULL,
+  /*.advance_clock =*/ NULL,
+  /*.set_offline_params =*/ NULL,
 };
 } // namespace anonymous
@@ -18,6 +18,7 @@
 #include <math.h>
 #include "cubeb/cubeb.h"
 #include "cubeb-internal.h"
+#include "cubeb_planar.h"
 
 /* This is missing from the MinGW headers. Use a safe fallback. */
 #if !defined(MEMORY_ALLOCATION_ALIGNMENT)
@@ -110,6 +111,8 @@ struct cubeb_stream {
   CRITICAL_SECTION lock;
   uint64_t written;
   float soft_volume;
+  /* Converts the buffers of planar streams. */
+  cubeb_planar_adapter * planar;
 };
 
 static size_t
@@ -180,7 +183,8 @@ winmm_refill_stream(cubeb_stream * stm)
   /* It is assumed that the caller is holding this lock.  It must be dropped
      during the callback to avoid deadlocks. */
   LeaveCriticalSection(&stm->lock);
-  got = stm->data_callback(stm, stm->user_ptr, NULL, hdr->lpData, wanted);
+  got = cubeb_planar_data_callback(stm->planar, stm->data_callback, stm,
+                                   stm->user_ptr, NULL, hdr->lpData, wanted);
   EnterCriticalSection(&stm->lock);
   if (got < 0) {
     LeaveCriticalSection(&stm->lock);
@@ -503,6 +507,13 @@ winmm_stream_init(cubeb * context, cubeb_stream ** stream, char const * stream_n
 
   stm->soft_volume = -1.0;
 
+  if (cubeb_planar_adapter_create(NULL, output_stream_params,
+                                  bufsz / bytes_per_frame(stm->params),
+                                  &stm->planar) != CUBEB_OK) {
+    winmm_stream_destroy(stm);
+    return CUBEB_ERROR;
+  }
+
   /* winmm_buffer_callback will be called during waveOutOpen, so all
      other initialization must be complete before calling it. */
   r = waveOutOpen(&stm->waveout, WAVE_MAPPER, &wfx.Format,
@@ -599,6 +610,8 @@ winmm_stream_destroy(cubeb_stream * stm)
     free(stm->buffers[i].lpData);
   }
 
+  cubeb_planar_adapter_destroy(stm->planar);
+
   EnterCriticalSection(&stm->context->lock);
   XASSERT(stm->context->active_streams >= 1);
   stm->context->active_streams -= 1;
@@ -1064,5 +1077,13 @@ static struct cubeb_ops const winmm_ops = {
   /*.stream_get_current_device =*/ NULL,
   /*.stream_device_destroy =*/ NULL,
   /*.stream_register_device_changed_callback=*/ NULL,
-  /*.register_device_collection_changed =*/ NULL
+  /*.register_device_collection_changed =*/ NULL,
+  /*.stream_dump_flight_recorder =*/ NULL,
+  /*.stream_get_stats =*/ NULL,
+  /*.stream_register_glitch_callback =*/ NULL,
+  /*.stream_register_load_callback =*/ NULL,
+  /*.stream_get_callback_histograms =*/ NULL,
+  /*.set_clock_mode =*/ NULL,
+  /*.advance_clock =*/ NULL,
+  /*.set_offline_params =*/ NULL
 };
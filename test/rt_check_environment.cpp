@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+/* Linked in the tests when building with CUBEB_RT_CHECKS: fails the run if
+   a test called functions that are not real-time safe from the audio
+   threads. The checker prints the backtraces. */
+
+#include "gtest/gtest.h"
+#include "cubeb_rt_check.h"
+#include <string>
+
+namespace {
+
+class rt_check_listener : public ::testing::EmptyTestEventListener
+{
+public:
+  void OnTestStart(::testing::TestInfo const &) override
+  {
+    violations_at_start = cubeb_rt_check_violations();
+  }
+
+  void OnTestEnd(::testing::TestInfo const & test_info) override
+  {
+    uint64_t violations = cubeb_rt_check_violations() - violations_at_start;
+    if (violations) {
+      failed_tests += std::string(" ") + test_info.test_case_name() + "." +
+                      test_info.name() + " (" + std::to_string(violations) + ")";
+    }
+  }
+
+  uint64_t violations_at_start = 0;
+  std::string failed_tests;
+};
+
+class rt_check_environment : public ::testing::Environment
+{
+public:
+  void SetUp() override
+  {
+    listener = new rt_check_listener();
+    /* The listeners own the listener. */
+    ::testing::UnitTest::GetInstance()->listeners().Append(listener);
+  }
+
+  void TearDown() override
+  {
+    EXPECT_TRUE(listener->failed_tests.empty())
+      << "Calls that are not real-time safe on audio threads in:"
+      << listener->failed_tests;
+  }
+
+private:
+  rt_check_listener * listener = nullptr;
+};
+
+::testing::Environment * const rt_check_environment_instance =
+  ::testing::AddGlobalTestEnvironment(new rt_check_environment());
+
+} // namespace
@@ -0,0 +1,125 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb_array_queue.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(cubeb, array_queue)
+{
+  const size_t num = 7;
+  uintptr_t items[2 * num];
+  array_queue * aq = array_queue_create(num);
+
+  ASSERT_EQ(array_queue_get_size(aq), 0u);
+  ASSERT_EQ(array_queue_pop(aq), nullptr);
+
+  for (size_t lap = 0; lap < 5; lap++) {
+    for (size_t i = 0; i < num; i++) {
+      ASSERT_EQ(array_queue_push(aq, &items[i]), 0);
+      ASSERT_EQ(array_queue_get_size(aq), i + 1);
+    }
+    /* Full. */
+    ASSERT_EQ(array_queue_push(aq, &items[num]), -1);
+    ASSERT_EQ(array_queue_get_size(aq), num);
+
+    for (size_t i = 0; i < num; i++) {
+      ASSERT_EQ(array_queue_pop(aq), &items[i]);
+    }
+    ASSERT_EQ(array_queue_pop(aq), nullptr);
+    ASSERT_EQ(array_queue_get_size(aq), 0u);
+
+    /* Interleaved. */
+    for (size_t i = 0; i < 2 * num; i++) {
+      ASSERT_EQ(array_queue_push(aq, &items[i]), 0);
+      ASSERT_EQ(array_queue_pop(aq), &items[i]);
+    }
+  }
+
+  array_queue_destroy(aq);
+}
+
+/* Several producers and consumers hammer the same queue. Each item is a
+   tagged value, that must come out exactly once. Run this under TSAN
+   (-DSANITIZE_THREAD=ON) to check the memory ordering. */
+TEST(cubeb, array_queue_stress)
+{
+  const int producers = 4;
+  const int consumers = 4;
+  const uintptr_t items_per_producer = 50000;
+  array_queue * aq = array_queue_create(16);
+  std::vector<std::atomic<int>> seen(producers * items_per_producer);
+  for (auto & s : seen) {
+    s.store(0);
+  }
+  std::atomic<uintptr_t> popped(0);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([=] {
+      for (uintptr_t i = 0; i < items_per_producer; i++) {
+        /* Items must be non-NULL. */
+        void * item = (void *)(p * items_per_producer + i + 1);
+        while (array_queue_push(aq, item) != 0) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < consumers; c++) {
+    threads.emplace_back([&] {
+      while (popped.load() < producers * items_per_producer) {
+        void * item = array_queue_pop(aq);
+        if (!item) {
+          std::this_thread::yield();
+          continue;
+        }
+        seen[(uintptr_t)item - 1]++;
+        popped++;
+      }
+    });
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  for (auto & s : seen) {
+    ASSERT_EQ(s.load(), 1);
+  }
+  ASSERT_EQ(array_queue_pop(aq), nullptr);
+
+  array_queue_destroy(aq);
+}
+
+/* With a single producer and a single consumer, the items come out in the
+ * order they were pushed, including when the queue is full. */
+TEST(cubeb, array_queue_spsc_order)
+{
+  const uintptr_t items = 1 << 16;
+  array_queue * aq = array_queue_create(64);
+
+  std::thread producer([=] {
+    for (uintptr_t i = 1; i <= items; i++) {
+      while (array_queue_push(aq, (void *)i) != 0) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (uintptr_t i = 1; i <= items; i++) {
+    void * item;
+    while (!(item = array_queue_pop(aq))) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ((uintptr_t)item, i);
+  }
+  producer.join();
+  ASSERT_EQ(array_queue_pop(aq), nullptr);
+
+  array_queue_destroy(aq);
+}
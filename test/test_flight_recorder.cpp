@@ -0,0 +1,135 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_flight_recorder.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(cubeb, flight_recorder)
+{
+  cubeb_flight_recorder * recorder = cubeb_flight_recorder_create("test");
+  ASSERT_TRUE(recorder);
+  std::vector<cubeb_flight_event> events(CUBEB_FLIGHT_RECORDER_SIZE);
+
+  ASSERT_EQ(cubeb_flight_recorder_read(recorder, events.data(), events.size()), 0u);
+
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_AVAIL, 512, 0);
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, 256, 0);
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END, 256, 0);
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_RECOVER, -32, 0);
+  ASSERT_EQ(cubeb_flight_recorder_read(recorder, events.data(), events.size()), 4u);
+  ASSERT_EQ(events[0].type, CUBEB_FLIGHT_EVENT_AVAIL);
+  ASSERT_EQ(events[0].value, 512);
+  ASSERT_EQ(events[1].type, CUBEB_FLIGHT_EVENT_CALLBACK_START);
+  ASSERT_EQ(events[2].type, CUBEB_FLIGHT_EVENT_CALLBACK_END);
+  ASSERT_EQ(events[3].type, CUBEB_FLIGHT_EVENT_RECOVER);
+  ASSERT_EQ(events[3].value, -32);
+  for (int i = 1; i < 4; i++) {
+    ASSERT_GE(events[i].timestamp_ns, events[i - 1].timestamp_ns);
+  }
+
+  /* Only the last events are kept, oldest first. */
+  for (int i = 0; i < 3 * CUBEB_FLIGHT_RECORDER_SIZE; i++) {
+    cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_XRUN, i, -i);
+  }
+  ASSERT_EQ(cubeb_flight_recorder_read(recorder, events.data(), events.size()),
+            size_t(CUBEB_FLIGHT_RECORDER_SIZE));
+  for (int i = 0; i < CUBEB_FLIGHT_RECORDER_SIZE; i++) {
+    ASSERT_EQ(events[i].value, 2 * CUBEB_FLIGHT_RECORDER_SIZE + i);
+    ASSERT_EQ(events[i].extra, -events[i].value);
+  }
+
+  /* Fewer than there are. */
+  ASSERT_EQ(cubeb_flight_recorder_read(recorder, events.data(), 10), 10u);
+  ASSERT_EQ(events[9].value, 3 * CUBEB_FLIGHT_RECORDER_SIZE - 1);
+
+  cubeb_flight_recorder_destroy(recorder);
+
+  /* Recording without a recorder does nothing. */
+  cubeb_flight_recorder_record(nullptr, CUBEB_FLIGHT_EVENT_XRUN, 0, 0);
+  cubeb_flight_recorder_dump(nullptr);
+}
+
+/* Events read while being recorded concurrently are either consistent, or
+   skipped. */
+TEST(cubeb, flight_recorder_concurrent)
+{
+  cubeb_flight_recorder * recorder = cubeb_flight_recorder_create("test");
+  ASSERT_TRUE(recorder);
+  std::atomic<bool> done(false);
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; t++) {
+    writers.emplace_back([recorder, &done, t] {
+      for (int64_t i = 0; !done.load(); i++) {
+        cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_CALLBACK_END,
+                                     i, t * 1000000000 + i);
+      }
+    });
+  }
+
+  std::vector<cubeb_flight_event> events(CUBEB_FLIGHT_RECORDER_SIZE);
+  for (int i = 0; i < 2000; i++) {
+    size_t count =
+      cubeb_flight_recorder_read(recorder, events.data(), events.size());
+    ASSERT_LE(count, events.size());
+    for (size_t j = 0; j < count; j++) {
+      ASSERT_EQ(events[j].type, CUBEB_FLIGHT_EVENT_CALLBACK_END);
+      int64_t value = events[j].extra % 1000000000;
+      ASSERT_EQ(events[j].value, value);
+    }
+  }
+  done.store(true);
+  for (std::thread & writer : writers) {
+    writer.join();
+  }
+  cubeb_flight_recorder_destroy(recorder);
+}
+
+static std::vector<std::string> dump_lines;
+
+static void
+dump_log_callback(char const * fmt, ...)
+{
+  char line[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  dump_lines.push_back(line);
+}
+
+TEST(cubeb, flight_recorder_dump)
+{
+  cubeb_flight_recorder * recorder = cubeb_flight_recorder_create("my stream");
+  ASSERT_TRUE(recorder);
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_CALLBACK_START, 128, 0);
+  cubeb_flight_recorder_record(recorder, CUBEB_FLIGHT_EVENT_STATE, CUBEB_STATE_ERROR, 0);
+
+  /* Nothing is logged without a log callback. */
+  cubeb_flight_recorder_dump(recorder);
+  ASSERT_TRUE(dump_lines.empty());
+
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_NORMAL, dump_log_callback), CUBEB_OK);
+  cubeb_flight_recorder_dump(recorder);
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+
+  ASSERT_EQ(dump_lines.size(), 3u);
+  ASSERT_NE(dump_lines[0].find("\"my stream\": 2 events"), std::string::npos);
+  ASSERT_NE(dump_lines[1].find("callback start"), std::string::npos);
+  ASSERT_NE(dump_lines[1].find(" 128 0"), std::string::npos);
+  ASSERT_NE(dump_lines[2].find("state"), std::string::npos);
+  ASSERT_NE(dump_lines[2].find("0.000 "), std::string::npos);
+
+  cubeb_flight_recorder_destroy(recorder);
+}
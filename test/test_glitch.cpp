@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_glitch.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct glitch_log
+{
+  std::mutex mutex;
+  std::vector<cubeb_glitch_info> glitches;
+  std::thread::id thread;
+  cubeb_stream * stream = nullptr;
+};
+
+void
+glitch_callback(cubeb_stream * stream, void * user_ptr,
+                cubeb_glitch_info const * glitch)
+{
+  glitch_log * log = static_cast<glitch_log *>(user_ptr);
+  std::lock_guard<std::mutex> lock(log->mutex);
+  log->glitches.push_back(*glitch);
+  log->thread = std::this_thread::get_id();
+  log->stream = stream;
+}
+
+size_t
+wait_for_glitches(glitch_log & log, size_t count)
+{
+  for (int i = 0; i < 1000; i++) {
+    {
+      std::lock_guard<std::mutex> lock(log.mutex);
+      if (log.glitches.size() >= count) {
+        return log.glitches.size();
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::lock_guard<std::mutex> lock(log.mutex);
+  return log.glitches.size();
+}
+
+} // namespace
+
+TEST(cubeb, glitch)
+{
+  cubeb_glitch_notifier * notifier = cubeb_glitch_notifier_create();
+  ASSERT_TRUE(notifier);
+  glitch_log log;
+  cubeb_stream * stream = reinterpret_cast<cubeb_stream *>(&log);
+
+  /* Nothing happens without a callback. */
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT, 0);
+
+  cubeb_glitch_notifier_set_callback(notifier, stream, glitch_callback, &log);
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT, 0);
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT, 480);
+  ASSERT_EQ(wait_for_glitches(log, 2), 2u);
+  {
+    std::lock_guard<std::mutex> lock(log.mutex);
+    ASSERT_EQ(log.glitches[0].type, CUBEB_GLITCH_UNDERRUN);
+    ASSERT_EQ(log.glitches[0].direction, CUBEB_DEVICE_TYPE_OUTPUT);
+    ASSERT_EQ(log.glitches[0].frames_lost, 0u);
+    ASSERT_EQ(log.glitches[1].type, CUBEB_GLITCH_OVERRUN);
+    ASSERT_EQ(log.glitches[1].direction, CUBEB_DEVICE_TYPE_INPUT);
+    ASSERT_EQ(log.glitches[1].frames_lost, 480u);
+    ASSERT_GE(log.glitches[1].timestamp_ns, log.glitches[0].timestamp_ns);
+    /* The callback isn't called on the thread that reported the glitch. */
+    ASSERT_NE(log.thread, std::this_thread::get_id());
+    ASSERT_EQ(log.stream, stream);
+  }
+
+  /* Once unregistered, the callback isn't called anymore. */
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT, 0);
+  cubeb_glitch_notifier_set_callback(notifier, nullptr, nullptr, nullptr);
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(log.mutex);
+    count = log.glitches.size();
+  }
+  ASSERT_LE(count, 3u);
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT, 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  {
+    std::lock_guard<std::mutex> lock(log.mutex);
+    ASSERT_EQ(log.glitches.size(), count);
+  }
+
+  /* It can be registered again. */
+  cubeb_glitch_notifier_set_callback(notifier, stream, glitch_callback, &log);
+  cubeb_glitch_report(notifier, CUBEB_GLITCH_OVERRUN, CUBEB_DEVICE_TYPE_INPUT, 0);
+  ASSERT_EQ(wait_for_glitches(log, count + 1), count + 1);
+
+  cubeb_glitch_notifier_destroy(notifier);
+
+  /* Reporting without a notifier does nothing. */
+  cubeb_glitch_report(nullptr, CUBEB_GLITCH_UNDERRUN, CUBEB_DEVICE_TYPE_OUTPUT, 0);
+  cubeb_glitch_notifier_set_callback(nullptr, nullptr, glitch_callback, nullptr);
+}
+
+/* Destroying notifiers while audio threads report glitches doesn't call the
+   callbacks of the destroyed notifiers. */
+TEST(cubeb, glitch_concurrent)
+{
+  for (int round = 0; round < 20; round++) {
+    std::atomic<uint64_t> calls(0);
+    cubeb_glitch_notifier * notifiers[2];
+    std::vector<std::thread> audio;
+    std::atomic<bool> done(false);
+
+    for (int i = 0; i < 2; i++) {
+      notifiers[i] = cubeb_glitch_notifier_create();
+      ASSERT_TRUE(notifiers[i]);
+      cubeb_glitch_notifier_set_callback(
+        notifiers[i], nullptr,
+        [](cubeb_stream *, void * user_ptr, cubeb_glitch_info const *) {
+          static_cast<std::atomic<uint64_t> *>(user_ptr)->fetch_add(1);
+        },
+        &calls);
+      cubeb_glitch_notifier * notifier = notifiers[i];
+      audio.emplace_back([notifier, &done] {
+        while (!done.load()) {
+          cubeb_glitch_report(notifier, CUBEB_GLITCH_UNDERRUN,
+                              CUBEB_DEVICE_TYPE_OUTPUT, 1);
+          std::this_thread::yield();
+        }
+      });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    /* Unregister while the audio threads are still reporting. */
+    cubeb_glitch_notifier_set_callback(notifiers[0], nullptr, nullptr, nullptr);
+    cubeb_glitch_notifier_set_callback(notifiers[1], nullptr, nullptr, nullptr);
+    uint64_t after_unregister = calls.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    ASSERT_EQ(calls.load(), after_unregister);
+
+    done.store(true);
+    for (std::thread & t : audio) {
+      t.join();
+    }
+    for (cubeb_glitch_notifier * notifier : notifiers) {
+      cubeb_glitch_notifier_destroy(notifier);
+    }
+  }
+}
+
+TEST(cubeb, glitch_load)
+{
+  cubeb_glitch_notifier * notifier = cubeb_glitch_notifier_create();
+  ASSERT_TRUE(notifier);
+  struct load_log {
+    std::mutex mutex;
+    std::vector<float> loads;
+  } log;
+  cubeb_load_callback callback = [](cubeb_stream *, void * user_ptr, float load) {
+    load_log * log = static_cast<load_log *>(user_ptr);
+    std::lock_guard<std::mutex> lock(log->mutex);
+    log->loads.push_back(load);
+  };
+  auto count = [&log] {
+    std::lock_guard<std::mutex> lock(log.mutex);
+    return log.loads.size();
+  };
+
+  /* Nothing happens without a callback. */
+  cubeb_glitch_report_load(notifier, 2.0f);
+
+  cubeb_glitch_notifier_set_load_callback(notifier, nullptr, callback, 0.8f, &log);
+  cubeb_glitch_report_load(notifier, 0.5f);
+  cubeb_glitch_report_load(notifier, 0.85f);
+  /* Called once while the load stays high. */
+  cubeb_glitch_report_load(notifier, 0.9f);
+  /* Still too close to the threshold to be called again. */
+  cubeb_glitch_report_load(notifier, 0.75f);
+  cubeb_glitch_report_load(notifier, 0.95f);
+  /* Back to a low load, then above the threshold again. */
+  cubeb_glitch_report_load(notifier, 0.5f);
+  cubeb_glitch_report_load(notifier, 1.5f);
+
+  for (int i = 0; i < 1000 && count() < 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  cubeb_glitch_notifier_set_load_callback(notifier, nullptr, nullptr, 0, nullptr);
+  ASSERT_EQ(count(), 2u);
+  ASSERT_EQ(log.loads[0], 0.85f);
+  ASSERT_EQ(log.loads[1], 1.5f);
+
+  cubeb_glitch_report_load(notifier, 2.0f);
+  cubeb_glitch_notifier_destroy(notifier);
+  ASSERT_EQ(count(), 2u);
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_log.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::mutex log_mutex;
+static std::vector<std::string> log_lines;
+
+static void log_callback(char const * fmt, ...)
+{
+  char line[1024];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  std::lock_guard<std::mutex> lock(log_mutex);
+  log_lines.push_back(line);
+}
+
+/* Wait for `count` lines logged by the test, and return them without their
+   prefix. */
+static std::vector<std::string> wait_for_lines(size_t count)
+{
+  std::vector<std::string> lines;
+  for (int i = 0; i < 200 && lines.size() < count; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::lock_guard<std::mutex> lock(log_mutex);
+    for (std::string const & line : log_lines) {
+      if (line.find("] test: ") != std::string::npos) {
+        lines.push_back(line.substr(line.find("] test: ") + 2));
+      }
+    }
+    if (lines.size() < count) {
+      lines.clear();
+    }
+  }
+  return lines;
+}
+
+TEST(cubeb, async_log_deferred_formatting)
+{
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_VERBOSE, log_callback), CUBEB_OK);
+  /* As if a context was alive, so that the logger thread runs. */
+  cubeb_async_log_acquire();
+
+  char const * message = "transient";
+  char transient[32];
+  snprintf(transient, sizeof(transient), "%s", message);
+  std::string long_string(200, 'x');
+  void * pointer = &message;
+
+  std::vector<std::string> expected;
+  char buf[512];
+#define CHECK_ALOGV(fmt, ...)                                \
+  do {                                                       \
+    ALOGV("test: " fmt, ##__VA_ARGS__);                      \
+    snprintf(buf, sizeof(buf), "test: " fmt, ##__VA_ARGS__); \
+    expected.push_back(std::string(buf) + "\n");             \
+  } while (0)
+
+  CHECK_ALOGV("no arguments, 100%%");
+  CHECK_ALOGV("%d %i %u %x %X %o %c", -42, 7, 3000000000u, 255, 255, 8, 'a');
+  CHECK_ALOGV("%hd %hhu %ld %lu %lld %llx", short(-3), (unsigned char)200,
+              -123456789L, 123456789UL, -1234567890123LL, 0xfedcba987654ULL);
+  CHECK_ALOGV("%zu %jd %td", size_t(99), intmax_t(-5), ptrdiff_t(-6));
+  CHECK_ALOGV("%f %.2f %e %g %8.3f|%-8.1f|", 1.5, 3.14159, 1e-10, 0.0001,
+              2.5, -2.5);
+  CHECK_ALOGV("%*d|%-*d|%.*f|%.*f", 6, 42, 6, 42, 3, 1.23456, -1, 1.5);
+  CHECK_ALOGV("%p", pointer);
+  CHECK_ALOGV("%s and %10s and %.3s", transient, "right", "truncated");
+  ALOGV("test: %s", (char const *)nullptr);
+  expected.push_back("test: (null)\n");
+
+  /* The strings are copied: changing them afterwards has no effect. */
+  snprintf(transient, sizeof(transient), "changed");
+
+  /* Long strings are truncated. */
+  ALOGV("test: %s|%s", long_string.c_str(), "end");
+  expected.push_back("test: " + long_string.substr(0, 63) + "|\n");
+
+  std::vector<std::string> lines = wait_for_lines(expected.size());
+  ASSERT_EQ(lines.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(lines[i], expected[i]);
+  }
+
+  cubeb_async_log_release();
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+}
+
+static size_t count_lines(char const * needle)
+{
+  std::lock_guard<std::mutex> lock(log_mutex);
+  size_t count = 0;
+  for (std::string const & line : log_lines) {
+    count += line.find(needle) != std::string::npos;
+  }
+  return count;
+}
+
+TEST(cubeb, async_log_shutdown)
+{
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_VERBOSE, log_callback), CUBEB_OK);
+  {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    log_lines.clear();
+  }
+
+  /* Messages logged while no context is alive are kept, and printed when the
+   * logger thread starts. */
+  ALOGV("shutdown: queued");
+  ASSERT_EQ(count_lines("shutdown: queued"), 0u);
+
+  /* The queued messages are printed before the thread is joined, the
+   * release is synchronous. */
+  for (int round = 0; round < 20; round++) {
+    cubeb_async_log_acquire();
+    for (int i = 0; i < 10; i++) {
+      ALOGV("shutdown: round %d message %d", round, i);
+    }
+    cubeb_async_log_release();
+    ASSERT_EQ(count_lines("shutdown: round"), (round + 1) * 10u);
+  }
+  ASSERT_EQ(count_lines("shutdown: queued"), 1u);
+
+  /* Nothing is printed once the last context is gone, and a full queue drops
+   * messages, and counts them. The count is reported when the thread runs
+   * again. */
+  uint64_t dropped = cubeb_async_log_dropped_count();
+  for (int i = 0; i < 10000; i++) {
+    ALOGV("shutdown: overflow %d", i);
+  }
+  ASSERT_EQ(count_lines("shutdown: overflow"), 0u);
+  ASSERT_GT(cubeb_async_log_dropped_count(), dropped);
+  cubeb_async_log_acquire();
+  cubeb_async_log_release();
+  ASSERT_GT(count_lines("shutdown: overflow"), 0u);
+  ASSERT_LT(count_lines("shutdown: overflow"), 10000u);
+  ASSERT_EQ(count_lines("asynchronous log messages dropped"), 1u);
+
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+}
+
+TEST(cubeb, log_categories)
+{
+  /* No callback. */
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_RESAMPLER,
+                                         CUBEB_LOG_VERBOSE),
+            CUBEB_ERROR_INVALID_PARAMETER);
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_RESAMPLER,
+                                         CUBEB_LOG_DISABLED), CUBEB_OK);
+
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_NORMAL, log_callback), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_COUNT,
+                                         CUBEB_LOG_VERBOSE),
+            CUBEB_ERROR_INVALID_FORMAT);
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_MIXER,
+                                         (cubeb_log_level)3),
+            CUBEB_ERROR_INVALID_FORMAT);
+  {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    log_lines.clear();
+  }
+
+  /* Only the resampler logs verbosely. */
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_RESAMPLER,
+                                         CUBEB_LOG_VERBOSE), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_DEVICE,
+                                         CUBEB_LOG_DISABLED), CUBEB_OK);
+  LOGV_CATEGORY(RESAMPLER, "category: resampler verbose");
+  LOGV_HOT(RESAMPLER, "category: resampler hot");
+  LOGV_CATEGORY(MIXER, "category: mixer verbose");
+  LOGV("category: backend verbose");
+  LOG("category: backend normal");
+  LOG_CATEGORY(DEVICE, "category: device normal");
+  ASSERT_EQ(count_lines("category: resampler verbose"), 1u);
+#if defined(CUBEB_NO_HOT_PATH_VERBOSE_LOGGING)
+  ASSERT_EQ(count_lines("category: resampler hot"), 0u);
+#else
+  ASSERT_EQ(count_lines("category: resampler hot"), 1u);
+#endif
+  ASSERT_EQ(count_lines("category: mixer verbose"), 0u);
+  ASSERT_EQ(count_lines("category: backend verbose"), 0u);
+  ASSERT_EQ(count_lines("category: backend normal"), 1u);
+  ASSERT_EQ(count_lines("category: device normal"), 0u);
+
+  /* Setting the callback resets all the categories. */
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+  LOG_CATEGORY(RESAMPLER, "category: after reset");
+  ASSERT_EQ(count_lines("category: after reset"), 0u);
+}
+
+static bool has_logger_thread(cubeb * ctx)
+{
+  cubeb_thread_collection collection;
+  if (cubeb_get_threads(ctx, &collection) != CUBEB_OK) {
+    return false;
+  }
+  bool found = false;
+  for (size_t i = 0; i < collection.count; i++) {
+    found |= !strcmp(collection.threads[i].name, "cubeb-log");
+  }
+  cubeb_thread_collection_destroy(ctx, &collection);
+  return found;
+}
+
+TEST(cubeb, async_log_thread_lifetime)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb log test", "null"), CUBEB_OK);
+
+  /* The logger thread only runs when verbose messages can be logged. */
+  ASSERT_FALSE(has_logger_thread(ctx));
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_NORMAL, log_callback), CUBEB_OK);
+  ASSERT_FALSE(has_logger_thread(ctx));
+
+  /* The thread registers itself once it has started. */
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_RESAMPLER,
+                                         CUBEB_LOG_VERBOSE), CUBEB_OK);
+  for (int i = 0; i < 200 && !has_logger_thread(ctx); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(has_logger_thread(ctx));
+
+  /* It's joined when the callback is cleared. */
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+  ASSERT_FALSE(has_logger_thread(ctx));
+
+  cubeb_destroy(ctx);
+}
+
+static long silence_cb(cubeb_stream * /*stream*/, void * /*user*/,
+                       const void * /*input*/, void * output, long nframes)
+{
+  memset(output, 0, nframes * sizeof(float));
+  return nframes;
+}
+
+static void ignore_state_cb(cubeb_stream * /*stream*/, void * /*user*/,
+                            cubeb_state /*state*/)
+{
+}
+
+TEST(cubeb, log_timing_category)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb log test", "null"), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_NORMAL, log_callback), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_log_category_level(CUBEB_LOG_CATEGORY_TIMING,
+                                         CUBEB_LOG_VERBOSE), CUBEB_OK);
+  {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    log_lines.clear();
+  }
+
+  cubeb_stream_params params;
+  params.format = CUBEB_SAMPLE_FLOAT32NE;
+  params.rate = 48000;
+  params.channels = 1;
+  params.layout = CUBEB_LAYOUT_MONO;
+  params.prefs = CUBEB_STREAM_PREF_NONE;
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "timing", NULL, NULL, NULL,
+                              &params, 480, silence_cb, ignore_state_cb,
+                              NULL), CUBEB_OK);
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  /* Each data callback logs its duration, from the audio thread. */
+  for (int i = 0; i < 200 && count_lines("timing: 480 frames requested") < 3;
+       i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+  cubeb_stream_destroy(stream);
+#if defined(CUBEB_NO_HOT_PATH_VERBOSE_LOGGING)
+  ASSERT_EQ(count_lines("timing: "), 0u);
+#else
+  ASSERT_GE(count_lines("timing: 480 frames requested"), 3u);
+#endif
+
+  ASSERT_EQ(cubeb_set_log_callback(CUBEB_LOG_DISABLED, nullptr), CUBEB_OK);
+  cubeb_destroy(ctx);
+}
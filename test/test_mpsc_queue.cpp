@@ -0,0 +1,90 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#define NOMINMAX
+
+#include "gtest/gtest.h"
+#include "cubeb_mpsc_queue.h"
+#include <thread>
+#include <vector>
+
+struct mpsc_element
+{
+  int producer;
+  int sequence;
+};
+
+TEST(cubeb, mpsc_queue)
+{
+  lock_free_mpsc_queue<int> q(100);
+  ASSERT_EQ(q.capacity(), 128);
+
+  int out[200];
+  ASSERT_EQ(q.dequeue(out, 200), 0);
+
+  for (int i = 0; i < 128; i++) {
+    ASSERT_EQ(q.enqueue(i), 1);
+  }
+  /* Full. */
+  ASSERT_EQ(q.enqueue(128), 0);
+
+  ASSERT_EQ(q.dequeue(out, 100), 100);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(out[i], i);
+  }
+  for (int i = 128; i < 228; i++) {
+    ASSERT_EQ(q.enqueue(i), 1);
+  }
+  ASSERT_EQ(q.dequeue(out, 200), 128);
+  for (int i = 0; i < 128; i++) {
+    ASSERT_EQ(out[i], i + 100);
+  }
+  ASSERT_EQ(q.dequeue(out, 200), 0);
+}
+
+TEST(cubeb, mpsc_queue_multi)
+{
+  const int producers = 8;
+  const int elements_per_producer = 100000;
+  lock_free_mpsc_queue<mpsc_element> q(64);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([p, &q] {
+      for (int i = 0; i < elements_per_producer; i++) {
+        mpsc_element e = { p, i };
+        while (!q.enqueue(e)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  /* Elements from a given producer arrive in order. */
+  std::vector<int> next(producers, 0);
+  int remaining = producers * elements_per_producer;
+  mpsc_element out[16];
+  while (remaining) {
+    int rv = q.dequeue(out, 16);
+    for (int i = 0; i < rv; i++) {
+      ASSERT_EQ(out[i].sequence, next[out[i].producer]);
+      next[out[i].producer]++;
+    }
+    remaining -= rv;
+    if (!rv) {
+      std::this_thread::yield();
+    }
+  }
+
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  for (int p = 0; p < producers; p++) {
+    ASSERT_EQ(next[p], elements_per_producer);
+  }
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace {
+
+struct null_test_state {
+  std::atomic<long> callbacks{0};
+  std::atomic<long> frames{0};
+  /** Frames after which the data callback returns less than requested. */
+  long drain_after = -1;
+  std::atomic<int> drained{0};
+  std::atomic<int> silent_input{1};
+};
+
+long
+data_cb(cubeb_stream * /*stream*/, void * user, const void * inputbuffer,
+        void * outputbuffer, long nframes)
+{
+  null_test_state * state = static_cast<null_test_state *>(user);
+  if (inputbuffer) {
+    const float * in = static_cast<const float *>(inputbuffer);
+    for (long i = 0; i < nframes; i++) {
+      if (in[i] != 0.0f) {
+        state->silent_input = 0;
+      }
+    }
+  }
+  if (outputbuffer) {
+    memset(outputbuffer, 0, nframes * sizeof(float));
+  }
+  state->callbacks++;
+  long frames = state->frames.fetch_add(nframes);
+  if (state->drain_after >= 0 && frames + nframes > state->drain_after) {
+    return std::max(0l, state->drain_after - frames);
+  }
+  return nframes;
+}
+
+void
+state_cb(cubeb_stream * /*stream*/, void * user, cubeb_state state)
+{
+  null_test_state * test_state = static_cast<null_test_state *>(user);
+  if (state == CUBEB_STATE_DRAINED) {
+    test_state->drained = 1;
+  }
+}
+
+cubeb_stream_params
+mono_params(uint32_t rate)
+{
+  cubeb_stream_params params;
+  params.format = CUBEB_SAMPLE_FLOAT32NE;
+  params.rate = rate;
+  params.channels = 1;
+  params.layout = CUBEB_LAYOUT_MONO;
+  params.prefs = CUBEB_STREAM_PREF_NONE;
+  return params;
+}
+
+} // namespace
+
+TEST(cubeb, null_devices)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb null backend test", "null"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+  ASSERT_STREQ(cubeb_get_backend_id(ctx), "null");
+
+  cubeb_device_collection collection;
+  ASSERT_EQ(cubeb_enumerate_devices(ctx, static_cast<cubeb_device_type>(
+                                      CUBEB_DEVICE_TYPE_INPUT | CUBEB_DEVICE_TYPE_OUTPUT),
+                                    &collection), CUBEB_OK);
+  ASSERT_EQ(collection.count, 2u);
+  ASSERT_EQ(collection.device[0].type, CUBEB_DEVICE_TYPE_INPUT);
+  ASSERT_EQ(collection.device[1].type, CUBEB_DEVICE_TYPE_OUTPUT);
+  cubeb_devid output_device = collection.device[1].devid;
+  ASSERT_EQ(cubeb_device_collection_destroy(ctx, &collection), CUBEB_OK);
+
+  null_test_state state;
+  cubeb_stream_params params = mono_params(48000);
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, output_device,
+                              &params, 480, data_cb, state_cb, &state), CUBEB_OK);
+  cubeb_device * device;
+  ASSERT_EQ(cubeb_stream_get_current_device(stream, &device), CUBEB_OK);
+  ASSERT_STREQ(device->output_name, "null-output");
+  ASSERT_EQ(device->input_name, nullptr);
+  ASSERT_EQ(cubeb_stream_device_destroy(stream, device), CUBEB_OK);
+  cubeb_stream_destroy(stream);
+
+  /* Devices of other backends don't exist here. */
+  int unknown_device;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, &unknown_device,
+                              &params, 480, data_cb, state_cb, &state),
+            CUBEB_ERROR_DEVICE_UNAVAILABLE);
+  params.format = CUBEB_SAMPLE_S16BE == CUBEB_SAMPLE_S16NE ? CUBEB_SAMPLE_S16LE
+                                                           : CUBEB_SAMPLE_S16BE;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, NULL,
+                              &params, 480, data_cb, state_cb, &state),
+            CUBEB_ERROR_INVALID_FORMAT);
+}
+
+TEST(cubeb, null_stepped_clock)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb null backend test", "null"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+
+  /* Only the stepped clock can be advanced. */
+  ASSERT_EQ(cubeb_advance_clock(ctx, 1000000), CUBEB_ERROR_INVALID_PARAMETER);
+  ASSERT_EQ(cubeb_set_clock_mode(ctx, static_cast<cubeb_clock_mode>(42)),
+            CUBEB_ERROR_INVALID_PARAMETER);
+  ASSERT_EQ(cubeb_set_clock_mode(ctx, CUBEB_CLOCK_STEPPED), CUBEB_OK);
+
+  null_test_state state;
+  cubeb_stream_params input_params = mono_params(48000);
+  cubeb_stream_params output_params = mono_params(48000);
+  cubeb_stream * stream;
+  /* Duplex, 10ms per callback. */
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, &input_params, NULL,
+                              &output_params, 480, data_cb, state_cb, &state),
+            CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  /* The first period is due when the stream starts. */
+  ASSERT_EQ(cubeb_advance_clock(ctx, 0), CUBEB_OK);
+  ASSERT_EQ(state.callbacks, 1);
+  ASSERT_EQ(cubeb_advance_clock(ctx, 100000000), CUBEB_OK);
+  ASSERT_EQ(state.callbacks, 11);
+  ASSERT_EQ(state.frames, 11 * 480);
+  uint64_t position;
+  ASSERT_EQ(cubeb_stream_get_position(stream, &position), CUBEB_OK);
+  ASSERT_EQ(position, 11u * 480);
+  ASSERT_TRUE(state.silent_input);
+
+  /* The clock doesn't run by itself. */
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(state.callbacks, 11);
+
+  cubeb_stream_stats stats;
+  ASSERT_EQ(cubeb_stream_get_stats(stream, &stats), CUBEB_OK);
+  ASSERT_EQ(stats.data_callback_count, 11u);
+  ASSERT_EQ(stats.frames_delivered, 11u * 480);
+
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+  ASSERT_EQ(cubeb_advance_clock(ctx, 100000000), CUBEB_OK);
+  ASSERT_EQ(state.callbacks, 11);
+}
+
+TEST(cubeb, null_resampling)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb null backend test", "null"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+  ASSERT_EQ(cubeb_set_clock_mode(ctx, CUBEB_CLOCK_STEPPED), CUBEB_OK);
+
+  null_test_state state;
+  cubeb_stream_params params = mono_params(44100);
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, NULL,
+                              &params, 441, data_cb, state_cb, &state), CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  /* One second of audio, at the rate of the stream. */
+  ASSERT_EQ(cubeb_advance_clock(ctx, 1000000000), CUBEB_OK);
+  uint64_t position;
+  ASSERT_EQ(cubeb_stream_get_position(stream, &position), CUBEB_OK);
+  ASSERT_NEAR(static_cast<double>(position), 44100.0 + 441, 1.0);
+  /* The resampler asks for a bit more, to fill its buffers. */
+  ASSERT_GE(state.frames, 44100);
+  ASSERT_LE(state.frames, 44100 + 2 * 441);
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+}
+
+TEST(cubeb, null_drain)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb null backend test", "null"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+  ASSERT_EQ(cubeb_set_clock_mode(ctx, CUBEB_CLOCK_STEPPED), CUBEB_OK);
+
+  null_test_state state;
+  state.drain_after = 1000;
+  cubeb_stream_params params = mono_params(48000);
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, NULL,
+                              &params, 480, data_cb, state_cb, &state), CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  /* Three callbacks, the last one partial: drained when it has played. */
+  ASSERT_EQ(cubeb_advance_clock(ctx, 20000000), CUBEB_OK);
+  ASSERT_EQ(state.callbacks, 3);
+  ASSERT_FALSE(state.drained);
+  ASSERT_EQ(cubeb_advance_clock(ctx, 10000000), CUBEB_OK);
+  ASSERT_TRUE(state.drained);
+  uint64_t position;
+  ASSERT_EQ(cubeb_stream_get_position(stream, &position), CUBEB_OK);
+  ASSERT_EQ(position, 1000u);
+  ASSERT_EQ(cubeb_advance_clock(ctx, 100000000), CUBEB_OK);
+  ASSERT_EQ(state.callbacks, 3);
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+}
+
+TEST(cubeb, null_fast_clock)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb null backend test", "null"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+  ASSERT_EQ(cubeb_set_clock_mode(ctx, CUBEB_CLOCK_FAST), CUBEB_OK);
+
+  null_test_state state;
+  cubeb_stream_params params = mono_params(48000);
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "null", NULL, NULL, NULL,
+                              &params, 480, data_cb, state_cb, &state), CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+
+  /* Ten seconds of audio render much faster than in real time. */
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  while (state.frames < 10 * 48000) {
+    std::this_thread::yield();
+  }
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
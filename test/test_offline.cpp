@@ -0,0 +1,253 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct offline_test_state {
+  /** Frames after which the data callback returns less than requested. */
+  long length = 0;
+  long frames = 0;
+  std::vector<int16_t> rendered;
+  std::vector<int16_t> captured;
+  std::atomic<int> drained{0};
+};
+
+/** A ramp, so that the rendered samples can be checked. */
+int16_t
+ramp(long frame)
+{
+  return static_cast<int16_t>(frame % 20000);
+}
+
+long
+output_cb(cubeb_stream * /*stream*/, void * user, const void * /*inputbuffer*/,
+          void * outputbuffer, long nframes)
+{
+  offline_test_state * state = static_cast<offline_test_state *>(user);
+  int16_t * out = static_cast<int16_t *>(outputbuffer);
+  long count = std::min(nframes, state->length - state->frames);
+  for (long i = 0; i < count; i++) {
+    out[2 * i] = out[2 * i + 1] = ramp(state->frames + i);
+  }
+  state->frames += count;
+  return count;
+}
+
+long
+input_cb(cubeb_stream * /*stream*/, void * user, const void * inputbuffer,
+         void * /*outputbuffer*/, long nframes)
+{
+  offline_test_state * state = static_cast<offline_test_state *>(user);
+  const int16_t * in = static_cast<const int16_t *>(inputbuffer);
+  state->captured.insert(state->captured.end(), in, in + 2 * nframes);
+  return nframes;
+}
+
+/** Planar output: the ramp on the left channel, negated on the right. */
+long
+planar_output_cb(cubeb_stream * /*stream*/, void * user,
+                 const void * /*inputbuffer*/, void * outputbuffer, long nframes)
+{
+  offline_test_state * state = static_cast<offline_test_state *>(user);
+  int16_t * const * out = static_cast<int16_t * const *>(outputbuffer);
+  long count = std::min(nframes, state->length - state->frames);
+  for (long i = 0; i < count; i++) {
+    out[0][i] = ramp(state->frames + i);
+    out[1][i] = -ramp(state->frames + i);
+  }
+  state->frames += count;
+  return count;
+}
+
+void
+state_cb(cubeb_stream * /*stream*/, void * user, cubeb_state state)
+{
+  offline_test_state * test_state = static_cast<offline_test_state *>(user);
+  if (state == CUBEB_STATE_DRAINED) {
+    test_state->drained = 1;
+  }
+}
+
+void
+sink_cb(cubeb_stream * /*stream*/, void * user, void const * buffer, long nframes)
+{
+  offline_test_state * state = static_cast<offline_test_state *>(user);
+  const int16_t * samples = static_cast<const int16_t *>(buffer);
+  state->rendered.insert(state->rendered.end(), samples, samples + 2 * nframes);
+}
+
+cubeb_stream_params
+stereo_params()
+{
+  cubeb_stream_params params;
+  params.format = CUBEB_SAMPLE_S16NE;
+  params.rate = 44100;
+  params.channels = 2;
+  params.layout = CUBEB_LAYOUT_STEREO;
+  params.prefs = CUBEB_STREAM_PREF_NONE;
+  return params;
+}
+
+void
+wait_for_drain(offline_test_state const & state)
+{
+  while (!state.drained) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+} // namespace
+
+TEST(cubeb, offline_render_to_memory)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb offline backend test", "offline"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+  ASSERT_STREQ(cubeb_get_backend_id(ctx), "offline");
+
+  offline_test_state state;
+  /* Ten seconds of audio. */
+  state.length = 10 * 44100;
+  state.rendered.reserve(2 * state.length);
+  cubeb_offline_params offline_params = {};
+  offline_params.output_callback = sink_cb;
+  offline_params.output_user_ptr = &state;
+  ASSERT_EQ(cubeb_set_offline_params(ctx, &offline_params), CUBEB_OK);
+
+  cubeb_stream_params params = stereo_params();
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "offline", NULL, NULL, NULL,
+                              &params, 512, output_cb, state_cb, &state),
+            CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+  uint32_t latency;
+  ASSERT_EQ(cubeb_stream_get_latency(stream, &latency), CUBEB_OK);
+  ASSERT_EQ(latency, 512u);
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  wait_for_drain(state);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+
+  /* Rendered at the rate of the stream, without resampling. */
+  uint64_t position;
+  ASSERT_EQ(cubeb_stream_get_position(stream, &position), CUBEB_OK);
+  ASSERT_EQ(position, static_cast<uint64_t>(state.length));
+  ASSERT_EQ(state.rendered.size(), 2u * state.length);
+  for (long i = 0; i < state.length; i++) {
+    ASSERT_EQ(state.rendered[2 * i], ramp(i));
+  }
+
+  /* The null backend has no sinks. */
+  cubeb * null_ctx;
+  ASSERT_EQ(cubeb_init(&null_ctx, "Cubeb offline backend test", "null"), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_offline_params(null_ctx, &offline_params),
+            CUBEB_ERROR_NOT_SUPPORTED);
+  cubeb_destroy(null_ctx);
+}
+
+TEST(cubeb, offline_wav_files)
+{
+  char const * path = "test_offline.wav";
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb offline backend test", "offline"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+
+  cubeb_stream_params params = stereo_params();
+  offline_test_state render;
+  render.length = 1000;
+  cubeb_offline_params offline_params = {};
+  offline_params.output_path = path;
+  ASSERT_EQ(cubeb_set_offline_params(ctx, &offline_params), CUBEB_OK);
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "render", NULL, NULL, NULL,
+                              &params, 256, output_cb, state_cb, &render),
+            CUBEB_OK);
+  ASSERT_EQ(cubeb_stream_set_volume(stream, 0.5f), CUBEB_OK);
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  wait_for_drain(render);
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+  cubeb_stream_destroy(stream);
+
+  /* Read the file back, as the input of another stream. */
+  offline_test_state capture;
+  /* Not allocating in the data callback. */
+  capture.captured.reserve(2 * 2048);
+  offline_params.output_path = NULL;
+  offline_params.input_path = path;
+  ASSERT_EQ(cubeb_set_offline_params(ctx, &offline_params), CUBEB_OK);
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "capture", NULL, &params, NULL,
+                              NULL, 256, input_cb, state_cb, &capture),
+            CUBEB_OK);
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  /* Drained at the end of the file. */
+  wait_for_drain(capture);
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+  uint64_t position;
+  ASSERT_EQ(cubeb_stream_get_position(stream, &position), CUBEB_OK);
+  ASSERT_EQ(position, 1000u);
+  cubeb_stream_destroy(stream);
+
+  ASSERT_GE(capture.captured.size(), 2u * 1000);
+  for (long i = 0; i < 1000; i++) {
+    ASSERT_EQ(capture.captured[2 * i], ramp(i) / 2);
+    ASSERT_EQ(capture.captured[2 * i + 1], ramp(i) / 2);
+  }
+
+  /* The format of the file must be the format of the stream. */
+  params.rate = 48000;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "capture", NULL, &params, NULL,
+                              NULL, 256, input_cb, state_cb, &capture),
+            CUBEB_ERROR_INVALID_FORMAT);
+  remove(path);
+}
+
+TEST(cubeb, offline_planar)
+{
+  cubeb * ctx;
+  ASSERT_EQ(cubeb_init(&ctx, "Cubeb offline backend test", "offline"), CUBEB_OK);
+  std::unique_ptr<cubeb, decltype(&cubeb_destroy)> cleanup_ctx(ctx, cubeb_destroy);
+
+  offline_test_state state;
+  state.length = 44100;
+  state.rendered.reserve(2 * state.length);
+  cubeb_offline_params offline_params = {};
+  offline_params.output_callback = sink_cb;
+  offline_params.output_user_ptr = &state;
+  ASSERT_EQ(cubeb_set_offline_params(ctx, &offline_params), CUBEB_OK);
+
+  cubeb_stream_params params = stereo_params();
+  params.prefs = CUBEB_STREAM_PREF_PLANAR;
+  cubeb_stream * stream;
+  ASSERT_EQ(cubeb_stream_init(ctx, &stream, "planar", NULL, NULL, NULL,
+                              &params, 512, planar_output_cb, state_cb, &state),
+            CUBEB_OK);
+  std::unique_ptr<cubeb_stream, decltype(&cubeb_stream_destroy)>
+    cleanup_stream(stream, cubeb_stream_destroy);
+  ASSERT_EQ(cubeb_stream_start(stream), CUBEB_OK);
+  wait_for_drain(state);
+  ASSERT_EQ(cubeb_stream_stop(stream), CUBEB_OK);
+
+  /* The sink gets the channels interleaved. */
+  ASSERT_EQ(state.rendered.size(), 2u * state.length);
+  for (long i = 0; i < state.length; i++) {
+    ASSERT_EQ(state.rendered[2 * i], ramp(i));
+    ASSERT_EQ(state.rendered[2 * i + 1], -ramp(i));
+  }
+}
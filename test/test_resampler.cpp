@@ -479,6 +479,7 @@ TEST(cubeb, resampler_output_only_noop)
   output_params.rate = 44100;
   output_params.channels = 1;
   output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  output_params.prefs = CUBEB_STREAM_PREF_NONE;
   target_rate = output_params.rate;
 
   cubeb_resampler * resampler =
@@ -517,6 +518,7 @@ TEST(cubeb, resampler_drain)
   output_params.rate = 44100;
   output_params.channels = 1;
   output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  output_params.prefs = CUBEB_STREAM_PREF_NONE;
   target_rate = 48000;
   int cb_count = 0;
 
@@ -567,6 +569,7 @@ TEST(cubeb, resampler_passthrough_output_only)
   output_params.channels = output_channels;
   output_params.rate = 44100;
   output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  output_params.prefs = CUBEB_STREAM_PREF_NONE;
   int target_rate = output_params.rate;
 
   cubeb_resampler * resampler =
@@ -611,6 +614,7 @@ TEST(cubeb, resampler_passthrough_input_only)
   input_params.channels = input_channels;
   input_params.rate = 44100;
   input_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  input_params.prefs = CUBEB_STREAM_PREF_NONE;
   int target_rate = input_params.rate;
 
   cubeb_resampler * resampler =
@@ -724,10 +728,12 @@ TEST(cubeb, resampler_passthrough_duplex_callback_reordering)
   input_params.channels = input_channels;
   input_params.rate = 44100;
   input_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  input_params.prefs = CUBEB_STREAM_PREF_NONE;
 
   output_params.channels = output_channels;
   output_params.rate = input_params.rate;
   output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  output_params.prefs = CUBEB_STREAM_PREF_NONE;
 
   int target_rate = input_params.rate;
 
@@ -807,10 +813,12 @@ TEST(cubeb, resampler_drift_drop_data)
     input_params.channels = input_channels;
     input_params.rate = sample_rate;
     input_params.format = CUBEB_SAMPLE_FLOAT32NE;
+    input_params.prefs = CUBEB_STREAM_PREF_NONE;
 
     output_params.channels = output_channels;
     output_params.rate = sample_rate;
     output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+    output_params.prefs = CUBEB_STREAM_PREF_NONE;
 
     int target_rate = input_params.rate;
 
@@ -1079,3 +1087,230 @@ TEST(cubeb, individual_methods) {
   ASSERT_EQ(frames_needed2, 0u);
 }
 
+
+struct planar_test_state {
+  const void * input = nullptr;
+  void * output = nullptr;
+};
+
+static long
+cb_silence(cubeb_stream * /*stm*/, void * /*user_ptr*/,
+           const void * /*input_buffer*/, void * output_buffer, long frame_count)
+{
+  memset(output_buffer, 0, frame_count * 2 * sizeof(float));
+  return frame_count;
+}
+
+// Callbacks bigger than what the resampler is sized for when it's created
+// don't allocate once the resampler has been reserved for them. This is only
+// checked when building with CUBEB_RT_CHECKS.
+TEST(cubeb, resampler_reserve)
+{
+  cubeb_stream_params output_params;
+  output_params.channels = 2;
+  output_params.rate = 44100;
+  output_params.format = CUBEB_SAMPLE_FLOAT32NE;
+  output_params.prefs = CUBEB_STREAM_PREF_NONE;
+
+  const long frames = 48000;
+  cubeb_resampler * resampler =
+    cubeb_resampler_create((cubeb_stream*)nullptr, nullptr, &output_params,
+                           48000, cb_silence, nullptr,
+                           CUBEB_RESAMPLER_QUALITY_VOIP);
+  cubeb_resampler_reserve(resampler, frames);
+
+  std::vector<float> output(frames * output_params.channels);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(cubeb_resampler_fill(resampler, nullptr, nullptr, output.data(),
+                                   frames), frames);
+  }
+
+  cubeb_resampler_destroy(resampler);
+}
+
+static long
+cb_planar(cubeb_stream * /*stm*/, void * user_ptr,
+          const void * input_buffer, void * output_buffer, long frame_count)
+{
+  planar_test_state * state = static_cast<planar_test_state *>(user_ptr);
+  state->input = input_buffer;
+  state->output = output_buffer;
+  float const * const * in = static_cast<float const * const *>(input_buffer);
+  float * const * out = static_cast<float * const *>(output_buffer);
+  for (uint32_t c = 0; c < 2; c++) {
+    for (long f = 0; f < frame_count; f++) {
+      // Constant channels when there is no input, to check resampled output.
+      out[c][f] = in ? in[c][f] : (c == 0 ? 0.5f : -0.5f);
+    }
+  }
+  return frame_count;
+}
+
+TEST(cubeb, resampler_planar_passthrough)
+{
+  const long frames = 256;
+  cubeb_stream_params params;
+  params.channels = 2;
+  params.rate = 48000;
+  params.format = CUBEB_SAMPLE_FLOAT32NE;
+  params.prefs = CUBEB_STREAM_PREF_PLANAR;
+
+  planar_test_state state;
+  cubeb_resampler * resampler =
+    cubeb_resampler_create(nullptr, &params, &params, 48000, cb_planar, &state,
+                           CUBEB_RESAMPLER_QUALITY_DEFAULT);
+  ASSERT_NE(resampler, nullptr);
+
+  float in_buffers[2][frames];
+  float out_buffers[2][frames];
+  for (long f = 0; f < frames; f++) {
+    in_buffers[0][f] = 0.01f * f;
+    in_buffers[1][f] = -0.01f * f;
+  }
+  float * in_channels[2] = { in_buffers[0], in_buffers[1] };
+  float * out_channels[2] = { out_buffers[0], out_buffers[1] };
+
+  // Not resampled: the callback gets the buffers of the backend.
+  long input_frames = frames;
+  long got = cubeb_resampler_fill_planar(resampler, (void * const *)in_channels,
+                                         &input_frames,
+                                         (void * const *)out_channels, frames);
+  ASSERT_EQ(got, frames);
+  ASSERT_EQ(state.input, in_channels);
+  ASSERT_EQ(state.output, out_channels);
+  for (long f = 0; f < frames; f++) {
+    ASSERT_EQ(out_buffers[0][f], in_buffers[0][f]);
+    ASSERT_EQ(out_buffers[1][f], in_buffers[1][f]);
+  }
+
+  // Interleaved buffers of the backend are converted for the callback.
+  float interleaved_in[2 * frames];
+  float interleaved_out[2 * frames];
+  for (long f = 0; f < frames; f++) {
+    interleaved_in[2 * f] = in_buffers[0][f];
+    interleaved_in[2 * f + 1] = in_buffers[1][f];
+  }
+  input_frames = frames;
+  got = cubeb_resampler_fill(resampler, interleaved_in, &input_frames,
+                             interleaved_out, frames);
+  ASSERT_EQ(got, frames);
+  ASSERT_NE(state.input, static_cast<const void *>(interleaved_in));
+  ASSERT_NE(state.output, static_cast<void *>(interleaved_out));
+  for (long i = 0; i < 2 * frames; i++) {
+    ASSERT_EQ(interleaved_out[i], interleaved_in[i]);
+  }
+
+  cubeb_resampler_destroy(resampler);
+
+  // Only the resamplers of planar streams take planar buffers.
+  params.prefs = CUBEB_STREAM_PREF_NONE;
+  resampler = cubeb_resampler_create(nullptr, nullptr, &params, 48000, cb_planar,
+                                     &state, CUBEB_RESAMPLER_QUALITY_DEFAULT);
+  ASSERT_EQ(cubeb_resampler_fill_planar(resampler, nullptr, nullptr,
+                                        (void * const *)out_channels, frames),
+            CUBEB_ERROR);
+  cubeb_resampler_destroy(resampler);
+}
+
+TEST(cubeb, resampler_planar_resampled)
+{
+  const long frames = 480;
+  cubeb_stream_params params;
+  params.channels = 2;
+  params.rate = 44100;
+  params.format = CUBEB_SAMPLE_FLOAT32NE;
+  params.prefs = CUBEB_STREAM_PREF_PLANAR;
+
+  planar_test_state state;
+  cubeb_resampler * resampler =
+    cubeb_resampler_create(nullptr, nullptr, &params, 48000, cb_planar, &state,
+                           CUBEB_RESAMPLER_QUALITY_DEFAULT);
+  ASSERT_NE(resampler, nullptr);
+
+  float out_buffers[2][frames];
+  float * out_channels[2] = { out_buffers[0], out_buffers[1] };
+  // Resampled buffers are interleaved.
+  ASSERT_EQ(cubeb_resampler_fill_planar(resampler, nullptr, nullptr,
+                                        (void * const *)out_channels, frames),
+            CUBEB_ERROR);
+
+  float interleaved_out[2 * frames];
+  // The callback still gets the channels, until the resampler has settled.
+  for (int i = 0; i < 10; i++) {
+    long got = cubeb_resampler_fill(resampler, nullptr, nullptr,
+                                    interleaved_out, frames);
+    ASSERT_EQ(got, frames);
+    ASSERT_NE(state.output, static_cast<void *>(interleaved_out));
+  }
+  for (long f = 0; f < frames; f++) {
+    ASSERT_NEAR(interleaved_out[2 * f], 0.5f, 0.01f);
+    ASSERT_NEAR(interleaved_out[2 * f + 1], -0.5f, 0.01f);
+  }
+
+  cubeb_resampler_destroy(resampler);
+}
+
+static long
+cb_planar_count(cubeb_stream * /*stm*/, void * user_ptr,
+                const void * /*input_buffer*/, void * output_buffer,
+                long frame_count)
+{
+  int * calls = static_cast<int *>(user_ptr);
+  int16_t * const * out = static_cast<int16_t * const *>(output_buffer);
+  for (long f = 0; f < frame_count; f++) {
+    out[0][f] = static_cast<int16_t>(*calls);
+  }
+  (*calls)++;
+  return frame_count;
+}
+
+TEST(cubeb, planar_adapter_split)
+{
+  cubeb_stream_params params;
+  params.channels = 1;
+  params.rate = 48000;
+  params.format = CUBEB_SAMPLE_S16NE;
+  params.prefs = CUBEB_STREAM_PREF_PLANAR;
+
+  cubeb_planar_adapter * adapter;
+  ASSERT_EQ(cubeb_planar_adapter_create(nullptr, &params, 64, &adapter), CUBEB_OK);
+  ASSERT_NE(adapter, nullptr);
+
+  // Longer callbacks are split rather than growing the buffers.
+  int calls = 0;
+  int16_t out[200];
+  ASSERT_EQ(cubeb_planar_data_callback(adapter, cb_planar_count, nullptr, &calls,
+                                       nullptr, out, 200), 200);
+  ASSERT_EQ(calls, 4);
+  for (long f = 0; f < 200; f++) {
+    ASSERT_EQ(out[f], f / 64);
+  }
+  cubeb_planar_adapter_destroy(adapter);
+
+  // No adapter for interleaved streams.
+  params.prefs = CUBEB_STREAM_PREF_NONE;
+  ASSERT_EQ(cubeb_planar_adapter_create(nullptr, &params, 64, &adapter), CUBEB_OK);
+  ASSERT_EQ(adapter, nullptr);
+}
+
+TEST(cubeb, planar_interleave)
+{
+  int16_t left[3] = { 1, 2, 3 };
+  int16_t right[3] = { -1, -2, -3 };
+  void const * channels[2] = { left, right };
+  int16_t interleaved[6];
+  cubeb_planar_interleave(channels, 2, sizeof(int16_t), interleaved, 3);
+  int16_t expected[6] = { 1, -1, 2, -2, 3, -3 };
+  for (int i = 0; i < 6; i++) {
+    ASSERT_EQ(interleaved[i], expected[i]);
+  }
+
+  int16_t left_out[3];
+  int16_t right_out[3];
+  void * channels_out[2] = { left_out, right_out };
+  cubeb_planar_deinterleave(interleaved, 2, sizeof(int16_t), channels_out, 3);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(left_out[i], left[i]);
+    ASSERT_EQ(right_out[i], right[i]);
+  }
+}
@@ -1,8 +1,7 @@
 #include "gtest/gtest.h"
-#ifdef __APPLE__
 #include <string.h>
 #include <iostream>
-#include <CoreAudio/CoreAudioTypes.h>
+#include <thread>
 #include "cubeb/cubeb.h"
 #include "cubeb_ring_array.h"
 
@@ -16,28 +15,40 @@ TEST(cubeb, ring_array)
   unsigned int capacity = 8;
   ring_array_init(&ra, capacity, sizeof(int), 1, 1);
   int verify_data[capacity] ;// {1,2,3,4,5,6,7,8};
-  AudioBuffer * p_data = NULL;
+  ring_array_buffer * p_data = NULL;
 
   for (unsigned int i = 0; i < capacity; ++i) {
     verify_data[i] = i; // in case capacity change value
     *(int*)ra.buffer_array[i].mData = i;
     ASSERT_EQ(ra.buffer_array[i].mDataByteSize, sizeof(int));
     ASSERT_EQ(ra.buffer_array[i].mNumberChannels, 1u);
+    /* Each buffer starts on its own cache line. */
+    ASSERT_EQ((uintptr_t)ra.buffer_array[i].mData % CUBEB_CACHE_LINE_SIZE, 0u);
   }
 
+  /* Empty: a dummy buffer is available. */
+  p_data = ring_array_get_dummy_buffer(&ra);
+  ASSERT_NE(p_data, nullptr);
+  ASSERT_EQ(*(int*)p_data->mData, 0);
+
   /* Get store buffers*/
   for (unsigned int i = 0; i < capacity; ++i) {
     p_data = ring_array_get_free_buffer(&ra);
     ASSERT_NE(p_data, nullptr);
     ASSERT_EQ(*(int*)p_data->mData, verify_data[i]);
+    /* Not committed yet, the same buffer is returned. */
+    ASSERT_EQ(ring_array_get_free_buffer(&ra), p_data);
+    ring_array_commit_free_buffer(&ra);
   }
   /*Now array is full extra store should give NULL*/
   ASSERT_EQ(ring_array_get_free_buffer(&ra), nullptr);
+  ASSERT_EQ(ring_array_get_dummy_buffer(&ra), nullptr);
   /* Get fetch buffers*/
   for (unsigned int i = 0; i < capacity; ++i) {
     p_data = ring_array_get_data_buffer(&ra);
     ASSERT_NE(p_data, nullptr);
     ASSERT_EQ(*(int*)p_data->mData, verify_data[i]);
+    ring_array_release_data_buffer(&ra);
   }
   /*Now array is empty extra fetch should give NULL*/
   ASSERT_EQ(ring_array_get_data_buffer(&ra), nullptr);
@@ -47,7 +58,9 @@ TEST(cubeb, ring_array)
   for (unsigned int i = 0; i < 2*capacity; ++i) {
     p_data = ring_array_get_free_buffer(&ra);
     ASSERT_NE(p_data, nullptr);
+    ring_array_commit_free_buffer(&ra);
     ASSERT_EQ(ring_array_get_data_buffer(&ra), p_data);
+    ring_array_release_data_buffer(&ra);
   }
 
   p_data = NULL;
@@ -57,17 +70,57 @@ TEST(cubeb, ring_array)
     ASSERT_NE(p_data, nullptr);
     ASSERT_EQ(*((int*)p_data->mData), verify_data[i]);
     (*((int*)p_data->mData))++; // Modify data
+    ring_array_commit_free_buffer(&ra);
   }
   for (unsigned int i = 0; i < capacity; ++i) {
     p_data = ring_array_get_data_buffer(&ra);
     ASSERT_NE(p_data, nullptr);
     ASSERT_EQ(*((int*)p_data->mData), verify_data[i]+1); // Verify modified data
+    ring_array_release_data_buffer(&ra);
   }
 
   ring_array_destroy(&ra);
 }
-#else
-TEST(cubeb, DISABLED_ring_array)
+
+/* Fill each buffer with a sequence number on one thread, and check it on
+   another thread. */
+static void
+ring_array_producer_consumer(ring_array * ra, unsigned int buffers,
+                             unsigned int frames)
 {
+  std::thread producer([=] {
+    for (unsigned int i = 0; i < buffers; ++i) {
+      ring_array_buffer * b;
+      while (!(b = ring_array_get_free_buffer(ra))) {
+        std::this_thread::yield();
+      }
+      for (unsigned int j = 0; j < frames; ++j) {
+        static_cast<unsigned int *>(b->mData)[j] = i;
+      }
+      ring_array_commit_free_buffer(ra);
+    }
+  });
+
+  for (unsigned int i = 0; i < buffers; ++i) {
+    ring_array_buffer * b;
+    while (!(b = ring_array_get_data_buffer(ra))) {
+      std::this_thread::yield();
+    }
+    for (unsigned int j = 0; j < frames; ++j) {
+      ASSERT_EQ(static_cast<unsigned int *>(b->mData)[j], i);
+    }
+    ring_array_release_data_buffer(ra);
+  }
+
+  producer.join();
+}
+
+TEST(cubeb, ring_array_stress)
+{
+  for (unsigned int capacity = 1; capacity < 10; ++capacity) {
+    ring_array ra;
+    ASSERT_EQ(ring_array_init(&ra, capacity, sizeof(unsigned int), 1, 67), CUBEB_OK);
+    ring_array_producer_consumer(&ra, 20000, 67);
+    ring_array_destroy(&ra);
+  }
 }
-#endif
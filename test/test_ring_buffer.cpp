@@ -12,6 +12,7 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <string>
 
 /* Generate a monotonically increasing sequence of numbers. */
 template<typename T>
@@ -66,8 +67,8 @@ class sequence_verifier
     size_t channels = 0;
 };
 
-template<typename T>
-void test_ring(lock_free_audio_ring_buffer<T>& buf, int channels, int capacity_frames)
+template<typename T, typename S>
+void test_ring(audio_ring_buffer_base<T, S>& buf, int channels, int capacity_frames)
 {
   std::unique_ptr<T[]> seq(new T[capacity_frames * channels]);
   sequence_generator<T> gen(channels);
@@ -88,8 +89,8 @@ void test_ring(lock_free_audio_ring_buffer<T>& buf, int channels, int capacity_f
   }
 }
 
-template<typename T>
-void test_ring_multi(lock_free_audio_ring_buffer<T>& buf, int channels, int capacity_frames)
+template<typename T, typename S>
+void test_ring_multi(audio_ring_buffer_base<T, S>& buf, int channels, int capacity_frames)
 {
   sequence_verifier<T> checker(channels);
   std::unique_ptr<T[]> out_buffer(new T[capacity_frames * channels]);
@@ -155,6 +156,72 @@ void basic_api_test(T& ring)
   ASSERT_EQ(ring.available_write(), 128);
 }
 
+template<typename T, typename S>
+void test_ring_zero_copy(audio_ring_buffer_base<T, S>& buf, int channels, int capacity_frames)
+{
+  sequence_generator<T> gen(channels);
+  sequence_verifier<T> checker(channels);
+
+  int iterations = 1002;
+
+  const int block_size = 128;
+
+  while(iterations--) {
+    ring_buffer_region<T> w = buf.reserve_write(block_size);
+    ASSERT_EQ(w.length(), block_size);
+    ASSERT_TRUE(!buf.mirrored() || w.second_length == 0);
+    gen.get(w.first, w.first_length);
+    gen.get(w.second, w.second_length);
+    ASSERT_EQ(buf.available_read(), 0);
+    buf.commit_write(w.length());
+    ASSERT_EQ(buf.available_read(), block_size);
+
+    ring_buffer_region<T> r = buf.peek_read(block_size);
+    ASSERT_EQ(r.length(), block_size);
+    ASSERT_TRUE(!buf.mirrored() || r.second_length == 0);
+    checker.check(r.first, r.first_length);
+    checker.check(r.second, r.second_length);
+    ASSERT_EQ(buf.available_read(), block_size);
+    buf.consume(r.length());
+    ASSERT_EQ(buf.available_read(), 0);
+  }
+}
+
+template<typename T, typename S>
+void test_ring_zero_copy_multi(audio_ring_buffer_base<T, S>& buf, int channels, int capacity_frames)
+{
+  sequence_verifier<T> checker(channels);
+
+  const int block_size = 128;
+
+  std::thread t([=, &buf] {
+    int iterations = 1002;
+    sequence_generator<T> gen(channels);
+
+    while(iterations--) {
+      std::this_thread::yield();
+      ring_buffer_region<T> w = buf.reserve_write(block_size);
+      ASSERT_TRUE(w.length() <= block_size);
+      gen.get(w.first, w.first_length);
+      gen.get(w.second, w.second_length);
+      buf.commit_write(w.length());
+    }
+  });
+
+  int remaining = 1002;
+
+  while(remaining--) {
+    std::this_thread::yield();
+    ring_buffer_region<T> r = buf.peek_read(block_size);
+    ASSERT_TRUE(r.length() <= block_size);
+    checker.check(r.first, r.first_length);
+    checker.check(r.second, r.second_length);
+    buf.consume(r.length());
+  }
+
+  t.join();
+}
+
 void test_reset_api() {
 	const size_t ring_buffer_size = 128;
 	const size_t enqueue_size = ring_buffer_size / 2;
@@ -225,3 +292,174 @@ TEST(cubeb, ring_buffer)
 
   test_reset_api();
 }
+
+TEST(cubeb, ring_buffer_zero_copy)
+{
+  const int min_channels = 1;
+  const int max_channels = 10;
+  const int min_capacity = 199;
+  const int max_capacity = 1277;
+  const int capacity_increment = 27;
+
+  /* Partial commit and consume. */
+  lock_free_queue<float> q(100);
+  ring_buffer_region<float> w = q.reserve_write(90);
+  ASSERT_EQ(w.length(), 90);
+  ASSERT_EQ(w.second_length, 0);
+  q.commit_write(80);
+  ASSERT_EQ(q.available_read(), 80);
+  ASSERT_EQ(q.available_write(), 20);
+  ring_buffer_region<float> r = q.peek_read(100);
+  ASSERT_EQ(r.length(), 80);
+  q.consume(70);
+  ASSERT_EQ(q.available_read(), 10);
+  /* Wrapping around the end of the storage. */
+  w = q.reserve_write(100);
+  ASSERT_EQ(w.length(), 90);
+  ASSERT_TRUE(w.second_length > 0);
+  ASSERT_EQ(w.second, r.first);
+  q.commit_write(w.length());
+  ASSERT_EQ(q.available_write(), 0);
+  ASSERT_EQ(q.reserve_write(1).length(), 0);
+
+  /* Regions of an audio ring buffer never split a frame. */
+  for (int channels = min_channels; channels < max_channels; channels++) {
+    lock_free_audio_ring_buffer<float> a(channels, 7);
+    for (int i = 0; i < 20; i++) {
+      ring_buffer_region<float> aw = a.reserve_write(5);
+      ASSERT_EQ(aw.length(), 5);
+      a.commit_write(aw.length());
+      ring_buffer_region<float> ar = a.peek_read(5);
+      ASSERT_EQ(ar.length(), 5);
+      ASSERT_EQ(ar.first, aw.first);
+      a.consume(ar.length());
+    }
+  }
+
+  /* Single thread testing. */
+  for (int channels = min_channels; channels < max_channels; channels++) {
+    for (int capacity_frames = min_capacity;
+         capacity_frames < max_capacity; capacity_frames+=capacity_increment) {
+      lock_free_audio_ring_buffer<float> ring(channels, capacity_frames);
+      test_ring_zero_copy(ring, channels, capacity_frames);
+    }
+  }
+
+  /* Multi thread testing */
+  for (int channels = min_channels; channels < max_channels; channels++) {
+    for (int capacity_frames = min_capacity;
+         capacity_frames < max_capacity; capacity_frames+=capacity_increment) {
+      lock_free_audio_ring_buffer<short> ring(channels, capacity_frames);
+      test_ring_zero_copy_multi(ring, channels, capacity_frames);
+    }
+  }
+}
+
+TEST(cubeb, ring_buffer_mirrored)
+{
+  const int min_channels = 1;
+  const int max_channels = 10;
+  const int min_capacity = 199;
+  const int max_capacity = 1277;
+  const int capacity_increment = 277;
+
+  mirrored_lock_free_queue<float> q1(128);
+  basic_api_test(q1);
+#ifdef __linux__
+  ASSERT_TRUE(q1.mirrored());
+#endif
+
+  /* Writes and reads are contiguous across the end of the storage. */
+  mirrored_lock_free_queue<int> q2(1000);
+  int written = 0;
+  int read = 0;
+  for (int i = 0; i < 100; i++) {
+    int count = 700;
+    int * w = q2.reserve_write_contiguous(&count);
+    ASSERT_TRUE(count > 0);
+    ASSERT_TRUE(!q2.mirrored() || count == std::min(700, q2.available_write()));
+    for (int j = 0; j < count; j++) {
+      w[j] = written++;
+    }
+    q2.commit_write(count);
+
+    count = 700;
+    int * r = q2.peek_read_contiguous(&count);
+    ASSERT_TRUE(count > 0);
+    for (int j = 0; j < count; j++) {
+      ASSERT_EQ(r[j], read++);
+    }
+    q2.consume(count);
+  }
+
+  for (int channels = min_channels; channels < max_channels; channels++) {
+    mirrored_lock_free_audio_ring_buffer<float> q3(channels, 128);
+    basic_api_test(q3);
+  }
+
+  for (int channels = min_channels; channels < max_channels; channels++) {
+    for (int capacity_frames = min_capacity;
+         capacity_frames < max_capacity; capacity_frames+=capacity_increment) {
+      mirrored_lock_free_audio_ring_buffer<float> ring(channels, capacity_frames);
+      test_ring(ring, channels, capacity_frames);
+      mirrored_lock_free_audio_ring_buffer<float> ring2(channels, capacity_frames);
+      test_ring_zero_copy(ring2, channels, capacity_frames);
+      mirrored_lock_free_audio_ring_buffer<short> ring3(channels, capacity_frames);
+      test_ring_zero_copy_multi(ring3, channels, capacity_frames);
+    }
+  }
+
+  /* Non-trivial types fall back to a regular storage. */
+  mirrored_lock_free_queue<std::string> q4(16);
+  ASSERT_FALSE(q4.mirrored());
+  std::string str("cubeb");
+  ASSERT_EQ(q4.enqueue(str), 1);
+  std::string out;
+  ASSERT_EQ(q4.dequeue(&out, 1), 1);
+  ASSERT_EQ(out, str);
+}
+
+TEST(cubeb, ring_buffer_waitable)
+{
+  const int channels = 2;
+  const int block = 64;
+  const int blocks = 5000;
+  waitable_audio_ring_buffer<int> buf(channels, 256);
+
+  /* Nothing to read, times out. */
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(buf.wait_for_read(1, 20), 0);
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(20));
+
+  /* The producer publishes small chunks, the consumer only wakes up once a
+   * whole block is there. */
+  std::thread producer([&] {
+    int in[16 * channels];
+    int value = 0;
+    for (int i = 0; i < blocks * block / 16; i++) {
+      for (int j = 0; j < 16 * channels; j++) {
+        in[j] = value++;
+      }
+      int written = 0;
+      while (written < 16) {
+        written += buf.enqueue(in + written * channels, 16 - written);
+        if (written < 16) {
+          std::this_thread::yield();
+        }
+      }
+    }
+  });
+
+  int out[block * channels];
+  int value = 0;
+  for (int i = 0; i < blocks; i++) {
+    ASSERT_GE(buf.wait_for_read(block, 5000), block);
+    ASSERT_EQ(buf.dequeue(out, block), block);
+    for (int j = 0; j < block * channels; j++) {
+      ASSERT_EQ(out[j], value++);
+    }
+  }
+  producer.join();
+  ASSERT_EQ(buf.available_read(), 0);
+}
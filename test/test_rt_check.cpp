@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb_rt_check.h"
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+/* Keep the compiler from removing the allocations. */
+void * volatile rt_check_sink;
+
+} // namespace
+
+TEST(cubeb, rt_check)
+{
+  uint64_t violations = cubeb_rt_check_violations();
+
+  /* Outside of real-time sections, nothing is reported. */
+  rt_check_sink = malloc(16);
+  free(rt_check_sink);
+  ASSERT_EQ(cubeb_rt_check_violations(), violations);
+
+  cubeb_rt_check_enter();
+  rt_check_sink = malloc(16);
+  cubeb_rt_check_leave();
+  ASSERT_EQ(cubeb_rt_check_violations(), violations + 1);
+
+  {
+    CUBEB_RT_SCOPE();
+    /* Sections can be nested. */
+    {
+      CUBEB_RT_SCOPE();
+    }
+    free(rt_check_sink);
+    /* Freeing NULL does nothing, and is allowed. */
+    free(nullptr);
+  }
+  ASSERT_EQ(cubeb_rt_check_violations(), violations + 2);
+
+  std::mutex mutex;
+  cubeb_rt_check_enter();
+  mutex.lock();
+  cubeb_rt_check_leave();
+  mutex.unlock();
+  ASSERT_EQ(cubeb_rt_check_violations(), violations + 3);
+
+  cubeb_rt_check_enter();
+  ssize_t written = write(STDOUT_FILENO, "", 0);
+  rt_check_sink = new int[4];
+  cubeb_rt_check_leave();
+  ASSERT_EQ(written, 0);
+  delete[] static_cast<int *>(rt_check_sink);
+  ASSERT_EQ(cubeb_rt_check_violations(), violations + 5);
+
+  /* Sections are per thread. */
+  std::atomic<int> step(0);
+  std::thread other([&step] {
+    while (step.load() != 1) {
+    }
+    rt_check_sink = malloc(16);
+    free(rt_check_sink);
+    step.store(2);
+  });
+  cubeb_rt_check_enter();
+  step.store(1);
+  while (step.load() != 2) {
+  }
+  cubeb_rt_check_leave();
+  other.join();
+  ASSERT_EQ(cubeb_rt_check_violations(), violations + 5);
+}
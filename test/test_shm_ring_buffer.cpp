@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb_shm_ring_buffer.h"
+#include <chrono>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+TEST(cubeb, shm_ring_buffer)
+{
+  const int channels = 3;
+  shared_audio_ring_buffer<float> producer(channels, 1000);
+  ASSERT_TRUE(producer.valid());
+  ASSERT_GE(producer.fd(), 0);
+  ASSERT_GE(producer.capacity(), 1000);
+  /* A power of two, and a whole number of pages. */
+  ASSERT_EQ(producer.capacity() & (producer.capacity() - 1), 0);
+  ASSERT_EQ(producer.capacity() * channels * sizeof(float) %
+            sysconf(_SC_PAGESIZE), 0u);
+
+  /* A second mapping of the same memory, as another process would have. */
+  shared_audio_ring_buffer<float> consumer(producer.fd());
+  ASSERT_TRUE(consumer.valid());
+  ASSERT_EQ(consumer.fd(), -1);
+  ASSERT_EQ(consumer.channel_count(), channels);
+  ASSERT_EQ(consumer.capacity(), producer.capacity());
+
+  const int capacity = producer.capacity();
+  const int block = capacity / 3 + 7;
+  std::vector<float> in(block * channels);
+  std::vector<float> out(block * channels);
+  float next_in = 0;
+  float next_out = 0;
+
+  /* Go around the storage a few times, so that regions straddle its end. */
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(consumer.available_read(), 0);
+    ASSERT_EQ(producer.available_write(), capacity);
+
+    ring_buffer_region<float> region = producer.reserve_write(block);
+    ASSERT_EQ(region.first_length, block);
+    ASSERT_EQ(region.second_length, 0);
+    for (int j = 0; j < block * channels; j++) {
+      region.first[j] = next_in++;
+    }
+    producer.commit_write(block);
+
+    for (int j = 0; j < block * channels; j++) {
+      in[j] = next_in++;
+    }
+    ASSERT_EQ(producer.enqueue(in.data(), block), block);
+    ASSERT_EQ(consumer.available_read(), 2 * block);
+
+    region = consumer.peek_read(block);
+    ASSERT_EQ(region.first_length, block);
+    ASSERT_EQ(region.second_length, 0);
+    for (int j = 0; j < block * channels; j++) {
+      ASSERT_EQ(region.first[j], next_out++);
+    }
+    consumer.consume(block);
+
+    ASSERT_EQ(consumer.dequeue(out.data(), block), block);
+    for (int j = 0; j < block * channels; j++) {
+      ASSERT_EQ(out[j], next_out++);
+    }
+  }
+
+  /* Full. */
+  ASSERT_EQ(producer.enqueue(nullptr, capacity + 1), capacity);
+  ASSERT_EQ(producer.available_write(), 0);
+  ASSERT_EQ(producer.enqueue(nullptr, 1), 0);
+  ASSERT_EQ(consumer.dequeue(nullptr, capacity), capacity);
+}
+
+TEST(cubeb, shm_ring_buffer_invalid)
+{
+  shared_audio_ring_buffer<float> buf(2, 256);
+  ASSERT_TRUE(buf.valid());
+
+  /* Different sample type. */
+  shared_audio_ring_buffer<short> other(buf.fd());
+  ASSERT_FALSE(other.valid());
+
+  /* Not a sealed memfd. */
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  shared_audio_ring_buffer<float> not_shm(fds[0]);
+  ASSERT_FALSE(not_shm.valid());
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(cubeb, shm_ring_buffer_wait)
+{
+  shared_audio_ring_buffer<float> buf(1, 128);
+  ASSERT_TRUE(buf.valid());
+
+  /* Nothing to read, times out. */
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(buf.wait_for_read(1, 20), 0);
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(20));
+
+  /* Enough room, doesn't wait. */
+  ASSERT_EQ(buf.wait_for_write(buf.capacity(), -1), buf.capacity());
+
+  /* Woken up by the producer. */
+  std::thread producer([&buf] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    buf.enqueue(nullptr, 10);
+  });
+  ASSERT_GE(buf.wait_for_read(10, -1), 10);
+  producer.join();
+}
+
+/* The producer is another process, that only has the file descriptor. Both
+   sides block when they can't make progress. */
+TEST(cubeb, shm_ring_buffer_fork)
+{
+  const int channels = 2;
+  const int block = 100;
+  const int blocks = 2000;
+  shared_audio_ring_buffer<int> buf(channels, 256);
+  ASSERT_TRUE(buf.valid());
+
+  pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    shared_audio_ring_buffer<int> producer(buf.fd());
+    if (!producer.valid()) {
+      _exit(1);
+    }
+    int value = 0;
+    for (int i = 0; i < blocks; i++) {
+      if (producer.wait_for_write(block, 5000) < block) {
+        _exit(2);
+      }
+      ring_buffer_region<int> region = producer.reserve_write(block);
+      for (int j = 0; j < block * channels; j++) {
+        region.first[j] = value++;
+      }
+      producer.commit_write(block);
+    }
+    _exit(0);
+  }
+
+  int value = 0;
+  for (int i = 0; i < blocks; i++) {
+    ASSERT_GE(buf.wait_for_read(block, 5000), block) << "block " << i;
+    ring_buffer_region<int> region = buf.peek_read(block);
+    for (int j = 0; j < block * channels; j++) {
+      ASSERT_EQ(region.first[j], value++);
+    }
+    buf.consume(block);
+  }
+
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_stream_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+TEST(cubeb, stream_stats)
+{
+  cubeb_stream_stats_counters * counters = cubeb_stream_stats_counters_create(0, nullptr);
+  ASSERT_TRUE(counters);
+  cubeb_stream_stats stats;
+
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  ASSERT_EQ(stats.data_callback_count, 0u);
+  ASSERT_EQ(stats.frames_delivered, 0u);
+  ASSERT_EQ(stats.callback_duration_min_ns, 0u);
+  ASSERT_EQ(stats.callback_duration_mean_ns, 0u);
+  ASSERT_EQ(stats.callback_duration_max_ns, 0u);
+
+  uint64_t start = cubeb_stream_stats_callback_start(counters);
+  cubeb_stream_stats_callback_end(counters, start, 128, 128);
+  start = cubeb_stream_stats_callback_start(counters);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  cubeb_stream_stats_callback_end(counters, start, 64, 64);
+  /* Errors are counted as callbacks, but don't deliver frames. */
+  start = cubeb_stream_stats_callback_start(counters);
+  cubeb_stream_stats_callback_end(counters, start, 128, CUBEB_ERROR);
+  cubeb_stream_stats_underrun(counters, 2);
+  cubeb_stream_stats_overrun(counters, 1);
+
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  ASSERT_EQ(stats.data_callback_count, 3u);
+  ASSERT_EQ(stats.frames_delivered, 192u);
+  ASSERT_GE(stats.callback_duration_max_ns, 5000000u);
+  ASSERT_LT(stats.callback_duration_min_ns, 5000000u);
+  ASSERT_LE(stats.callback_duration_min_ns, stats.callback_duration_mean_ns);
+  ASSERT_LE(stats.callback_duration_mean_ns, stats.callback_duration_max_ns);
+  ASSERT_EQ(stats.underrun_count, 2u);
+  ASSERT_EQ(stats.overrun_count, 1u);
+  /* No rate, no load. */
+  ASSERT_EQ(stats.dsp_load, 0.0f);
+
+  /* The counters of the two halves of a duplex stream add up. */
+  cubeb_stream_stats_counters * duplex[3] = {
+    counters, nullptr, cubeb_stream_stats_counters_create(0, nullptr)
+  };
+  start = cubeb_stream_stats_callback_start(duplex[2]);
+  cubeb_stream_stats_callback_end(duplex[2], start, 8, 8);
+  cubeb_stream_stats_overrun(duplex[2], 1);
+  cubeb_stream_stats duplex_stats;
+  cubeb_stream_stats_counters_get(duplex, 3, &duplex_stats);
+  ASSERT_EQ(duplex_stats.data_callback_count, 4u);
+  ASSERT_EQ(duplex_stats.frames_delivered, 200u);
+  ASSERT_EQ(duplex_stats.callback_duration_max_ns, stats.callback_duration_max_ns);
+  ASSERT_LE(duplex_stats.callback_duration_min_ns, stats.callback_duration_min_ns);
+  ASSERT_EQ(duplex_stats.overrun_count, 2u);
+
+  cubeb_stream_stats_counters_destroy(duplex[2]);
+  cubeb_stream_stats_counters_destroy(counters);
+
+  /* No counters. */
+  ASSERT_EQ(cubeb_stream_stats_callback_start(nullptr), 0u);
+  cubeb_stream_stats_callback_end(nullptr, 0, 1, 1);
+  cubeb_stream_stats_underrun(nullptr, 1);
+}
+
+/* The statistics can be read while the audio thread updates them. */
+TEST(cubeb, stream_stats_concurrent)
+{
+  cubeb_stream_stats_counters * counters = cubeb_stream_stats_counters_create(0, nullptr);
+  ASSERT_TRUE(counters);
+  std::atomic<bool> done(false);
+
+  std::thread audio([counters, &done] {
+    while (!done.load()) {
+      uint64_t start = cubeb_stream_stats_callback_start(counters);
+      cubeb_stream_stats_callback_end(counters, start, 1, 1);
+    }
+  });
+
+  uint64_t previous = 0;
+  for (int i = 0; i < 10000; i++) {
+    cubeb_stream_stats stats;
+    cubeb_stream_stats_counters_get(&counters, 1, &stats);
+    ASSERT_GE(stats.data_callback_count, previous);
+    previous = stats.data_callback_count;
+  }
+  done.store(true);
+  audio.join();
+
+  cubeb_stream_stats stats;
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  ASSERT_EQ(stats.frames_delivered, stats.data_callback_count);
+  cubeb_stream_stats_counters_destroy(counters);
+}
+
+TEST(cubeb, stream_stats_load)
+{
+  /* At 1000Hz, 10 frames last 10ms. */
+  cubeb_stream_stats_counters * counters =
+    cubeb_stream_stats_counters_create(1000, nullptr);
+  ASSERT_TRUE(counters);
+  cubeb_stream_stats stats;
+
+  /* Callbacks that take about half of the time of their buffer. */
+  for (int i = 0; i < 20; i++) {
+    uint64_t start = cubeb_stream_stats_callback_start(counters);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cubeb_stream_stats_callback_end(counters, start, 10, 10);
+  }
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  /* The average starts at 0, and 200ms is a fraction of the averaging
+   * time. */
+  ASSERT_GT(stats.dsp_load, 0.05f);
+  ASSERT_LT(stats.dsp_load, stats.dsp_load_peak);
+  ASSERT_GE(stats.dsp_load_peak, 0.5f);
+  float average = stats.dsp_load;
+
+  /* A late callback raises the peak, and a bit the average. */
+  uint64_t start = cubeb_stream_stats_callback_start(counters);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  cubeb_stream_stats_callback_end(counters, start, 10, 10);
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  ASSERT_GE(stats.dsp_load_peak, 2.0f);
+  ASSERT_GT(stats.dsp_load, average);
+
+  /* The peak is held for a while. */
+  start = cubeb_stream_stats_callback_start(counters);
+  cubeb_stream_stats_callback_end(counters, start, 10, 10);
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  ASSERT_GE(stats.dsp_load_peak, 2.0f);
+
+  cubeb_stream_stats_counters_destroy(counters);
+}
+
+TEST(cubeb, stream_stats_histograms)
+{
+  cubeb_stream_stats_counters * counters = cubeb_stream_stats_counters_create(0, nullptr);
+  ASSERT_TRUE(counters);
+  cubeb_callback_histograms histograms;
+
+  cubeb_stream_stats_counters_get_histograms(&counters, 1, &histograms);
+  ASSERT_EQ(histograms.duration.count, 0u);
+  ASSERT_EQ(histograms.interval.count, 0u);
+  ASSERT_EQ(cubeb_histogram_percentile(&histograms.duration, 50), 0u);
+
+  /* Callbacks every 2ms or so, one of them late. */
+  for (int i = 0; i < 10; i++) {
+    uint64_t start = cubeb_stream_stats_callback_start(counters);
+    std::this_thread::sleep_for(std::chrono::milliseconds(i == 5 ? 20 : 2));
+    cubeb_stream_stats_callback_end(counters, start, 1, 1);
+  }
+  cubeb_stream_stats_counters_get_histograms(&counters, 1, &histograms);
+  ASSERT_EQ(histograms.duration.count, 10u);
+  /* No interval before the first callback. */
+  ASSERT_EQ(histograms.interval.count, 9u);
+  ASSERT_GE(cubeb_histogram_percentile(&histograms.duration, 50), 2000000u);
+  ASSERT_LT(cubeb_histogram_percentile(&histograms.duration, 50), 20000000u);
+  ASSERT_GE(cubeb_histogram_percentile(&histograms.duration, 99.9), 20000000u);
+  ASSERT_GE(cubeb_histogram_percentile(&histograms.interval, 100), 20000000u);
+
+  /* The time a stream is stopped isn't an interval. */
+  cubeb_stream_stats_started(counters);
+  uint64_t start = cubeb_stream_stats_callback_start(counters);
+  cubeb_stream_stats_callback_end(counters, start, 1, 1);
+  cubeb_stream_stats_counters_get_histograms(&counters, 1, &histograms);
+  ASSERT_EQ(histograms.duration.count, 11u);
+  ASSERT_EQ(histograms.interval.count, 9u);
+
+  /* The histograms of the two halves of a duplex stream add up. */
+  cubeb_stream_stats_counters * duplex[2] = {
+    counters, cubeb_stream_stats_counters_create(0, nullptr)
+  };
+  start = cubeb_stream_stats_callback_start(duplex[1]);
+  cubeb_stream_stats_callback_end(duplex[1], start, 1, 1);
+  cubeb_stream_stats_counters_get_histograms(duplex, 2, &histograms);
+  ASSERT_EQ(histograms.duration.count, 12u);
+  uint64_t sum = 0;
+  for (uint64_t bucket : histograms.duration.buckets) {
+    sum += bucket;
+  }
+  ASSERT_EQ(sum, histograms.duration.count);
+
+  cubeb_stream_stats_counters_destroy(duplex[1]);
+  cubeb_stream_stats_counters_destroy(counters);
+  cubeb_stream_stats_started(nullptr);
+}
+
+TEST(cubeb, stream_stats_backend_phases)
+{
+  cubeb_stream_stats_counters * counters = cubeb_stream_stats_counters_create(0, nullptr);
+  ASSERT_TRUE(counters);
+  cubeb_stream_stats stats;
+
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  for (cubeb_phase_timing const & timing : stats.backend_phases) {
+    ASSERT_EQ(timing.count, 0u);
+    ASSERT_EQ(timing.total_ns, 0u);
+    ASSERT_EQ(timing.max_ns, 0u);
+  }
+
+  uint64_t wakeup = cubeb_stream_stats_now();
+  ASSERT_GT(wakeup, 0u);
+  cubeb_stream_stats_phase(counters, CUBEB_BACKEND_PHASE_WAKEUP, wakeup, wakeup + 1000);
+  cubeb_stream_stats_phase(counters, CUBEB_BACKEND_PHASE_WAKEUP, wakeup, wakeup + 3000);
+  uint64_t start = cubeb_stream_stats_callback_start(counters);
+  uint64_t end = cubeb_stream_stats_callback_end(counters, start, 1, 1);
+  ASSERT_GE(end, start);
+  cubeb_stream_stats_phase(counters, CUBEB_BACKEND_PHASE_WRITE, end, end + 500);
+  /* Not measured: no start, or a clock going backwards. */
+  cubeb_stream_stats_phase(counters, CUBEB_BACKEND_PHASE_PREPARE, 0, end);
+  cubeb_stream_stats_phase(counters, CUBEB_BACKEND_PHASE_RELOCK, end, end - 1);
+
+  cubeb_stream_stats_counters_get(&counters, 1, &stats);
+  cubeb_phase_timing const & wakeup_timing = stats.backend_phases[CUBEB_BACKEND_PHASE_WAKEUP];
+  ASSERT_EQ(wakeup_timing.count, 2u);
+  ASSERT_EQ(wakeup_timing.total_ns, 4000u);
+  ASSERT_EQ(wakeup_timing.max_ns, 3000u);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_PREPARE].count, 0u);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_RELOCK].count, 0u);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_WRITE].count, 1u);
+
+  /* The phases of the two halves of a duplex stream add up. */
+  cubeb_stream_stats_counters * duplex[2] = {
+    counters, cubeb_stream_stats_counters_create(0, nullptr)
+  };
+  cubeb_stream_stats_phase(duplex[1], CUBEB_BACKEND_PHASE_WAKEUP, wakeup, wakeup + 5000);
+  cubeb_stream_stats_counters_get(duplex, 2, &stats);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_WAKEUP].count, 3u);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_WAKEUP].total_ns, 9000u);
+  ASSERT_EQ(stats.backend_phases[CUBEB_BACKEND_PHASE_WAKEUP].max_ns, 5000u);
+
+  cubeb_stream_stats_counters_destroy(duplex[1]);
+  cubeb_stream_stats_counters_destroy(counters);
+
+  /* No counters. */
+  ASSERT_EQ(cubeb_stream_stats_callback_end(nullptr, 0, 1, 1), 0u);
+  cubeb_stream_stats_phase(nullptr, CUBEB_BACKEND_PHASE_WAKEUP, wakeup, wakeup + 1);
+}
+
+TEST(cubeb, histogram_layout)
+{
+  /* Nanoseconds first, then 16 buckets per power of two. */
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(0), 0u);
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(15), 15u);
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(16), 16u);
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(32), 32u);
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(33), 34u);
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(48), 64u);
+  for (uint32_t i = 1; i < CUBEB_HISTOGRAM_BUCKET_COUNT; i++) {
+    uint64_t lower = cubeb_histogram_bucket_lower_bound(i - 1);
+    uint64_t upper = cubeb_histogram_bucket_lower_bound(i);
+    ASSERT_GT(upper, lower);
+    ASSERT_LE(upper - lower, std::max<uint64_t>(1, lower / 16));
+  }
+  /* About 34s. */
+  ASSERT_EQ(cubeb_histogram_bucket_lower_bound(CUBEB_HISTOGRAM_BUCKET_COUNT - 1),
+            (uint64_t(31) << 30));
+
+  cubeb_histogram histogram = cubeb_histogram();
+  histogram.buckets[20] = 999;
+  histogram.buckets[100] = 1;
+  histogram.count = 1000;
+  ASSERT_EQ(cubeb_histogram_percentile(&histogram, 0),
+            cubeb_histogram_bucket_lower_bound(21));
+  ASSERT_EQ(cubeb_histogram_percentile(&histogram, 99.9),
+            cubeb_histogram_bucket_lower_bound(21));
+  ASSERT_EQ(cubeb_histogram_percentile(&histogram, 99.95),
+            cubeb_histogram_bucket_lower_bound(101));
+  ASSERT_EQ(cubeb_histogram_percentile(&histogram, 100),
+            cubeb_histogram_bucket_lower_bound(101));
+  histogram.buckets[CUBEB_HISTOGRAM_BUCKET_COUNT - 1] = 1;
+  histogram.count++;
+  ASSERT_EQ(cubeb_histogram_percentile(&histogram, 100), UINT64_MAX);
+  ASSERT_EQ(cubeb_histogram_percentile(nullptr, 50), 0u);
+}
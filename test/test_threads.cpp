@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_threads.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+cubeb_thread_info const *
+find_thread(cubeb_thread_collection const & collection, char const * name)
+{
+  for (size_t i = 0; i < collection.count; i++) {
+    if (!strcmp(collection.threads[i].name, name)) {
+      return &collection.threads[i];
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST(cubeb, threads)
+{
+  /* Only compared, never dereferenced. */
+  cubeb * context = reinterpret_cast<cubeb *>(0x1000);
+  cubeb * other_context = reinterpret_cast<cubeb *>(0x2000);
+  std::atomic<int> step(0);
+
+  std::thread backend([context, &step] {
+    cubeb_thread_register(context, "test-backend-thread");
+    cubeb_thread_wakeup();
+    cubeb_thread_wakeup();
+    /* Use some CPU time. */
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+    step.store(1);
+    while (step.load() != 2) {
+      std::this_thread::yield();
+    }
+    cubeb_thread_unregister();
+  });
+  std::thread shared([&step] {
+    cubeb_thread_register(nullptr, "test-shared");
+    while (step.load() != 2) {
+      std::this_thread::yield();
+    }
+    cubeb_thread_unregister();
+  });
+  while (step.load() != 1) {
+    std::this_thread::yield();
+  }
+
+  cubeb_thread_collection collection;
+  ASSERT_EQ(cubeb_threads_get(context, &collection), CUBEB_OK);
+  /* The name is truncated to fit in 16 bytes. */
+  cubeb_thread_info const * info = find_thread(collection, "test-backend-th");
+  ASSERT_TRUE(info);
+  ASSERT_EQ(info->wakeups, 2u);
+#if defined(__linux__)
+  ASSERT_GT(info->cpu_seconds, 0.0);
+#endif
+  ASSERT_TRUE(find_thread(collection, "test-shared"));
+  cubeb_threads_collection_destroy(&collection);
+  ASSERT_EQ(collection.threads, nullptr);
+  ASSERT_EQ(collection.count, 0u);
+
+  /* The threads of other contexts aren't listed. */
+  ASSERT_EQ(cubeb_threads_get(other_context, &collection), CUBEB_OK);
+  ASSERT_FALSE(find_thread(collection, "test-backend-th"));
+  ASSERT_TRUE(find_thread(collection, "test-shared"));
+  cubeb_threads_collection_destroy(&collection);
+
+  step.store(2);
+  backend.join();
+  shared.join();
+
+  /* Unregistered threads aren't listed. */
+  ASSERT_EQ(cubeb_threads_get(context, &collection), CUBEB_OK);
+  ASSERT_FALSE(find_thread(collection, "test-backend-th"));
+  ASSERT_FALSE(find_thread(collection, "test-shared"));
+  cubeb_threads_collection_destroy(&collection);
+
+  /* Does nothing on threads that aren't registered. */
+  cubeb_thread_wakeup();
+  cubeb_thread_unregister();
+
+  ASSERT_EQ(cubeb_get_threads(nullptr, &collection), CUBEB_ERROR_INVALID_PARAMETER);
+  ASSERT_EQ(cubeb_get_threads(context, nullptr), CUBEB_ERROR_INVALID_PARAMETER);
+  ASSERT_EQ(cubeb_thread_collection_destroy(context, nullptr),
+            CUBEB_ERROR_INVALID_PARAMETER);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+#include "gtest/gtest.h"
+#include "cubeb/cubeb.h"
+#include "cubeb_mixer.h"
+#include "cubeb_trace.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+std::string
+write_trace()
+{
+  char const * path = "test_trace.json";
+  EXPECT_EQ(cubeb_write_trace(path), CUBEB_OK);
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  remove(path);
+  return contents.str();
+}
+
+size_t
+count(std::string const & haystack, std::string const & needle)
+{
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+
+} // namespace
+
+TEST(cubeb, trace)
+{
+  ASSERT_EQ(cubeb_write_trace(nullptr), CUBEB_ERROR_INVALID_PARAMETER);
+
+  /* Nothing is recorded when tracing is disabled. */
+  CUBEB_TRACE_BEGIN("disabled");
+  CUBEB_TRACE_END("disabled");
+  ASSERT_EQ(write_trace().find("disabled"), std::string::npos);
+
+  ASSERT_EQ(cubeb_set_tracing(1), CUBEB_OK);
+
+  {
+    CUBEB_TRACE_SCOPE("outer \"scope\"");
+    float input[2] = { 0.5f, 0.5f };
+    float output[1];
+    cubeb_mixer * mixer = cubeb_mixer_create(CUBEB_SAMPLE_FLOAT32NE,
+                                             2, CUBEB_LAYOUT_STEREO,
+                                             1, CUBEB_LAYOUT_MONO);
+    ASSERT_TRUE(mixer);
+    ASSERT_EQ(cubeb_mixer_mix(mixer, 1, input, sizeof(input),
+                              output, sizeof(output)), 0);
+    cubeb_mixer_destroy(mixer);
+  }
+  std::thread audio([] {
+    for (int i = 0; i < 10; i++) {
+      CUBEB_TRACE_BEGIN("audio thread");
+      CUBEB_TRACE_END("audio thread");
+    }
+  });
+  audio.join();
+
+  std::string trace = write_trace();
+  ASSERT_EQ(trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0u);
+  ASSERT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+  ASSERT_EQ(count(trace, "\"name\":\"thread_name\""), 2u);
+  ASSERT_EQ(count(trace, "\"name\":\"outer \\\"scope\\\"\",\"ph\":\"B\""), 1u);
+  ASSERT_EQ(count(trace, "\"name\":\"outer \\\"scope\\\"\",\"ph\":\"E\""), 1u);
+  ASSERT_EQ(count(trace, "\"name\":\"cubeb_mixer_mix\",\"ph\":\"B\""), 1u);
+  ASSERT_EQ(count(trace, "\"name\":\"cubeb_mixer_mix\",\"ph\":\"E\""), 1u);
+  ASSERT_EQ(count(trace, "\"name\":\"audio thread\",\"ph\":\"B\""), 10u);
+  ASSERT_EQ(trace.find("disabled"), std::string::npos);
+  /* The scope opens before the mixer, and ends after. */
+  ASSERT_LT(trace.find("outer"), trace.find("cubeb_mixer_mix"));
+  ASSERT_LT(trace.rfind("cubeb_mixer_mix"), trace.rfind("outer"));
+
+  /* Only the last events of each thread are kept. */
+  for (int i = 0; i < CUBEB_TRACE_BUFFER_SIZE; i++) {
+    CUBEB_TRACE_BEGIN("wrap");
+  }
+  trace = write_trace();
+  ASSERT_EQ(count(trace, "\"name\":\"wrap\""), size_t(CUBEB_TRACE_BUFFER_SIZE));
+  ASSERT_EQ(trace.find("outer"), std::string::npos);
+
+  /* Enabling tracing again starts a new timeline. */
+  ASSERT_EQ(cubeb_set_tracing(0), CUBEB_OK);
+  ASSERT_EQ(cubeb_set_tracing(1), CUBEB_OK);
+  ASSERT_EQ(write_trace().find("wrap"), std::string::npos);
+  ASSERT_EQ(cubeb_set_tracing(0), CUBEB_OK);
+}
+
+TEST(cubeb, trace_thread_buffers_reused)
+{
+  ASSERT_EQ(cubeb_set_tracing(1), CUBEB_OK);
+
+  /* The buffers of threads that have exited are reused. */
+  for (int i = 0; i < 2 * CUBEB_TRACE_MAX_THREADS; i++) {
+    std::thread short_lived([] {
+      CUBEB_TRACE_BEGIN("short-lived");
+      CUBEB_TRACE_END("short-lived");
+    });
+    short_lived.join();
+  }
+  std::thread last([] {
+    CUBEB_TRACE_BEGIN("last thread");
+    CUBEB_TRACE_END("last thread");
+  });
+  last.join();
+
+  std::string trace = write_trace();
+  ASSERT_EQ(count(trace, "\"name\":\"last thread\",\"ph\":\"B\""), 1u);
+  /* Only the events of the last thread that used a buffer are kept. */
+  ASSERT_LE(count(trace, "\"name\":\"thread_name\""),
+            size_t(CUBEB_TRACE_MAX_THREADS));
+  ASSERT_EQ(cubeb_set_tracing(0), CUBEB_OK);
+}
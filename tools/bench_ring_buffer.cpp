@@ -0,0 +1,454 @@
+/*
+ * Copyright © 2026 Mozilla Foundation
+ *
+ * This program is made available under an ISC-style license.  See the
+ * accompanying file LICENSE for details.
+ */
+
+/* Benchmark of the single producer single consumer ring buffers, and of the
+ * other queues the backends use to hand data to another thread.
+ *
+ * For each ring buffer type, element size and batch size, a producer thread
+ * and a consumer thread, pinned to two cores, move batches of elements through
+ * the ring buffer. Two things are measured:
+ * - throughput: the producer pushes as fast as the ring buffer lets it, and
+ *   we count batches and elements per second, and cache misses per batch when
+ *   `perf_event_open` is available.
+ * - handoff latency: a single batch is in flight at a time, and we measure the
+ *   time between the start of its `enqueue` and the end of its `dequeue`.
+ *
+ * Usage: bench_ring_buffer [-p producer_core] [-c consumer_core]
+ *                          [-n batches] [-f filter]
+ */
+
+#include "cubeb/cubeb.h"
+#include "cubeb_ring_array.h"
+#include "cubeb_ringbuffer.h"
+#if !defined(_WIN32)
+#include "cubeb_array_queue.h"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct bench_options
+{
+  int producer_core = 1;
+  int consumer_core = 0;
+  int batches = 1 << 18;
+  /** Only run the benchmarks whose name contains this string. */
+  std::string filter;
+};
+
+bench_options options;
+
+void pin_to_core(int core)
+{
+#if defined(__linux__)
+  if (core < 0 || std::thread::hardware_concurrency() <= unsigned(core)) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/** Busy-wait a bit, then let the other thread run, in case both threads
+ * share a core. */
+void backoff(int & spins)
+{
+  if (++spins > 1000) {
+    std::this_thread::yield();
+    spins = 0;
+  }
+}
+
+uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Hardware cache misses of this thread, and of threads it creates. */
+class cache_miss_counter
+{
+public:
+  cache_miss_counter()
+  {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+  ~cache_miss_counter()
+  {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+  /** Number of cache misses so far, or -1 if not available. */
+  int64_t read()
+  {
+#if defined(__linux__)
+    uint64_t value;
+    if (fd_ >= 0 && ::read(fd_, &value, sizeof(value)) == sizeof(value)) {
+      return value;
+    }
+#endif
+    return -1;
+  }
+private:
+  int fd_ = -1;
+};
+
+template <size_t N>
+struct payload
+{
+  char bytes[N];
+};
+
+uint64_t percentile(const std::vector<uint64_t> & sorted, double p)
+{
+  return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+/**
+ * Run the throughput and latency benchmarks on a ring buffer.
+ *
+ * @param name Name of the ring buffer type.
+ * @param make_buffer Returns a new ring buffer.
+ * @param element_size Size of an element, or of a frame, in bytes.
+ * @param samples_per_element Number of `T` in an element, this is the channel
+ * count for audio ring buffers, 1 otherwise.
+ * @param batch Number of elements per `enqueue` and `dequeue`.
+ */
+template <typename T, typename Buffer, typename Factory>
+void bench(const std::string & name, Factory make_buffer, size_t element_size,
+           int samples_per_element, int batch)
+{
+  if (!options.filter.empty() &&
+      name.find(options.filter) == std::string::npos) {
+    return;
+  }
+
+  const int batches = options.batches;
+
+  /* Throughput. */
+  double seconds;
+  int64_t misses;
+  {
+    std::unique_ptr<Buffer> buffer(make_buffer());
+    cache_miss_counter counter;
+    uint64_t start = now_ns();
+
+    std::thread producer([&] {
+      pin_to_core(options.producer_core);
+      std::vector<T> in(batch * samples_per_element);
+      for (int i = 0; i < batches; i++) {
+        int written = 0;
+        int spins = 0;
+        while (written < batch) {
+          int rv = buffer->enqueue(in.data(), batch - written);
+          if (!rv) {
+            backoff(spins);
+          }
+          written += rv;
+        }
+      }
+    });
+
+    pin_to_core(options.consumer_core);
+    std::vector<T> out(batch * samples_per_element);
+    int64_t remaining = int64_t(batches) * batch;
+    int spins = 0;
+    while (remaining) {
+      int rv = buffer->dequeue(out.data(), batch);
+      if (!rv) {
+        backoff(spins);
+      }
+      remaining -= rv;
+    }
+    producer.join();
+
+    seconds = (now_ns() - start) / 1e9;
+    misses = counter.read();
+  }
+
+  /* Handoff latency, one batch in flight at a time. */
+  const int latency_batches = std::min(batches, 1 << 16);
+  std::vector<uint64_t> latencies(latency_batches);
+  {
+    std::unique_ptr<Buffer> buffer(make_buffer());
+    std::vector<uint64_t> sent(latency_batches);
+    std::atomic<int> received(0);
+
+    std::thread producer([&] {
+      pin_to_core(options.producer_core);
+      std::vector<T> in(batch * samples_per_element);
+      for (int i = 0; i < latency_batches; i++) {
+        /* Wait for the previous batch to be received. */
+        int spins = 0;
+        while (received.load(std::memory_order_acquire) != i) {
+          backoff(spins);
+        }
+        sent[i] = now_ns();
+        int rv = buffer->enqueue(in.data(), batch);
+        (void)rv;
+        assert(rv == batch);
+      }
+    });
+
+    pin_to_core(options.consumer_core);
+    std::vector<T> out(batch * samples_per_element);
+    for (int i = 0; i < latency_batches; i++) {
+      int read = 0;
+      int spins = 0;
+      while (read < batch) {
+        int rv = buffer->dequeue(out.data(), batch - read);
+        if (!rv) {
+          backoff(spins);
+        }
+        read += rv;
+      }
+      latencies[i] = now_ns() - sent[i];
+      received.store(i + 1, std::memory_order_release);
+    }
+    producer.join();
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  char misses_per_batch[32] = "n/a";
+  if (misses >= 0) {
+    snprintf(misses_per_batch, sizeof(misses_per_batch), "%.2f",
+             double(misses) / batches);
+  }
+  printf("%-42s %5zu %6d %10.3f %10.2f %8llu %8llu %8llu %12s\n", name.c_str(),
+         element_size, batch, batches / seconds / 1e6,
+         double(batches) * batch * element_size / seconds / 1e9,
+         (unsigned long long)percentile(latencies, 0.5),
+         (unsigned long long)percentile(latencies, 0.99),
+         (unsigned long long)percentile(latencies, 0.999), misses_per_batch);
+}
+
+const int queue_capacity = 1 << 14;
+const int batch_sizes[] = { 1, 16, 256, 4096 };
+
+template <typename T>
+void bench_queues(size_t element_size)
+{
+  for (int batch : batch_sizes) {
+    bench<T, lock_free_queue<T>>("lock_free_queue", [] {
+      return new lock_free_queue<T>(queue_capacity);
+    }, element_size, 1, batch);
+    bench<T, mirrored_lock_free_queue<T>>("mirrored_lock_free_queue", [] {
+      return new mirrored_lock_free_queue<T>(queue_capacity);
+    }, element_size, 1, batch);
+    /* The storage is not a power of two, and indices wrap with a comparison,
+     * as in audio ring buffers with an odd number of channels. */
+    bench<T, ring_buffer_base<T>>("ring_buffer_base (alignment 3)", [] {
+      return new ring_buffer_base<T>(queue_capacity * 3 / 4 * 3, 3);
+    }, element_size, 1, batch);
+  }
+}
+
+#if !defined(_WIN32)
+/** `array_queue` with the interface of the ring buffers. It holds pointers,
+ * and can't hold NULL: the address of each element is pushed, as the OpenSL
+ * backend pushes the addresses of its input buffers. */
+class array_queue_buffer
+{
+public:
+  explicit array_queue_buffer(size_t capacity)
+    : queue_(array_queue_create(capacity))
+  {
+  }
+  ~array_queue_buffer() { array_queue_destroy(queue_); }
+  int enqueue(void * const * elements, int count)
+  {
+    int i = 0;
+    while (i < count &&
+           !array_queue_push(queue_, const_cast<void **>(elements + i))) {
+      i++;
+    }
+    return i;
+  }
+  int dequeue(void ** elements, int count)
+  {
+    int i = 0;
+    while (i < count && (elements[i] = array_queue_pop(queue_))) {
+      i++;
+    }
+    return i;
+  }
+private:
+  array_queue * queue_;
+};
+
+void bench_array_queue()
+{
+  for (int batch : batch_sizes) {
+    bench<void *, array_queue_buffer>("array_queue", [] {
+      return new array_queue_buffer(queue_capacity);
+    }, sizeof(void *), 1, batch);
+  }
+}
+#endif
+
+/** `ring_array` with the interface of the ring buffers. An element is a whole
+ * buffer of audio, that the producer fills and the consumer reads. */
+class ring_array_queue
+{
+public:
+  ring_array_queue(uint32_t capacity, int channels, int frames)
+    : samples_(channels * frames)
+  {
+    int rv = ring_array_init(&ring_, capacity, sizeof(float) * channels,
+                             channels, frames);
+    (void)rv;
+    assert(rv == CUBEB_OK);
+  }
+  ~ring_array_queue() { ring_array_destroy(&ring_); }
+  int enqueue(float const * elements, int count)
+  {
+    int i = 0;
+    ring_array_buffer * buffer;
+    while (i < count && (buffer = ring_array_get_free_buffer(&ring_))) {
+      memcpy(buffer->mData, elements + i * samples_, buffer->mDataByteSize);
+      ring_array_commit_free_buffer(&ring_);
+      i++;
+    }
+    return i;
+  }
+  int dequeue(float * elements, int count)
+  {
+    int i = 0;
+    ring_array_buffer * buffer;
+    while (i < count && (buffer = ring_array_get_data_buffer(&ring_))) {
+      memcpy(elements + i * samples_, buffer->mData, buffer->mDataByteSize);
+      ring_array_release_data_buffer(&ring_);
+      i++;
+    }
+    return i;
+  }
+private:
+  ring_array ring_;
+  const int samples_;
+};
+
+/** A few buffers of a period each, as the backends use it. */
+void bench_ring_array(int channels, int frames)
+{
+  const uint32_t capacity = 16;
+  std::string name = "ring_array " + std::to_string(channels) + "ch " +
+                     std::to_string(frames) + " frames";
+  for (int batch : { 1, int(capacity) }) {
+    bench<float, ring_array_queue>(name, [=] {
+      return new ring_array_queue(capacity, channels, frames);
+    }, sizeof(float) * channels * frames, channels * frames, batch);
+  }
+}
+
+template <typename T>
+void bench_audio(int channels)
+{
+  std::string suffix = " " + std::to_string(channels) + "ch";
+  for (int batch : batch_sizes) {
+    bench<T, lock_free_audio_ring_buffer<T>>(
+      "lock_free_audio_ring_buffer" + suffix, [channels] {
+      return new lock_free_audio_ring_buffer<T>(channels, queue_capacity);
+    }, sizeof(T) * channels, channels, batch);
+    bench<T, mirrored_lock_free_audio_ring_buffer<T>>(
+      "mirrored_lock_free_audio_ring_buffer" + suffix, [channels] {
+      return new mirrored_lock_free_audio_ring_buffer<T>(channels,
+                                                         queue_capacity);
+    }, sizeof(T) * channels, channels, batch);
+  }
+}
+
+void usage(const char * argv0)
+{
+  fprintf(stderr,
+          "Usage: %s [-p producer_core] [-c consumer_core] [-n batches] "
+          "[-f filter]\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char * argv[])
+{
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (!strcmp(argv[i], "-p")) {
+      options.producer_core = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-c")) {
+      options.consumer_core = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-n")) {
+      options.batches = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "-f")) {
+      options.filter = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  printf("producer on core %d, consumer on core %d, %d batches, "
+         "%u cores available\n", options.producer_core,
+         options.consumer_core, options.batches,
+         std::thread::hardware_concurrency());
+  printf("%-42s %5s %6s %10s %10s %8s %8s %8s %12s\n", "ring buffer", "size",
+         "batch", "Mbatch/s", "GB/s", "p50 ns", "p99 ns", "p999 ns",
+         "misses/batch");
+
+  bench_queues<float>(sizeof(float));
+  bench_queues<payload<16>>(16);
+  bench_queues<payload<64>>(64);
+#if !defined(_WIN32)
+  bench_array_queue();
+#endif
+  bench_audio<float>(1);
+  bench_audio<float>(2);
+  bench_audio<short>(2);
+  bench_audio<float>(6);
+  bench_ring_array(2, 128);
+  bench_ring_array(2, 1024);
+
+  return 0;
+}